@@ -21,11 +21,26 @@ fi
 # For Linux
 LIBS="-L $LBM/lib -l lbm -l pthread -l m -l rt"
 
-rm -rf *.class mon_self
+rm -rf *.class mon_self stats_fmt_bench stats_recorder_dump stats_archive_query mon_self_top mon_self_agg
 
 echo "Building code"
 
-gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o mon_self stats_thread.c mon_self.c $LIBS
+gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o mon_self stats_thread.c stats_fields.c stats_index.c stats_sample.c stats_queue.c stats_sink.c stats_monitor.c stats_fmt.c stats_store.c stats_recorder.c stats_archive.c stats_shm.c stats_stream.c stats_scrape.c stats_rules.c stats_window.c stats_source.c stats_latency.c stats_send.c mon_self.c $LIBS
+if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -Wall -g -O2 -I $LBM/include -I $LBM/include/lbm -o stats_fmt_bench stats_fmt_bench.c stats_fmt.c stats_fields.c stats_sample.c stats_window.c stats_index.c $LIBS
+if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o stats_recorder_dump stats_recorder_dump.c stats_fmt.c stats_fields.c stats_sample.c stats_window.c stats_index.c $LIBS
+if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o stats_archive_query stats_archive_query.c stats_archive.c stats_index.c stats_fields.c $LIBS
+if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o mon_self_top mon_self_top.c stats_shm.c stats_fields.c stats_sample.c $LIBS
+if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -Wall -g -I $LBM/include -I $LBM/include/lbm -o mon_self_agg mon_self_agg.c stats_fields.c stats_index.c $LIBS
 if [ $? -ne 0 ]; then exit 1; fi
 
 
@@ -0,0 +1,18 @@
+#!/bin/sh
+# bld_mock.sh - build stats_thread_bench with lbm_mock instead of UM, and
+# mon_self_agg (which only needs UM's header).
+# Needs no UM install or license (see mock/lbm/lbm.h).
+
+rm -f stats_thread_bench mon_self_agg
+
+echo "Building stats_thread_bench"
+
+gcc -Wall -g -O2 -I mock -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -o stats_thread_bench stats_thread_bench.c lbm_mock.c stats_thread.c stats_fields.c stats_index.c stats_sample.c stats_queue.c stats_sink.c stats_monitor.c stats_fmt.c stats_store.c stats_recorder.c stats_archive.c stats_shm.c stats_stream.c stats_scrape.c stats_rules.c stats_window.c stats_source.c stats_latency.c stats_send.c -l pthread -l m -l rt
+if [ $? -ne 0 ]; then exit 1; fi
+
+echo "Building mon_self_agg"
+
+gcc -Wall -g -O2 -I mock -o mon_self_agg mon_self_agg.c stats_fields.c stats_index.c
+if [ $? -ne 0 ]; then exit 1; fi
+
+echo "Success"
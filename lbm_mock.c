@@ -0,0 +1,343 @@
+/* lbm_mock.c - synthetic UM statistics, for benchmarking without UM.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Implements the UM calls that the stats_* modules make, over synthetic
+ * sessions of every transport type. Build with mock/lbm/lbm.h (see
+ * bld_mock.sh) instead of linking with UM. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "lbm_mock.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* Publisher hosts and multicast groups the sessions are spread over. */
+#define NUM_HOSTS 500
+#define NUM_GROUPS 64
+
+
+/* Like UM's, per thread. */
+static __thread int mock_errnum = 0;
+static __thread char mock_errmsg[256] = "";
+
+static const int mock_types[] = { LBM_TRANSPORT_STAT_LBTRM, LBM_TRANSPORT_STAT_LBTRU, LBM_TRANSPORT_STAT_TCP,
+    LBM_TRANSPORT_STAT_LBTIPC, LBM_TRANSPORT_STAT_LBTSMX };
+
+
+int lbm_errnum(void)
+{
+  return mock_errnum;
+}  /* lbm_errnum */
+
+
+const char *lbm_errmsg(void)
+{
+  return mock_errmsg;
+}  /* lbm_errmsg */
+
+
+static void set_error(int errnum, const char *msg)
+{
+  mock_errnum = errnum;
+  snprintf(mock_errmsg, sizeof(mock_errmsg), "lbm_mock: %s", msg);
+}  /* set_error */
+
+
+/* xorshift64*; rand() is too slow for 100,000 sessions. */
+static uint64_t next_rand(lbm_mock_t *mock)
+{
+  uint64_t x = mock->rand_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  mock->rand_state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}  /* next_rand */
+
+
+/* Pointers into one session's entry; returns how many counters it has
+ * (the whole transport union). */
+static int session_parts(lbm_mock_t *mock, lbm_mock_sessions_t *sessions, int i, int **type, char **source,
+    lbm_ulong_t **counters)
+{
+  char *entry = sessions->stats + sessions->size * i;
+
+  if (sessions == &mock->src) {
+    lbm_src_transport_stats_t *stats = (lbm_src_transport_stats_t *)entry;
+    *type = &stats->type;
+    *source = stats->source;
+    *counters = (lbm_ulong_t *)&stats->transport;
+    return (int)(sizeof(stats->transport) / sizeof(lbm_ulong_t));
+  } else {
+    lbm_rcv_transport_stats_t *stats = (lbm_rcv_transport_stats_t *)entry;
+    *type = &stats->type;
+    *source = stats->source;
+    *counters = (lbm_ulong_t *)&stats->transport;
+    return (int)(sizeof(stats->transport) / sizeof(lbm_ulong_t));
+  }
+}  /* session_parts */
+
+
+/* (Re)create session "i" with a new source string and zero counters. */
+static void new_session(lbm_mock_t *mock, lbm_mock_sessions_t *sessions, int i)
+{
+  int *type;
+  char *source;
+  lbm_ulong_t *counters;
+  int num_counters = session_parts(mock, sessions, i, &type, &source, &counters);
+  uint32_t host = (uint32_t)(next_rand(mock) % NUM_HOSTS);
+  uint32_t group = (uint32_t)(next_rand(mock) % NUM_GROUPS);
+  uint32_t session_id = mock->next_session_id++;
+
+  memset(counters, 0, sizeof(lbm_ulong_t) * num_counters);
+  *type = mock_types[next_rand(mock) % 5];
+  switch (*type) {
+    case LBM_TRANSPORT_STAT_LBTRM:
+      sprintf(source, "LBTRM:10.29.%u.%u:14400:%08x:239.101.%u.%u:12090",
+          host / 256, host % 256, session_id, group / 256, group % 256);
+      break;
+    case LBM_TRANSPORT_STAT_LBTRU:
+      sprintf(source, "LBTRU:10.29.%u.%u:24000:%08x", host / 256, host % 256, session_id);
+      break;
+    case LBM_TRANSPORT_STAT_TCP:
+      sprintf(source, "TCP:10.29.%u.%u:14371:%08x", host / 256, host % 256, session_id);
+      break;
+    case LBM_TRANSPORT_STAT_LBTIPC:
+      sprintf(source, "LBT-IPC:%08x:20000", session_id);
+      break;
+    default:
+      sprintf(source, "LBT-SMX:%08x:30000", session_id);
+      break;
+  }
+}  /* new_session */
+
+
+static void add_sessions(lbm_mock_t *mock, lbm_mock_sessions_t *sessions, int num)
+{
+  int i;
+
+  if (sessions->num + num > sessions->capacity) {
+    sessions->capacity = sessions->num + num + (sessions->num + num) / 2;
+    ENL(sessions->stats = (char *)realloc(sessions->stats, sessions->size * sessions->capacity));
+  }
+  for (i = sessions->num; i < sessions->num + num; i++) {
+    new_session(mock, sessions, i);
+  }
+  sessions->num += num;
+}  /* add_sessions */
+
+
+static void step_sessions(lbm_mock_t *mock, lbm_mock_sessions_t *sessions)
+{
+  /* Churn as a threshold on 32 random bits. */
+  uint64_t churn = (uint64_t)(mock->config.churn_pct / 100.0 * 4294967296.0);
+  lbm_ulong_t range = mock->config.max_growth + 1;
+  int i, c;
+
+  for (i = 0; i < sessions->num; i++) {
+    if (churn > 0 && (next_rand(mock) >> 32) < churn) {
+      new_session(mock, sessions, i);
+    } else {
+      int *type;
+      char *source;
+      lbm_ulong_t *counters;
+      int num_counters = session_parts(mock, sessions, i, &type, &source, &counters);
+      for (c = 0; c < num_counters; c++) {
+        counters[c] += next_rand(mock) % range;
+      }
+    }
+  }
+  add_sessions(mock, sessions, mock->config.add_per_step);
+}  /* step_sessions */
+
+
+void lbm_mock_step(lbm_mock_t *mock)
+{
+  lbm_ulong_t range = mock->config.max_growth + 1;
+  lbm_ulong_t *counters = (lbm_ulong_t *)&mock->ctx_stats;
+  size_t c;
+
+  ENZ(errno = pthread_mutex_lock(&mock->lock));
+  mock->num_steps++;
+  for (c = 0; c < sizeof(mock->ctx_stats) / sizeof(lbm_ulong_t); c++) {
+    counters[c] += next_rand(mock) % range;
+  }
+  step_sessions(mock, &mock->src);
+  step_sessions(mock, &mock->rcv);
+  mock->ctx_stats.tr_src_topics = mock->src.num;
+  mock->ctx_stats.tr_rcv_topics = mock->rcv.num;
+  ENZ(errno = pthread_mutex_unlock(&mock->lock));
+}  /* lbm_mock_step */
+
+
+/* Copy one side's sessions out, with UM's semantics: if "*num" entries
+ * aren't enough, fail with LBM_EINVAL and set "*num" to the number needed. */
+static int retrieve_sessions(lbm_mock_t *mock, lbm_mock_sessions_t *sessions, int *num, int size, char *stats)
+{
+  size_t copy_size = ((size_t)size < sessions->size) ? (size_t)size : sessions->size;
+  int i;
+
+  ENZ(errno = pthread_mutex_lock(&mock->lock));
+  mock->num_retrieves++;
+  if (*num < sessions->num) {
+    *num = sessions->num;
+    mock->num_einvals++;
+    ENZ(errno = pthread_mutex_unlock(&mock->lock));
+    set_error(LBM_EINVAL, "not enough entries");
+    return LBM_FAILURE;
+  }
+  if (sessions->num == 0) {
+    /* Nothing to copy. */
+  } else if ((size_t)size == sessions->size) {
+    memcpy(stats, sessions->stats, sessions->size * sessions->num);
+  } else {
+    for (i = 0; i < sessions->num; i++) {
+      memcpy(stats + (size_t)size * i, sessions->stats + sessions->size * i, copy_size);
+    }
+  }
+  *num = sessions->num;
+  ENZ(errno = pthread_mutex_unlock(&mock->lock));
+  return LBM_OK;
+}  /* retrieve_sessions */
+
+
+int lbm_context_retrieve_stats(lbm_context_t *ctx, lbm_context_stats_t *stats)
+{
+  lbm_mock_t *mock = (lbm_mock_t *)ctx;
+
+  if (mock == NULL) {
+    set_error(LBM_EINVAL, "NULL context");
+    return LBM_FAILURE;
+  }
+  ENZ(errno = pthread_mutex_lock(&mock->lock));
+  *stats = mock->ctx_stats;
+  ENZ(errno = pthread_mutex_unlock(&mock->lock));
+  return LBM_OK;
+}  /* lbm_context_retrieve_stats */
+
+
+int lbm_context_retrieve_src_transport_stats_ex(lbm_context_t *ctx, int *num, int size,
+    lbm_src_transport_stats_t *stats)
+{
+  lbm_mock_t *mock = (lbm_mock_t *)ctx;
+
+  if (mock == NULL) {
+    set_error(LBM_EINVAL, "NULL context");
+    return LBM_FAILURE;
+  }
+  return retrieve_sessions(mock, &mock->src, num, size, (char *)stats);
+}  /* lbm_context_retrieve_src_transport_stats_ex */
+
+
+int lbm_context_retrieve_rcv_transport_stats_ex(lbm_context_t *ctx, int *num, int size,
+    lbm_rcv_transport_stats_t *stats)
+{
+  lbm_mock_t *mock = (lbm_mock_t *)ctx;
+
+  if (mock == NULL) {
+    set_error(LBM_EINVAL, "NULL context");
+    return LBM_FAILURE;
+  }
+  return retrieve_sessions(mock, &mock->rcv, num, size, (char *)stats);
+}  /* lbm_context_retrieve_rcv_transport_stats_ex */
+
+
+/* For stats_send.c; nothing is sent. */
+int lbm_src_send(lbm_src_t *src, const char *msg, size_t len, int flags)
+{
+  (void)src; (void)msg; (void)len; (void)flags;
+  return LBM_OK;
+}  /* lbm_src_send */
+
+
+void lbm_mock_config_init(lbm_mock_config_t *config)
+{
+  config->num_src = 10;
+  config->num_rcv = 10;
+  config->max_growth = 1000;
+  config->churn_pct = 0.0;  /* No churn. */
+  config->add_per_step = 0;
+  config->seed = 1;
+}  /* lbm_mock_config_init */
+
+
+lbm_mock_t *lbm_mock_create(const lbm_mock_config_t *config)
+{
+  lbm_mock_t *mock;
+
+  ENL(mock = (lbm_mock_t *)malloc(sizeof(lbm_mock_t)));
+  memset(mock, 0, sizeof(lbm_mock_t));
+  mock->config = *config;
+  ENZ(errno = pthread_mutex_init(&mock->lock, NULL));
+  mock->rand_state = 0x9E3779B97F4A7C15ULL ^ config->seed;
+  mock->next_session_id = (uint32_t)config->seed * 0x10000;
+  mock->src.size = sizeof(lbm_src_transport_stats_t);
+  mock->rcv.size = sizeof(lbm_rcv_transport_stats_t);
+  add_sessions(mock, &mock->src, config->num_src);
+  add_sessions(mock, &mock->rcv, config->num_rcv);
+
+  return mock;
+}  /* lbm_mock_create */
+
+
+lbm_context_t *lbm_mock_ctx(lbm_mock_t *mock)
+{
+  return (lbm_context_t *)mock;
+}  /* lbm_mock_ctx */
+
+
+void lbm_mock_delete(lbm_mock_t *mock)
+{
+  free(mock->src.stats);
+  free(mock->rcv.stats);
+  pthread_mutex_destroy(&mock->lock);
+  free(mock);
+}  /* lbm_mock_delete */
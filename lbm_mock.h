@@ -0,0 +1,92 @@
+/* lbm_mock.h - synthetic UM statistics, for benchmarking without UM.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef LBM_MOCK_H
+#define LBM_MOCK_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <pthread.h>
+#include "lbm/lbm.h"
+
+
+/* Options for a mock context. Initialize with lbm_mock_config_init(). */
+struct lbm_mock_config_s {
+  int num_src;  /* Source transport sessions at the start. */
+  int num_rcv;  /* Receiver transport sessions at the start. */
+  /* Each counter goes up by 0 to max_growth each step. */
+  lbm_ulong_t max_growth;
+  /* Percent of the sessions replaced by new ones (different source
+   * strings, counters starting at 0) each step. */
+  double churn_pct;
+  /* Sessions added (on each side) each step. A retrieve with the previous
+   * capacity then fails with LBM_EINVAL, as with UM. */
+  int add_per_step;
+  unsigned int seed;
+};
+typedef struct lbm_mock_config_s lbm_mock_config_t;
+
+
+/* One side's sessions, in the form they are retrieved in. */
+struct lbm_mock_sessions_s {
+  int num;
+  int capacity;
+  size_t size;  /* Of one element. */
+  char *stats;  /* lbm_src_transport_stats_t or lbm_rcv_transport_stats_t. */
+};
+typedef struct lbm_mock_sessions_s lbm_mock_sessions_t;
+
+
+/* Mock context. Pass lbm_mock_ctx() to stats_thread_create_ex() in place
+ * of a UM context. "lock" protects the sessions, like UM's internal locks:
+ * stepping and retrieving can be in different threads. */
+struct lbm_mock_s {
+  lbm_mock_config_t config;
+  pthread_mutex_t lock;
+  uint64_t rand_state;
+  uint32_t next_session_id;
+  lbm_context_stats_t ctx_stats;
+  lbm_mock_sessions_t src;
+  lbm_mock_sessions_t rcv;
+  /* Counts of calls, for the benchmark. */
+  uint64_t num_steps;
+  uint64_t num_retrieves;
+  uint64_t num_einvals;  /* Retrieves that asked for a bigger array. */
+};
+typedef struct lbm_mock_s lbm_mock_t;
+
+
+void lbm_mock_config_init(lbm_mock_config_t *config);
+lbm_mock_t *lbm_mock_create(const lbm_mock_config_t *config);
+lbm_context_t *lbm_mock_ctx(lbm_mock_t *mock);
+/* Advance the counters, and churn and add sessions, per the config. */
+void lbm_mock_step(lbm_mock_t *mock);
+void lbm_mock_delete(lbm_mock_t *mock);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* LBM_MOCK_H */
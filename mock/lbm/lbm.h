@@ -0,0 +1,274 @@
+/* lbm.h - stand-in for UM's lbm/lbm.h, for building with lbm_mock.c.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Declares only what the stats_* modules use, with UM's names, so they can
+ * be built and benchmarked without a UM install (see bld_mock.sh). It is
+ * not the UM API: don't build mon_self or applications with it. The
+ * structures have UM's fields, but nothing depends on their layout
+ * matching UM's. */
+
+#ifndef LBM_H
+#define LBM_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+typedef unsigned long int lbm_ulong_t;
+typedef unsigned int lbm_uint_t;
+
+/* Opaque; see lbm_mock.h. */
+typedef struct lbm_context_stct_t lbm_context_t;
+typedef struct lbm_src_stct_t lbm_src_t;
+
+#define LBM_OK 0
+#define LBM_FAILURE -1
+
+#define LBM_EINVAL 1
+#define LBM_EWOULDBLOCK 3
+
+#define LBM_MSG_FLUSH 0x1
+#define LBM_MSG_MAX_SOURCE_LEN 128
+
+#define LBM_TRANSPORT_STAT_TCP 1
+#define LBM_TRANSPORT_STAT_LBTRM 2
+#define LBM_TRANSPORT_STAT_LBTRU 3
+#define LBM_TRANSPORT_STAT_LBTIPC 4
+#define LBM_TRANSPORT_STAT_LBTRDMA 5
+#define LBM_TRANSPORT_STAT_LBTSMX 7
+
+
+typedef struct lbm_context_stats_t_stct {
+  lbm_ulong_t tr_dgrams_sent;
+  lbm_ulong_t tr_bytes_sent;
+  lbm_ulong_t tr_dgrams_rcved;
+  lbm_ulong_t tr_bytes_rcved;
+  lbm_ulong_t tr_dgrams_dropped_ver;
+  lbm_ulong_t tr_dgrams_dropped_type;
+  lbm_ulong_t tr_dgrams_dropped_malformed;
+  lbm_ulong_t tr_dgrams_send_failed;
+  lbm_ulong_t tr_src_topics;
+  lbm_ulong_t tr_rcv_topics;
+  lbm_ulong_t tr_rcv_unresolved_topics;
+  lbm_ulong_t lbtrm_unknown_msgs_rcved;
+  lbm_ulong_t lbtru_unknown_msgs_rcved;
+  lbm_ulong_t send_blocked;
+  lbm_ulong_t send_would_block;
+  lbm_ulong_t resp_blocked;
+  lbm_ulong_t resp_would_block;
+  lbm_ulong_t uim_dup_msgs_rcved;
+  lbm_ulong_t uim_msgs_no_stream_rcved;
+  lbm_ulong_t fragments_lost;
+  lbm_ulong_t fragments_unrecoverably_lost;
+  lbm_ulong_t rcv_cb_svc_time_min;
+  lbm_ulong_t rcv_cb_svc_time_max;
+  lbm_ulong_t rcv_cb_svc_time_mean;
+} lbm_context_stats_t;
+
+
+typedef struct lbm_src_transport_stats_tcp_t_stct {
+  lbm_ulong_t num_clients;
+  lbm_ulong_t bytes_buffered;
+} lbm_src_transport_stats_tcp_t;
+
+typedef struct lbm_src_transport_stats_lbtrm_t_stct {
+  lbm_ulong_t msgs_sent;
+  lbm_ulong_t bytes_sent;
+  lbm_ulong_t txw_msgs;
+  lbm_ulong_t txw_bytes;
+  lbm_ulong_t nak_pckts_rcved;
+  lbm_ulong_t naks_rcved;
+  lbm_ulong_t naks_ignored;
+  lbm_ulong_t naks_shed;
+  lbm_ulong_t naks_rx_delay_ignored;
+  lbm_ulong_t rxs_sent;
+  lbm_ulong_t rctlr_data_msgs;
+  lbm_ulong_t rctlr_rx_msgs;
+  lbm_ulong_t rx_bytes_sent;
+} lbm_src_transport_stats_lbtrm_t;
+
+typedef struct lbm_src_transport_stats_lbtru_t_stct {
+  lbm_ulong_t msgs_sent;
+  lbm_ulong_t bytes_sent;
+  lbm_ulong_t nak_pckts_rcved;
+  lbm_ulong_t naks_rcved;
+  lbm_ulong_t naks_ignored;
+  lbm_ulong_t naks_shed;
+  lbm_ulong_t naks_rx_delay_ignored;
+  lbm_ulong_t rxs_sent;
+  lbm_ulong_t num_clients;
+  lbm_ulong_t rx_bytes_sent;
+} lbm_src_transport_stats_lbtru_t;
+
+typedef struct lbm_src_transport_stats_lbtipc_t_stct {
+  lbm_ulong_t num_clients;
+  lbm_ulong_t msgs_sent;
+  lbm_ulong_t bytes_sent;
+} lbm_src_transport_stats_lbtipc_t;
+
+typedef struct lbm_src_transport_stats_lbtsmx_t_stct {
+  lbm_ulong_t num_clients;
+  lbm_ulong_t msgs_sent;
+  lbm_ulong_t bytes_sent;
+} lbm_src_transport_stats_lbtsmx_t;
+
+typedef struct lbm_src_transport_stats_lbtrdma_t_stct {
+  lbm_ulong_t num_clients;
+  lbm_ulong_t msgs_sent;
+  lbm_ulong_t bytes_sent;
+} lbm_src_transport_stats_lbtrdma_t;
+
+typedef struct lbm_src_transport_stats_t_stct {
+  int type;
+  char source[LBM_MSG_MAX_SOURCE_LEN];
+  union {
+    lbm_src_transport_stats_tcp_t tcp;
+    lbm_src_transport_stats_lbtrm_t lbtrm;
+    lbm_src_transport_stats_lbtru_t lbtru;
+    lbm_src_transport_stats_lbtipc_t lbtipc;
+    lbm_src_transport_stats_lbtrdma_t lbtrdma;
+    lbm_src_transport_stats_lbtsmx_t lbtsmx;
+  } transport;
+} lbm_src_transport_stats_t;
+
+
+typedef struct lbm_rcv_transport_stats_tcp_t_stct {
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t lbm_reqs_rcved;
+} lbm_rcv_transport_stats_tcp_t;
+
+typedef struct lbm_rcv_transport_stats_lbtrm_t_stct {
+  lbm_ulong_t msgs_rcved;
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t nak_pckts_sent;
+  lbm_ulong_t naks_sent;
+  lbm_ulong_t lost;
+  lbm_ulong_t ncfs_ignored;
+  lbm_ulong_t ncfs_shed;
+  lbm_ulong_t ncfs_rx_delay;
+  lbm_ulong_t ncfs_unknown;
+  lbm_ulong_t nak_stm_min;
+  lbm_ulong_t nak_stm_mean;
+  lbm_ulong_t nak_stm_max;
+  lbm_ulong_t nak_tx_min;
+  lbm_ulong_t nak_tx_mean;
+  lbm_ulong_t nak_tx_max;
+  lbm_ulong_t duplicate_data;
+  lbm_ulong_t unrecovered_txw;
+  lbm_ulong_t unrecovered_tmo;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t lbm_reqs_rcved;
+  lbm_ulong_t dgrams_dropped_size;
+  lbm_ulong_t dgrams_dropped_type;
+  lbm_ulong_t dgrams_dropped_version;
+  lbm_ulong_t dgrams_dropped_hdr;
+  lbm_ulong_t dgrams_dropped_other;
+  lbm_ulong_t out_of_order;
+} lbm_rcv_transport_stats_lbtrm_t;
+
+typedef struct lbm_rcv_transport_stats_lbtru_t_stct {
+  lbm_ulong_t msgs_rcved;
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t nak_pckts_sent;
+  lbm_ulong_t naks_sent;
+  lbm_ulong_t lost;
+  lbm_ulong_t ncfs_ignored;
+  lbm_ulong_t ncfs_shed;
+  lbm_ulong_t ncfs_rx_delay;
+  lbm_ulong_t ncfs_unknown;
+  lbm_ulong_t nak_stm_min;
+  lbm_ulong_t nak_stm_mean;
+  lbm_ulong_t nak_stm_max;
+  lbm_ulong_t nak_tx_min;
+  lbm_ulong_t nak_tx_mean;
+  lbm_ulong_t nak_tx_max;
+  lbm_ulong_t duplicate_data;
+  lbm_ulong_t unrecovered_txw;
+  lbm_ulong_t unrecovered_tmo;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t lbm_reqs_rcved;
+  lbm_ulong_t dgrams_dropped_size;
+  lbm_ulong_t dgrams_dropped_type;
+  lbm_ulong_t dgrams_dropped_version;
+  lbm_ulong_t dgrams_dropped_hdr;
+  lbm_ulong_t dgrams_dropped_sid;
+  lbm_ulong_t dgrams_dropped_other;
+} lbm_rcv_transport_stats_lbtru_t;
+
+typedef struct lbm_rcv_transport_stats_lbtipc_t_stct {
+  lbm_ulong_t msgs_rcved;
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t lbm_reqs_rcved;
+} lbm_rcv_transport_stats_lbtipc_t;
+
+typedef struct lbm_rcv_transport_stats_lbtsmx_t_stct {
+  lbm_ulong_t msgs_rcved;
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t reserved1;
+} lbm_rcv_transport_stats_lbtsmx_t;
+
+typedef struct lbm_rcv_transport_stats_lbtrdma_t_stct {
+  lbm_ulong_t msgs_rcved;
+  lbm_ulong_t bytes_rcved;
+  lbm_ulong_t lbm_msgs_rcved;
+  lbm_ulong_t lbm_msgs_no_topic_rcved;
+  lbm_ulong_t lbm_reqs_rcved;
+} lbm_rcv_transport_stats_lbtrdma_t;
+
+typedef struct lbm_rcv_transport_stats_t_stct {
+  int type;
+  char source[LBM_MSG_MAX_SOURCE_LEN];
+  union {
+    lbm_rcv_transport_stats_tcp_t tcp;
+    lbm_rcv_transport_stats_lbtrm_t lbtrm;
+    lbm_rcv_transport_stats_lbtru_t lbtru;
+    lbm_rcv_transport_stats_lbtipc_t lbtipc;
+    lbm_rcv_transport_stats_lbtrdma_t lbtrdma;
+    lbm_rcv_transport_stats_lbtsmx_t lbtsmx;
+  } transport;
+} lbm_rcv_transport_stats_t;
+
+
+int lbm_errnum(void);
+const char *lbm_errmsg(void);
+int lbm_context_retrieve_stats(lbm_context_t *ctx, lbm_context_stats_t *stats);
+int lbm_context_retrieve_src_transport_stats_ex(lbm_context_t *ctx, int *num, int size,
+    lbm_src_transport_stats_t *stats);
+int lbm_context_retrieve_rcv_transport_stats_ex(lbm_context_t *ctx, int *num, int size,
+    lbm_rcv_transport_stats_t *stats);
+int lbm_src_send(lbm_src_t *src, const char *msg, size_t len, int flags);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* LBM_H */
@@ -29,6 +29,8 @@
 
 #include "lbm/lbm.h"
 #include "stats_thread.h"
+#include "stats_monitor.h"
+#include "stats_source.h"
 
 /* State to pass around. */
 struct my_objs_s {
@@ -37,6 +39,11 @@ struct my_objs_s {
   lbm_rcv_t *rcv;
   lbm_src_t *src1;
   lbm_src_t *src2;
+  stats_latency_t *latency;  /* Filled in by rcv_cb, reported by stats_thread1. */
+  stats_send_t *send1;  /* Sends on ctx1's sources, reported by stats_thread1. */
+  stats_send_t *send2;
+  stats_send_src_t *send_src1;
+  stats_send_src_t *send_src2;
 };
 typedef struct my_objs_s my_objs_t;
 
@@ -77,9 +84,33 @@ typedef struct my_objs_s my_objs_t;
 } while (0)  /* ENL */
 
 
-/* UM callback for receiver events, including received messages. */
+/* UM callback for receiver events, including received messages. Records
+ * the time spent in the callback and, since this program's messages start
+ * with the sender's CLOCK_REALTIME, the end-to-end latency. */
 int rcv_cb(lbm_rcv_t *rcv, lbm_msg_t *msg, void *clientd)
 {
+  my_objs_t *my_objs = (my_objs_t *)clientd;
+  uint64_t start_ns = stats_latency_now_ns();
+
+  switch (msg->type) {
+    case LBM_MSG_DATA: {
+      int type = stats_source_type(msg->source);
+      if (msg->len >= sizeof(uint64_t)) {
+        uint64_t sent_ns;
+        uint64_t now_ns = stats_latency_realtime_ns();
+        memcpy(&sent_ns, msg->data, sizeof(sent_ns));
+        if (now_ns >= sent_ns) {  /* Clocks can disagree. */
+          stats_latency_record(my_objs->latency, type, STATS_LATENCY_E2E, now_ns - sent_ns);
+        }
+      }
+
+      /* Application message processing goes here. */
+
+      stats_latency_record(my_objs->latency, type, STATS_LATENCY_CALLBACK, stats_latency_now_ns() - start_ns);
+      break;
+    }
+  }  /* switch */
+
   return 0;
 }  /* rcv_cb */
 
@@ -87,9 +118,12 @@ int rcv_cb(lbm_rcv_t *rcv, lbm_msg_t *msg, void *clientd)
 int main(int argc, char **argv)
 {
   my_objs_t *my_objs;
+  stats_thread_config_t stats_config;
   stats_thread_t *stats_thread1;
   stats_thread_t *stats_thread2;
+  stats_monitor_t *monitor = NULL;
   lbm_topic_t *topic_obj;
+  char msg_buf[sizeof(uint64_t) + 9];
   int i;
 
   ENL(my_objs = (my_objs_t *)malloc(sizeof(my_objs_t)));
@@ -99,12 +133,32 @@ int main(int argc, char **argv)
   E(lbm_context_create(&my_objs->ctx1, NULL, NULL, NULL));
   E(lbm_context_create(&my_objs->ctx2, NULL, NULL, NULL));
 
+  /* "-c": sample both contexts together, on whole seconds of the wall
+   * clock, and print each tick's output as one batch. */
+  if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+    stats_monitor_config_t monitor_config;
+    stats_monitor_config_init(&monitor_config);
+    monitor_config.coordinated = 1;
+    ENL(monitor = stats_monitor_create_ex(&monitor_config));
+  }
+
   /* Stats interval 2 seconds is much too small for most producton
    * deployments, where 10 minutes or more would typically be used. */
-  ENL(stats_thread1 = stats_thread_create(my_objs->ctx1, "ctx1", 2));
+  my_objs->latency = stats_latency_create();
+  stats_thread_config_init(&stats_config);
+  stats_config.monitor = monitor;  /* NULL for the default. */
+  stats_config.latency = my_objs->latency;  /* ctx1 has the receiver. */
+  my_objs->send1 = stats_send_create();
+  stats_config.send = my_objs->send1;
+  ENL(stats_thread1 = stats_thread_create_ex(my_objs->ctx1, "ctx1", 2, &stats_config));
   stats_thread_start(stats_thread1);
-  sleep(1);  /* Run the two stats threads out of phase. */
-  ENL(stats_thread2 = stats_thread_create(my_objs->ctx2, "ctx2", 2));
+  /* Both are sampled by one shared scheduler thread, which runs them
+   * out of phase with each other (unless "-c"). */
+  my_objs->send2 = stats_send_create();
+  stats_thread_config_init(&stats_config);
+  stats_config.monitor = monitor;
+  stats_config.send = my_objs->send2;
+  ENL(stats_thread2 = stats_thread_create_ex(my_objs->ctx2, "ctx2", 2, &stats_config));
   stats_thread_start(stats_thread2);
 
   E(lbm_rcv_topic_lookup(&topic_obj, my_objs->ctx1, "MyTopic", NULL));
@@ -112,22 +166,30 @@ int main(int argc, char **argv)
 
   E(lbm_src_topic_alloc(&topic_obj, my_objs->ctx1, "MyTopic", NULL));
   E(lbm_src_create(&my_objs->src1, my_objs->ctx1, topic_obj, NULL, NULL, NULL));
+  my_objs->send_src1 = stats_send_src_add(my_objs->send1, my_objs->src1, "MyTopic");
 
   E(lbm_src_topic_alloc(&topic_obj, my_objs->ctx2, "MyTopic", NULL));
   E(lbm_src_create(&my_objs->src2, my_objs->ctx2, topic_obj, NULL, NULL, NULL));
+  my_objs->send_src2 = stats_send_src_add(my_objs->send2, my_objs->src2, "MyTopic");
 
   usleep(500000);
 
   for (i = 0; i < 5; i++) {
-    E(lbm_src_send(my_objs->src1, "123456789", 9, LBM_MSG_FLUSH));
-    E(lbm_src_send(my_objs->src2, "123456789", 9, LBM_MSG_FLUSH));
+    uint64_t sent_ns = stats_latency_realtime_ns();
+    memcpy(msg_buf, &sent_ns, sizeof(sent_ns));
+    memcpy(msg_buf + sizeof(sent_ns), "123456789", 9);
+    /* Same as lbm_src_send(), but counted and timed. */
+    E(stats_send(my_objs->send_src1, msg_buf, sizeof(msg_buf), LBM_MSG_FLUSH));
+    E(stats_send(my_objs->send_src2, msg_buf, sizeof(msg_buf), LBM_MSG_FLUSH));
     sleep(1);
   }
 
   sleep(1);
 
   E(lbm_rcv_delete(my_objs->rcv));
+  stats_send_src_remove(my_objs->send_src1);
   E(lbm_src_delete(my_objs->src1));
+  stats_send_src_remove(my_objs->send_src2);
   E(lbm_src_delete(my_objs->src2));
   printf("terminate stats thread1\n");  fflush(stdout);
   stats_thread_terminate(stats_thread1);
@@ -135,6 +197,12 @@ int main(int argc, char **argv)
   printf("terminate stats thread2\n");  fflush(stdout);
   stats_thread_terminate(stats_thread2);
   stats_thread_delete(stats_thread2);
+  if (monitor != NULL) {
+    stats_monitor_delete(monitor);
+  }
+  stats_latency_delete(my_objs->latency);
+  stats_send_delete(my_objs->send1);
+  stats_send_delete(my_objs->send2);
   E(lbm_context_delete(my_objs->ctx1));
   E(lbm_context_delete(my_objs->ctx2));
 
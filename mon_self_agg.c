@@ -0,0 +1,665 @@
+/* mon_self_agg.c - host-level aggregator of stats_stream clients.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Receives the binary samples that stats_threads with a "stream_path"
+ * send (see stats_stream.h) from every process on the host, and writes one
+ * consolidated output: every interval, the host-wide sums of the counter
+ * deltas of all contexts and sessions, by direction and transport type,
+ * with rates, plus a line per connected context.
+ *   ./mon_self_agg [-s socket_path] [-i interval_sec] [-o output_file] [-c]
+ * -o appends to the file instead of writing to standard out.
+ * -c omits the per-context lines.
+ */
+
+#define _GNU_SOURCE  /* For accept4(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_stream.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* A session's counters from its previous sample. */
+struct row_s {
+  int type;
+  lbm_ulong_t prev[STATS_MAX_FIELDS];
+};
+typedef struct row_s row_t;
+
+/* One connected stats_stream: one context of one process. */
+struct client_s {
+  int fd;
+  uint8_t *buf;  /* Received but not yet parsed. */
+  size_t len;
+  int have_hello;
+  uint32_t pid;
+  char ctx_name[64];
+  int field_set;
+  uint64_t num_samples;  /* Since it connected. */
+  uint64_t interval_samples;  /* Since the last output. */
+  uint64_t dropped;  /* As reported by the client. */
+  lbm_ulong_t ctx_prev[STATS_MAX_FIELDS];
+  int num_sessions[2][STATS_NUM_TYPES];  /* In its latest sample. */
+  stats_index_t *sessions[2];  /* session->row is in "rows". */
+  row_t *rows;
+  int num_rows;
+  int *free_rows;
+  int num_free_rows;
+};
+typedef struct client_s client_t;
+
+/* Host-wide sums over one output interval, of the clients using one field
+ * set (normally all of them). */
+struct rollup_s {
+  int num_clients;  /* Connected at the end of the interval. */
+  uint64_t num_samples;
+  uint64_t ctx_totals[STATS_MAX_FIELDS];
+  int num_sessions[2][STATS_NUM_TYPES];
+  uint64_t totals[2][STATS_NUM_TYPES][STATS_MAX_FIELDS];
+};
+typedef struct rollup_s rollup_t;
+
+static client_t **clients = NULL;
+static int num_clients = 0;
+static rollup_t rollups[STATS_FIELDS_NUM_SETS];
+/* Since the last output. */
+static uint64_t interval_samples = 0;
+static uint64_t interval_dropped = 0;
+static int interval_connects = 0;
+static int interval_disconnects = 0;
+static volatile sig_atomic_t stop = 0;
+
+
+static void usage(const char *msg)
+{
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Usage: mon_self_agg [-s socket_path] [-i interval_sec] [-o output_file] [-c]\n");
+  exit(1);
+}  /* usage */
+
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}  /* on_signal */
+
+
+static uint64_t mono_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* mono_ns */
+
+
+/* Returns NULL if the varint runs past "end". */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *val)
+{
+  uint64_t v = 0;
+  int shift = 0;
+
+  while (p < end && shift < 64) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      *val = v;
+      return p;
+    }
+    shift += 7;
+  }
+  return NULL;
+}  /* get_varint */
+
+
+static int row_alloc(client_t *client)
+{
+  if (client->num_free_rows > 0) {
+    return client->free_rows[--client->num_free_rows];
+  }
+  ENL(client->rows = (row_t *)realloc(client->rows, (client->num_rows + 1) * sizeof(row_t)));
+  ENL(client->free_rows = (int *)realloc(client->free_rows, (client->num_rows + 1) * sizeof(int)));
+  return client->num_rows++;
+}  /* row_alloc */
+
+
+/* stats_index_sweep() callback: the session left; reuse its row. */
+static void sweep_row(stats_session_t *session, void *clientd)
+{
+  client_t *client = (client_t *)clientd;
+
+  if (session->row >= 0) {
+    client->free_rows[client->num_free_rows++] = session->row;
+  }
+}  /* sweep_row */
+
+
+static client_t *client_create(int fd)
+{
+  client_t *client;
+
+  ENL(client = (client_t *)calloc(1, sizeof(client_t)));
+  client->fd = fd;
+  ENL(client->buf = (uint8_t *)malloc(2 * STATS_STREAM_MAX_FRAME));
+  client->sessions[STATS_STREAM_SRC] = stats_index_create();
+  client->sessions[STATS_STREAM_RCV] = stats_index_create();
+  return client;
+}  /* client_create */
+
+
+static void client_delete(client_t *client)
+{
+  close(client->fd);  /* Also removes it from epoll. */
+  stats_index_delete(client->sessions[STATS_STREAM_SRC]);
+  stats_index_delete(client->sessions[STATS_STREAM_RCV]);
+  free(client->rows);
+  free(client->free_rows);
+  free(client->buf);
+  free(client);
+}  /* client_delete */
+
+
+static int on_hello(client_t *client, const uint8_t *p, size_t len)
+{
+  stats_stream_hello_t hello;
+
+  if (client->have_hello || len != sizeof(hello)) {
+    return -1;
+  }
+  memcpy(&hello, p, sizeof(hello));
+  if (hello.version != STATS_STREAM_VERSION || hello.field_set >= STATS_FIELDS_NUM_SETS) {
+    fprintf(stderr, "WARNING: client pid %u: unsupported version %u or field set %u\n",
+        hello.pid, hello.version, hello.field_set);
+    return -1;
+  }
+  client->pid = hello.pid;
+  memcpy(client->ctx_name, hello.ctx_name, sizeof(client->ctx_name));
+  client->ctx_name[sizeof(client->ctx_name) - 1] = '\0';
+  client->field_set = (int)hello.field_set;
+  client->have_hello = 1;
+  return 0;
+}  /* on_hello */
+
+
+static int on_sample(client_t *client, const uint8_t *p, size_t len)
+{
+  const uint8_t *end = p + len;
+  rollup_t *rollup = &rollups[client->field_set];
+  const stats_field_table_t *table = stats_fields_ctx_table(client->field_set);
+  stats_stream_sample_t hdr;
+  int f;
+
+  if (!client->have_hello || len < sizeof(hdr)) {
+    return -1;
+  }
+  memcpy(&hdr, p, sizeof(hdr));
+  p += sizeof(hdr);
+
+  /* Forget the sessions that weren't in the previous sample. */
+  if (client->num_samples > 0) {
+    (void)stats_index_sweep(client->sessions[STATS_STREAM_SRC], sweep_row, client);
+    (void)stats_index_sweep(client->sessions[STATS_STREAM_RCV], sweep_row, client);
+  }
+  stats_index_begin_sample(client->sessions[STATS_STREAM_SRC]);
+  stats_index_begin_sample(client->sessions[STATS_STREAM_RCV]);
+  memset(client->num_sessions, 0, sizeof(client->num_sessions));
+
+  for (f = 0; f < table->num_counters; f++) {
+    uint64_t v;
+    if ((p = get_varint(p, end, &v)) == NULL) {
+      return -1;
+    }
+    if (client->num_samples > 0) {
+      rollup->ctx_totals[f] += (v >= client->ctx_prev[f]) ? v - client->ctx_prev[f] : v;
+    }
+    client->ctx_prev[f] = (lbm_ulong_t)v;
+  }
+  if (hdr.dropped > client->dropped) {
+    interval_dropped += hdr.dropped - client->dropped;
+  }
+  client->dropped = hdr.dropped;
+  client->num_samples++;
+  client->interval_samples++;
+  rollup->num_samples++;
+  interval_samples++;
+  return 0;
+}  /* on_sample */
+
+
+static int on_sessions(client_t *client, const uint8_t *p, size_t len, int count)
+{
+  const uint8_t *end = p + len;
+  rollup_t *rollup = &rollups[client->field_set];
+  int i;
+
+  if (client->num_samples == 0) {
+    return -1;  /* Not after a SAMPLE. */
+  }
+  for (i = 0; i < count; i++) {
+    const stats_field_table_t *table;
+    char source[LBM_MSG_MAX_SOURCE_LEN];
+    lbm_ulong_t vals[STATS_MAX_FIELDS];
+    stats_session_t *session;
+    row_t *row;
+    int dir, type, type_index, source_len, is_new, f, reset;
+
+    if (end - p < 3) {
+      return -1;
+    }
+    dir = p[0];
+    type = p[1];
+    source_len = p[2];
+    p += 3;
+    type_index = stats_fields_type_index(type);
+    if (dir > STATS_STREAM_RCV || type_index < 0 || source_len >= (int)sizeof(source) || end - p < source_len) {
+      return -1;
+    }
+    memcpy(source, p, source_len);
+    source[source_len] = '\0';
+    p += source_len;
+    table = (dir == STATS_STREAM_SRC) ? stats_fields_src_table(client->field_set, type)
+                                      : stats_fields_rcv_table(client->field_set, type);
+    for (f = 0; f < table->num_counters; f++) {
+      uint64_t v;
+      if ((p = get_varint(p, end, &v)) == NULL) {
+        return -1;
+      }
+      vals[f] = (lbm_ulong_t)v;
+    }
+
+    session = stats_index_find_or_add(client->sessions[dir], source, &is_new);
+    client->num_sessions[dir][type_index]++;
+    rollup->num_sessions[dir][type_index]++;
+    if (session->row < 0) {
+      session->row = row_alloc(client);
+      row = &client->rows[session->row];
+      row->type = -1;
+    }
+    row = &client->rows[session->row];
+    /* Like the stats_thread's deltas: a new or reset session counts in
+     * full, except in a client's first sample (it only just connected). */
+    reset = (row->type != type);
+    for (f = 0; !reset && f < table->num_counters; f++) {
+      reset = (vals[f] < row->prev[f]);
+    }
+    if (!reset || client->num_samples > 1) {
+      for (f = 0; f < table->num_counters; f++) {
+        rollup->totals[dir][type_index][f] += reset ? vals[f] : vals[f] - row->prev[f];
+      }
+    }
+    row->type = type;
+    memcpy(row->prev, vals, table->num_counters * sizeof(lbm_ulong_t));
+  }
+  return (p == end) ? 0 : -1;
+}  /* on_sessions */
+
+
+/* Returns -1 if the client should be dropped. */
+static int client_read(client_t *client)
+{
+  size_t offset = 0;
+
+  for (;;) {
+    ssize_t n = read(client->fd, client->buf + client->len, 2 * STATS_STREAM_MAX_FRAME - client->len);
+    if (n == 0) {
+      return -1;  /* Closed; a partial sample is thrown away. */
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      return -1;
+    }
+    client->len += (size_t)n;
+
+    /* Whole frames. */
+    offset = 0;
+    while (client->len - offset >= sizeof(stats_stream_frame_hdr_t)) {
+      stats_stream_frame_hdr_t hdr;
+      const uint8_t *body;
+      size_t body_len;
+      int err;
+
+      memcpy(&hdr, client->buf + offset, sizeof(hdr));
+      if (hdr.len < sizeof(hdr) || hdr.len > STATS_STREAM_MAX_FRAME) {
+        fprintf(stderr, "WARNING: client pid %u: bad frame length %u\n", client->pid, hdr.len);
+        return -1;
+      }
+      if (client->len - offset < hdr.len) {
+        break;
+      }
+      body = client->buf + offset + sizeof(hdr);
+      body_len = hdr.len - sizeof(hdr);
+      switch (hdr.kind) {
+        case STATS_STREAM_HELLO: err = on_hello(client, body, body_len); break;
+        case STATS_STREAM_SAMPLE: err = on_sample(client, body, body_len); break;
+        case STATS_STREAM_SESSIONS: err = on_sessions(client, body, body_len, hdr.count); break;
+        default: err = -1;
+      }
+      if (err != 0) {
+        fprintf(stderr, "WARNING: client pid %u: bad frame (kind %u)\n", client->pid, hdr.kind);
+        return -1;
+      }
+      offset += hdr.len;
+    }
+    memmove(client->buf, client->buf + offset, client->len - offset);
+    client->len -= offset;
+  }
+}  /* client_read */
+
+
+static void print_rates(FILE *out, const stats_field_t *fields, int num_fields, const uint64_t *totals,
+    double interval_sec)
+{
+  int f;
+
+  for (f = 0; f < num_fields; f++) {
+    fprintf(out, ", %s=%lu (%.2f/s)", fields[f].name, (unsigned long)totals[f], (double)totals[f] / interval_sec);
+  }
+  fprintf(out, "\n");
+}  /* print_rates */
+
+
+static void print_output(FILE *out, const char *host, uint64_t interval_ns, int per_client)
+{
+  double interval_sec = (double)interval_ns / 1e9;
+  time_t now = time(NULL);
+  struct tm tm;
+  char time_str[32];
+  int num_contexts = 0;  /* Clients that sent their HELLO. */
+  int set, c, d, t;
+
+  for (c = 0; c < num_clients; c++) {
+    if (clients[c]->have_hello) {
+      rollups[clients[c]->field_set].num_clients++;
+      num_contexts++;
+    }
+  }
+
+  gmtime_r(&now, &tm);
+  strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  fprintf(out, "host='%s', agg: time=%s, interval_ms=%lu, contexts=%d, samples=%lu, dropped=%lu, "
+      "connects=%d, disconnects=%d\n", host, time_str, (unsigned long)(interval_ns / 1000000), num_contexts,
+      (unsigned long)interval_samples, (unsigned long)interval_dropped, interval_connects, interval_disconnects);
+  for (set = 0; set < STATS_FIELDS_NUM_SETS; set++) {
+    rollup_t *rollup = &rollups[set];
+    const stats_field_table_t *table = stats_fields_ctx_table(set);
+    if (rollup->num_clients == 0 && rollup->num_samples == 0) {
+      continue;
+    }
+    fprintf(out, "host='%s', ctx/total: contexts=%d", host, rollup->num_clients);
+    print_rates(out, table->counters, table->num_counters, rollup->ctx_totals, interval_sec);
+    for (d = 0; d < 2; d++) {
+      for (t = 0; t < STATS_NUM_TYPES; t++) {
+        int type = stats_fields_type_from_index(t);
+        int num_sessions = 0;
+        for (c = 0; c < num_clients; c++) {
+          if (clients[c]->have_hello && clients[c]->field_set == set) {
+            num_sessions += clients[c]->num_sessions[d][t];
+          }
+        }
+        if (num_sessions == 0 && rollup->num_sessions[d][t] == 0) {
+          continue;
+        }
+        table = (d == STATS_STREAM_SRC) ? stats_fields_src_table(set, type) : stats_fields_rcv_table(set, type);
+        fprintf(out, "host='%s', %s/%s/total: sessions=%d", host, (d == STATS_STREAM_SRC) ? "src" : "rcv",
+            stats_fields_type_name(type), num_sessions);
+        print_rates(out, table->counters, table->num_counters, rollup->totals[d][t], interval_sec);
+      }
+    }
+  }
+
+  if (per_client) {
+    for (c = 0; c < num_clients; c++) {
+      client_t *client = clients[c];
+      int num_src = 0, num_rcv = 0;
+      if (!client->have_hello) {
+        continue;
+      }
+      for (t = 0; t < STATS_NUM_TYPES; t++) {
+        num_src += client->num_sessions[STATS_STREAM_SRC][t];
+        num_rcv += client->num_sessions[STATS_STREAM_RCV][t];
+      }
+      fprintf(out, "host='%s', context: pid=%u, ctx_name='%s', samples=%lu, src_sessions=%d, rcv_sessions=%d, "
+          "dropped=%lu\n", host, client->pid, client->ctx_name, (unsigned long)client->interval_samples,
+          num_src, num_rcv, (unsigned long)client->dropped);
+    }
+  }
+  fflush(out);
+
+  /* Start the next interval. */
+  memset(rollups, 0, sizeof(rollups));
+  for (c = 0; c < num_clients; c++) {
+    clients[c]->interval_samples = 0;
+  }
+  interval_samples = 0;
+  interval_dropped = 0;
+  interval_connects = 0;
+  interval_disconnects = 0;
+}  /* print_output */
+
+
+static int listen_on(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    usage("Socket path too long");
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /* Replace a stale socket file, but not a running daemon. */
+  EM1(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "ERROR: another mon_self_agg is listening on %s\n", path);
+    exit(1);
+  }
+  close(fd);
+  (void)unlink(path);
+
+  EM1(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  EM1(bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EM1(listen(fd, 128));
+  return fd;
+}  /* listen_on */
+
+
+static void accept_clients(int epoll_fd, int listen_fd)
+{
+  for (;;) {
+    struct epoll_event event;
+    client_t *client;
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("WARNING: accept");
+      }
+      return;
+    }
+    client = client_create(fd);
+    ENL(clients = (client_t **)realloc(clients, (num_clients + 1) * sizeof(client_t *)));
+    clients[num_clients++] = client;
+    interval_connects++;
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    EM1(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event));
+  }
+}  /* accept_clients */
+
+
+int main(int argc, char **argv)
+{
+  const char *path = STATS_STREAM_PATH;
+  const char *out_path = NULL;
+  int interval_sec = 10;
+  int per_client = 1;
+  FILE *out = stdout;
+  char host[256];
+  struct epoll_event event;
+  uint64_t next_ns;
+  int listen_fd, epoll_fd, opt, c;
+
+  while ((opt = getopt(argc, argv, "s:i:o:ch")) != -1) {
+    switch (opt) {
+      case 's': path = optarg; break;
+      case 'i': interval_sec = atoi(optarg); break;
+      case 'o': out_path = optarg; break;
+      case 'c': per_client = 0; break;
+      default: usage(NULL);
+    }
+  }
+  if (interval_sec < 1) {
+    usage("Bad interval");
+  }
+  if (optind != argc) {
+    usage("Unexpected argument");
+  }
+  if (out_path != NULL) {
+    ENL(out = fopen(out_path, "a"));
+  }
+  if (gethostname(host, sizeof(host)) != 0) {
+    strcpy(host, "localhost");
+  }
+  host[sizeof(host) - 1] = '\0';
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  listen_fd = listen_on(path);
+  EM1(epoll_fd = epoll_create1(EPOLL_CLOEXEC));
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;  /* The listening socket. */
+  EM1(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event));
+
+  next_ns = mono_ns() + (uint64_t)interval_sec * 1000000000;
+  while (!stop) {
+    struct epoll_event events[64];
+    uint64_t now_ns = mono_ns();
+    int timeout_ms, num_events, e;
+
+    if (now_ns >= next_ns) {
+      print_output(out, host, now_ns - (next_ns - (uint64_t)interval_sec * 1000000000), per_client);
+      next_ns += (uint64_t)interval_sec * 1000000000;
+      if (next_ns <= now_ns) {
+        next_ns = now_ns + (uint64_t)interval_sec * 1000000000;  /* Fell behind; don't print a burst. */
+      }
+      continue;
+    }
+    timeout_ms = (int)((next_ns - now_ns + 999999) / 1000000);
+    num_events = epoll_wait(epoll_fd, events, 64, timeout_ms);
+    if (num_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      EM1(num_events);
+    }
+    for (e = 0; e < num_events; e++) {
+      client_t *client = (client_t *)events[e].data.ptr;
+      if (client == NULL) {
+        accept_clients(epoll_fd, listen_fd);
+        continue;
+      }
+      if (client_read(client) != 0) {
+        for (c = 0; c < num_clients; c++) {
+          if (clients[c] == client) {
+            clients[c] = clients[--num_clients];
+            break;
+          }
+        }
+        client_delete(client);
+        interval_disconnects++;
+      }
+    }
+  }
+
+  while (num_clients > 0) {
+    client_delete(clients[--num_clients]);
+  }
+  free(clients);
+  close(epoll_fd);
+  close(listen_fd);
+  (void)unlink(path);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}  /* main */
@@ -0,0 +1,291 @@
+/* mon_self_top.c - live view of the stats published in shared memory.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Attaches to the stats_shm objects (see stats_shm.h) of the given
+ * processes, or of all processes, and shows their latest values and the
+ * rates since the previous sample. Reading never blocks or slows down the
+ * application.
+ *   ./mon_self_top [-i interval_sec] [-n iterations] [-b] [-F] [pid...]
+ * -b (batch) prints each screen after the last, instead of redrawing.
+ * -F shows every counter of the UM structures, not just the usual ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_sample.h"
+#include "stats_shm.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* One attached context. */
+struct target_s {
+  stats_shm_reader_t *reader;
+  stats_sample_t next;  /* Read into this. */
+  stats_sample_t cur;
+  stats_sample_t prev;
+  int have_prev;
+  int seen;  /* Still listed in this pass. */
+};
+typedef struct target_s target_t;
+
+static target_t *targets = NULL;
+static int num_targets = 0;
+
+
+static void usage(const char *msg)
+{
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Usage: mon_self_top [-i interval_sec] [-n iterations] [-b] [-F] [pid...]\n");
+  exit(1);
+}  /* usage */
+
+
+/* stats_shm_list() callback: attach to objects we don't have yet. */
+static void attach(const char *name, void *clientd)
+{
+  stats_shm_reader_t *reader;
+  int t;
+
+  (void)clientd;
+  for (t = 0; t < num_targets; t++) {
+    if (strcmp(targets[t].reader->name, name) == 0) {
+      targets[t].seen = 1;
+      return;
+    }
+  }
+  reader = stats_shm_reader_open(name);
+  if (reader == NULL) {
+    return;
+  }
+  ENL(targets = (target_t *)realloc(targets, (num_targets + 1) * sizeof(target_t)));
+  memset(&targets[num_targets], 0, sizeof(target_t));
+  targets[num_targets].reader = reader;
+  stats_sample_init(&targets[num_targets].next);
+  stats_sample_init(&targets[num_targets].cur);
+  stats_sample_init(&targets[num_targets].prev);
+  targets[num_targets].seen = 1;
+  num_targets++;
+}  /* attach */
+
+
+static void detach(int t)
+{
+  stats_shm_reader_close(targets[t].reader);
+  stats_sample_free(&targets[t].next);
+  stats_sample_free(&targets[t].cur);
+  stats_sample_free(&targets[t].prev);
+  targets[t] = targets[--num_targets];
+}  /* detach */
+
+
+static void print_fields(const stats_field_t *fields, int num_fields, const void *cur, const void *prev,
+    uint64_t interval_ns)
+{
+  int f;
+
+  for (f = 0; f < num_fields; f++) {
+    lbm_ulong_t val = stats_field_value(&fields[f], cur);
+    printf("%s%s=%lu", (f == 0) ? "" : ", ", fields[f].name, (unsigned long)val);
+    if (prev != NULL) {
+      lbm_ulong_t prev_val = stats_field_value(&fields[f], prev);
+      if (val >= prev_val) {
+        printf(" (%.2f/s)", (double)(val - prev_val) * 1e9 / (double)interval_ns);
+      }
+    }
+  }
+  printf("\n");
+}  /* print_fields */
+
+
+/* Sessions are usually in the same order in consecutive samples, so try
+ * the same index first. */
+static int find_prev(const char *source, int type, int hint, int num_entries, const void *entries, size_t entry_size)
+{
+  int i;
+
+  for (i = 0; i < num_entries; i++) {
+    int j = (hint + i) % num_entries;
+    const char *e = (const char *)entries + (size_t)j * entry_size;
+    /* Both stats structures start with "type" and "source". */
+    const lbm_src_transport_stats_t *s = (const lbm_src_transport_stats_t *)e;
+    if (s->type == type && strcmp(s->source, source) == 0) {
+      return j;
+    }
+  }
+  return -1;
+}  /* find_prev */
+
+
+static void print_target(target_t *target)
+{
+  const stats_sample_t *cur = &target->cur;
+  const stats_sample_t *prev = target->have_prev ? &target->prev : NULL;
+  uint64_t interval_ns = (prev != NULL) ? cur->sample_ns - prev->sample_ns : 1;
+  struct timespec now_ts;
+  const stats_field_t *fields;
+  int num_fields, i;
+
+  if (interval_ns == 0) {
+    interval_ns = 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now_ts);
+  printf("pid %d, ctx_name='%s', seq=%lu, age=%.1fs%s\n", (int)target->reader->pid, target->reader->ctx_name,
+      (unsigned long)cur->seq,
+      ((double)now_ts.tv_sec * 1e9 + now_ts.tv_nsec - (double)cur->sample_ns) / 1e9,
+      (kill(target->reader->pid, 0) == -1 && errno == ESRCH) ? " (not running)" : "");
+
+  fields = stats_fields_ctx(&num_fields);
+  printf("  context: ");
+  print_fields(fields, num_fields, &cur->ctx_stats, (prev != NULL) ? &prev->ctx_stats : NULL, interval_ns);
+
+  for (i = 0; i < cur->src_num_entries; i++) {
+    const lbm_src_transport_stats_t *s = &cur->src_stats[i];
+    const void *p = NULL;
+    fields = stats_fields_src(s->type, &num_fields);
+    if (fields == NULL) {
+      continue;
+    }
+    if (prev != NULL) {
+      int j = find_prev(s->source, s->type, i, prev->src_num_entries, prev->src_stats, sizeof(*s));
+      p = (j >= 0) ? &prev->src_stats[j] : NULL;
+    }
+    printf("  src/%s %s: ", stats_fields_type_name(s->type), s->source);
+    print_fields(fields, num_fields, s, p, interval_ns);
+  }
+  for (i = 0; i < cur->rcv_num_entries; i++) {
+    const lbm_rcv_transport_stats_t *r = &cur->rcv_stats[i];
+    const void *p = NULL;
+    fields = stats_fields_rcv(r->type, &num_fields);
+    if (fields == NULL) {
+      continue;
+    }
+    if (prev != NULL) {
+      int j = find_prev(r->source, r->type, i, prev->rcv_num_entries, prev->rcv_stats, sizeof(*r));
+      p = (j >= 0) ? &prev->rcv_stats[j] : NULL;
+    }
+    printf("  rcv/%s %s: ", stats_fields_type_name(r->type), r->source);
+    print_fields(fields, num_fields, r, p, interval_ns);
+  }
+}  /* print_target */
+
+
+int main(int argc, char **argv)
+{
+  int interval_sec = 1;
+  long iterations = -1;
+  int batch = 0;
+  int opt, i, t;
+  long iter;
+
+  while ((opt = getopt(argc, argv, "i:n:bFh")) != -1) {
+    switch (opt) {
+      case 'i': interval_sec = atoi(optarg); break;
+      case 'n': iterations = atol(optarg); break;
+      case 'b': batch = 1; break;
+      case 'F': stats_fields_select(STATS_FIELDS_FULL); break;
+      default: usage(NULL);
+    }
+  }
+  if (interval_sec < 1) {
+    usage("Bad interval");
+  }
+
+  for (iter = 0; iterations < 0 || iter < iterations; iter++) {
+    time_t now = time(NULL);
+    struct tm tm;
+    char time_str[32];
+
+    if (iter > 0) {
+      sleep(interval_sec);
+    }
+
+    /* Pick up contexts that were created (or went away) since last time. */
+    for (t = 0; t < num_targets; t++) {
+      targets[t].seen = 0;
+    }
+    if (optind == argc) {
+      (void)stats_shm_list(0, attach, NULL);
+    }
+    for (i = optind; i < argc; i++) {
+      (void)stats_shm_list((pid_t)atoi(argv[i]), attach, NULL);
+    }
+    for (t = num_targets - 1; t >= 0; t--) {
+      if (!targets[t].seen) {
+        detach(t);
+      }
+    }
+
+    gmtime_r(&now, &tm);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    if (!batch) {
+      printf("\033[H\033[2J");  /* Home and clear. */
+    }
+    printf("mon_self_top %s, %d context(s)\n", time_str, num_targets);
+
+    for (t = 0; t < num_targets; t++) {
+      target_t *target = &targets[t];
+      if (stats_shm_reader_read(target->reader, &target->next) != 0) {
+        continue;
+      }
+      /* Rates are between the last two different samples. */
+      if (target->next.seq != target->cur.seq) {
+        stats_sample_t tmp = target->prev;
+        target->have_prev = (target->cur.seq != 0);
+        target->prev = target->cur;
+        target->cur = target->next;
+        target->next = tmp;
+      }
+      print_target(target);
+    }
+    fflush(stdout);
+  }
+
+  while (num_targets > 0) {
+    detach(num_targets - 1);
+  }
+  free(targets);
+  return 0;
+}  /* main */
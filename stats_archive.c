@@ -0,0 +1,645 @@
+/* stats_archive.c - compressed long-term archive of per-session counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_sample.h"
+#include "stats_archive.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* A varint is at most 10 bytes; a sample at most a mask, a timestamp, and
+ * one value per field. */
+#define MAX_VARINT 10
+#define MAX_SAMPLE_BYTES ((2 + STATS_MAX_FIELDS) * MAX_VARINT)
+
+
+static uint64_t zigzag(int64_t val)
+{
+  return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}  /* zigzag */
+
+
+static int64_t unzigzag(uint64_t val)
+{
+  return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}  /* unzigzag */
+
+
+static uint8_t *put_varint(uint8_t *p, uint64_t val)
+{
+  while (val >= 0x80) {
+    *p++ = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  *p++ = (uint8_t)val;
+  return p;
+}  /* put_varint */
+
+
+/* Returns NULL if the varint runs past "end". */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *val)
+{
+  uint64_t v = 0;
+  int shift = 0;
+
+  while (p < end && shift < 64) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      *val = v;
+      return p;
+    }
+    shift += 7;
+  }
+  return NULL;
+}  /* get_varint */
+
+
+/* A failing archive is reported but not fatal (see stats_sink.c). */
+static int write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *)buf;
+
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("WARNING: stats archive write");
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}  /* write_all */
+
+
+/* Writer. */
+
+static void series_reserve(stats_archive_series_t *series, size_t len)
+{
+  if (series->len + len > series->size) {
+    size_t new_size = (series->size == 0) ? 256 : series->size;
+    while (new_size < series->len + len) {
+      new_size *= 2;
+    }
+    ENL(series->buf = (uint8_t *)realloc(series->buf, new_size));
+    series->size = new_size;
+  }
+}  /* series_reserve */
+
+
+static void series_put_run(stats_archive_series_t *series)
+{
+  if (series->run > 0) {
+    series_reserve(series, MAX_VARINT);
+    series->len = put_varint(series->buf + series->len, (uint64_t)series->run << 1) - series->buf;
+    series->run = 0;
+  }
+}  /* series_put_run */
+
+
+/* Write the series' block (if it has samples) to the current segment and
+ * start a new one. */
+static void series_flush(stats_archive_t *archive, stats_archive_series_t *series)
+{
+  stats_archive_block_t block;
+  stats_archive_index_t *entry;
+  static const char zeros[8] = {0};
+  size_t source_len, pad;
+
+  if (series->num_samples == 0) {
+    return;
+  }
+  series_put_run(series);
+
+  source_len = strlen(series->source);
+  if (source_len > 255) {
+    source_len = 255;
+  }
+  pad = (8 - (sizeof(block) + source_len + series->len) % 8) % 8;
+  memset(&block, 0, sizeof(block));
+  block.magic = STATS_ARCHIVE_BLOCK_MAGIC;
+  block.len = (uint32_t)(sizeof(block) + source_len + series->len + pad);
+  block.source_hash = stats_index_hash(series->source);
+  block.first_ms = series->first_ms;
+  block.last_ms = series->prev_ms;
+  block.num_samples = series->num_samples;
+  block.dir = (uint8_t)series->dir;
+  block.type = (uint8_t)series->type;
+  block.num_fields = (uint8_t)series->num_fields;
+  block.source_len = (uint8_t)source_len;
+
+  if (archive->fd != -1
+      && write_all(archive->fd, &block, sizeof(block)) == 0
+      && write_all(archive->fd, series->source, source_len) == 0
+      && write_all(archive->fd, series->buf, series->len) == 0
+      && write_all(archive->fd, zeros, pad) == 0) {
+    if (archive->num_index == archive->index_capacity) {
+      archive->index_capacity = (archive->index_capacity == 0) ? 256 : archive->index_capacity * 2;
+      ENL(archive->index = (stats_archive_index_t *)realloc(archive->index,
+          archive->index_capacity * sizeof(stats_archive_index_t)));
+    }
+    entry = &archive->index[archive->num_index++];
+    memset(entry, 0, sizeof(*entry));
+    entry->offset = archive->offset;
+    entry->source_hash = block.source_hash;
+    entry->first_ms = block.first_ms;
+    entry->last_ms = block.last_ms;
+    entry->len = block.len;
+    entry->dir = block.dir;
+    entry->type = block.type;
+    archive->offset += block.len;
+  }
+
+  series->num_samples = 0;
+  series->len = 0;
+}  /* series_flush */
+
+
+static void series_add(stats_archive_t *archive, stats_archive_series_t *series, uint64_t time_ms,
+    const lbm_ulong_t *vals)
+{
+  uint8_t *p;
+  int f;
+
+  series_reserve(series, MAX_SAMPLE_BYTES);
+  p = series->buf + series->len;
+
+  if (series->num_samples == 0) {
+    /* Start of a block: absolute values. */
+    for (f = 0; f < series->num_fields; f++) {
+      p = put_varint(p, vals[f]);
+    }
+    series->first_ms = time_ms;
+    series->prev_step_ms = 0;
+  }
+  else {
+    int64_t step = (int64_t)(time_ms - series->prev_ms);
+    int64_t dod = step - series->prev_step_ms;
+    uint64_t mask = 0;
+
+    for (f = 0; f < series->num_fields; f++) {
+      if (vals[f] != series->prev[f]) {
+        mask |= (uint64_t)1 << f;
+      }
+    }
+    if (mask == 0 && dod == 0) {
+      series->run++;
+    }
+    else {
+      series_put_run(series);
+      p = series->buf + series->len;
+      p = put_varint(p, (mask << 1) | 1);
+      p = put_varint(p, zigzag(dod));
+      for (f = 0; f < series->num_fields; f++) {
+        if (mask & ((uint64_t)1 << f)) {
+          /* Counters can go backward if the session was recreated. */
+          p = put_varint(p, zigzag((int64_t)(vals[f] - series->prev[f])));
+        }
+      }
+    }
+    series->prev_step_ms = step;
+  }
+  series->len = p - series->buf;
+  memcpy(series->prev, vals, series->num_fields * sizeof(lbm_ulong_t));
+  series->prev_ms = time_ms;
+  series->num_samples++;
+
+  if (series->len >= archive->block_size) {
+    series_flush(archive, series);
+  }
+}  /* series_add */
+
+
+static int series_alloc(stats_archive_t *archive)
+{
+  int row;
+
+  if (archive->num_free_series > 0) {
+    return archive->free_series[--archive->num_free_series];
+  }
+  row = archive->num_series++;
+  ENL(archive->series = (stats_archive_series_t **)realloc(archive->series,
+      archive->num_series * sizeof(stats_archive_series_t *)));
+  ENL(archive->free_series = (int *)realloc(archive->free_series, archive->num_series * sizeof(int)));
+  ENL(archive->series[row] = (stats_archive_series_t *)calloc(1, sizeof(stats_archive_series_t)));
+  return row;
+}  /* series_alloc */
+
+
+/* Sweep callback: the session went away; write what it has. */
+static void sweep_series(stats_session_t *session, void *clientd)
+{
+  stats_archive_t *archive = (stats_archive_t *)clientd;
+
+  if (session->row >= 0) {
+    series_flush(archive, archive->series[session->row]);
+    archive->free_series[archive->num_free_series++] = session->row;
+    session->row = -1;
+  }
+}  /* sweep_series */
+
+
+static void close_segment(stats_archive_t *archive)
+{
+  stats_archive_trailer_t trailer;
+  int i;
+
+  for (i = 0; i < archive->num_series; i++) {
+    series_flush(archive, archive->series[i]);  /* Free ones have no samples. */
+  }
+  if (archive->fd == -1) {
+    return;
+  }
+  trailer.index_offset = archive->offset;
+  trailer.num_entries = (uint32_t)archive->num_index;
+  trailer.magic = STATS_ARCHIVE_INDEX_MAGIC;
+  if (write_all(archive->fd, archive->index, archive->num_index * sizeof(stats_archive_index_t)) == 0) {
+    (void)write_all(archive->fd, &trailer, sizeof(trailer));
+  }
+  close(archive->fd);
+  archive->fd = -1;
+  archive->num_index = 0;
+}  /* close_segment */
+
+
+static void open_segment(stats_archive_t *archive, uint64_t now_ms)
+{
+  stats_archive_file_hdr_t hdr;
+  uint64_t segment_ms = (uint64_t)archive->segment_sec * 1000;
+  time_t sec = (time_t)(now_ms / 1000);
+  struct tm tm;
+  char time_str[32];
+  char *path;
+  size_t path_len;
+
+  /* Segments end on multiples of segment_sec (e.g. midnight UTC). */
+  archive->segment_end_ms = (now_ms / segment_ms + 1) * segment_ms;
+
+  gmtime_r(&sec, &tm);
+  strftime(time_str, sizeof(time_str), "%Y%m%dT%H%M%S", &tm);
+  path_len = strlen(archive->dir_path) + strlen(archive->ctx_name) + 64;
+  ENL(path = (char *)malloc(path_len));
+  snprintf(path, path_len, "%s/%s.%s.%03dZ.msa", archive->dir_path, archive->ctx_name, time_str,
+      (int)(now_ms % 1000));
+  archive->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (archive->fd == -1) {
+    fprintf(stderr, "WARNING: stats archive open(%s): %s\n", path, strerror(errno));
+    free(path);
+    return;  /* Try again with the next segment. */
+  }
+  free(path);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, STATS_ARCHIVE_MAGIC, sizeof(hdr.magic));
+  hdr.version = STATS_ARCHIVE_VERSION;
+  hdr.field_set = (uint32_t)stats_fields_selected();
+  strncpy(hdr.ctx_name, archive->ctx_name, sizeof(hdr.ctx_name) - 1);
+  if (write_all(archive->fd, &hdr, sizeof(hdr)) != 0) {
+    close(archive->fd);
+    archive->fd = -1;
+    return;
+  }
+  archive->offset = sizeof(hdr);
+}  /* open_segment */
+
+
+stats_archive_t *stats_archive_create(const char *dir_path, const char *ctx_name, int segment_sec, size_t block_size)
+{
+  stats_archive_t *archive;
+  char *p;
+
+  if (access(dir_path, W_OK) != 0) {
+    int errno_ = errno;
+    char errstr[1024];
+    snprintf(errstr, sizeof(errstr), "ERROR (%s:%d): stats archive directory %s", __FILE__, __LINE__, dir_path);
+    errno = errno_;
+    perror(errstr);
+    exit(1);
+  }
+  ENL(archive = (stats_archive_t *)calloc(1, sizeof(stats_archive_t)));
+  ENL(archive->dir_path = strdup(dir_path));
+  ENL(archive->ctx_name = strdup((ctx_name != NULL && ctx_name[0] != '\0') ? ctx_name : "ctx"));
+  for (p = archive->ctx_name; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '_';  /* It goes in a file name. */
+    }
+  }
+  archive->segment_sec = (segment_sec > 0) ? segment_sec : 86400;
+  archive->block_size = block_size;
+  archive->fd = -1;
+  archive->sessions[STATS_ARCHIVE_SRC] = stats_index_create();
+  archive->sessions[STATS_ARCHIVE_RCV] = stats_index_create();
+
+  return archive;
+}  /* stats_archive_create */
+
+
+void stats_archive_delete(stats_archive_t *archive)
+{
+  int i;
+
+  close_segment(archive);
+  for (i = 0; i < archive->num_series; i++) {
+    free(archive->series[i]->buf);
+    free(archive->series[i]);
+  }
+  free(archive->series);
+  free(archive->free_series);
+  free(archive->index);
+  stats_index_delete(archive->sessions[STATS_ARCHIVE_SRC]);
+  stats_index_delete(archive->sessions[STATS_ARCHIVE_RCV]);
+  free(archive->ctx_name);
+  free(archive->dir_path);
+  free(archive);
+}  /* stats_archive_delete */
+
+
+static void archive_session(stats_archive_t *archive, uint64_t time_ms, int dir, int type, const char *source,
+    const void *stats)
+{
+  const stats_field_t *fields;
+  int num_fields, is_new, f;
+  stats_session_t *session;
+  stats_archive_series_t *series;
+  lbm_ulong_t vals[STATS_MAX_FIELDS];
+
+  fields = (dir == STATS_ARCHIVE_SRC) ? stats_fields_src(type, &num_fields) : stats_fields_rcv(type, &num_fields);
+  session = stats_index_find_or_add(archive->sessions[dir], source, &is_new);
+  if (fields == NULL || num_fields == 0) {
+    return;  /* Nothing to archive. */
+  }
+  if (session->row < 0) {
+    session->row = series_alloc(archive);
+    series = archive->series[session->row];
+    series->dir = dir;
+    series->type = type;
+    series->num_fields = num_fields;
+    strncpy(series->source, source, sizeof(series->source) - 1);
+    series->source[sizeof(series->source) - 1] = '\0';
+    series->num_samples = 0;
+    series->run = 0;
+    series->len = 0;
+  }
+  series = archive->series[session->row];
+  if (series->type != type) {
+    /* Source recreated with another transport; a block has one type. */
+    series_flush(archive, series);
+    series->type = type;
+    series->num_fields = num_fields;
+  }
+
+  for (f = 0; f < num_fields; f++) {
+    vals[f] = stats_field_value(&fields[f], stats);
+  }
+  series_add(archive, series, time_ms, vals);
+}  /* archive_session */
+
+
+/* Runs in the writer thread, once per printed sample. */
+void stats_archive_write(stats_archive_t *archive, const stats_sample_t *sample)
+{
+  uint64_t time_ms = sample->sample_realtime_ns / 1000000;
+  int i;
+
+  if (time_ms >= archive->segment_end_ms) {
+    close_segment(archive);
+    open_segment(archive, time_ms);
+  }
+
+  stats_index_begin_sample(archive->sessions[STATS_ARCHIVE_SRC]);
+  for (i = 0; i < sample->src_num_entries; i++) {
+    archive_session(archive, time_ms, STATS_ARCHIVE_SRC, sample->src_stats[i].type, sample->src_stats[i].source,
+        &sample->src_stats[i]);
+  }
+  stats_index_begin_sample(archive->sessions[STATS_ARCHIVE_RCV]);
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    archive_session(archive, time_ms, STATS_ARCHIVE_RCV, sample->rcv_stats[i].type, sample->rcv_stats[i].source,
+        &sample->rcv_stats[i]);
+  }
+  (void)stats_index_sweep(archive->sessions[STATS_ARCHIVE_SRC], sweep_series, archive);
+  (void)stats_index_sweep(archive->sessions[STATS_ARCHIVE_RCV], sweep_series, archive);
+}  /* stats_archive_write */
+
+
+/* Reader. */
+
+static void decode_block(const uint8_t *base, uint64_t size, uint64_t offset, int dir, const char *source,
+    uint64_t from_ms, uint64_t until_ms, stats_archive_point_cb cb, void *clientd)
+{
+  const stats_archive_block_t *block;
+  const uint8_t *p, *end;
+  char block_source[256];
+  lbm_ulong_t vals[STATS_MAX_FIELDS];
+  stats_archive_point_t point;
+  uint64_t time_ms, v;
+  int64_t step;
+  uint32_t n;
+  int f;
+
+  if (offset + sizeof(stats_archive_block_t) > size) {
+    return;
+  }
+  block = (const stats_archive_block_t *)(base + offset);
+  if (block->magic != STATS_ARCHIVE_BLOCK_MAGIC || block->len < sizeof(*block) + block->source_len
+      || offset + block->len > size || block->num_fields > STATS_MAX_FIELDS) {
+    return;
+  }
+  if ((dir != -1 && block->dir != dir) || block->last_ms < from_ms || block->first_ms > until_ms) {
+    return;
+  }
+  memcpy(block_source, block + 1, block->source_len);
+  block_source[block->source_len] = '\0';
+  if (source != NULL && strcmp(source, block_source) != 0) {
+    return;  /* Hash collision. */
+  }
+
+  point.dir = block->dir;
+  point.type = block->type;
+  point.source = block_source;
+  point.field_set = (int)((const stats_archive_file_hdr_t *)base)->field_set;
+  point.num_fields = block->num_fields;
+  point.values = vals;
+  p = (const uint8_t *)(block + 1) + block->source_len;
+  end = base + offset + block->len;
+
+  for (f = 0; f < block->num_fields; f++) {
+    if ((p = get_varint(p, end, &v)) == NULL) {
+      return;
+    }
+    vals[f] = (lbm_ulong_t)v;
+  }
+  /* Stop at the first sample past the window. */
+#define EMIT() do { \
+    if (time_ms > until_ms) { \
+      return; \
+    } \
+    if (time_ms >= from_ms) { \
+      point.time_ms = time_ms; \
+      cb(&point, clientd); \
+    } \
+  } while (0)
+
+  time_ms = block->first_ms;
+  step = 0;
+  EMIT();
+  n = 1;
+  while (n < block->num_samples) {
+    if ((p = get_varint(p, end, &v)) == NULL) {
+      return;
+    }
+    if (v & 1) {
+      uint64_t mask = v >> 1;
+      if ((p = get_varint(p, end, &v)) == NULL) {
+        return;
+      }
+      step += unzigzag(v);
+      for (f = 0; f < block->num_fields; f++) {
+        if (mask & ((uint64_t)1 << f)) {
+          if ((p = get_varint(p, end, &v)) == NULL) {
+            return;
+          }
+          vals[f] += (lbm_ulong_t)unzigzag(v);
+        }
+      }
+      time_ms += step;
+      EMIT();
+      n++;
+    }
+    else {
+      uint64_t run = v >> 1;
+      if (run == 0) {
+        return;  /* Corrupt. */
+      }
+      for (; run > 0 && n < block->num_samples; run--, n++) {
+        time_ms += step;
+        EMIT();
+      }
+    }
+  }
+#undef EMIT
+}  /* decode_block */
+
+
+int stats_archive_query(const char *path, int dir, const char *source, uint64_t from_ms, uint64_t until_ms,
+    stats_archive_point_cb cb, void *clientd)
+{
+  int fd;
+  struct stat st;
+  const uint8_t *base;
+  const stats_archive_file_hdr_t *hdr;
+  const stats_archive_trailer_t *trailer = NULL;
+  uint64_t size, hash = 0, offset;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    perror(path);
+    return -1;
+  }
+  if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < sizeof(stats_archive_file_hdr_t)) {
+    fprintf(stderr, "%s: not an archive segment\n", path);
+    close(fd);
+    return -1;
+  }
+  size = (uint64_t)st.st_size;
+  base = (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror(path);
+    return -1;
+  }
+  hdr = (const stats_archive_file_hdr_t *)base;
+  if (memcmp(hdr->magic, STATS_ARCHIVE_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != STATS_ARCHIVE_VERSION) {
+    fprintf(stderr, "%s: not an archive segment (or an unsupported version)\n", path);
+    munmap((void *)base, size);
+    return -1;
+  }
+  if (source != NULL) {
+    hash = stats_index_hash(source);
+  }
+
+  if (size >= sizeof(*hdr) + sizeof(*trailer)) {
+    trailer = (const stats_archive_trailer_t *)(base + size - sizeof(*trailer));
+    if (trailer->magic != STATS_ARCHIVE_INDEX_MAGIC || trailer->index_offset < sizeof(*hdr)
+        || trailer->index_offset + (uint64_t)trailer->num_entries * sizeof(stats_archive_index_t)
+           != size - sizeof(*trailer)) {
+      trailer = NULL;
+    }
+  }
+
+  if (trailer != NULL) {
+    /* Closed segment: only touch the blocks the index says can match. */
+    const stats_archive_index_t *index = (const stats_archive_index_t *)(base + trailer->index_offset);
+    uint32_t i;
+    for (i = 0; i < trailer->num_entries; i++) {
+      if ((source == NULL || index[i].source_hash == hash) && (dir == -1 || index[i].dir == dir)
+          && index[i].last_ms >= from_ms && index[i].first_ms <= until_ms) {
+        decode_block(base, trailer->index_offset, index[i].offset, dir, source, from_ms, until_ms, cb, clientd);
+      }
+    }
+  }
+  else {
+    /* Still being written, or the writer died: walk the block headers. */
+    offset = sizeof(*hdr);
+    while (offset + sizeof(stats_archive_block_t) <= size) {
+      const stats_archive_block_t *block = (const stats_archive_block_t *)(base + offset);
+      if (block->magic != STATS_ARCHIVE_BLOCK_MAGIC || block->len < sizeof(*block) || offset + block->len > size) {
+        break;
+      }
+      if (source == NULL || block->source_hash == hash) {
+        decode_block(base, size, offset, dir, source, from_ms, until_ms, cb, clientd);
+      }
+      offset += block->len;
+    }
+  }
+
+  munmap((void *)base, size);
+  return 0;
+}  /* stats_archive_query */
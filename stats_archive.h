@@ -0,0 +1,172 @@
+/* stats_archive.h - compressed long-term archive of per-session counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_ARCHIVE_H
+#define STATS_ARCHIVE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_sample.h"
+
+/* An archive is a directory of append-only segment files, one segment per
+ * "segment_sec" of wall clock time per context, named
+ * "<ctx_name>.<UTC time of first sample>.msa". A segment is:
+ *   stats_archive_file_hdr_t
+ *   blocks (stats_archive_block_t + source string + encoded samples)
+ *   index (stats_archive_index_t per block) + stats_archive_trailer_t
+ * The index is only written when the segment is closed; a reader of a
+ * segment without one (still open, or the process crashed) scans the block
+ * headers instead.
+ *
+ * Each block holds consecutive samples of one transport session. The first
+ * sample's counters are varints; each later sample is either:
+ *   varint(mask << 1 | 1), zigzag varint of the timestamp's delta-of-delta,
+ *     then a zigzag varint delta for each counter whose bit is in "mask";
+ *   varint(run << 1): "run" samples where nothing changed and the
+ *     timestamps kept the same spacing.
+ * So a session whose counters don't move costs a couple of bytes per block.
+ * Timestamps are milliseconds since the epoch. */
+#define STATS_ARCHIVE_MAGIC "MONSELFA"
+#define STATS_ARCHIVE_VERSION 1
+#define STATS_ARCHIVE_BLOCK_MAGIC 0x4b424153  /* "SABK" */
+#define STATS_ARCHIVE_INDEX_MAGIC 0x58444953  /* "SIDX" */
+#define STATS_ARCHIVE_SRC 0
+#define STATS_ARCHIVE_RCV 1
+
+struct stats_archive_file_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t field_set;  /* STATS_FIELDS_...; which counters the blocks have. */
+  char ctx_name[64];
+};
+typedef struct stats_archive_file_hdr_s stats_archive_file_hdr_t;
+
+struct stats_archive_block_s {
+  uint32_t magic;
+  uint32_t len;  /* Including this header, the source, and the samples. */
+  uint64_t source_hash;  /* stats_index_hash() of the source. */
+  uint64_t first_ms;
+  uint64_t last_ms;
+  uint32_t num_samples;
+  uint8_t dir;  /* STATS_ARCHIVE_SRC/RCV. */
+  uint8_t type;  /* LBM_TRANSPORT_STAT_... */
+  uint8_t num_fields;
+  uint8_t source_len;
+};
+typedef struct stats_archive_block_s stats_archive_block_t;
+
+struct stats_archive_index_s {
+  uint64_t offset;
+  uint64_t source_hash;  /* stats_index_hash() of the source. */
+  uint64_t first_ms;
+  uint64_t last_ms;
+  uint32_t len;
+  uint8_t dir;
+  uint8_t type;
+  uint16_t reserved;
+};
+typedef struct stats_archive_index_s stats_archive_index_t;
+
+/* Last bytes of a closed segment. */
+struct stats_archive_trailer_s {
+  uint64_t index_offset;
+  uint32_t num_entries;
+  uint32_t magic;
+};
+typedef struct stats_archive_trailer_s stats_archive_trailer_t;
+
+/* Writer state of one session: the block being built. */
+struct stats_archive_series_s {
+  int dir;
+  int type;
+  int num_fields;
+  char source[LBM_MSG_MAX_SOURCE_LEN];
+  uint64_t first_ms;
+  uint64_t prev_ms;
+  int64_t prev_step_ms;
+  uint32_t num_samples;
+  uint32_t run;  /* Unchanged samples not yet encoded. */
+  lbm_ulong_t prev[STATS_MAX_FIELDS];
+  uint8_t *buf;
+  size_t len;
+  size_t size;
+};
+typedef struct stats_archive_series_s stats_archive_series_t;
+
+struct stats_archive_s {
+  char *dir_path;
+  char *ctx_name;
+  int segment_sec;
+  size_t block_size;  /* A block is written once its samples take this much. */
+  int fd;  /* Current segment; -1=none. */
+  uint64_t segment_end_ms;
+  uint64_t offset;  /* Where the next block goes. */
+  stats_archive_index_t *index;
+  int num_index;
+  int index_capacity;
+  stats_index_t *sessions[2];  /* session->row is the series. */
+  stats_archive_series_t **series;
+  int num_series;
+  int *free_series;
+  int num_free_series;
+};
+typedef struct stats_archive_s stats_archive_t;
+
+/* One decoded sample, passed to the query callback. */
+struct stats_archive_point_s {
+  int dir;
+  int type;
+  const char *source;
+  uint64_t time_ms;
+  int field_set;  /* Of the segment; see stats_fields_src_table(). */
+  int num_fields;
+  const lbm_ulong_t *values;
+};
+typedef struct stats_archive_point_s stats_archive_point_t;
+
+typedef void (*stats_archive_point_cb)(const stats_archive_point_t *point, void *clientd);
+
+
+/* Writer; runs in the writer thread. */
+stats_archive_t *stats_archive_create(const char *dir_path, const char *ctx_name, int segment_sec, size_t block_size);
+void stats_archive_delete(stats_archive_t *archive);
+void stats_archive_write(stats_archive_t *archive, const stats_sample_t *sample);
+
+/* Reader. Calls "cb" for each sample of the sessions matching "dir" (-1 for
+ * both) and "source" (NULL for all) in [from_ms, until_ms]. Only blocks
+ * that can match are decoded. Returns -1 (and prints why) if "path" isn't
+ * a segment file. */
+int stats_archive_query(const char *path, int dir, const char *source, uint64_t from_ms, uint64_t until_ms,
+    stats_archive_point_cb cb, void *clientd);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_ARCHIVE_H */
@@ -0,0 +1,139 @@
+/* stats_archive_query.c - prints session series from archive segments.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Prints the samples of one session (or all) from stats_archive segment
+ * files, one line per sample, oldest first within each block.
+ *   ./stats_archive_query [-s source] [-d src|rcv] [-f from] [-u until] segment...
+ * "from" and "until" are UTC times, "2024-05-01T13:45:00", or seconds
+ * since the epoch.
+ */
+
+#define _GNU_SOURCE  /* For timegm(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_archive.h"
+
+
+static void usage(const char *msg)
+{
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Usage: stats_archive_query [-s source] [-d src|rcv] [-f from] [-u until] segment...\n"
+      "  from, until: UTC time (2024-05-01T13:45:00) or seconds since the epoch.\n");
+  exit(1);
+}  /* usage */
+
+
+/* Returns milliseconds since the epoch. */
+static uint64_t parse_time(const char *str)
+{
+  struct tm tm;
+  char *end;
+
+  memset(&tm, 0, sizeof(tm));
+  end = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm);
+  if (end != NULL && (*end == '\0' || strcmp(end, "Z") == 0)) {
+    return (uint64_t)timegm(&tm) * 1000;
+  }
+  else {
+    double sec = strtod(str, &end);
+    if (end == str || *end != '\0' || sec < 0) {
+      usage("Bad time");
+    }
+    return (uint64_t)(sec * 1e3);
+  }
+}  /* parse_time */
+
+
+static void print_point(const stats_archive_point_t *point, void *clientd)
+{
+  const stats_field_table_t *table = NULL;
+  const stats_field_t *fields = NULL;
+  int f;
+  time_t sec = (time_t)(point->time_ms / 1000);
+  struct tm tm;
+  char time_str[32];
+
+  (void)clientd;
+  gmtime_r(&sec, &tm);
+  strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S", &tm);
+  if (point->field_set >= 0 && point->field_set < STATS_FIELDS_NUM_SETS) {
+    table = (point->dir == STATS_ARCHIVE_SRC) ? stats_fields_src_table(point->field_set, point->type)
+                                              : stats_fields_rcv_table(point->field_set, point->type);
+  }
+  if (table != NULL && table->num_counters == point->num_fields) {
+    fields = table->counters;
+  }  /* Else written by a different version; don't guess names. */
+  printf("time=%s.%03dZ, %s/%s: source=%s", time_str, (int)(point->time_ms % 1000),
+      (point->dir == STATS_ARCHIVE_SRC) ? "src" : "rcv", stats_fields_type_name(point->type), point->source);
+  for (f = 0; f < point->num_fields; f++) {
+    if (fields != NULL) {
+      printf(", %s=%lu", fields[f].name, (unsigned long)point->values[f]);
+    }
+    else {
+      printf(", field%d=%lu", f, (unsigned long)point->values[f]);
+    }
+  }
+  printf("\n");
+}  /* print_point */
+
+
+int main(int argc, char **argv)
+{
+  const char *source = NULL;
+  int dir = -1;
+  uint64_t from_ms = 0;
+  uint64_t until_ms = UINT64_MAX;
+  int opt, i, status = 0;
+
+  while ((opt = getopt(argc, argv, "s:d:f:u:h")) != -1) {
+    switch (opt) {
+      case 's': source = optarg; break;
+      case 'd':
+        if (strcmp(optarg, "src") == 0) { dir = STATS_ARCHIVE_SRC; }
+        else if (strcmp(optarg, "rcv") == 0) { dir = STATS_ARCHIVE_RCV; }
+        else { usage("Bad -d"); }
+        break;
+      case 'f': from_ms = parse_time(optarg); break;
+      case 'u': until_ms = parse_time(optarg); break;
+      default: usage(NULL);
+    }
+  }
+  if (optind >= argc) {
+    usage("Need at least one segment file");
+  }
+
+  for (i = optind; i < argc; i++) {
+    if (stats_archive_query(argv[i], dir, source, from_ms, until_ms, print_point, NULL) != 0) {
+      status = 1;
+    }
+  }
+  return status;
+}  /* main */
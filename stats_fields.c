@@ -0,0 +1,460 @@
+/* stats_fields.c - tables of monitored UM fields.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+
+/* Each structure's fields are listed once, as X(name, kind, offset...), in
+ * output order; a field with several offsets is their sum. The tables of
+ * all fields and of just the counters are both generated from the list.
+ *
+ * The minimal set is what mon_self has always printed. Gauges like
+ * "num_clients" and "tr_src_topics" are printed as values but have no
+ * meaningful rate. The full set is every field of the UM structure. */
+
+#define CTX_OFF(f_) offsetof(lbm_context_stats_t, f_)
+#define SRC_OFF(t_, f_) offsetof(lbm_src_transport_stats_t, transport.t_.f_)
+#define RCV_OFF(t_, f_) offsetof(lbm_rcv_transport_stats_t, transport.t_.f_)
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__context__stats__t__stct.html */
+#define CTX_MINIMAL(X) \
+  X(tr_dgrams_sent, COUNTER, CTX_OFF(tr_dgrams_sent)) \
+  X(tr_dgrams_rcved, COUNTER, CTX_OFF(tr_dgrams_rcved)) \
+  X(tr_drops, COUNTER, CTX_OFF(tr_dgrams_dropped_ver), CTX_OFF(tr_dgrams_dropped_type), \
+      CTX_OFF(tr_dgrams_dropped_malformed)) \
+  X(tr_src_topics, GAUGE, CTX_OFF(tr_src_topics)) \
+  X(tr_rcv_topics, GAUGE, CTX_OFF(tr_rcv_topics)) \
+  X(tr_rcv_unresolved_topics, GAUGE, CTX_OFF(tr_rcv_unresolved_topics)) \
+  X(lbtrm_unknown_msgs_rcved, COUNTER, CTX_OFF(lbtrm_unknown_msgs_rcved)) \
+  X(lbtru_unknown_msgs_rcved, COUNTER, CTX_OFF(lbtru_unknown_msgs_rcved)) \
+  X(send_blocked, COUNTER, CTX_OFF(send_blocked)) \
+  X(send_would_block, COUNTER, CTX_OFF(send_would_block)) \
+  X(fragments_unrecoverably_lost, COUNTER, CTX_OFF(fragments_unrecoverably_lost))
+
+#define CTX_FULL(X) \
+  X(tr_dgrams_sent, COUNTER, CTX_OFF(tr_dgrams_sent)) \
+  X(tr_bytes_sent, COUNTER, CTX_OFF(tr_bytes_sent)) \
+  X(tr_dgrams_rcved, COUNTER, CTX_OFF(tr_dgrams_rcved)) \
+  X(tr_bytes_rcved, COUNTER, CTX_OFF(tr_bytes_rcved)) \
+  X(tr_dgrams_dropped_ver, COUNTER, CTX_OFF(tr_dgrams_dropped_ver)) \
+  X(tr_dgrams_dropped_type, COUNTER, CTX_OFF(tr_dgrams_dropped_type)) \
+  X(tr_dgrams_dropped_malformed, COUNTER, CTX_OFF(tr_dgrams_dropped_malformed)) \
+  X(tr_dgrams_send_failed, COUNTER, CTX_OFF(tr_dgrams_send_failed)) \
+  X(tr_src_topics, GAUGE, CTX_OFF(tr_src_topics)) \
+  X(tr_rcv_topics, GAUGE, CTX_OFF(tr_rcv_topics)) \
+  X(tr_rcv_unresolved_topics, GAUGE, CTX_OFF(tr_rcv_unresolved_topics)) \
+  X(lbtrm_unknown_msgs_rcved, COUNTER, CTX_OFF(lbtrm_unknown_msgs_rcved)) \
+  X(lbtru_unknown_msgs_rcved, COUNTER, CTX_OFF(lbtru_unknown_msgs_rcved)) \
+  X(send_blocked, COUNTER, CTX_OFF(send_blocked)) \
+  X(send_would_block, COUNTER, CTX_OFF(send_would_block)) \
+  X(resp_blocked, COUNTER, CTX_OFF(resp_blocked)) \
+  X(resp_would_block, COUNTER, CTX_OFF(resp_would_block)) \
+  X(uim_dup_msgs_rcved, COUNTER, CTX_OFF(uim_dup_msgs_rcved)) \
+  X(uim_msgs_no_stream_rcved, COUNTER, CTX_OFF(uim_msgs_no_stream_rcved)) \
+  X(fragments_lost, COUNTER, CTX_OFF(fragments_lost)) \
+  X(fragments_unrecoverably_lost, COUNTER, CTX_OFF(fragments_unrecoverably_lost)) \
+  X(rcv_cb_svc_time_min, MIN, CTX_OFF(rcv_cb_svc_time_min)) \
+  X(rcv_cb_svc_time_max, MAX, CTX_OFF(rcv_cb_svc_time_max)) \
+  X(rcv_cb_svc_time_mean, MEAN, CTX_OFF(rcv_cb_svc_time_mean))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtrm__t__stct.html */
+#define SRC_LBTRM_MINIMAL(X) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtrm, msgs_sent)) \
+  X(naks_rcved, COUNTER, SRC_OFF(lbtrm, naks_rcved)) \
+  X(naks_ignored, COUNTER, SRC_OFF(lbtrm, naks_ignored)) \
+  X(naks_shed, COUNTER, SRC_OFF(lbtrm, naks_shed)) \
+  X(naks_rx_delay_ignored, COUNTER, SRC_OFF(lbtrm, naks_rx_delay_ignored)) \
+  X(rxs_sent, COUNTER, SRC_OFF(lbtrm, rxs_sent))
+
+#define SRC_LBTRM_FULL(X) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtrm, msgs_sent)) \
+  X(bytes_sent, COUNTER, SRC_OFF(lbtrm, bytes_sent)) \
+  X(txw_msgs, GAUGE, SRC_OFF(lbtrm, txw_msgs)) \
+  X(txw_bytes, GAUGE, SRC_OFF(lbtrm, txw_bytes)) \
+  X(nak_pckts_rcved, COUNTER, SRC_OFF(lbtrm, nak_pckts_rcved)) \
+  X(naks_rcved, COUNTER, SRC_OFF(lbtrm, naks_rcved)) \
+  X(naks_ignored, COUNTER, SRC_OFF(lbtrm, naks_ignored)) \
+  X(naks_shed, COUNTER, SRC_OFF(lbtrm, naks_shed)) \
+  X(naks_rx_delay_ignored, COUNTER, SRC_OFF(lbtrm, naks_rx_delay_ignored)) \
+  X(rxs_sent, COUNTER, SRC_OFF(lbtrm, rxs_sent)) \
+  X(rctlr_data_msgs, COUNTER, SRC_OFF(lbtrm, rctlr_data_msgs)) \
+  X(rctlr_rx_msgs, COUNTER, SRC_OFF(lbtrm, rctlr_rx_msgs)) \
+  X(rx_bytes_sent, COUNTER, SRC_OFF(lbtrm, rx_bytes_sent))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtru__t__stct.html */
+#define SRC_LBTRU_MINIMAL(X) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtru, msgs_sent)) \
+  X(naks_rcved, COUNTER, SRC_OFF(lbtru, naks_rcved)) \
+  X(naks_ignored, COUNTER, SRC_OFF(lbtru, naks_ignored)) \
+  X(naks_shed, COUNTER, SRC_OFF(lbtru, naks_shed)) \
+  X(naks_rx_delay_ignored, COUNTER, SRC_OFF(lbtru, naks_rx_delay_ignored)) \
+  X(rxs_sent, COUNTER, SRC_OFF(lbtru, rxs_sent))
+
+#define SRC_LBTRU_FULL(X) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtru, msgs_sent)) \
+  X(bytes_sent, COUNTER, SRC_OFF(lbtru, bytes_sent)) \
+  X(nak_pckts_rcved, COUNTER, SRC_OFF(lbtru, nak_pckts_rcved)) \
+  X(naks_rcved, COUNTER, SRC_OFF(lbtru, naks_rcved)) \
+  X(naks_ignored, COUNTER, SRC_OFF(lbtru, naks_ignored)) \
+  X(naks_shed, COUNTER, SRC_OFF(lbtru, naks_shed)) \
+  X(naks_rx_delay_ignored, COUNTER, SRC_OFF(lbtru, naks_rx_delay_ignored)) \
+  X(rxs_sent, COUNTER, SRC_OFF(lbtru, rxs_sent)) \
+  X(num_clients, GAUGE, SRC_OFF(lbtru, num_clients)) \
+  X(rx_bytes_sent, COUNTER, SRC_OFF(lbtru, rx_bytes_sent))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__tcp__t__stct.html */
+#define SRC_TCP_MINIMAL(X) \
+  X(num_clients, GAUGE, SRC_OFF(tcp, num_clients))
+
+#define SRC_TCP_FULL(X) \
+  X(num_clients, GAUGE, SRC_OFF(tcp, num_clients)) \
+  X(bytes_buffered, GAUGE, SRC_OFF(tcp, bytes_buffered))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtipc__t__stct.html */
+#define SRC_LBTIPC_MINIMAL(X) \
+  X(num_clients, GAUGE, SRC_OFF(lbtipc, num_clients)) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtipc, msgs_sent))
+
+#define SRC_LBTIPC_FULL(X) \
+  X(num_clients, GAUGE, SRC_OFF(lbtipc, num_clients)) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtipc, msgs_sent)) \
+  X(bytes_sent, COUNTER, SRC_OFF(lbtipc, bytes_sent))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtsmx__t__stct.html */
+#define SRC_LBTSMX_MINIMAL(X) \
+  X(num_clients, GAUGE, SRC_OFF(lbtsmx, num_clients)) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtsmx, msgs_sent))
+
+#define SRC_LBTSMX_FULL(X) \
+  X(num_clients, GAUGE, SRC_OFF(lbtsmx, num_clients)) \
+  X(msgs_sent, COUNTER, SRC_OFF(lbtsmx, msgs_sent)) \
+  X(bytes_sent, COUNTER, SRC_OFF(lbtsmx, bytes_sent))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtrm__t__stct.html */
+#define RCV_LBTRM_MINIMAL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtrm, msgs_rcved)) \
+  X(naks_sent, COUNTER, RCV_OFF(lbtrm, naks_sent)) \
+  X(lost, COUNTER, RCV_OFF(lbtrm, lost)) \
+  X(unrecovered_txw, COUNTER, RCV_OFF(lbtrm, unrecovered_txw)) \
+  X(unrecovered_tmo, COUNTER, RCV_OFF(lbtrm, unrecovered_tmo)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtrm, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtrm, lbm_msgs_no_topic_rcved)) \
+  X(drops, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_size), RCV_OFF(lbtrm, dgrams_dropped_type), \
+      RCV_OFF(lbtrm, dgrams_dropped_version), RCV_OFF(lbtrm, dgrams_dropped_hdr), \
+      RCV_OFF(lbtrm, dgrams_dropped_other)) \
+  X(out_of_order, COUNTER, RCV_OFF(lbtrm, out_of_order))
+
+#define RCV_LBTRM_FULL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtrm, msgs_rcved)) \
+  X(bytes_rcved, COUNTER, RCV_OFF(lbtrm, bytes_rcved)) \
+  X(nak_pckts_sent, COUNTER, RCV_OFF(lbtrm, nak_pckts_sent)) \
+  X(naks_sent, COUNTER, RCV_OFF(lbtrm, naks_sent)) \
+  X(lost, COUNTER, RCV_OFF(lbtrm, lost)) \
+  X(ncfs_ignored, COUNTER, RCV_OFF(lbtrm, ncfs_ignored)) \
+  X(ncfs_shed, COUNTER, RCV_OFF(lbtrm, ncfs_shed)) \
+  X(ncfs_rx_delay, COUNTER, RCV_OFF(lbtrm, ncfs_rx_delay)) \
+  X(ncfs_unknown, COUNTER, RCV_OFF(lbtrm, ncfs_unknown)) \
+  X(nak_stm_min, MIN, RCV_OFF(lbtrm, nak_stm_min)) \
+  X(nak_stm_mean, MEAN, RCV_OFF(lbtrm, nak_stm_mean)) \
+  X(nak_stm_max, MAX, RCV_OFF(lbtrm, nak_stm_max)) \
+  X(nak_tx_min, MIN, RCV_OFF(lbtrm, nak_tx_min)) \
+  X(nak_tx_mean, MEAN, RCV_OFF(lbtrm, nak_tx_mean)) \
+  X(nak_tx_max, MAX, RCV_OFF(lbtrm, nak_tx_max)) \
+  X(duplicate_data, COUNTER, RCV_OFF(lbtrm, duplicate_data)) \
+  X(unrecovered_txw, COUNTER, RCV_OFF(lbtrm, unrecovered_txw)) \
+  X(unrecovered_tmo, COUNTER, RCV_OFF(lbtrm, unrecovered_tmo)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtrm, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtrm, lbm_msgs_no_topic_rcved)) \
+  X(lbm_reqs_rcved, COUNTER, RCV_OFF(lbtrm, lbm_reqs_rcved)) \
+  X(dgrams_dropped_size, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_size)) \
+  X(dgrams_dropped_type, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_type)) \
+  X(dgrams_dropped_version, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_version)) \
+  X(dgrams_dropped_hdr, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_hdr)) \
+  X(dgrams_dropped_other, COUNTER, RCV_OFF(lbtrm, dgrams_dropped_other)) \
+  X(out_of_order, COUNTER, RCV_OFF(lbtrm, out_of_order))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtru__t__stct.html */
+#define RCV_LBTRU_MINIMAL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtru, msgs_rcved)) \
+  X(naks_sent, COUNTER, RCV_OFF(lbtru, naks_sent)) \
+  X(lost, COUNTER, RCV_OFF(lbtru, lost)) \
+  X(unrecovered_txw, COUNTER, RCV_OFF(lbtru, unrecovered_txw)) \
+  X(unrecovered_tmo, COUNTER, RCV_OFF(lbtru, unrecovered_tmo)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtru, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtru, lbm_msgs_no_topic_rcved)) \
+  X(drops, COUNTER, RCV_OFF(lbtru, dgrams_dropped_size), RCV_OFF(lbtru, dgrams_dropped_type), \
+      RCV_OFF(lbtru, dgrams_dropped_version), RCV_OFF(lbtru, dgrams_dropped_hdr), \
+      RCV_OFF(lbtru, dgrams_dropped_sid), RCV_OFF(lbtru, dgrams_dropped_other))
+
+#define RCV_LBTRU_FULL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtru, msgs_rcved)) \
+  X(bytes_rcved, COUNTER, RCV_OFF(lbtru, bytes_rcved)) \
+  X(nak_pckts_sent, COUNTER, RCV_OFF(lbtru, nak_pckts_sent)) \
+  X(naks_sent, COUNTER, RCV_OFF(lbtru, naks_sent)) \
+  X(lost, COUNTER, RCV_OFF(lbtru, lost)) \
+  X(ncfs_ignored, COUNTER, RCV_OFF(lbtru, ncfs_ignored)) \
+  X(ncfs_shed, COUNTER, RCV_OFF(lbtru, ncfs_shed)) \
+  X(ncfs_rx_delay, COUNTER, RCV_OFF(lbtru, ncfs_rx_delay)) \
+  X(ncfs_unknown, COUNTER, RCV_OFF(lbtru, ncfs_unknown)) \
+  X(nak_stm_min, MIN, RCV_OFF(lbtru, nak_stm_min)) \
+  X(nak_stm_mean, MEAN, RCV_OFF(lbtru, nak_stm_mean)) \
+  X(nak_stm_max, MAX, RCV_OFF(lbtru, nak_stm_max)) \
+  X(nak_tx_min, MIN, RCV_OFF(lbtru, nak_tx_min)) \
+  X(nak_tx_mean, MEAN, RCV_OFF(lbtru, nak_tx_mean)) \
+  X(nak_tx_max, MAX, RCV_OFF(lbtru, nak_tx_max)) \
+  X(duplicate_data, COUNTER, RCV_OFF(lbtru, duplicate_data)) \
+  X(unrecovered_txw, COUNTER, RCV_OFF(lbtru, unrecovered_txw)) \
+  X(unrecovered_tmo, COUNTER, RCV_OFF(lbtru, unrecovered_tmo)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtru, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtru, lbm_msgs_no_topic_rcved)) \
+  X(lbm_reqs_rcved, COUNTER, RCV_OFF(lbtru, lbm_reqs_rcved)) \
+  X(dgrams_dropped_size, COUNTER, RCV_OFF(lbtru, dgrams_dropped_size)) \
+  X(dgrams_dropped_type, COUNTER, RCV_OFF(lbtru, dgrams_dropped_type)) \
+  X(dgrams_dropped_version, COUNTER, RCV_OFF(lbtru, dgrams_dropped_version)) \
+  X(dgrams_dropped_hdr, COUNTER, RCV_OFF(lbtru, dgrams_dropped_hdr)) \
+  X(dgrams_dropped_sid, COUNTER, RCV_OFF(lbtru, dgrams_dropped_sid)) \
+  X(dgrams_dropped_other, COUNTER, RCV_OFF(lbtru, dgrams_dropped_other))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__tcp__t__stct.html */
+#define RCV_TCP_MINIMAL(X) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(tcp, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(tcp, lbm_msgs_no_topic_rcved))
+
+#define RCV_TCP_FULL(X) \
+  X(bytes_rcved, COUNTER, RCV_OFF(tcp, bytes_rcved)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(tcp, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(tcp, lbm_msgs_no_topic_rcved)) \
+  X(lbm_reqs_rcved, COUNTER, RCV_OFF(tcp, lbm_reqs_rcved))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtipc__t__stct.html */
+#define RCV_LBTIPC_MINIMAL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtipc, msgs_rcved)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtipc, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtipc, lbm_msgs_no_topic_rcved))
+
+#define RCV_LBTIPC_FULL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtipc, msgs_rcved)) \
+  X(bytes_rcved, COUNTER, RCV_OFF(lbtipc, bytes_rcved)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtipc, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtipc, lbm_msgs_no_topic_rcved)) \
+  X(lbm_reqs_rcved, COUNTER, RCV_OFF(lbtipc, lbm_reqs_rcved))
+
+/******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtsmx__t__stct.html */
+#define RCV_LBTSMX_MINIMAL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtsmx, msgs_rcved)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtsmx, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtsmx, lbm_msgs_no_topic_rcved))
+
+#define RCV_LBTSMX_FULL(X) \
+  X(msgs_rcved, COUNTER, RCV_OFF(lbtsmx, msgs_rcved)) \
+  X(bytes_rcved, COUNTER, RCV_OFF(lbtsmx, bytes_rcved)) \
+  X(lbm_msgs_rcved, COUNTER, RCV_OFF(lbtsmx, lbm_msgs_rcved)) \
+  X(lbm_msgs_no_topic_rcved, COUNTER, RCV_OFF(lbtsmx, lbm_msgs_no_topic_rcved))
+
+
+/* Expansions of the lists above. Each array ends with an all-zero entry
+ * (so that a list with no counters still makes a valid array), which isn't
+ * counted. */
+#define NUM_OFFSETS(...) ((int)(sizeof((size_t[]){ __VA_ARGS__ }) / sizeof(size_t)))
+#define FIELD_ENTRY(name_, kind_, ...) \
+  { #name_, ", " #name_ "=", (int)sizeof(", " #name_ "=") - 1, STATS_FIELD_##kind_, \
+    NUM_OFFSETS(__VA_ARGS__), { __VA_ARGS__ } },
+#define COUNTER_ENTRY(name_, kind_, ...) COUNTER_ENTRY_##kind_(name_, kind_, __VA_ARGS__)
+#define COUNTER_ENTRY_COUNTER(name_, kind_, ...) FIELD_ENTRY(name_, kind_, __VA_ARGS__)
+#define COUNTER_ENTRY_GAUGE(name_, kind_, ...)
+#define COUNTER_ENTRY_MIN(name_, kind_, ...)
+#define COUNTER_ENTRY_MAX(name_, kind_, ...)
+#define COUNTER_ENTRY_MEAN(name_, kind_, ...)
+#define END_ENTRY { NULL, NULL, 0, 0, 0, { 0 } }
+
+#define DEFINE_FIELDS(prefix_, list_) \
+  static const stats_field_t prefix_##_fields[] = { list_(FIELD_ENTRY) END_ENTRY }; \
+  static const stats_field_t prefix_##_counters[] = { list_(COUNTER_ENTRY) END_ENTRY };
+
+#define NUM_FIELDS(a_) ((int)(sizeof(a_) / sizeof(a_[0])) - 1)
+#define TABLE(prefix_) { prefix_##_fields, NUM_FIELDS(prefix_##_fields), \
+                         prefix_##_counters, NUM_FIELDS(prefix_##_counters) }
+
+DEFINE_FIELDS(ctx_minimal, CTX_MINIMAL)
+DEFINE_FIELDS(ctx_full, CTX_FULL)
+DEFINE_FIELDS(src_lbtrm_minimal, SRC_LBTRM_MINIMAL)
+DEFINE_FIELDS(src_lbtrm_full, SRC_LBTRM_FULL)
+DEFINE_FIELDS(src_lbtru_minimal, SRC_LBTRU_MINIMAL)
+DEFINE_FIELDS(src_lbtru_full, SRC_LBTRU_FULL)
+DEFINE_FIELDS(src_tcp_minimal, SRC_TCP_MINIMAL)
+DEFINE_FIELDS(src_tcp_full, SRC_TCP_FULL)
+DEFINE_FIELDS(src_lbtipc_minimal, SRC_LBTIPC_MINIMAL)
+DEFINE_FIELDS(src_lbtipc_full, SRC_LBTIPC_FULL)
+DEFINE_FIELDS(src_lbtsmx_minimal, SRC_LBTSMX_MINIMAL)
+DEFINE_FIELDS(src_lbtsmx_full, SRC_LBTSMX_FULL)
+DEFINE_FIELDS(rcv_lbtrm_minimal, RCV_LBTRM_MINIMAL)
+DEFINE_FIELDS(rcv_lbtrm_full, RCV_LBTRM_FULL)
+DEFINE_FIELDS(rcv_lbtru_minimal, RCV_LBTRU_MINIMAL)
+DEFINE_FIELDS(rcv_lbtru_full, RCV_LBTRU_FULL)
+DEFINE_FIELDS(rcv_tcp_minimal, RCV_TCP_MINIMAL)
+DEFINE_FIELDS(rcv_tcp_full, RCV_TCP_FULL)
+DEFINE_FIELDS(rcv_lbtipc_minimal, RCV_LBTIPC_MINIMAL)
+DEFINE_FIELDS(rcv_lbtipc_full, RCV_LBTIPC_FULL)
+DEFINE_FIELDS(rcv_lbtsmx_minimal, RCV_LBTSMX_MINIMAL)
+DEFINE_FIELDS(rcv_lbtsmx_full, RCV_LBTSMX_FULL)
+
+static const stats_field_table_t ctx_tables[STATS_FIELDS_NUM_SETS] = {
+  TABLE(ctx_minimal),
+  TABLE(ctx_full),
+};
+
+/* In stats_fields_type_index() order. */
+static const stats_field_table_t src_tables[STATS_FIELDS_NUM_SETS][STATS_NUM_TYPES] = {
+  { TABLE(src_lbtrm_minimal), TABLE(src_lbtru_minimal), TABLE(src_tcp_minimal), TABLE(src_lbtipc_minimal),
+    TABLE(src_lbtsmx_minimal) },
+  { TABLE(src_lbtrm_full), TABLE(src_lbtru_full), TABLE(src_tcp_full), TABLE(src_lbtipc_full),
+    TABLE(src_lbtsmx_full) },
+};
+
+static const stats_field_table_t rcv_tables[STATS_FIELDS_NUM_SETS][STATS_NUM_TYPES] = {
+  { TABLE(rcv_lbtrm_minimal), TABLE(rcv_lbtru_minimal), TABLE(rcv_tcp_minimal), TABLE(rcv_lbtipc_minimal),
+    TABLE(rcv_lbtsmx_minimal) },
+  { TABLE(rcv_lbtrm_full), TABLE(rcv_lbtru_full), TABLE(rcv_tcp_full), TABLE(rcv_lbtipc_full),
+    TABLE(rcv_lbtsmx_full) },
+};
+
+static int selected_set = STATS_FIELDS_MINIMAL;
+
+
+const char *stats_fields_type_name(int type)
+{
+  switch (type) {
+    case LBM_TRANSPORT_STAT_LBTRM: return "lbtrm";
+    case LBM_TRANSPORT_STAT_LBTRU: return "lbtru";
+    case LBM_TRANSPORT_STAT_TCP: return "tcp";
+    case LBM_TRANSPORT_STAT_LBTIPC: return "lbtipc";
+    case LBM_TRANSPORT_STAT_LBTSMX: return "lbtsmx";
+    default: return NULL;
+  }
+}  /* stats_fields_type_name */
+
+
+/* Maps LBM_TRANSPORT_STAT_... to 0..STATS_NUM_TYPES-1, or -1 if unknown. */
+int stats_fields_type_index(int type)
+{
+  switch (type) {
+    case LBM_TRANSPORT_STAT_LBTRM: return 0;
+    case LBM_TRANSPORT_STAT_LBTRU: return 1;
+    case LBM_TRANSPORT_STAT_TCP: return 2;
+    case LBM_TRANSPORT_STAT_LBTIPC: return 3;
+    case LBM_TRANSPORT_STAT_LBTSMX: return 4;
+    default: return -1;
+  }
+}  /* stats_fields_type_index */
+
+
+/* The inverse of stats_fields_type_index(). */
+int stats_fields_type_from_index(int index)
+{
+  static const int types[STATS_NUM_TYPES] = { LBM_TRANSPORT_STAT_LBTRM, LBM_TRANSPORT_STAT_LBTRU,
+      LBM_TRANSPORT_STAT_TCP, LBM_TRANSPORT_STAT_LBTIPC, LBM_TRANSPORT_STAT_LBTSMX };
+  return types[index];
+}  /* stats_fields_type_from_index */
+
+
+/* The stats_threads' tables, deltas, and archives all depend on the set,
+ * so it can't change once they exist. */
+void stats_fields_select(int set)
+{
+  if (set < 0 || set >= STATS_FIELDS_NUM_SETS) {
+    fprintf(stderr, "ERROR (%s:%d): unknown field set %d\n", __FILE__, __LINE__, set);
+    exit(1);
+  }
+  selected_set = set;
+}  /* stats_fields_select */
+
+
+int stats_fields_selected(void)
+{
+  return selected_set;
+}  /* stats_fields_selected */
+
+
+const stats_field_table_t *stats_fields_ctx_table(int set)
+{
+  return &ctx_tables[set];
+}  /* stats_fields_ctx_table */
+
+
+const stats_field_table_t *stats_fields_src_table(int set, int type)
+{
+  int t = stats_fields_type_index(type);
+  return (t < 0) ? NULL : &src_tables[set][t];
+}  /* stats_fields_src_table */
+
+
+const stats_field_table_t *stats_fields_rcv_table(int set, int type)
+{
+  int t = stats_fields_type_index(type);
+  return (t < 0) ? NULL : &rcv_tables[set][t];
+}  /* stats_fields_rcv_table */
+
+
+static const stats_field_t *table_counters(const stats_field_table_t *table, int *num_fields)
+{
+  if (table == NULL || table->num_counters == 0) {
+    *num_fields = 0;
+    return NULL;  /* E.g. TCP sources have no counters. */
+  }
+  *num_fields = table->num_counters;
+  return table->counters;
+}  /* table_counters */
+
+
+const stats_field_t *stats_fields_ctx(int *num_fields)
+{
+  return table_counters(stats_fields_ctx_table(selected_set), num_fields);
+}  /* stats_fields_ctx */
+
+
+const stats_field_t *stats_fields_src(int type, int *num_fields)
+{
+  return table_counters(stats_fields_src_table(selected_set, type), num_fields);
+}  /* stats_fields_src */
+
+
+const stats_field_t *stats_fields_rcv(int type, int *num_fields)
+{
+  return table_counters(stats_fields_rcv_table(selected_set, type), num_fields);
+}  /* stats_fields_rcv */
+
+
+lbm_ulong_t stats_field_value(const stats_field_t *field, const void *stats)
+{
+  const char *base = (const char *)stats;
+  lbm_ulong_t value = 0;
+  int i;
+
+  for (i = 0; i < field->num_offsets; i++) {
+    value += *(const lbm_ulong_t *)(base + field->offsets[i]);
+  }
+  return value;
+}  /* stats_field_value */
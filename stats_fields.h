@@ -0,0 +1,100 @@
+/* stats_fields.h - tables of monitored UM fields.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_FIELDS_H
+#define STATS_FIELDS_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include "lbm/lbm.h"
+
+
+/* Most counters any one table can hold (the full lbtrm and lbtru receiver
+ * tables have 21). */
+#define STATS_MAX_FIELDS 24
+/* Transport types with stats (see stats_fields_type_index()). */
+#define STATS_NUM_TYPES 5
+/* A counter can be the sum of several UM fields (e.g. "drops"). */
+#define STATS_FIELD_MAX_OFFSETS 6
+
+/* Field sets (see stats_fields_select()). */
+#define STATS_FIELDS_MINIMAL 0  /* The fields mon_self has always printed. */
+#define STATS_FIELDS_FULL 1  /* Every field of the UM structures. */
+#define STATS_FIELDS_NUM_SETS 2
+
+/* How a field's values combine over time and across sessions. Only
+ * counters have deltas, rates and sums. */
+#define STATS_FIELD_COUNTER 0  /* Only goes up while the session exists. */
+#define STATS_FIELD_GAUGE 1  /* A current level, e.g. num_clients. */
+#define STATS_FIELD_MIN 2  /* Statistics that UM computes; not summable. */
+#define STATS_FIELD_MAX 3
+#define STATS_FIELD_MEAN 4
+
+/* One monitored field. The offsets are from the start of the UM stats
+ * structure (lbm_context_stats_t, lbm_src_transport_stats_t, or
+ * lbm_rcv_transport_stats_t), each pointing at an lbm_ulong_t. */
+struct stats_field_s {
+  const char *name;
+  const char *label;  /* ", <name>=", for output lines. */
+  int label_len;
+  int kind;  /* STATS_FIELD_... */
+  int num_offsets;
+  size_t offsets[STATS_FIELD_MAX_OFFSETS];
+};
+typedef struct stats_field_s stats_field_t;
+
+/* The fields of one structure (or one transport type's part of it) in one
+ * set: all of them, in output order, and just the counters. */
+struct stats_field_table_s {
+  const stats_field_t *fields;
+  int num_fields;
+  const stats_field_t *counters;
+  int num_counters;
+};
+typedef struct stats_field_table_s stats_field_table_t;
+
+
+const char *stats_fields_type_name(int type);
+int stats_fields_type_index(int type);
+int stats_fields_type_from_index(int index);
+/* Process-wide; call before creating any stats_thread. Default
+ * STATS_FIELDS_MINIMAL. */
+void stats_fields_select(int set);
+int stats_fields_selected(void);
+/* A set's tables; NULL for an unknown transport type. */
+const stats_field_table_t *stats_fields_ctx_table(int set);
+const stats_field_table_t *stats_fields_src_table(int set, int type);
+const stats_field_table_t *stats_fields_rcv_table(int set, int type);
+/* The counters of the selected set; NULL if there are none. */
+const stats_field_t *stats_fields_ctx(int *num_fields);
+const stats_field_t *stats_fields_src(int type, int *num_fields);
+const stats_field_t *stats_fields_rcv(int type, int *num_fields);
+lbm_ulong_t stats_field_value(const stats_field_t *field, const void *stats);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_FIELDS_H */
@@ -0,0 +1,912 @@
+/* stats_fmt.c - formats samples into text without printf.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_sample.h"
+#include "stats_store.h"
+#include "stats_rules.h"
+#include "stats_window.h"
+#include "stats_send.h"
+#include "stats_thread.h"
+#include "stats_fmt.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* "00" through "99", so that integers convert two digits per divide. */
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+
+stats_fmt_t *stats_fmt_create(size_t size)
+{
+  stats_fmt_t *fmt;
+
+  ENL(fmt = (stats_fmt_t *)malloc(sizeof(stats_fmt_t)));
+  fmt->size = (size > 0) ? size : 1;
+  fmt->len = 0;
+  ENL(fmt->buf = (char *)malloc(fmt->size));
+
+  return fmt;
+}  /* stats_fmt_create */
+
+
+void stats_fmt_delete(stats_fmt_t *fmt)
+{
+  free(fmt->buf);
+  free(fmt);
+}  /* stats_fmt_delete */
+
+
+/* Make room for "len" more bytes. */
+void stats_fmt_reserve(stats_fmt_t *fmt, size_t len)
+{
+  if (fmt->size - fmt->len < len) {
+    while (fmt->size - fmt->len < len) {
+      fmt->size *= 2;
+    }
+    ENL(fmt->buf = (char *)realloc(fmt->buf, fmt->size));
+  }
+}  /* stats_fmt_reserve */
+
+
+void stats_fmt_mem(stats_fmt_t *fmt, const char *mem, size_t len)
+{
+  if (fmt->size - fmt->len < len) {
+    stats_fmt_reserve(fmt, len);
+  }
+  memcpy(fmt->buf + fmt->len, mem, len);
+  fmt->len += len;
+}  /* stats_fmt_mem */
+
+
+void stats_fmt_str(stats_fmt_t *fmt, const char *str)
+{
+  stats_fmt_mem(fmt, str, strlen(str));
+}  /* stats_fmt_str */
+
+
+/* Same output as printf("%lu"). */
+void stats_fmt_ulong(stats_fmt_t *fmt, uint64_t val)
+{
+  char digits[20];  /* Enough for 2**64-1. */
+  char *p = digits + sizeof(digits);
+
+  while (val >= 100) {
+    int pair = (int)(val % 100) * 2;
+    val /= 100;
+    p -= 2;
+    p[0] = digit_pairs[pair];
+    p[1] = digit_pairs[pair + 1];
+  }
+  if (val >= 10) {
+    p -= 2;
+    p[0] = digit_pairs[val * 2];
+    p[1] = digit_pairs[val * 2 + 1];
+  }
+  else {
+    *(--p) = (char)('0' + val);
+  }
+  stats_fmt_mem(fmt, p, digits + sizeof(digits) - p);
+}  /* stats_fmt_ulong */
+
+
+/* Same output as printf("%.2f") for a non-negative value. printf rounds
+ * the exact binary value, and multiplying by 100 can be off by an ulp,
+ * so values that land too close to a rounding tie (and very large or
+ * negative values) are handed to snprintf. That is rare for real rates. */
+void stats_fmt_fixed2(stats_fmt_t *fmt, double val)
+{
+  double scaled = val * 100.0;
+
+  if (scaled >= 0.0 && scaled < 1e15) {
+    uint64_t whole = (uint64_t)scaled;
+    double frac = scaled - (double)whole;
+    double tie_dist = (frac > 0.5) ? (frac - 0.5) : (0.5 - frac);
+
+    if (tie_dist > scaled * 1e-14 + 1e-9) {
+      uint64_t cents = whole + (frac > 0.5);
+      int pair = (int)(cents % 100) * 2;
+
+      stats_fmt_ulong(fmt, cents / 100);
+      stats_fmt_reserve(fmt, 3);
+      fmt->buf[fmt->len++] = '.';
+      fmt->buf[fmt->len++] = digit_pairs[pair];
+      fmt->buf[fmt->len++] = digit_pairs[pair + 1];
+      return;
+    }
+  }
+  stats_fmt_printf(fmt, "%.2f", val);
+}  /* stats_fmt_fixed2 */
+
+
+/* For rare lines (warnings, one per sample at most) where speed does not
+ * matter. */
+void stats_fmt_printf(stats_fmt_t *fmt, const char *format, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, format);
+  n = vsnprintf(fmt->buf + fmt->len, fmt->size - fmt->len, format, ap);
+  va_end(ap);
+  if (n >= 0 && (size_t)n >= fmt->size - fmt->len) {
+    stats_fmt_reserve(fmt, (size_t)n + 1);
+    va_start(ap, format);
+    n = vsnprintf(fmt->buf + fmt->len, fmt->size - fmt->len, format, ap);
+    va_end(ap);
+  }
+  if (n > 0) {
+    fmt->len += n;
+  }
+}  /* stats_fmt_printf */
+
+
+/* Append ", <name>=<value>". "name_lit_" must be a literal with the leading
+ * ", " and trailing "=". */
+#define FIELD(name_lit_, val_) do { \
+  STATS_FMT_LIT(fmt, name_lit_); \
+  stats_fmt_ulong(fmt, (val_)); \
+} while (0)  /* FIELD */
+
+
+/* Start a line: "ctx_name='<ctx_name>', <label>". */
+static void line_start(stats_fmt_t *fmt, const char *ctx_name, const char *label, size_t label_len)
+{
+  STATS_FMT_LIT(fmt, "ctx_name='");
+  stats_fmt_str(fmt, ctx_name);
+  STATS_FMT_LIT(fmt, "', ");
+  stats_fmt_mem(fmt, label, label_len);
+}  /* line_start */
+
+#define LINE_START(label_lit_) line_start(fmt, ctx_name, (label_lit_), sizeof(label_lit_) - 1)
+
+
+/* Format one line of deltas and per-second rates. The source and status are
+ * omitted (NULL) for the context line and for totals ("kind" is "total"),
+ * which have a session count instead. Host and group sums have a "key"
+ * (the address), printed as "<kind>=<key>". */
+static void format_deltas(stats_fmt_t *fmt, const char *ctx_name, const char *dir, const char *type_name,
+    const char *kind, const char *key, const char *source, const char *status, int num_sessions, uint64_t interval_ns,
+    const stats_field_t *fields, int num_fields, const uint64_t *deltas)
+{
+  double interval_sec = (double)interval_ns / 1000000000.0;
+  int f;
+
+  STATS_FMT_LIT(fmt, "ctx_name='");
+  stats_fmt_str(fmt, ctx_name);
+  STATS_FMT_LIT(fmt, "', ");
+  stats_fmt_str(fmt, dir);
+  if (type_name != NULL) {
+    STATS_FMT_LIT(fmt, "/");
+    stats_fmt_str(fmt, type_name);
+  }
+  STATS_FMT_LIT(fmt, "/");
+  stats_fmt_str(fmt, kind);
+  STATS_FMT_LIT(fmt, ":");
+  if (key != NULL) {
+    STATS_FMT_LIT(fmt, " ");
+    stats_fmt_str(fmt, kind);
+    STATS_FMT_LIT(fmt, "=");
+    stats_fmt_str(fmt, key);
+    STATS_FMT_LIT(fmt, ",");
+  }
+  if (source != NULL) {
+    STATS_FMT_LIT(fmt, " source=");
+    stats_fmt_str(fmt, source);
+    STATS_FMT_LIT(fmt, ", status=");
+    stats_fmt_str(fmt, status);
+    STATS_FMT_LIT(fmt, ",");
+  }
+  if (num_sessions >= 0) {
+    STATS_FMT_LIT(fmt, " sessions=");
+    stats_fmt_ulong(fmt, num_sessions);
+    STATS_FMT_LIT(fmt, ",");
+  }
+  STATS_FMT_LIT(fmt, " interval_ms=");
+  stats_fmt_ulong(fmt, interval_ns / 1000000);
+  for (f = 0; f < num_fields; f++) {
+    STATS_FMT_LIT(fmt, ", ");
+    stats_fmt_str(fmt, fields[f].name);
+    STATS_FMT_LIT(fmt, "=");
+    stats_fmt_ulong(fmt, deltas[f]);
+    STATS_FMT_LIT(fmt, " (");
+    stats_fmt_fixed2(fmt, (double)deltas[f] / interval_sec);
+    STATS_FMT_LIT(fmt, "/s)");
+  }
+  STATS_FMT_LIT(fmt, "\n");
+}  /* format_deltas */
+
+
+/* One line per transport type with sessions, summing all their deltas. */
+static void format_totals(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample, int dir)
+{
+  int t;
+
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    int type = stats_fields_type_from_index(t);
+    const stats_field_t *fields;
+    int num_fields;
+
+    if (dir == STATS_STORE_SRC) {
+      fields = stats_fields_src(type, &num_fields);
+    } else {
+      fields = stats_fields_rcv(type, &num_fields);
+    }
+    if (sample->total_sessions[dir][t] > 0 && num_fields > 0) {
+      format_deltas(fmt, ctx_name, (dir == STATS_STORE_SRC) ? "src" : "rcv", stats_fields_type_name(type), "total",
+          NULL, NULL, NULL, sample->total_sessions[dir][t], sample->interval_ns, fields, num_fields, sample->totals[dir][t]);
+    }
+  }
+}  /* format_totals */
+
+
+/* Dotted quad of a host byte order IPv4 address; "buf" needs 16 bytes. */
+static const char *addr_str(char *buf, uint32_t addr)
+{
+  char *p = buf;
+  int shift;
+
+  for (shift = 24; shift >= 0; shift -= 8) {
+    unsigned int octet = (addr >> shift) & 0xff;
+    if (octet >= 100) {
+      *p++ = (char)('0' + octet / 100);
+    }
+    if (octet >= 10) {
+      *p++ = (char)('0' + (octet / 10) % 10);
+    }
+    *p++ = (char)('0' + octet % 10);
+    *p++ = (shift > 0) ? '.' : '\0';
+  }
+  return buf;
+}  /* addr_str */
+
+
+/* "<dir>/<type>/host: host=..., sessions=N, ..." for each publisher host,
+ * then ".../group: group=..." for each multicast group; by type, then in
+ * order of first session. */
+static void format_aggregates(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample, int dir)
+{
+  int by_group, t, a;
+
+  for (by_group = 0; by_group < 2; by_group++) {
+    for (t = 0; t < STATS_NUM_TYPES; t++) {
+      int type = stats_fields_type_from_index(t);
+      const stats_field_t *fields;
+      int num_fields;
+
+      if (dir == STATS_STORE_SRC) {
+        fields = stats_fields_src(type, &num_fields);
+      } else {
+        fields = stats_fields_rcv(type, &num_fields);
+      }
+      for (a = 0; a < sample->num_aggregates; a++) {
+        const stats_aggregate_t *aggregate = &sample->aggregates[a];
+        char addr[16];
+
+        if (aggregate->dir == dir && aggregate->type == type && aggregate->by_group == by_group) {
+          format_deltas(fmt, ctx_name, (dir == STATS_STORE_SRC) ? "src" : "rcv", stats_fields_type_name(type),
+              by_group ? "group" : "host", addr_str(addr, aggregate->addr), NULL, NULL, aggregate->num_sessions,
+              sample->interval_ns, fields, num_fields, aggregate->deltas);
+        }
+      }
+    }
+  }
+}  /* format_aggregates */
+
+
+/* ", mean_us=..., p50_us=..., p90_us=..., p99_us=..., p99.9_us=...,
+ * max_us=..." */
+static void format_percentiles(stats_fmt_t *fmt, const stats_latency_summary_t *summary)
+{
+  STATS_FMT_LIT(fmt, ", mean_us=");
+  stats_fmt_fixed2(fmt, (double)summary->mean_ns / 1000.0);
+  STATS_FMT_LIT(fmt, ", p50_us=");
+  stats_fmt_fixed2(fmt, (double)summary->p50_ns / 1000.0);
+  STATS_FMT_LIT(fmt, ", p90_us=");
+  stats_fmt_fixed2(fmt, (double)summary->p90_ns / 1000.0);
+  STATS_FMT_LIT(fmt, ", p99_us=");
+  stats_fmt_fixed2(fmt, (double)summary->p99_ns / 1000.0);
+  STATS_FMT_LIT(fmt, ", p99.9_us=");
+  stats_fmt_fixed2(fmt, (double)summary->p999_ns / 1000.0);
+  STATS_FMT_LIT(fmt, ", max_us=");
+  stats_fmt_fixed2(fmt, (double)summary->max_ns / 1000.0);
+}  /* format_percentiles */
+
+
+/* "rcv/<type>/latency: metric=callback, n=..., mean_us=..., p50_us=...,
+ * p90_us=..., p99_us=..., p99.9_us=..., max_us=..." for each transport type
+ * and metric that recorded anything this interval. */
+static void format_latency(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample)
+{
+  static const char *metric_names[STATS_LATENCY_NUM_METRICS] = { "callback", "end_to_end" };
+  int t, m;
+
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    for (m = 0; m < STATS_LATENCY_NUM_METRICS; m++) {
+      const stats_latency_summary_t *summary = &sample->latency[t][m];
+      if (summary->count == 0) {
+        continue;
+      }
+      LINE_START("rcv/");
+      stats_fmt_str(fmt, stats_fields_type_name(stats_fields_type_from_index(t)));
+      STATS_FMT_LIT(fmt, "/latency: metric=");
+      stats_fmt_str(fmt, metric_names[m]);
+      FIELD(", n=", summary->count);
+      format_percentiles(fmt, summary);
+      STATS_FMT_LIT(fmt, "\n");
+    }
+  }
+}  /* format_latency */
+
+
+/* "src/send: name=..., interval_ms=..., calls=N (R/s), bytes=...,
+ * would_block=..., errors=..., mean_us=..., ..." for each source sent on
+ * with stats_send(); the percentiles are of the send call's duration. */
+static void format_sends(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample)
+{
+  double interval_sec = (double)sample->interval_ns / 1000000000.0;
+  int s;
+
+  for (s = 0; s < sample->num_sends; s++) {
+    const stats_send_summary_t *send = &sample->sends[s];
+    const char *names[4] = { ", calls=", ", bytes=", ", would_block=", ", errors=" };
+    uint64_t vals[4];
+    int v;
+
+    vals[0] = send->calls;
+    vals[1] = send->bytes;
+    vals[2] = send->would_block;
+    vals[3] = send->errors;
+    LINE_START("src/send: name=");
+    stats_fmt_str(fmt, send->name);
+    FIELD(", interval_ms=", sample->interval_ns / 1000000);
+    for (v = 0; v < 4; v++) {
+      stats_fmt_str(fmt, names[v]);
+      stats_fmt_ulong(fmt, vals[v]);
+      STATS_FMT_LIT(fmt, " (");
+      stats_fmt_fixed2(fmt, (double)vals[v] / interval_sec);
+      STATS_FMT_LIT(fmt, "/s)");
+    }
+    if (send->calls > 0) {
+      format_percentiles(fmt, &send->duration);
+    }
+    STATS_FMT_LIT(fmt, "\n");
+  }
+}  /* format_sends */
+
+
+/* "<dir>/<type>/session_joined: source=..." or ".../session_left: ...". */
+static void format_event(stats_fmt_t *fmt, const char *ctx_name, const char *dir, int type, const char *event,
+    const char *source)
+{
+  const char *type_name = stats_fields_type_name(type);
+
+  STATS_FMT_LIT(fmt, "ctx_name='");
+  stats_fmt_str(fmt, ctx_name);
+  STATS_FMT_LIT(fmt, "', ");
+  stats_fmt_str(fmt, dir);
+  STATS_FMT_LIT(fmt, "/");
+  stats_fmt_str(fmt, (type_name != NULL) ? type_name : "unknown");
+  STATS_FMT_LIT(fmt, "/");
+  stats_fmt_str(fmt, event);
+  STATS_FMT_LIT(fmt, ": source=");
+  stats_fmt_str(fmt, source);
+  STATS_FMT_LIT(fmt, "\n");
+}  /* format_event */
+
+
+static void format_left(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample, int dir)
+{
+  int i;
+
+  for (i = 0; i < sample->num_left; i++) {
+    if (sample->left[i].dir == dir) {
+      format_event(fmt, ctx_name, (dir == STATS_STORE_SRC) ? "src" : "rcv", sample->left[i].type, "session_left",
+          sample->left[i].source);
+    }
+  }
+}  /* format_left */
+
+
+/* "<dir>/<type>/window: source=..., field=<name>, window=1m, n=..., min=...,
+ * mean=..., max=..., p50=..., p99=..., p99.9=..." (rates per second). */
+static void format_summaries(stats_fmt_t *fmt, const char *ctx_name, const stats_sample_t *sample)
+{
+  int s;
+
+  for (s = 0; s < sample->num_summaries; s++) {
+    const stats_window_summary_t *summary = &sample->summaries[s];
+    int type = (summary->dir == STATS_WINDOW_SRC) ? sample->src_stats[summary->entry].type
+                                                  : sample->rcv_stats[summary->entry].type;
+    LINE_START("");
+    stats_fmt_str(fmt, (summary->dir == STATS_WINDOW_SRC) ? "src/" : "rcv/");
+    stats_fmt_str(fmt, stats_fields_type_name(type));
+    STATS_FMT_LIT(fmt, "/window: source=");
+    stats_fmt_str(fmt, (summary->dir == STATS_WINDOW_SRC) ? sample->src_stats[summary->entry].source
+                                                          : sample->rcv_stats[summary->entry].source);
+    STATS_FMT_LIT(fmt, ", field=");
+    stats_fmt_str(fmt, summary->field);
+    STATS_FMT_LIT(fmt, ", window=");
+    stats_fmt_str(fmt, stats_window_name(summary->window));
+    FIELD(", n=", summary->count);
+    STATS_FMT_LIT(fmt, ", min=");
+    stats_fmt_fixed2(fmt, summary->min);
+    STATS_FMT_LIT(fmt, ", mean=");
+    stats_fmt_fixed2(fmt, summary->mean);
+    STATS_FMT_LIT(fmt, ", max=");
+    stats_fmt_fixed2(fmt, summary->max);
+    STATS_FMT_LIT(fmt, ", p50=");
+    stats_fmt_fixed2(fmt, summary->p50);
+    STATS_FMT_LIT(fmt, ", p99=");
+    stats_fmt_fixed2(fmt, summary->p99);
+    STATS_FMT_LIT(fmt, ", p99.9=");
+    stats_fmt_fixed2(fmt, summary->p999);
+    STATS_FMT_LIT(fmt, "\n");
+  }
+}  /* format_summaries */
+
+
+/* "<dir>/<type>/alert: source=..., <field>=<delta> (<rate>/s), rule='...'",
+ * or "context/alert: ..." without the source. */
+static void format_alerts(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const char *ctx_name,
+    const stats_sample_t *sample)
+{
+  int a;
+
+  for (a = 0; a < sample->num_alerts; a++) {
+    const stats_alert_t *alert = &sample->alerts[a];
+    if (alert->dir == STATS_RULE_CTX) {
+      LINE_START("context/alert: ");
+    }
+    else {
+      const char *type_name = stats_fields_type_name(alert->type);
+      LINE_START("");
+      stats_fmt_str(fmt, (alert->dir == STATS_STORE_SRC) ? "src/" : "rcv/");
+      stats_fmt_str(fmt, (type_name != NULL) ? type_name : "unknown");
+      STATS_FMT_LIT(fmt, "/alert: source=");
+      stats_fmt_str(fmt, alert->source);
+      STATS_FMT_LIT(fmt, ", ");
+    }
+    stats_fmt_str(fmt, alert->field);
+    STATS_FMT_LIT(fmt, "=");
+    stats_fmt_ulong(fmt, alert->delta);
+    STATS_FMT_LIT(fmt, " (");
+    stats_fmt_fixed2(fmt, alert->rate);
+    STATS_FMT_LIT(fmt, "/s), rule='");
+    stats_fmt_str(fmt, alert->rule);
+    STATS_FMT_LIT(fmt, "'\n");
+  }
+  if (sample->num_violations > sample->num_alerts) {
+    STATS_FMT_LIT(fmt, "WARNING: ctx_name='");
+    stats_fmt_str(fmt, ctx_name);
+    STATS_FMT_LIT(fmt, "', ");
+    stats_fmt_ulong(fmt, (unsigned int)(sample->num_violations - sample->num_alerts));
+    STATS_FMT_LIT(fmt, " more alerts not shown\n");
+  }
+  if (sample->burst_change != 0) {
+    LINE_START("sampling: burst=");
+    stats_fmt_ulong(fmt, (sample->burst_change > 0) ? 1 : 0);
+    STATS_FMT_LIT(fmt, ", interval_ms=");
+    stats_fmt_ulong(fmt, sample->burst_sample_interval_ns / 1000000);
+    STATS_FMT_LIT(fmt, "\n");
+  }
+}  /* format_alerts */
+
+
+/* "self: retrieve_us=..., retries=N, cpu_us=..., cpu_pct=..., degrade=N,
+ * last_format_us=..., last_bytes=..." The last two are for the previous
+ * sample, which was formatted after it was taken. */
+static void format_self(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const char *ctx_name,
+    const stats_sample_t *sample)
+{
+  LINE_START("self: retrieve_us=");
+  stats_fmt_ulong(fmt, sample->retrieve_ns / 1000);
+  FIELD(", retries=", (unsigned int)sample->retrieve_retries);
+  FIELD(", cpu_us=", sample->cpu_ns / 1000);
+  if (sample->interval_ns > 0) {
+    STATS_FMT_LIT(fmt, ", cpu_pct=");
+    stats_fmt_fixed2(fmt, (double)sample->cpu_ns * 100.0 / (double)sample->interval_ns);
+  }
+  FIELD(", degrade=", (unsigned int)sample->degrade);
+  FIELD(", last_format_us=", stats_thread->format_ns / 1000);
+  FIELD(", last_bytes=", stats_thread->format_bytes);
+  if (stats_thread->stream != NULL) {
+    FIELD(", stream_sent=", stats_thread->stream->num_samples);
+    FIELD(", stream_dropped=", stats_thread->stream->num_dropped);
+  }
+  STATS_FMT_LIT(fmt, "\n");
+}  /* format_self */
+
+
+/* "sampling: degrade=N, interval_ms=..., cpu_pct=..., budget_pct=..." when
+ * the CPU budget changed what is printed (from this sample on) or how often
+ * samples are taken (from the next one on); a WARNING when going over. */
+static void format_degrade(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const char *ctx_name,
+    const stats_sample_t *sample)
+{
+  int degrade = sample->degrade;
+  uint64_t interval_ms = (uint64_t)stats_thread->stats_interval_sec * 1000;
+
+  if (sample->degrade_change > 0) {
+    STATS_FMT_LIT(fmt, "WARNING: ");
+  }
+  LINE_START("sampling: degrade=");
+  stats_fmt_ulong(fmt, (unsigned int)degrade);
+  FIELD(", interval_ms=", (degrade > 1) ? interval_ms << (degrade - 1) : interval_ms);
+  STATS_FMT_LIT(fmt, ", session_lines=");
+  stats_fmt_str(fmt, (degrade == 0) ? "yes" : "no");
+  STATS_FMT_LIT(fmt, ", cpu_pct=");
+  stats_fmt_fixed2(fmt, (double)sample->cpu_ns * 100.0 / (double)sample->interval_ns);
+  STATS_FMT_LIT(fmt, ", budget_pct=");
+  stats_fmt_fixed2(fmt, stats_thread->config.cpu_budget_pct);
+  STATS_FMT_LIT(fmt, "\n");
+}  /* format_degrade */
+
+
+static void format_unknown_type(stats_fmt_t *fmt, const char *ctx_name, int type)
+{
+  STATS_FMT_LIT(fmt, "WARNING: ctx_name='");
+  stats_fmt_str(fmt, ctx_name);
+  STATS_FMT_LIT(fmt, "', unrecognized transport type (");
+  stats_fmt_ulong(fmt, (unsigned int)type);
+  STATS_FMT_LIT(fmt, ")\n");
+}  /* format_unknown_type */
+
+
+/* Every field in "table" of a UM stats structure, as ", <name>=<value>".
+ * "skip" bytes of the first label are left out (1 for " <name>="). */
+static void format_values(stats_fmt_t *fmt, const stats_field_table_t *table, const void *stats, int skip)
+{
+  const stats_field_t *field = table->fields;
+  const stats_field_t *end = field + table->num_fields;
+
+  for (; field < end; field++) {
+    stats_fmt_mem(fmt, field->label + skip, field->label_len - skip);
+    stats_fmt_ulong(fmt, stats_field_value(field, stats));
+    skip = 0;
+  }
+}  /* format_values */
+
+
+/* "<dir>/<type>: source=<source>, <name>=<value>..." for one transport
+ * session; "table" is NULL for a type we don't know. */
+static void format_session(stats_fmt_t *fmt, const char *ctx_name, const char *dir, int type, const char *source,
+    const stats_field_table_t *table, const void *stats)
+{
+  if (table == NULL) {
+    format_unknown_type(fmt, ctx_name, type);
+    return;
+  }
+  line_start(fmt, ctx_name, dir, strlen(dir));
+  STATS_FMT_LIT(fmt, "/");
+  stats_fmt_str(fmt, stats_fields_type_name(type));
+  STATS_FMT_LIT(fmt, ": source=");
+  stats_fmt_str(fmt, source);
+  format_values(fmt, table, stats, 0);
+  STATS_FMT_LIT(fmt, "\n");
+}  /* format_session */
+
+
+/* Runs in the writer thread. Appends a whole sample to "fmt". The output
+ * is the same, byte for byte, as the original printf() calls (except that
+ * lbtrm and lbtru receivers' lbm_msgs_no_topic_rcved and drops are no
+ * longer swapped), unless changes_only, session_events, rules, windows,
+ * self_stats, cpu_budget_pct or the full field set are configured. */
+void stats_fmt_sample(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const stats_sample_t *sample)
+{
+  int i;
+  int changes_only = stats_thread->config.changes_only && !sample->keyframe;
+  int field_set = stats_fields_selected();
+  /* Over the CPU budget, no per-session lines. */
+  int session_events = stats_thread->config.session_events && sample->degrade == 0;
+  int src_num_entries = (sample->degrade == 0) ? sample->src_num_entries : 0;
+  int rcv_num_entries = (sample->degrade == 0) ? sample->rcv_num_entries : 0;
+  const char *ctx_name = stats_thread->ctx_name;
+  if (ctx_name == NULL) {
+    ctx_name = "";
+  }
+
+  if (stats_thread->config.timestamps) {
+    time_t sec = (time_t)(sample->sample_realtime_ns / 1000000000);
+    struct tm tm;
+    char time_str[32];
+    gmtime_r(&sec, &tm);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S", &tm);
+    stats_fmt_printf(fmt, "ctx_name='%s', sample: seq=%lu, time=%s.%09luZ, mono_ns=%lu, retrieve_us=%lu",
+        ctx_name, (unsigned long)sample->seq, time_str, (unsigned long)(sample->sample_realtime_ns % 1000000000),
+        (unsigned long)sample->sample_ns, (unsigned long)(sample->retrieve_ns / 1000));
+    if (sample->tick_id != 0) {
+      /* Coordinated sampling; see stats_monitor.h. */
+      FIELD(", tick=", sample->tick_id);
+    }
+    STATS_FMT_LIT(fmt, "\n");
+  }
+
+  if (stats_thread->config.changes_only && sample->keyframe) {
+    LINE_START("keyframe: src_sessions=");
+    stats_fmt_ulong(fmt, sample->src_num_entries);
+    FIELD(", rcv_sessions=", sample->rcv_num_entries);
+    STATS_FMT_LIT(fmt, "\n");
+  }
+
+  /* Print context stats. */
+  {
+    LINE_START("context:");
+    format_values(fmt, stats_fields_ctx_table(field_set), &sample->ctx_stats, 1);
+    STATS_FMT_LIT(fmt, "\n");
+
+    if (sample->have_deltas) {
+      const stats_field_t *fields;
+      int num_fields;
+      fields = stats_fields_ctx(&num_fields);
+      format_deltas(fmt, ctx_name, "context", NULL, "delta", NULL, NULL, NULL, -1, sample->interval_ns,
+          fields, num_fields, sample->ctx_deltas);
+    }
+  }
+  if (stats_thread->config.self_stats) {
+    format_self(fmt, stats_thread, ctx_name, sample);
+  }
+
+  /* Print source stats, one line per published transport session. */
+  for (i = 0; i < src_num_entries; i++) {
+    if (session_events && sample->src_deltas[i].status[0] == 'n') {
+      format_event(fmt, ctx_name, "src", sample->src_stats[i].type, "session_joined", sample->src_stats[i].source);
+    }
+    if (changes_only && !sample->src_deltas[i].changed) {
+      continue;
+    }
+    format_session(fmt, ctx_name, "src", sample->src_stats[i].type, sample->src_stats[i].source,
+        stats_fields_src_table(field_set, sample->src_stats[i].type), &sample->src_stats[i]);
+
+    if (sample->have_deltas) {
+      int type = sample->src_stats[i].type;
+      const char *type_name = stats_fields_type_name(type);
+      const stats_field_t *fields;
+      int num_fields;
+
+      fields = stats_fields_src(type, &num_fields);
+      if (type_name != NULL && num_fields > 0) {
+        format_deltas(fmt, ctx_name, "src", type_name, "delta", NULL, sample->src_stats[i].source,
+            sample->src_deltas[i].status, -1, sample->interval_ns, fields, num_fields, sample->src_deltas[i].deltas);
+      }
+    }
+  }  /* for */
+  if (session_events) {
+    format_left(fmt, ctx_name, sample, STATS_STORE_SRC);
+  }
+  if (sample->have_totals) {
+    format_totals(fmt, ctx_name, sample, STATS_STORE_SRC);
+  }
+  format_aggregates(fmt, ctx_name, sample, STATS_STORE_SRC);
+  format_sends(fmt, ctx_name, sample);
+
+  /* Print receiver stats, one line per subscribed transport session. */
+  for (i = 0; i < rcv_num_entries; i++) {
+    if (session_events && sample->rcv_deltas[i].status[0] == 'n') {
+      format_event(fmt, ctx_name, "rcv", sample->rcv_stats[i].type, "session_joined", sample->rcv_stats[i].source);
+    }
+    if (changes_only && !sample->rcv_deltas[i].changed) {
+      continue;
+    }
+    format_session(fmt, ctx_name, "rcv", sample->rcv_stats[i].type, sample->rcv_stats[i].source,
+        stats_fields_rcv_table(field_set, sample->rcv_stats[i].type), &sample->rcv_stats[i]);
+
+    if (sample->have_deltas) {
+      int type = sample->rcv_stats[i].type;
+      const char *type_name = stats_fields_type_name(type);
+      const stats_field_t *fields;
+      int num_fields;
+
+      fields = stats_fields_rcv(type, &num_fields);
+      if (type_name != NULL && num_fields > 0) {
+        format_deltas(fmt, ctx_name, "rcv", type_name, "delta", NULL, sample->rcv_stats[i].source,
+            sample->rcv_deltas[i].status, -1, sample->interval_ns, fields, num_fields, sample->rcv_deltas[i].deltas);
+      }
+    }
+  }  /* for */
+  if (session_events) {
+    format_left(fmt, ctx_name, sample, STATS_STORE_RCV);
+  }
+  if (sample->have_totals) {
+    format_totals(fmt, ctx_name, sample, STATS_STORE_RCV);
+  }
+  format_aggregates(fmt, ctx_name, sample, STATS_STORE_RCV);
+  if (sample->have_latency) {
+    format_latency(fmt, ctx_name, sample);
+  }
+  if (sample->degrade == 0) {
+    format_summaries(fmt, ctx_name, sample);
+  }
+  format_alerts(fmt, stats_thread, ctx_name, sample);
+  if (sample->degrade_change != 0) {
+    format_degrade(fmt, stats_thread, ctx_name, sample);
+  }
+
+}  /* stats_fmt_sample */
+
+
+/* Append an OpenMetrics label value, with '\', '"' and newline escaped. */
+static void om_label_value(stats_fmt_t *fmt, const char *str)
+{
+  if (strpbrk(str, "\\\"\n") == NULL) {
+    stats_fmt_str(fmt, str);
+    return;
+  }
+  for (; *str != '\0'; str++) {
+    if (*str == '\\') {
+      STATS_FMT_LIT(fmt, "\\\\");
+    }
+    else if (*str == '"') {
+      STATS_FMT_LIT(fmt, "\\\"");
+    }
+    else if (*str == '\n') {
+      STATS_FMT_LIT(fmt, "\\n");
+    }
+    else {
+      stats_fmt_mem(fmt, str, 1);
+    }
+  }
+}  /* om_label_value */
+
+
+/* Append a metric family's "# TYPE" line, and put the name its samples
+ * use ("_total" added for counters) in "name". Returns the name's length. */
+static size_t om_family(stats_fmt_t *fmt, char *name, size_t name_size, const char *dir, const char *type_name,
+    const stats_field_t *field)
+{
+  int is_counter = (field->kind == STATS_FIELD_COUNTER);
+  int len;
+
+  len = snprintf(name, name_size, "lbm_%s_%s%s%s", dir, (type_name != NULL) ? type_name : "",
+      (type_name != NULL) ? "_" : "", field->name);
+  STATS_FMT_LIT(fmt, "# TYPE ");
+  stats_fmt_mem(fmt, name, len);
+  if (is_counter) {
+    STATS_FMT_LIT(fmt, " counter\n");
+    memcpy(name + len, "_total", sizeof("_total"));  /* Fits; names are short. */
+    len += sizeof("_total") - 1;
+  } else {
+    STATS_FMT_LIT(fmt, " gauge\n");
+  }
+  return (size_t)len;
+}  /* om_family */
+
+
+/* Append one sample: <name>{ctx="<ctx_name>"[,source="<source>"]} <value>. */
+static void om_sample(stats_fmt_t *fmt, const char *name, size_t name_len, const char *ctx_name, const char *source,
+    uint64_t value)
+{
+  stats_fmt_mem(fmt, name, name_len);
+  STATS_FMT_LIT(fmt, "{ctx=\"");
+  om_label_value(fmt, ctx_name);
+  if (source != NULL) {
+    STATS_FMT_LIT(fmt, "\",source=\"");
+    om_label_value(fmt, source);
+  }
+  STATS_FMT_LIT(fmt, "\"} ");
+  stats_fmt_ulong(fmt, value);
+  STATS_FMT_LIT(fmt, "\n");
+}  /* om_sample */
+
+
+/* Format a sample's current values (not deltas) in OpenMetrics text
+ * format, for scrapers. Every field of the selected set is a metric
+ * family named lbm_context_<field>, lbm_src_<type>_<field>, or
+ * lbm_rcv_<type>_<field>, with one sample per session (labelled with its
+ * source string). Counters are "counter" families, everything else
+ * "gauge". A family's samples have to be together, so the sessions are
+ * walked once per field of their type. */
+void stats_fmt_openmetrics(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const stats_sample_t *sample)
+{
+  int field_set = stats_fields_selected();
+  int src_types[STATS_NUM_TYPES];
+  int rcv_types[STATS_NUM_TYPES];
+  const stats_field_table_t *table;
+  char name[128];
+  size_t name_len;
+  int i, t, f;
+  const char *ctx_name = stats_thread->ctx_name;
+  if (ctx_name == NULL) {
+    ctx_name = "";
+  }
+
+  table = stats_fields_ctx_table(field_set);
+  for (f = 0; f < table->num_fields; f++) {
+    name_len = om_family(fmt, name, sizeof(name), "context", NULL, &table->fields[f]);
+    om_sample(fmt, name, name_len, ctx_name, NULL, stats_field_value(&table->fields[f], &sample->ctx_stats));
+  }
+
+  /* Only types that have sessions get families. */
+  memset(src_types, 0, sizeof(src_types));
+  memset(rcv_types, 0, sizeof(rcv_types));
+  for (i = 0; i < sample->src_num_entries; i++) {
+    t = stats_fields_type_index(sample->src_stats[i].type);
+    if (t >= 0) {
+      src_types[t]++;
+    }
+  }
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    t = stats_fields_type_index(sample->rcv_stats[i].type);
+    if (t >= 0) {
+      rcv_types[t]++;
+    }
+  }
+
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    int type = stats_fields_type_from_index(t);
+    table = stats_fields_src_table(field_set, type);
+    if (src_types[t] == 0 || table == NULL) {
+      continue;
+    }
+    for (f = 0; f < table->num_fields; f++) {
+      name_len = om_family(fmt, name, sizeof(name), "src", stats_fields_type_name(type), &table->fields[f]);
+      for (i = 0; i < sample->src_num_entries; i++) {
+        if (sample->src_stats[i].type == type) {
+          om_sample(fmt, name, name_len, ctx_name, sample->src_stats[i].source,
+              stats_field_value(&table->fields[f], &sample->src_stats[i]));
+        }
+      }
+    }
+  }
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    int type = stats_fields_type_from_index(t);
+    table = stats_fields_rcv_table(field_set, type);
+    if (rcv_types[t] == 0 || table == NULL) {
+      continue;
+    }
+    for (f = 0; f < table->num_fields; f++) {
+      name_len = om_family(fmt, name, sizeof(name), "rcv", stats_fields_type_name(type), &table->fields[f]);
+      for (i = 0; i < sample->rcv_num_entries; i++) {
+        if (sample->rcv_stats[i].type == type) {
+          om_sample(fmt, name, name_len, ctx_name, sample->rcv_stats[i].source,
+              stats_field_value(&table->fields[f], &sample->rcv_stats[i]));
+        }
+      }
+    }
+  }
+
+  STATS_FMT_LIT(fmt, "# EOF\n");
+}  /* stats_fmt_openmetrics */
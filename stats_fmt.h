@@ -0,0 +1,66 @@
+/* stats_fmt.h - formats samples into text without printf.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_FMT_H
+#define STATS_FMT_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats_sample.h"
+#include "stats_thread.h"
+
+
+/* Growable text buffer. Allocate it once and reuse it (set len to 0); it
+ * only grows, so formatting stops allocating once it is big enough. */
+struct stats_fmt_s {
+  char *buf;
+  size_t len;
+  size_t size;
+};
+typedef struct stats_fmt_s stats_fmt_t;
+
+/* Append a string literal (its length is known at compile time). */
+#define STATS_FMT_LIT(fmt_, lit_) stats_fmt_mem((fmt_), (lit_), sizeof(lit_) - 1)
+
+
+stats_fmt_t *stats_fmt_create(size_t size);
+void stats_fmt_delete(stats_fmt_t *fmt);
+void stats_fmt_reserve(stats_fmt_t *fmt, size_t len);
+void stats_fmt_mem(stats_fmt_t *fmt, const char *mem, size_t len);
+void stats_fmt_str(stats_fmt_t *fmt, const char *str);
+void stats_fmt_ulong(stats_fmt_t *fmt, uint64_t val);
+void stats_fmt_fixed2(stats_fmt_t *fmt, double val);
+void stats_fmt_printf(stats_fmt_t *fmt, const char *format, ...);
+/* Format a whole sample (all lines) for the stats_thread. */
+void stats_fmt_sample(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const stats_sample_t *sample);
+/* Format a sample's current values as OpenMetrics text (see stats_scrape.h). */
+void stats_fmt_openmetrics(stats_fmt_t *fmt, const stats_thread_t *stats_thread, const stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_FMT_H */
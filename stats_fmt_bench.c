@@ -0,0 +1,374 @@
+/* stats_fmt_bench.c - compares stats_fmt with the original printf output path.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+/* Builds synthetic samples (no UM context needed) with 10, 1000, and
+ * 10000 transport sessions, checks that both paths produce the same bytes,
+ * then times them. Output goes to /dev/null.
+ *   ./stats_fmt_bench [iterations_scale]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_sample.h"
+#include "stats_thread.h"
+#include "stats_fmt.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* now_ns */
+
+
+/* Counter values of varied magnitude, like a long-running process. */
+static lbm_ulong_t rand_counter(void)
+{
+  static const lbm_ulong_t limits[] = { 10, 1000, 100000, 10000000, 4000000000UL };
+  return ((lbm_ulong_t)rand() * RAND_MAX + rand()) % limits[rand() % 5];
+}  /* rand_counter */
+
+
+static void fill_counters(void *stats, size_t len)
+{
+  lbm_ulong_t *p = (lbm_ulong_t *)stats;
+  size_t i;
+  for (i = 0; i < len / sizeof(lbm_ulong_t); i++) {
+    p[i] = rand_counter();
+  }
+}  /* fill_counters */
+
+
+static void build_sample(stats_sample_t *sample, int num_sessions, int deltas)
+{
+  static const int types[] = { LBM_TRANSPORT_STAT_LBTRM, LBM_TRANSPORT_STAT_LBTRU, LBM_TRANSPORT_STAT_TCP,
+      LBM_TRANSPORT_STAT_LBTIPC, LBM_TRANSPORT_STAT_LBTSMX };
+  int num_src = num_sessions / 2;
+  int num_rcv = num_sessions - num_src;
+  int i, f;
+
+  stats_sample_reserve(sample, num_src, num_rcv);
+  sample->seq = 1;
+  sample->interval_ns = 1000000000 + (rand() % 1000000);
+  sample->have_deltas = deltas;
+  fill_counters(&sample->ctx_stats, sizeof(sample->ctx_stats));
+  for (f = 0; f < STATS_MAX_FIELDS; f++) {
+    sample->ctx_deltas[f] = rand_counter();
+  }
+
+  sample->src_num_entries = num_src;
+  for (i = 0; i < num_src; i++) {
+    memset(&sample->src_stats[i], 0, sizeof(sample->src_stats[i]));
+    sample->src_stats[i].type = types[i % 5];
+    sprintf(sample->src_stats[i].source, "LBTRM:10.29.%d.%d:14400:%08x:239.101.3.%d:12090",
+        (i / 256) % 256, i % 256, i * 7919, i % 250);
+    fill_counters(&sample->src_stats[i].transport, sizeof(sample->src_stats[i].transport));
+    sample->src_deltas[i].status = "cont";
+    for (f = 0; f < STATS_MAX_FIELDS; f++) {
+      sample->src_deltas[i].deltas[f] = rand_counter();
+    }
+  }
+
+  sample->rcv_num_entries = num_rcv;
+  for (i = 0; i < num_rcv; i++) {
+    memset(&sample->rcv_stats[i], 0, sizeof(sample->rcv_stats[i]));
+    sample->rcv_stats[i].type = types[i % 5];
+    sprintf(sample->rcv_stats[i].source, "LBTRM:10.29.%d.%d:14400:%08x:239.101.3.%d:12090",
+        (i / 256) % 256, i % 256, i * 104729, i % 250);
+    fill_counters(&sample->rcv_stats[i].transport, sizeof(sample->rcv_stats[i].transport));
+    sample->rcv_deltas[i].status = "cont";
+    for (f = 0; f < STATS_MAX_FIELDS; f++) {
+      sample->rcv_deltas[i].deltas[f] = rand_counter();
+    }
+  }
+}  /* build_sample */
+
+
+/* The original output path: one fprintf() per line (stdout in mon_self). */
+static void printf_deltas(FILE *fp, const char *ctx_name, const char *label, const char *source,
+    const char *status, uint64_t interval_ns, const stats_field_t *fields, int num_fields,
+    const lbm_ulong_t *deltas)
+{
+  double interval_sec = (double)interval_ns / 1000000000.0;
+  int f;
+
+  fprintf(fp, "ctx_name='%s', %s/delta:", ctx_name, label);
+  if (source != NULL) {
+    fprintf(fp, " source=%s, status=%s,", source, status);
+  }
+  fprintf(fp, " interval_ms=%lu", (unsigned long)(interval_ns / 1000000));
+  for (f = 0; f < num_fields; f++) {
+    fprintf(fp, ", %s=%lu (%.2f/s)", fields[f].name, deltas[f], (double)deltas[f] / interval_sec);
+  }
+  fprintf(fp, "\n");
+}  /* printf_deltas */
+
+
+static void printf_sample(FILE *fp, const char *ctx_name, const stats_sample_t *sample)
+{
+  const stats_field_t *fields;
+  int num_fields;
+  int i;
+  char label[32];
+
+  {
+    const lbm_context_stats_t *ctx_stats = &sample->ctx_stats;
+    unsigned long tr_drops = ctx_stats->tr_dgrams_dropped_ver + ctx_stats->tr_dgrams_dropped_type
+                             + ctx_stats->tr_dgrams_dropped_malformed;
+    fprintf(fp, "ctx_name='%s', context: tr_dgrams_sent=%lu, tr_dgrams_rcved=%lu, tr_drops=%lu"
+           ", tr_src_topics=%lu, tr_rcv_topics=%lu, tr_rcv_unresolved_topics=%lu"
+           ", lbtrm_unknown_msgs_rcved=%lu, lbtru_unknown_msgs_rcved=%lu"
+           ", send_blocked=%lu, send_would_block=%lu, fragments_unrecoverably_lost=%lu"
+           "\n",
+           ctx_name, ctx_stats->tr_dgrams_sent, ctx_stats->tr_dgrams_rcved, tr_drops,
+           ctx_stats->tr_src_topics, ctx_stats->tr_rcv_topics, ctx_stats->tr_rcv_unresolved_topics,
+           ctx_stats->lbtrm_unknown_msgs_rcved, ctx_stats->lbtru_unknown_msgs_rcved,
+           ctx_stats->send_blocked, ctx_stats->send_would_block, ctx_stats->fragments_unrecoverably_lost
+    );
+    if (sample->have_deltas) {
+      fields = stats_fields_ctx(&num_fields);
+      printf_deltas(fp, ctx_name, "context", NULL, NULL, sample->interval_ns, fields, num_fields, sample->ctx_deltas);
+    }
+  }
+
+  for (i = 0; i < sample->src_num_entries; i++) {
+    const lbm_src_transport_stats_t *s = &sample->src_stats[i];
+    switch (s->type) {
+      case LBM_TRANSPORT_STAT_LBTRM:
+        fprintf(fp, "ctx_name='%s', src/lbtrm: source=%s, msgs_sent=%lu, naks_rcved=%lu"
+            ", naks_ignored=%lu, naks_shed=%lu, naks_rx_delay_ignored=%lu, rxs_sent=%lu\n",
+            ctx_name, s->source, s->transport.lbtrm.msgs_sent, s->transport.lbtrm.naks_rcved,
+            s->transport.lbtrm.naks_ignored, s->transport.lbtrm.naks_shed,
+            s->transport.lbtrm.naks_rx_delay_ignored, s->transport.lbtrm.rxs_sent);
+        break;
+      case LBM_TRANSPORT_STAT_LBTRU:
+        fprintf(fp, "ctx_name='%s', src/lbtru: source=%s, msgs_sent=%lu, naks_rcved=%lu"
+            ", naks_ignored=%lu, naks_shed=%lu, naks_rx_delay_ignored=%lu, rxs_sent=%lu\n",
+            ctx_name, s->source, s->transport.lbtru.msgs_sent, s->transport.lbtru.naks_rcved,
+            s->transport.lbtru.naks_ignored, s->transport.lbtru.naks_shed,
+            s->transport.lbtru.naks_rx_delay_ignored, s->transport.lbtru.rxs_sent);
+        break;
+      case LBM_TRANSPORT_STAT_TCP:
+        fprintf(fp, "ctx_name='%s', src/tcp: source=%s, num_clients=%lu\n",
+            ctx_name, s->source, s->transport.tcp.num_clients);
+        break;
+      case LBM_TRANSPORT_STAT_LBTIPC:
+        fprintf(fp, "ctx_name='%s', src/lbtipc: source=%s, num_clients=%lu, msgs_sent=%lu\n",
+            ctx_name, s->source, s->transport.lbtipc.num_clients, s->transport.lbtipc.msgs_sent);
+        break;
+      case LBM_TRANSPORT_STAT_LBTSMX:
+        fprintf(fp, "ctx_name='%s', src/lbtsmx: source=%s, num_clients=%lu, msgs_sent=%lu\n",
+            ctx_name, s->source, s->transport.lbtsmx.num_clients, s->transport.lbtsmx.msgs_sent);
+        break;
+    }
+    fields = stats_fields_src(s->type, &num_fields);
+    if (sample->have_deltas && num_fields > 0) {
+      sprintf(label, "src/%s", stats_fields_type_name(s->type));
+      printf_deltas(fp, ctx_name, label, s->source, sample->src_deltas[i].status, sample->interval_ns,
+          fields, num_fields, sample->src_deltas[i].deltas);
+    }
+  }
+
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    const lbm_rcv_transport_stats_t *r = &sample->rcv_stats[i];
+    switch (r->type) {
+      case LBM_TRANSPORT_STAT_LBTRM: {
+        const lbm_rcv_transport_stats_lbtrm_t *stats = &r->transport.lbtrm;
+        unsigned long drops = stats->dgrams_dropped_size + stats->dgrams_dropped_type + stats->dgrams_dropped_version
+                              + stats->dgrams_dropped_hdr + stats->dgrams_dropped_other;
+        fprintf(fp, "ctx_name='%s', rcv/lbtrm: source=%s, msgs_rcved=%lu, naks_sent=%lu"
+               ", lost=%lu, unrecovered_txw=%lu, unrecovered_tmo=%lu, lbm_msgs_rcved=%lu"
+               ", lbm_msgs_no_topic_rcved=%lu, drops=%lu, out_of_order=%lu\n",
+               ctx_name, r->source, stats->msgs_rcved, stats->naks_sent,
+               stats->lost, stats->unrecovered_txw, stats->unrecovered_tmo, stats->lbm_msgs_rcved,
+               stats->lbm_msgs_no_topic_rcved, drops, stats->out_of_order);
+        break;
+      }
+      case LBM_TRANSPORT_STAT_LBTRU: {
+        const lbm_rcv_transport_stats_lbtru_t *stats = &r->transport.lbtru;
+        unsigned long drops = stats->dgrams_dropped_size + stats->dgrams_dropped_type + stats->dgrams_dropped_version
+                              + stats->dgrams_dropped_hdr + stats->dgrams_dropped_sid + stats->dgrams_dropped_other;
+        fprintf(fp, "ctx_name='%s', rcv/lbtru: source=%s, msgs_rcved=%lu, naks_sent=%lu"
+               ", lost=%lu, unrecovered_txw=%lu, unrecovered_tmo=%lu, lbm_msgs_rcved=%lu"
+               ", lbm_msgs_no_topic_rcved=%lu, drops=%lu\n",
+               ctx_name, r->source, stats->msgs_rcved, stats->naks_sent,
+               stats->lost, stats->unrecovered_txw, stats->unrecovered_tmo, stats->lbm_msgs_rcved,
+               stats->lbm_msgs_no_topic_rcved, drops);
+        break;
+      }
+      case LBM_TRANSPORT_STAT_TCP:
+        fprintf(fp, "ctx_name='%s', rcv/tcp: source=%s, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu\n",
+            ctx_name, r->source, r->transport.tcp.lbm_msgs_rcved, r->transport.tcp.lbm_msgs_no_topic_rcved);
+        break;
+      case LBM_TRANSPORT_STAT_LBTIPC:
+        fprintf(fp, "ctx_name='%s', rcv/lbtipc: source=%s, msgs_rcved=%lu, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu\n",
+            ctx_name, r->source, r->transport.lbtipc.msgs_rcved, r->transport.lbtipc.lbm_msgs_rcved,
+            r->transport.lbtipc.lbm_msgs_no_topic_rcved);
+        break;
+      case LBM_TRANSPORT_STAT_LBTSMX:
+        fprintf(fp, "ctx_name='%s', rcv/lbtsmx: source=%s, msgs_rcved=%lu, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu\n",
+            ctx_name, r->source, r->transport.lbtsmx.msgs_rcved, r->transport.lbtsmx.lbm_msgs_rcved,
+            r->transport.lbtsmx.lbm_msgs_no_topic_rcved);
+        break;
+    }
+    fields = stats_fields_rcv(r->type, &num_fields);
+    if (sample->have_deltas && num_fields > 0) {
+      sprintf(label, "rcv/%s", stats_fields_type_name(r->type));
+      printf_deltas(fp, ctx_name, label, r->source, sample->rcv_deltas[i].status, sample->interval_ns,
+          fields, num_fields, sample->rcv_deltas[i].deltas);
+    }
+  }
+}  /* printf_sample */
+
+
+/* Both paths must produce the same bytes. */
+static void check_identical(stats_thread_t *stats_thread, stats_sample_t *sample, stats_fmt_t *fmt)
+{
+  char *old_buf;
+  size_t old_len;
+  FILE *fp;
+
+  ENL(fp = open_memstream(&old_buf, &old_len));
+  printf_sample(fp, stats_thread->ctx_name, sample);
+  fclose(fp);
+
+  fmt->len = 0;
+  stats_fmt_sample(fmt, stats_thread, sample);
+  if (fmt->len != old_len || memcmp(fmt->buf, old_buf, old_len) != 0) {
+    size_t i = 0;
+    while (i < old_len && i < fmt->len && old_buf[i] == fmt->buf[i]) {
+      i++;
+    }
+    fprintf(stderr, "ERROR: output differs at byte %lu (printf len=%lu, stats_fmt len=%lu)\n",
+        (unsigned long)i, (unsigned long)old_len, (unsigned long)fmt->len);
+    exit(1);
+  }
+  free(old_buf);
+}  /* check_identical */
+
+
+static void bench(int num_sessions, int deltas, int iterations)
+{
+  stats_thread_t stats_thread;
+  stats_sample_t sample;
+  stats_fmt_t *fmt;
+  FILE *line_fp, *full_fp;
+  int null_fd, i;
+  uint64_t start, line_ns, full_ns, fmt_ns;
+
+  memset(&stats_thread, 0, sizeof(stats_thread));
+  stats_thread.ctx_name = "bench";
+  stats_sample_init(&sample);
+  build_sample(&sample, num_sessions, deltas);
+  fmt = stats_fmt_create(64 * 1024);
+  check_identical(&stats_thread, &sample, fmt);
+
+  /* A terminal makes stdout line buffered: one write(2) per line. */
+  ENL(line_fp = fopen("/dev/null", "w"));
+  setvbuf(line_fp, NULL, _IOLBF, BUFSIZ);
+  ENL(full_fp = fopen("/dev/null", "w"));
+  null_fd = open("/dev/null", O_WRONLY);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    printf_sample(line_fp, stats_thread.ctx_name, &sample);
+  }
+  line_ns = (now_ns() - start) / iterations;
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    printf_sample(full_fp, stats_thread.ctx_name, &sample);
+    fflush(full_fp);
+  }
+  full_ns = (now_ns() - start) / iterations;
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    fmt->len = 0;
+    stats_fmt_sample(fmt, &stats_thread, &sample);
+    if (write(null_fd, fmt->buf, fmt->len) < 0) {
+      perror("write");
+    }
+  }
+  fmt_ns = (now_ns() - start) / iterations;
+
+  printf("sessions=%5d deltas=%d bytes=%8lu  printf_line_buffered=%9lu ns  printf_fully_buffered=%9lu ns"
+      "  stats_fmt=%9lu ns  speedup=%.1fx/%.1fx\n",
+      num_sessions, deltas, (unsigned long)fmt->len, (unsigned long)line_ns, (unsigned long)full_ns,
+      (unsigned long)fmt_ns, (double)line_ns / (double)fmt_ns, (double)full_ns / (double)fmt_ns);
+
+  close(null_fd);
+  fclose(full_fp);
+  fclose(line_fp);
+  stats_fmt_delete(fmt);
+  stats_sample_free(&sample);
+}  /* bench */
+
+
+int main(int argc, char **argv)
+{
+  static const int session_counts[] = { 10, 1000, 10000 };
+  int scale = 1;
+  int c, deltas;
+
+  if (argc > 1) {
+    scale = atoi(argv[1]);
+    if (scale < 1) {
+      fprintf(stderr, "Usage: stats_fmt_bench [iterations_scale]\n");
+      exit(1);
+    }
+  }
+
+  srand(1);
+  for (deltas = 0; deltas <= 1; deltas++) {
+    for (c = 0; c < 3; c++) {
+      /* About the same number of lines per run at each size. */
+      bench(session_counts[c], deltas, scale * 200000 / (session_counts[c] + 10) + 1);
+    }
+  }
+
+  return 0;
+}  /* main */
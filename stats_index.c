@@ -0,0 +1,224 @@
+/* stats_index.c - hashed index of transport sessions, keyed by source string.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_index.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define MIN_CAPACITY 64
+
+/* Marks a slot whose session was removed; probes must continue past it. */
+static stats_session_t tombstone;
+#define TOMBSTONE (&tombstone)
+
+
+/* FNV-1a, 64-bit. Source strings share long prefixes ("LBTRM:10.1.2.3:..."),
+ * so a hash that mixes every byte matters more than raw speed. Also stored
+ * in archive segments (see stats_archive.h), so don't change it. */
+uint64_t stats_index_hash(const char *source)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  const unsigned char *p = (const unsigned char *)source;
+
+  while (*p != '\0') {
+    hash ^= *p++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}  /* stats_index_hash */
+
+
+/* Rebuild the table at a new capacity, discarding tombstones. */
+static void index_rehash(stats_index_t *index, uint64_t new_capacity)
+{
+  stats_index_slot_t *old_slots = index->slots;
+  uint64_t old_capacity = index->capacity;
+  uint64_t mask = new_capacity - 1;
+  uint64_t i;
+
+  ENL(index->slots = (stats_index_slot_t *)calloc(new_capacity, sizeof(stats_index_slot_t)));
+  index->capacity = new_capacity;
+  index->num_tombstones = 0;
+
+  for (i = 0; i < old_capacity; i++) {
+    stats_session_t *session = old_slots[i].session;
+    if (session != NULL && session != TOMBSTONE) {
+      uint64_t s = old_slots[i].hash & mask;
+      while (index->slots[s].session != NULL) {
+        s = (s + 1) & mask;
+      }
+      index->slots[s] = old_slots[i];
+    }
+  }
+
+  free(old_slots);
+}  /* index_rehash */
+
+
+stats_index_t *stats_index_create(void)
+{
+  stats_index_t *index;
+
+  ENL(index = (stats_index_t *)malloc(sizeof(stats_index_t)));
+  index->capacity = MIN_CAPACITY;
+  ENL(index->slots = (stats_index_slot_t *)calloc(index->capacity, sizeof(stats_index_slot_t)));
+  index->num_sessions = 0;
+  index->num_tombstones = 0;
+  index->generation = 0;
+  index->free_list = NULL;
+
+  return index;
+}  /* stats_index_create */
+
+
+void stats_index_delete(stats_index_t *index)
+{
+  uint64_t i;
+
+  for (i = 0; i < index->capacity; i++) {
+    stats_session_t *session = index->slots[i].session;
+    if (session != NULL && session != TOMBSTONE) {
+      free(session);
+    }
+  }
+  while (index->free_list != NULL) {
+    stats_session_t *session = index->free_list;
+    index->free_list = session->next_free;
+    free(session);
+  }
+  free(index->slots);
+  free(index);
+}  /* stats_index_delete */
+
+
+/* Call once per sample, before any stats_index_find_or_add(). */
+void stats_index_begin_sample(stats_index_t *index)
+{
+  index->generation++;
+}  /* stats_index_begin_sample */
+
+
+/* Returns the session for "source", creating it if needed. Either way, the
+ * session is marked as seen in the current sample. */
+stats_session_t *stats_index_find_or_add(stats_index_t *index, const char *source, int *is_new)
+{
+  uint64_t hash = stats_index_hash(source);
+  uint64_t mask, s;
+  stats_index_slot_t *reuse = NULL;
+  stats_session_t *session;
+
+  /* Keep load (including tombstones) at or under 1/2 so probes stay short. */
+  if ((index->num_sessions + index->num_tombstones + 1) * 2 > index->capacity) {
+    uint64_t new_capacity = MIN_CAPACITY;
+    while (new_capacity < (index->num_sessions + 1) * 4) {
+      new_capacity *= 2;
+    }
+    index_rehash(index, new_capacity);
+  }
+
+  mask = index->capacity - 1;
+  for (s = hash & mask; index->slots[s].session != NULL; s = (s + 1) & mask) {
+    session = index->slots[s].session;
+    if (session == TOMBSTONE) {
+      if (reuse == NULL) {
+        reuse = &index->slots[s];
+      }
+    }
+    else if (index->slots[s].hash == hash && strcmp(session->source, source) == 0) {
+      session->generation = index->generation;
+      *is_new = 0;
+      return session;
+    }
+  }
+
+  /* Not found; add it. */
+  if (reuse == NULL) {
+    reuse = &index->slots[s];
+  } else {
+    index->num_tombstones--;
+  }
+  if (index->free_list != NULL) {
+    session = index->free_list;
+    index->free_list = session->next_free;
+  } else {
+    ENL(session = (stats_session_t *)malloc(sizeof(stats_session_t)));
+  }
+  strncpy(session->source, source, sizeof(session->source) - 1);
+  session->source[sizeof(session->source) - 1] = '\0';
+  session->type = 0;
+  session->generation = index->generation;
+  session->row = -1;
+  session->digest = 0;
+  session->next_free = NULL;
+
+  reuse->hash = hash;
+  reuse->session = session;
+  index->num_sessions++;
+
+  *is_new = 1;
+  return session;
+}  /* stats_index_find_or_add */
+
+
+/* Remove every session that was not seen in the current sample, calling
+ * "cb" (if not NULL) for each. Returns the number removed. */
+int stats_index_sweep(stats_index_t *index, stats_index_sweep_cb cb, void *clientd)
+{
+  uint64_t i;
+  int removed = 0;
+
+  for (i = 0; i < index->capacity; i++) {
+    stats_session_t *session = index->slots[i].session;
+    if (session != NULL && session != TOMBSTONE && session->generation != index->generation) {
+      if (cb != NULL) {
+        (*cb)(session, clientd);
+      }
+      index->slots[i].session = TOMBSTONE;
+      session->next_free = index->free_list;
+      index->free_list = session;
+      index->num_sessions--;
+      index->num_tombstones++;
+      removed++;
+    }
+  }
+
+  return removed;
+}  /* stats_index_sweep */
@@ -0,0 +1,81 @@
+/* stats_index.h - hashed index of transport sessions, keyed by source string.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_INDEX_H
+#define STATS_INDEX_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_source.h"
+
+
+/* Per-transport-session state remembered between samples. */
+struct stats_session_s {
+  char source[LBM_MSG_MAX_SOURCE_LEN];
+  int type;  /* LBM_TRANSPORT_STAT_... */
+  uint64_t generation;  /* Sample in which this session was last seen. */
+  int row;  /* In the stats_store column group for "type"; -1=none. */
+  uint64_t digest;  /* Of the session's previous stats, for changes_only. */
+  stats_source_info_t info;  /* "source" parsed; redone only if the type changes. */
+  struct stats_session_s *next_free;
+};
+typedef struct stats_session_s stats_session_t;
+
+/* Open-addressing (linear probe) hash table. The full hash is kept in the
+ * slot so that most probes never touch the session itself. */
+struct stats_index_slot_s {
+  uint64_t hash;
+  stats_session_t *session;  /* NULL=empty. */
+};
+typedef struct stats_index_slot_s stats_index_slot_t;
+
+struct stats_index_s {
+  stats_index_slot_t *slots;
+  uint64_t capacity;  /* Always a power of 2. */
+  uint64_t num_sessions;
+  uint64_t num_tombstones;
+  uint64_t generation;
+  stats_session_t *free_list;
+};
+typedef struct stats_index_s stats_index_t;
+
+/* Called by stats_index_sweep() for each session just before it is removed. */
+typedef void (*stats_index_sweep_cb)(stats_session_t *session, void *clientd);
+
+
+uint64_t stats_index_hash(const char *source);
+stats_index_t *stats_index_create(void);
+void stats_index_delete(stats_index_t *index);
+void stats_index_begin_sample(stats_index_t *index);
+stats_session_t *stats_index_find_or_add(stats_index_t *index, const char *source, int *is_new);
+int stats_index_sweep(stats_index_t *index, stats_index_sweep_cb cb, void *clientd);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_INDEX_H */
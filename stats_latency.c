@@ -0,0 +1,259 @@
+/* stats_latency.c - receive-path latency histograms, recorded per thread.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "stats_latency.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define SUB_BUCKETS (1 << STATS_LATENCY_SUB_BITS)
+
+
+stats_latency_t *stats_latency_create(void)
+{
+  stats_latency_t *latency;
+
+  ENL(latency = (stats_latency_t *)calloc(1, sizeof(stats_latency_t)));
+  ENZ(errno = pthread_key_create(&latency->key, NULL));
+  ENZ(errno = pthread_mutex_init(&latency->lock, NULL));
+  latency->threads = NULL;
+
+  return latency;
+}  /* stats_latency_create */
+
+
+/* Only once nobody records any more and the stats_thread is deleted. */
+void stats_latency_delete(stats_latency_t *latency)
+{
+  while (latency->threads != NULL) {
+    stats_latency_thread_t *thread = latency->threads;
+    latency->threads = thread->next;
+    free(thread);
+  }
+  pthread_key_delete(latency->key);
+  pthread_mutex_destroy(&latency->lock);
+  free(latency);
+}  /* stats_latency_delete */
+
+
+/* CLOCK_MONOTONIC, for timing a callback. */
+uint64_t stats_latency_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}  /* stats_latency_now_ns */
+
+
+/* CLOCK_REALTIME, for a timestamp that a sender embeds in a message (the
+ * hosts' clocks must be synchronized for end-to-end latency to mean much). */
+uint64_t stats_latency_realtime_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}  /* stats_latency_realtime_ns */
+
+
+/* Histogram bucket of a value (also used by stats_send.c). */
+int stats_latency_bucket(uint64_t ns)
+{
+  int exponent;
+
+  if (ns < SUB_BUCKETS) {
+    return (int)ns;
+  }
+  exponent = 63 - __builtin_clzll(ns);
+  if (exponent >= STATS_LATENCY_MAX_BITS) {
+    return STATS_LATENCY_NUM_BUCKETS - 1;
+  }
+  return ((exponent - STATS_LATENCY_SUB_BITS + 1) << STATS_LATENCY_SUB_BITS)
+         + (int)((ns >> (exponent - STATS_LATENCY_SUB_BITS)) & (SUB_BUCKETS - 1));
+}  /* stats_latency_bucket */
+
+
+/* Lowest value in the bucket, and its width. */
+static uint64_t bucket_low(int bucket, uint64_t *width)
+{
+  int shift;
+
+  if (bucket < SUB_BUCKETS) {
+    *width = 1;
+    return (uint64_t)bucket;
+  }
+  shift = (bucket >> STATS_LATENCY_SUB_BITS) - 1;
+  *width = (uint64_t)1 << shift;
+  return (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}  /* bucket_low */
+
+
+/* The calling thread's histograms, created the first time. */
+static stats_latency_thread_t *this_thread(stats_latency_t *latency)
+{
+  stats_latency_thread_t *thread = (stats_latency_thread_t *)pthread_getspecific(latency->key);
+
+  if (thread == NULL) {
+    ENL(thread = (stats_latency_thread_t *)calloc(1, sizeof(stats_latency_thread_t)));
+    ENZ(errno = pthread_setspecific(latency->key, thread));
+    ENZ(errno = pthread_mutex_lock(&latency->lock));
+    thread->next = latency->threads;
+    /* The collector walks the list without the lock. */
+    __atomic_store_n(&latency->threads, thread, __ATOMIC_RELEASE);
+    ENZ(errno = pthread_mutex_unlock(&latency->lock));
+  }
+  return thread;
+}  /* this_thread */
+
+
+/* Add to a counter that only the calling thread writes (also used by
+ * stats_send.c). Single writer, so a plain increment; the atomic load and
+ * store only keep the collector from reading a torn value. */
+void stats_latency_add(uint64_t *counter, uint64_t val)
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}  /* stats_latency_add */
+
+
+/* Record one measurement for a transport type (LBM_TRANSPORT_STAT_...;
+ * unknown types are ignored) and metric (STATS_LATENCY_...). Any thread. */
+void stats_latency_record(stats_latency_t *latency, int type, int metric, uint64_t ns)
+{
+  stats_latency_thread_t *thread;
+  int t = stats_fields_type_index(type);
+
+  if (t < 0 || metric < 0 || metric >= STATS_LATENCY_NUM_METRICS) {
+    return;
+  }
+  thread = this_thread(latency);
+  stats_latency_add(&thread->counts[t][metric][stats_latency_bucket(ns)], 1);
+  stats_latency_add(&thread->sum_ns[t][metric], ns);
+}  /* stats_latency_record */
+
+
+/* Value at which "rank" (1-based) of the interval's counts is reached. */
+static uint64_t percentile(const uint64_t *counts, uint64_t rank)
+{
+  uint64_t seen = 0;
+  int b;
+
+  for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+    seen += counts[b];
+    if (seen >= rank) {
+      uint64_t width;
+      uint64_t low = bucket_low(b, &width);
+      return low + (width - 1) / 2;  /* Middle of the bucket. */
+    }
+  }
+  return 0;
+}  /* percentile */
+
+
+/* Fill in a summary from one interval's bucket counts and sum. */
+void stats_latency_summarize(const uint64_t *counts, uint64_t sum_ns, stats_latency_summary_t *summary)
+{
+  int b;
+
+  memset(summary, 0, sizeof(*summary));
+  for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+    summary->count += counts[b];
+    if (counts[b] > 0) {
+      uint64_t width;
+      summary->max_ns = bucket_low(b, &width) + width - 1;
+    }
+  }
+  if (summary->count > 0) {
+    summary->mean_ns = sum_ns / summary->count;
+    summary->p50_ns = percentile(counts, (summary->count * 50 + 99) / 100);
+    summary->p90_ns = percentile(counts, (summary->count * 90 + 99) / 100);
+    summary->p99_ns = percentile(counts, (summary->count * 99 + 99) / 100);
+    summary->p999_ns = percentile(counts, (summary->count * 999 + 999) / 1000);
+  }
+}  /* stats_latency_summarize */
+
+
+/* Summarize everything recorded since the previous call. Called by the
+ * stats_thread for each output sample. */
+void stats_latency_collect(stats_latency_t *latency,
+    stats_latency_summary_t summaries[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS])
+{
+  stats_latency_thread_t *threads = __atomic_load_n(&latency->threads, __ATOMIC_ACQUIRE);
+  int t, m, b;
+
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    for (m = 0; m < STATS_LATENCY_NUM_METRICS; m++) {
+      uint64_t counts[STATS_LATENCY_NUM_BUCKETS];
+      uint64_t sum_ns = 0;
+      stats_latency_thread_t *thread;
+
+      memset(counts, 0, sizeof(counts));
+      for (thread = threads; thread != NULL; thread = thread->next) {
+        sum_ns += __atomic_load_n(&thread->sum_ns[t][m], __ATOMIC_RELAXED);
+        for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+          counts[b] += __atomic_load_n(&thread->counts[t][m][b], __ATOMIC_RELAXED);
+        }
+      }
+
+      /* A recording that lands in between the reads of its bucket and of
+       * the sum is just counted in the next interval. */
+      for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+        uint64_t cur = counts[b];
+        counts[b] = cur - latency->prev_counts[t][m][b];
+        latency->prev_counts[t][m][b] = cur;
+      }
+      stats_latency_summarize(counts, sum_ns - latency->prev_sum_ns[t][m], &summaries[t][m]);
+      latency->prev_sum_ns[t][m] = sum_ns;
+    }
+  }
+}  /* stats_latency_collect */
@@ -0,0 +1,102 @@
+/* stats_latency.h - receive-path latency histograms, recorded per thread.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_LATENCY_H
+#define STATS_LATENCY_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <pthread.h>
+#include "stats_fields.h"
+
+/* Each thread that records gets its own histograms (one per transport type
+ * and metric), allocated the first time it records. After that, recording
+ * is a bucket lookup and two single-writer increments: no locks, atomic
+ * read-modify-writes, or allocation. The counts only ever increase; at
+ * each output sample the stats_thread sums every thread's histograms and
+ * subtracts the previous sums, the same way as for the transport counters,
+ * so recording threads are never stopped or reset.
+ *
+ * Buckets are log-linear (like HdrHistogram): values below
+ * 2^STATS_LATENCY_SUB_BITS nanoseconds are exact, and each power of 2 above
+ * that is split into 2^STATS_LATENCY_SUB_BITS buckets, so percentiles are
+ * within about 6%. Values of 2^40 ns (about 18 minutes) or more all land in
+ * the last bucket. Each thread's histograms take about 24 KB. */
+#define STATS_LATENCY_CALLBACK 0  /* Time spent in the receiver callback. */
+#define STATS_LATENCY_E2E 1  /* From the sender's timestamp to delivery. */
+#define STATS_LATENCY_NUM_METRICS 2
+#define STATS_LATENCY_SUB_BITS 3
+#define STATS_LATENCY_MAX_BITS 40
+#define STATS_LATENCY_NUM_BUCKETS ((STATS_LATENCY_MAX_BITS - STATS_LATENCY_SUB_BITS + 1) << STATS_LATENCY_SUB_BITS)
+
+/* One recording thread's histograms; only that thread writes them. */
+struct stats_latency_thread_s {
+  uint64_t sum_ns[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS];
+  uint64_t counts[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS][STATS_LATENCY_NUM_BUCKETS];
+  struct stats_latency_thread_s *next;
+};
+typedef struct stats_latency_thread_s stats_latency_thread_t;
+
+/* Shared by the recording threads and one stats_thread (see the "latency"
+ * config field). */
+struct stats_latency_s {
+  pthread_key_t key;  /* The calling thread's stats_latency_thread_t. */
+  pthread_mutex_t lock;  /* Only taken when a thread records for the first time. */
+  stats_latency_thread_t *threads;  /* Kept until stats_latency_delete(), even if the thread exits. */
+  /* Used by the collecting stats_thread only: the sums at the previous sample. */
+  uint64_t prev_sum_ns[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS];
+  uint64_t prev_counts[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS][STATS_LATENCY_NUM_BUCKETS];
+};
+typedef struct stats_latency_s stats_latency_t;
+
+/* One interval of one transport type and metric. */
+struct stats_latency_summary_s {
+  uint64_t count;
+  uint64_t mean_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;  /* Of the highest non-empty bucket. */
+};
+typedef struct stats_latency_summary_s stats_latency_summary_t;
+
+
+stats_latency_t *stats_latency_create(void);
+void stats_latency_delete(stats_latency_t *latency);
+uint64_t stats_latency_now_ns(void);
+uint64_t stats_latency_realtime_ns(void);
+void stats_latency_record(stats_latency_t *latency, int type, int metric, uint64_t ns);
+int stats_latency_bucket(uint64_t ns);
+void stats_latency_add(uint64_t *counter, uint64_t val);
+void stats_latency_summarize(const uint64_t *counts, uint64_t sum_ns, stats_latency_summary_t *summary);
+void stats_latency_collect(stats_latency_t *latency,
+    stats_latency_summary_t summaries[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS]);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_LATENCY_H */
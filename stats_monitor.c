@@ -0,0 +1,928 @@
+/* stats_monitor.c - one scheduler thread (plus one writer thread) shared by
+ * any number of stats_thread objects.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#define _GNU_SOURCE  /* For pthread_setaffinity_np(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "lbm/lbm.h"
+#include "stats_fmt.h"
+#include "stats_thread.h"
+#include "stats_monitor.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* Ready fds handled per epoll_wait(): the timer, the eventfd, and watched
+ * fds. More just wait for the next call. */
+#define MAX_EVENTS 16
+
+
+static uint64_t mono_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* mono_ns */
+
+
+static uint64_t realtime_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_REALTIME, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* realtime_ns */
+
+
+/* CLOCK_REALTIME minus CLOCK_MONOTONIC, read now (so it follows clock
+ * steps). */
+static int64_t wall_offset_ns(void)
+{
+  uint64_t mono = mono_ns();
+  uint64_t real = realtime_ns();
+
+  return (int64_t)(real - mono);
+}  /* wall_offset_ns */
+
+
+static uint64_t interval_ns(struct stats_thread_s *stats_thread)
+{
+  return stats_thread->sample_interval_ns;
+}  /* interval_ns */
+
+
+/* Van der Corput sequence (bit-reversed k, as a fraction of 2^32).
+ * Gives 0, 1/2, 1/4, 3/4, 1/8, ... so each new member lands in the middle of
+ * the largest remaining gap, without moving anybody already scheduled. */
+static double phase_fraction(uint64_t k)
+{
+  uint32_t x = (uint32_t)k;
+
+  x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+  x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+  x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+  x = (x >> 16) | (x << 16);
+  return (double)x / 4294967296.0;
+}  /* phase_fraction */
+
+
+/* First deadline on the member's phase grid strictly after "after_ns".
+ * When coordinated, the grid is the wall clock's multiples of the
+ * interval instead. */
+static uint64_t next_deadline(stats_monitor_t *monitor, struct stats_thread_s *stats_thread, uint64_t after_ns)
+{
+  uint64_t interval = interval_ns(stats_thread);
+  uint64_t base = monitor->epoch_ns + stats_thread->phase_ns;
+
+  if (monitor->config.coordinated) {
+    int64_t offset = wall_offset_ns();
+    uint64_t wall = after_ns + (uint64_t)offset;
+    return (wall / interval + 1) * interval - (uint64_t)offset;
+  }
+  if (after_ns < base) {
+    return base;
+  }
+  return base + ((after_ns - base) / interval + 1) * interval;
+}  /* next_deadline */
+
+
+/* Min-heap helpers. Each member remembers its heap position so that it can
+ * be removed in O(log n). Caller holds the lock. */
+
+static void heap_set(stats_monitor_t *monitor, int i, struct stats_thread_s *stats_thread)
+{
+  monitor->heap[i] = stats_thread;
+  stats_thread->heap_index = i;
+}  /* heap_set */
+
+
+static void heap_sift_up(stats_monitor_t *monitor, int i)
+{
+  struct stats_thread_s *stats_thread = monitor->heap[i];
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (monitor->heap[parent]->next_deadline_ns <= stats_thread->next_deadline_ns) {
+      break;
+    }
+    heap_set(monitor, i, monitor->heap[parent]);
+    i = parent;
+  }
+  heap_set(monitor, i, stats_thread);
+}  /* heap_sift_up */
+
+
+static void heap_sift_down(stats_monitor_t *monitor, int i)
+{
+  struct stats_thread_s *stats_thread = monitor->heap[i];
+
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= monitor->heap_size) {
+      break;
+    }
+    if (child + 1 < monitor->heap_size
+        && monitor->heap[child + 1]->next_deadline_ns < monitor->heap[child]->next_deadline_ns) {
+      child++;
+    }
+    if (stats_thread->next_deadline_ns <= monitor->heap[child]->next_deadline_ns) {
+      break;
+    }
+    heap_set(monitor, i, monitor->heap[child]);
+    i = child;
+  }
+  heap_set(monitor, i, stats_thread);
+}  /* heap_sift_down */
+
+
+static void heap_push(stats_monitor_t *monitor, struct stats_thread_s *stats_thread)
+{
+  heap_set(monitor, monitor->heap_size, stats_thread);
+  monitor->heap_size++;
+  heap_sift_up(monitor, monitor->heap_size - 1);
+}  /* heap_push */
+
+
+static void heap_remove(stats_monitor_t *monitor, struct stats_thread_s *stats_thread)
+{
+  int i = stats_thread->heap_index;
+
+  if (i < 0) {
+    return;  /* Not in the heap. */
+  }
+  stats_thread->heap_index = -1;
+  monitor->heap_size--;
+  if (i < monitor->heap_size) {
+    struct stats_thread_s *moved = monitor->heap[monitor->heap_size];
+    heap_set(monitor, i, moved);
+    heap_sift_up(monitor, i);
+    heap_sift_down(monitor, moved->heap_index);
+  }
+}  /* heap_remove */
+
+
+/* Wake the scheduler thread. Async-signal-safe. */
+static void wake_scheduler(stats_monitor_t *monitor)
+{
+  uint64_t one = 1;
+  ssize_t n;
+
+  do {
+    n = write(monitor->event_fd, &one, sizeof(one));
+  } while (n == -1 && errno == EINTR);
+  /* EAGAIN only means the counter is already non-zero, i.e. already woken. */
+}  /* wake_scheduler */
+
+
+/* Arm the timer for the earliest deadline (or disarm if there is none).
+ * The deadline is absolute CLOCK_MONOTONIC, so time spent sampling and
+ * formatting never accumulates as drift. Caller holds the lock. */
+static void arm_timer(stats_monitor_t *monitor)
+{
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  if (monitor->heap_size > 0) {
+    uint64_t deadline = monitor->heap[0]->next_deadline_ns;
+    its.it_value.tv_sec = deadline / 1000000000;
+    its.it_value.tv_nsec = deadline % 1000000000;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+      its.it_value.tv_nsec = 1;  /* Zero would disarm. */
+    }
+  }
+  EM1(timerfd_settime(monitor->timer_fd, TFD_TIMER_ABSTIME, &its, NULL));
+}  /* arm_timer */
+
+
+/* Apply the monitor's CPU and scheduling options to the calling thread. */
+static void apply_thread_options(stats_monitor_t *monitor)
+{
+  if (monitor->config.cpus != NULL) {
+    cpu_set_t cpu_set;
+    const char *p = monitor->config.cpus;
+
+    /* Parse a CPU list like "0,2-3". */
+    CPU_ZERO(&cpu_set);
+    while (*p != '\0') {
+      char *end;
+      long first = strtol(p, &end, 10);
+      long last = first;
+      if (end == p || first < 0) {
+        fprintf(stderr, "ERROR (%s:%d): bad cpus list '%s'\n", __FILE__, __LINE__, monitor->config.cpus);
+        exit(1);
+      }
+      p = end;
+      if (*p == '-') {
+        p++;
+        last = strtol(p, &end, 10);
+        if (end == p || last < first) {
+          fprintf(stderr, "ERROR (%s:%d): bad cpus list '%s'\n", __FILE__, __LINE__, monitor->config.cpus);
+          exit(1);
+        }
+        p = end;
+      }
+      for (; first <= last; first++) {
+        CPU_SET(first, &cpu_set);
+      }
+      if (*p == ',') {
+        p++;
+      }
+    }
+    ENZ(errno = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set));
+  }
+
+  if (monitor->config.sched_policy != SCHED_OTHER) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));  /* SCHED_BATCH and SCHED_IDLE need priority 0. */
+    ENZ(errno = pthread_setschedparam(pthread_self(), monitor->config.sched_policy, &param));
+  }
+}  /* apply_thread_options */
+
+
+/* Sample any member that asked for an immediate sample. Its regular
+ * schedule is not changed. Caller holds the lock. */
+static void sample_requested(stats_monitor_t *monitor)
+{
+  int i;
+
+  for (i = 0; i < monitor->num_members && monitor->running; i++) {
+    struct stats_thread_s *stats_thread = monitor->members[i];
+    if (stats_thread->heap_index >= 0 && __atomic_exchange_n(&stats_thread->sample_now, 0, __ATOMIC_ACQUIRE)) {
+      uint64_t interval = interval_ns(stats_thread);
+      monitor->sampling = stats_thread;
+      ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+      stats_thread_sample(stats_thread, 0);
+
+      ENZ(errno = pthread_mutex_lock(&monitor->lock));
+      monitor->sampling = NULL;
+      if (interval_ns(stats_thread) != interval) {
+        /* Burst sampling or the CPU budget changed the interval; move to the new grid. */
+        heap_remove(monitor, stats_thread);
+        stats_thread->next_deadline_ns = next_deadline(monitor, stats_thread, mono_ns());
+        heap_push(monitor, stats_thread);
+      }
+      monitor->writer_pending = 1;
+      ENZ(errno = pthread_cond_signal(&monitor->writer_cond));
+      ENZ(errno = pthread_cond_broadcast(&monitor->idle_cond));
+    }
+  }
+}  /* sample_requested */
+
+
+/* Run the callback of a watched fd, if it is still watched (an earlier
+ * callback in the same epoll_wait() batch may have unwatched it). Caller
+ * doesn't hold the lock. */
+static void call_watch(stats_monitor_t *monitor, int fd, uint32_t events)
+{
+  stats_monitor_fd_cb_t cb = NULL;
+  void *clientd = NULL;
+  int i;
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  for (i = 0; i < monitor->num_watches; i++) {
+    if (monitor->watches[i].fd == fd) {
+      cb = monitor->watches[i].cb;
+      clientd = monitor->watches[i].clientd;
+      monitor->calling = clientd;
+      break;
+    }
+  }
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+  if (cb == NULL) {
+    return;
+  }
+
+  (*cb)(clientd, fd, events);
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  monitor->calling = NULL;
+  ENZ(errno = pthread_cond_broadcast(&monitor->idle_cond));
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* call_watch */
+
+
+/* Coordinated: samples every member that is due, back-to-back, as one
+ * tick, and queues the tick for the writer. The lock is released once for
+ * the whole tick (members can't be removed meanwhile; see
+ * stats_monitor_remove()). "tick_members" is the scheduler's scratch
+ * array. Caller holds the lock. */
+static void sample_tick(stats_monitor_t *monitor, struct stats_thread_s ***tick_members, int *tick_capacity)
+{
+  uint64_t deadline = monitor->heap[0]->next_deadline_ns;
+  uint64_t now = mono_ns();
+  uint64_t first_ns = 0, last_ns = 0;
+  stats_monitor_tick_t tick;
+  int num_members = 0;
+  int i;
+
+  if (*tick_capacity < monitor->heap_size) {
+    *tick_capacity = monitor->heap_capacity;
+    ENL(*tick_members = (struct stats_thread_s **)realloc(*tick_members,
+        sizeof(struct stats_thread_s *) * *tick_capacity));
+  }
+  while (monitor->heap_size > 0 && monitor->heap[0]->next_deadline_ns <= now) {
+    struct stats_thread_s *stats_thread = monitor->heap[0];
+    heap_remove(monitor, stats_thread);
+    (*tick_members)[num_members++] = stats_thread;
+  }
+  memset(&tick, 0, sizeof(tick));
+  tick.id = ++monitor->num_ticks;
+  /* To the millisecond; the rest is the clocks' disagreement. */
+  tick.realtime_ns = (deadline + (uint64_t)wall_offset_ns() + 500000) / 1000000 * 1000000;
+  monitor->tick_busy = 1;
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+  for (i = 0; i < num_members; i++) {
+    struct stats_thread_s *stats_thread = (*tick_members)[i];
+    uint64_t num_emitted = stats_thread->num_emitted;
+    stats_thread->tick_id = tick.id;
+    stats_thread->tick_realtime_ns = tick.realtime_ns;
+
+    stats_thread_sample(stats_thread, 1);
+
+    stats_thread->tick_id = 0;
+    stats_thread->tick_realtime_ns = 0;
+    if (stats_thread->num_emitted != num_emitted) {
+      /* prev_sample_ns is now this sample's time. */
+      if (tick.num_samples == 0) {
+        first_ns = stats_thread->prev_sample_ns;
+      }
+      last_ns = stats_thread->prev_sample_ns;
+      tick.num_samples++;
+    }
+  }
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  monitor->tick_busy = 0;
+  now = mono_ns();
+  for (i = 0; i < num_members; i++) {
+    struct stats_thread_s *stats_thread = (*tick_members)[i];
+    uint64_t after = now;
+    /* As in stats_monitor_sched_run(): skip overrun deadlines. */
+    if (after < deadline + interval_ns(stats_thread) / 2) {
+      after = deadline + interval_ns(stats_thread) / 2;
+    }
+    stats_thread->next_deadline_ns = next_deadline(monitor, stats_thread, after);
+    heap_push(monitor, stats_thread);
+  }
+  if (tick.num_samples > 0) {
+    tick.lag_ns = (first_ns > deadline) ? first_ns - deadline : 0;
+    tick.spread_ns = last_ns - first_ns;
+    if (monitor->num_pending_ticks == monitor->ticks_capacity) {
+      monitor->ticks_capacity = (monitor->ticks_capacity == 0) ? 8 : monitor->ticks_capacity * 2;
+      ENL(monitor->ticks = (stats_monitor_tick_t *)realloc(monitor->ticks,
+          sizeof(stats_monitor_tick_t) * monitor->ticks_capacity));
+    }
+    monitor->ticks[monitor->num_pending_ticks++] = tick;
+  }
+  monitor->writer_pending = 1;
+  ENZ(errno = pthread_cond_signal(&monitor->writer_cond));
+  ENZ(errno = pthread_cond_broadcast(&monitor->idle_cond));
+}  /* sample_tick */
+
+
+/* Samples each member when its deadline arrives, then puts it back on the
+ * heap with its next deadline. Between deadlines, sleeps in epoll on a
+ * timerfd (the earliest deadline) and an eventfd (membership changes,
+ * "sample now" requests, and shutdown), so it wakes exactly when needed. */
+void *stats_monitor_sched_run(void *in_arg)
+{
+  stats_monitor_t *monitor = (stats_monitor_t *)in_arg;
+  struct stats_thread_s **tick_members = NULL;
+  int tick_capacity = 0;
+
+  apply_thread_options(monitor);
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  while (monitor->running) {
+    struct stats_thread_s *stats_thread;
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t now, deadline, count;
+    int num_events, e;
+
+    now = mono_ns();
+    if (monitor->heap_size > 0 && monitor->heap[0]->next_deadline_ns <= now && monitor->config.coordinated) {
+      sample_tick(monitor, &tick_members, &tick_capacity);
+      continue;
+    }
+    if (monitor->heap_size > 0 && monitor->heap[0]->next_deadline_ns <= now) {
+      stats_thread = monitor->heap[0];
+      deadline = stats_thread->next_deadline_ns;
+      heap_remove(monitor, stats_thread);
+      monitor->sampling = stats_thread;
+      ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+      stats_thread_sample(stats_thread, 1);
+
+      ENZ(errno = pthread_mutex_lock(&monitor->lock));
+      monitor->sampling = NULL;
+      /* Stay on the phase grid. If sampling overran one or more deadlines,
+       * skip them rather than sampling back-to-back. */
+      now = mono_ns();
+      if (now < deadline + interval_ns(stats_thread) / 2) {
+        now = deadline + interval_ns(stats_thread) / 2;
+      }
+      stats_thread->next_deadline_ns = next_deadline(monitor, stats_thread, now);
+      heap_push(monitor, stats_thread);
+      monitor->writer_pending = 1;
+      ENZ(errno = pthread_cond_signal(&monitor->writer_cond));
+      ENZ(errno = pthread_cond_broadcast(&monitor->idle_cond));
+      continue;
+    }
+
+    arm_timer(monitor);
+    ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+    num_events = epoll_wait(monitor->epoll_fd, events, MAX_EVENTS, -1);
+    if (num_events == -1 && errno != EINTR) {
+      EM1(num_events);
+    }
+    for (e = 0; e < num_events; e++) {
+      if (events[e].data.fd != monitor->timer_fd && events[e].data.fd != monitor->event_fd) {
+        call_watch(monitor, events[e].data.fd, events[e].events);
+        continue;
+      }
+      /* Reading clears the fd; the count itself isn't needed. */
+      if (read(events[e].data.fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        EM1(-1);
+      }
+    }
+
+    ENZ(errno = pthread_mutex_lock(&monitor->lock));
+    sample_requested(monitor);
+  }  /* while running */
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+  free(tick_members);
+  pthread_exit(NULL);
+  return NULL;
+}  /* stats_monitor_sched_run */
+
+
+/* Coordinated: writes each tick's output, of all members, as one batch
+ * that starts with a "tick" line. Samples taken outside ticks (sample-now
+ * requests and final samples) are written as their own batch, without a
+ * "tick" line, before the tick that follows them in their member's queue;
+ * the ones after the last tick go in a final batch. */
+static void write_ticks(stats_monitor_t *monitor, struct stats_thread_s **members, int num_members,
+    const stats_monitor_tick_t *ticks, int num_ticks, stats_fmt_t *batch)
+{
+  int t, i;
+
+  for (t = 0; t <= num_ticks; t++) {
+    batch->len = 0;
+    for (i = 0; i < num_members; i++) {
+      stats_thread_drain_batch(members[i], batch, 0);
+    }
+    if (batch->len > 0) {
+      monitor->config.sink.write(monitor->config.sink.clientd, batch->buf, batch->len);
+    }
+    if (t == num_ticks) {
+      break;
+    }
+
+    batch->len = 0;
+    {
+      time_t sec = (time_t)(ticks[t].realtime_ns / 1000000000);
+      struct tm tm;
+      char time_str[32];
+      gmtime_r(&sec, &tm);
+      strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S", &tm);
+      stats_fmt_printf(batch, "tick: id=%lu, time=%s.%03luZ, contexts=%d, lag_us=%lu, spread_us=%lu\n",
+          (unsigned long)ticks[t].id, time_str, (unsigned long)(ticks[t].realtime_ns % 1000000000 / 1000000),
+          ticks[t].num_samples, (unsigned long)(ticks[t].lag_ns / 1000), (unsigned long)(ticks[t].spread_ns / 1000));
+    }
+    for (i = 0; i < num_members; i++) {
+      stats_thread_drain_batch(members[i], batch, ticks[t].id);
+    }
+    monitor->config.sink.write(monitor->config.sink.clientd, batch->buf, batch->len);
+  }
+}  /* write_ticks */
+
+
+/* Drains every member's queue to its sinks. Members can't be removed while
+ * a pass is running (see stats_monitor_remove()). */
+void *stats_monitor_writer_run(void *in_arg)
+{
+  stats_monitor_t *monitor = (stats_monitor_t *)in_arg;
+  struct stats_thread_s **members = NULL;
+  int members_capacity = 0;
+  stats_monitor_tick_t *ticks = NULL;
+  int num_ticks = 0;
+  int ticks_capacity = 0;
+  stats_fmt_t *batch = NULL;
+
+  apply_thread_options(monitor);
+  if (monitor->config.coordinated) {
+    batch = stats_fmt_create(64 * 1024);
+  }
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  while (monitor->running || monitor->writer_pending) {
+    int num_members, i;
+
+    while (monitor->running && !monitor->writer_pending) {
+      ENZ(errno = pthread_cond_wait(&monitor->writer_cond, &monitor->lock));
+    }
+    monitor->writer_pending = 0;
+
+    if (monitor->num_members > members_capacity) {
+      members_capacity = monitor->members_capacity;
+      ENL(members = (struct stats_thread_s **)realloc(members, sizeof(struct stats_thread_s *) * members_capacity));
+    }
+    num_members = monitor->num_members;
+    memcpy(members, monitor->members, sizeof(struct stats_thread_s *) * num_members);
+    if (monitor->num_pending_ticks > ticks_capacity) {
+      ticks_capacity = monitor->ticks_capacity;
+      ENL(ticks = (stats_monitor_tick_t *)realloc(ticks, sizeof(stats_monitor_tick_t) * ticks_capacity));
+    }
+    num_ticks = monitor->num_pending_ticks;
+    memcpy(ticks, monitor->ticks, sizeof(stats_monitor_tick_t) * num_ticks);
+    monitor->num_pending_ticks = 0;
+    monitor->writer_busy = 1;
+    ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+    if (monitor->config.coordinated) {
+      write_ticks(monitor, members, num_members, ticks, num_ticks, batch);
+    } else {
+      for (i = 0; i < num_members; i++) {
+        stats_thread_drain(members[i]);
+      }
+    }
+
+    ENZ(errno = pthread_mutex_lock(&monitor->lock));
+    monitor->writer_busy = 0;
+    ENZ(errno = pthread_cond_broadcast(&monitor->idle_cond));
+  }  /* while running */
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+  if (batch != NULL) {
+    stats_fmt_delete(batch);
+  }
+  free(ticks);
+  free(members);
+  pthread_exit(NULL);
+  return NULL;
+}  /* stats_monitor_writer_run */
+
+
+void stats_monitor_config_init(stats_monitor_config_t *config)
+{
+  memset(config, 0, sizeof(*config));
+  config->cpus = NULL;  /* No pinning. */
+  config->sched_policy = SCHED_OTHER;
+  config->coordinated = 0;
+  config->sink.write = NULL;  /* Standard out. */
+  config->sink.close = NULL;
+  config->sink.clientd = NULL;
+}  /* stats_monitor_config_init */
+
+
+stats_monitor_t *stats_monitor_create(void)
+{
+  stats_monitor_config_t config;
+
+  stats_monitor_config_init(&config);
+  return stats_monitor_create_ex(&config);
+}  /* stats_monitor_create */
+
+
+stats_monitor_t *stats_monitor_create_ex(const stats_monitor_config_t *config)
+{
+  stats_monitor_t *monitor;
+  struct epoll_event event;
+
+  ENL(monitor = (stats_monitor_t *)malloc(sizeof(stats_monitor_t)));
+  monitor->config = *config;
+  if (config->cpus != NULL) {
+    ENL(monitor->config.cpus = strdup(config->cpus));
+  }
+  if (config->coordinated && config->sink.write == NULL) {
+    stats_sink_stdout(&monitor->config.sink);
+  }
+  ENZ(errno = pthread_mutex_init(&monitor->lock, NULL));
+  EM1(monitor->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+  EM1(monitor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  EM1(monitor->epoll_fd = epoll_create1(EPOLL_CLOEXEC));
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = monitor->timer_fd;
+  EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->timer_fd, &event));
+  event.data.fd = monitor->event_fd;
+  EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->event_fd, &event));
+  ENZ(errno = pthread_cond_init(&monitor->writer_cond, NULL));
+  ENZ(errno = pthread_cond_init(&monitor->idle_cond, NULL));
+  monitor->running = 1;
+  monitor->epoch_ns = mono_ns();
+  monitor->num_adds = 0;
+  monitor->heap_size = 0;
+  monitor->heap_capacity = 8;
+  ENL(monitor->heap = (struct stats_thread_s **)malloc(sizeof(struct stats_thread_s *) * monitor->heap_capacity));
+  monitor->num_members = 0;
+  monitor->members_capacity = 8;
+  ENL(monitor->members = (struct stats_thread_s **)malloc(sizeof(struct stats_thread_s *) * monitor->members_capacity));
+  monitor->sampling = NULL;
+  monitor->writer_pending = 0;
+  monitor->writer_busy = 0;
+  monitor->num_ticks = 0;
+  monitor->tick_busy = 0;
+  monitor->ticks = NULL;
+  monitor->num_pending_ticks = 0;
+  monitor->ticks_capacity = 0;
+  monitor->watches = NULL;
+  monitor->num_watches = 0;
+  monitor->watches_capacity = 0;
+  monitor->calling = NULL;
+
+  ENZ(errno = pthread_create(&monitor->writer_thread_id, NULL, stats_monitor_writer_run, monitor));
+  ENZ(errno = pthread_create(&monitor->sched_thread_id, NULL, stats_monitor_sched_run, monitor));
+
+  return monitor;
+}  /* stats_monitor_create_ex */
+
+
+static stats_monitor_t *default_monitor = NULL;
+static pthread_once_t default_monitor_once = PTHREAD_ONCE_INIT;
+
+static void default_monitor_init(void)
+{
+  default_monitor = stats_monitor_create();
+}  /* default_monitor_init */
+
+
+/* Process-wide monitor used by stats_thread_start() when the config doesn't
+ * name one. Created on first use and never deleted. */
+stats_monitor_t *stats_monitor_default(void)
+{
+  ENZ(errno = pthread_once(&default_monitor_once, default_monitor_init));
+  return default_monitor;
+}  /* stats_monitor_default */
+
+
+/* Start sampling a stats_thread. The first sample is taken right away;
+ * after that it samples on its own phase of its interval. When
+ * coordinated, the first sample is in the next tick instead. */
+void stats_monitor_add(stats_monitor_t *monitor, struct stats_thread_s *stats_thread)
+{
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+
+  if (monitor->num_members == monitor->members_capacity) {
+    monitor->members_capacity *= 2;
+    ENL(monitor->members = (struct stats_thread_s **)realloc(monitor->members,
+        sizeof(struct stats_thread_s *) * monitor->members_capacity));
+  }
+  monitor->members[monitor->num_members++] = stats_thread;
+  if (monitor->heap_size == monitor->heap_capacity) {
+    monitor->heap_capacity *= 2;
+    ENL(monitor->heap = (struct stats_thread_s **)realloc(monitor->heap,
+        sizeof(struct stats_thread_s *) * monitor->heap_capacity));
+  }
+
+  stats_thread->phase_ns = (uint64_t)(phase_fraction(monitor->num_adds++) * (double)interval_ns(stats_thread));
+  stats_thread->next_deadline_ns = mono_ns();  /* Print stats immediately on start. */
+  if (interval_ns(stats_thread) > 0) {  /* Zero: only sampled when scraped. */
+    if (monitor->config.coordinated) {
+      stats_thread->next_deadline_ns = next_deadline(monitor, stats_thread, stats_thread->next_deadline_ns);
+    }
+    heap_push(monitor, stats_thread);
+  }
+  wake_scheduler(monitor);
+
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* stats_monitor_add */
+
+
+/* Stop sampling a stats_thread. Takes one final sample and waits for the
+ * writer to finish its output, so nothing is lost. */
+void stats_monitor_remove(stats_monitor_t *monitor, struct stats_thread_s *stats_thread)
+{
+  int i;
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  while (monitor->sampling == stats_thread || monitor->tick_busy) {
+    ENZ(errno = pthread_cond_wait(&monitor->idle_cond, &monitor->lock));
+  }
+  heap_remove(monitor, stats_thread);
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+
+  /* Final stats. The scheduler no longer touches this member, so it is safe
+   * to sample from the caller's thread. */
+  if (interval_ns(stats_thread) > 0) {
+    stats_thread_sample(stats_thread, 0);
+  }
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  monitor->writer_pending = 1;
+  ENZ(errno = pthread_cond_signal(&monitor->writer_cond));
+  while (monitor->writer_pending || monitor->writer_busy) {
+    ENZ(errno = pthread_cond_wait(&monitor->idle_cond, &monitor->lock));
+  }
+  for (i = 0; i < monitor->num_members; i++) {
+    if (monitor->members[i] == stats_thread) {
+      monitor->members[i] = monitor->members[--monitor->num_members];
+      break;
+    }
+  }
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* stats_monitor_remove */
+
+
+/* Ask for an extra sample as soon as possible. Safe to call from a signal
+ * handler (it only sets a flag and writes to an eventfd). */
+void stats_monitor_sample_now(stats_monitor_t *monitor, struct stats_thread_s *stats_thread)
+{
+  __atomic_store_n(&stats_thread->sample_now, 1, __ATOMIC_RELEASE);
+  wake_scheduler(monitor);
+}  /* stats_monitor_sample_now */
+
+
+/* Have the scheduler thread wait for "events" (EPOLLIN etc.; level
+ * triggered) on "fd" too, and call "cb" when they happen. The callback
+ * runs without the lock and can watch, modify and unwatch fds. Sampling
+ * waits for it, so it must not block. */
+void stats_monitor_watch(stats_monitor_t *monitor, int fd, uint32_t events, stats_monitor_fd_cb_t cb, void *clientd)
+{
+  struct epoll_event event;
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  if (monitor->num_watches == monitor->watches_capacity) {
+    monitor->watches_capacity = (monitor->watches_capacity == 0) ? 8 : monitor->watches_capacity * 2;
+    ENL(monitor->watches = (stats_monitor_watch_t *)realloc(monitor->watches,
+        sizeof(stats_monitor_watch_t) * monitor->watches_capacity));
+  }
+  monitor->watches[monitor->num_watches].fd = fd;
+  monitor->watches[monitor->num_watches].cb = cb;
+  monitor->watches[monitor->num_watches].clientd = clientd;
+  monitor->num_watches++;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.fd = fd;
+  EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, fd, &event));
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* stats_monitor_watch */
+
+
+void stats_monitor_watch_modify(stats_monitor_t *monitor, int fd, uint32_t events)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.fd = fd;
+  EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_MOD, fd, &event));
+}  /* stats_monitor_watch_modify */
+
+
+/* Stop watching "fd" (the caller closes it). */
+void stats_monitor_unwatch(stats_monitor_t *monitor, int fd)
+{
+  int i;
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  for (i = 0; i < monitor->num_watches; i++) {
+    if (monitor->watches[i].fd == fd) {
+      monitor->watches[i] = monitor->watches[--monitor->num_watches];
+      EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_DEL, fd, NULL));
+      break;
+    }
+  }
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* stats_monitor_unwatch */
+
+
+/* Stop watching all of clientd's fds (the caller closes them), and wait
+ * for its callback to return, so that clientd can be freed. Not from the
+ * callback itself. */
+void stats_monitor_unwatch_all(stats_monitor_t *monitor, void *clientd)
+{
+  int i;
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  for (;;) {
+    for (i = 0; i < monitor->num_watches; i++) {
+      if (monitor->watches[i].clientd == clientd) {
+        EM1(epoll_ctl(monitor->epoll_fd, EPOLL_CTL_DEL, monitor->watches[i].fd, NULL));
+        monitor->watches[i--] = monitor->watches[--monitor->num_watches];
+      }
+    }
+    if (monitor->calling != clientd) {
+      break;
+    }
+    /* The callback can watch new fds before it returns. */
+    ENZ(errno = pthread_cond_wait(&monitor->idle_cond, &monitor->lock));
+  }
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+}  /* stats_monitor_unwatch_all */
+
+
+void stats_monitor_delete(stats_monitor_t *monitor)
+{
+  /* Remove any remaining members (with their final stats). */
+  for (;;) {
+    struct stats_thread_s *stats_thread = NULL;
+    ENZ(errno = pthread_mutex_lock(&monitor->lock));
+    if (monitor->num_members > 0) {
+      stats_thread = monitor->members[0];
+    }
+    ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+    if (stats_thread == NULL) {
+      break;
+    }
+    stats_thread_terminate(stats_thread);
+  }
+
+  ENZ(errno = pthread_mutex_lock(&monitor->lock));
+  monitor->running = 0;
+  wake_scheduler(monitor);
+  ENZ(errno = pthread_cond_signal(&monitor->writer_cond));
+  ENZ(errno = pthread_mutex_unlock(&monitor->lock));
+  ENZ(errno = pthread_join(monitor->sched_thread_id, NULL));
+  ENZ(errno = pthread_join(monitor->writer_thread_id, NULL));
+
+  close(monitor->epoll_fd);
+  close(monitor->event_fd);
+  close(monitor->timer_fd);
+  ENZ(errno = pthread_cond_destroy(&monitor->writer_cond));
+  ENZ(errno = pthread_cond_destroy(&monitor->idle_cond));
+  ENZ(errno = pthread_mutex_destroy(&monitor->lock));
+  if (monitor->config.sink.close != NULL) {
+    monitor->config.sink.close(monitor->config.sink.clientd);
+  }
+  free(monitor->watches);
+  free(monitor->ticks);
+  free(monitor->heap);
+  free(monitor->members);
+  free(monitor->config.cpus);
+  free(monitor);
+}  /* stats_monitor_delete */
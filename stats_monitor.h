@@ -0,0 +1,142 @@
+/* stats_monitor.h - one scheduler thread (plus one writer thread) shared by
+ * any number of stats_thread objects.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_MONITOR_H
+#define STATS_MONITOR_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "stats_sink.h"
+
+struct stats_thread_s;  /* See stats_thread.h. */
+
+
+/* Options for the monitor's threads. Initialize with
+ * stats_monitor_config_init(). Both threads get the same options. */
+struct stats_monitor_config_s {
+  /* CPU list to pin to, e.g. "0,2-3" (a housekeeping set away from
+   * latency-critical receive threads). NULL means no pinning. */
+  char *cpus;
+  /* SCHED_OTHER (default), SCHED_BATCH, or SCHED_IDLE (the last two need
+   * _GNU_SOURCE). With SCHED_IDLE, sampling only runs when the CPU has
+   * nothing else to do. */
+  int sched_policy;
+  /* Non-zero for coordinated sampling: members are sampled on the wall
+   * clock's multiples of their interval (e.g. :00, :10, :20 for 10
+   * seconds) instead of spread over it, and all members due at the same
+   * time are sampled back-to-back as one "tick". A tick's output, of all
+   * members, is written as one batch to "sink" (standard out if its write
+   * callback is NULL), not to the members' own sinks. Samples taken
+   * outside ticks are written to "sink" in batches of their own. The monitor closes
+   * "sink" at delete. */
+  int coordinated;
+  stats_sink_t sink;
+};
+typedef struct stats_monitor_config_s stats_monitor_config_t;
+
+/* One coordinated sampling tick, from the scheduler to the writer. */
+struct stats_monitor_tick_s {
+  uint64_t id;  /* Counts ticks, from 1. */
+  uint64_t realtime_ns;  /* Wall clock time the tick is aligned to. */
+  int num_samples;  /* Members that output a sample in it. */
+  uint64_t lag_ns;  /* From the tick's deadline to the first member's sample. */
+  uint64_t spread_ns;  /* From the first member's sample to the last one's. */
+};
+typedef struct stats_monitor_tick_s stats_monitor_tick_t;
+
+/* Called by the scheduler thread, without the monitor's lock, when a
+ * watched fd is ready ("events" are EPOLL... flags). See
+ * stats_monitor_watch(). */
+typedef void (*stats_monitor_fd_cb_t)(void *clientd, int fd, uint32_t events);
+
+struct stats_monitor_watch_s {
+  int fd;
+  stats_monitor_fd_cb_t cb;
+  void *clientd;
+};
+typedef struct stats_monitor_watch_s stats_monitor_watch_t;
+
+
+/* stats_monitor object. All fields are protected by "lock". */
+struct stats_monitor_s {
+  stats_monitor_config_t config;
+  pthread_mutex_t lock;
+  int timer_fd;  /* Absolute CLOCK_MONOTONIC time of the earliest deadline. */
+  int event_fd;  /* Wakes the scheduler. */
+  int epoll_fd;  /* The scheduler waits on both. */
+  pthread_cond_t writer_cond;  /* Wakes the writer. */
+  pthread_cond_t idle_cond;  /* Broadcast when a sample or write pass ends. */
+  pthread_t sched_thread_id;
+  pthread_t writer_thread_id;
+  int running;
+  uint64_t epoch_ns;  /* Phases are relative to this. */
+  uint64_t num_adds;  /* Used to pick each new member's phase. */
+  /* Min-heap of members, ordered by next_deadline_ns. */
+  struct stats_thread_s **heap;
+  int heap_size;
+  int heap_capacity;
+  /* All members, for the writer. */
+  struct stats_thread_s **members;
+  int num_members;
+  int members_capacity;
+  struct stats_thread_s *sampling;  /* Being sampled outside the lock. */
+  int writer_pending;
+  int writer_busy;
+  /* Coordinated sampling. */
+  uint64_t num_ticks;
+  int tick_busy;  /* A tick's members are being sampled outside the lock. */
+  stats_monitor_tick_t *ticks;  /* Waiting for the writer. */
+  int num_pending_ticks;
+  int ticks_capacity;
+  /* Other fds the scheduler waits on (e.g. scrape sockets). */
+  stats_monitor_watch_t *watches;
+  int num_watches;
+  int watches_capacity;
+  void *calling;  /* Clientd of the fd callback running outside the lock. */
+};
+typedef struct stats_monitor_s stats_monitor_t;
+
+
+void stats_monitor_config_init(stats_monitor_config_t *config);
+stats_monitor_t *stats_monitor_create(void);
+stats_monitor_t *stats_monitor_create_ex(const stats_monitor_config_t *config);
+stats_monitor_t *stats_monitor_default(void);
+void stats_monitor_add(stats_monitor_t *monitor, struct stats_thread_s *stats_thread);
+void stats_monitor_remove(stats_monitor_t *monitor, struct stats_thread_s *stats_thread);
+void stats_monitor_sample_now(stats_monitor_t *monitor, struct stats_thread_s *stats_thread);
+void stats_monitor_watch(stats_monitor_t *monitor, int fd, uint32_t events, stats_monitor_fd_cb_t cb, void *clientd);
+void stats_monitor_watch_modify(stats_monitor_t *monitor, int fd, uint32_t events);
+void stats_monitor_unwatch(stats_monitor_t *monitor, int fd);
+void stats_monitor_unwatch_all(stats_monitor_t *monitor, void *clientd);
+void stats_monitor_delete(stats_monitor_t *monitor);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_MONITOR_H */
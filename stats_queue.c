@@ -0,0 +1,155 @@
+/* stats_queue.c - bounded single-producer/single-consumer ring of samples.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "stats_sample.h"
+#include "stats_queue.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define CACHE_LINE 64
+
+/* The producer only writes "head" and its counters, the consumer only
+ * writes "tail"; keep them on separate cache lines. */
+struct stats_queue_s {
+  stats_sample_t *slots;
+  uint64_t num_slots;  /* Power of 2. */
+  uint64_t mask;
+  _Alignas(CACHE_LINE) _Atomic uint64_t head;  /* Next slot to publish. */
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t max_depth;
+  _Alignas(CACHE_LINE) _Atomic uint64_t tail;  /* Next slot to consume. */
+};
+
+
+stats_queue_t *stats_queue_create(int num_slots)
+{
+  stats_queue_t *queue;
+  uint64_t i;
+
+  ENL(queue = (stats_queue_t *)aligned_alloc(CACHE_LINE,
+      (sizeof(stats_queue_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE));
+  queue->num_slots = 2;
+  while (queue->num_slots < (uint64_t)num_slots) {
+    queue->num_slots *= 2;
+  }
+  queue->mask = queue->num_slots - 1;
+  ENL(queue->slots = (stats_sample_t *)malloc(sizeof(stats_sample_t) * queue->num_slots));
+  for (i = 0; i < queue->num_slots; i++) {
+    stats_sample_init(&queue->slots[i]);
+  }
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->dropped, 0);
+  atomic_init(&queue->max_depth, 0);
+  atomic_init(&queue->tail, 0);
+
+  return queue;
+}  /* stats_queue_create */
+
+
+void stats_queue_delete(stats_queue_t *queue)
+{
+  uint64_t i;
+
+  for (i = 0; i < queue->num_slots; i++) {
+    stats_sample_free(&queue->slots[i]);
+  }
+  free(queue->slots);
+  free(queue);
+}  /* stats_queue_delete */
+
+
+/* Returns the next free slot for the producer to fill, or NULL if the
+ * consumer has fallen behind (counted as a drop). Never blocks. */
+stats_sample_t *stats_queue_claim(stats_queue_t *queue)
+{
+  uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head - tail >= queue->num_slots) {
+    atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  return &queue->slots[head & queue->mask];
+}  /* stats_queue_claim */
+
+
+/* Make the claimed slot visible to the consumer. */
+void stats_queue_publish(stats_queue_t *queue)
+{
+  uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed) + 1;
+  uint64_t depth = head - atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  if (depth > atomic_load_explicit(&queue->max_depth, memory_order_relaxed)) {
+    atomic_store_explicit(&queue->max_depth, depth, memory_order_relaxed);
+  }
+  atomic_store_explicit(&queue->head, head, memory_order_release);
+}  /* stats_queue_publish */
+
+
+/* Returns the oldest published sample, or NULL if there is none. */
+stats_sample_t *stats_queue_peek(stats_queue_t *queue)
+{
+  uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  if (atomic_load_explicit(&queue->head, memory_order_acquire) == tail) {
+    return NULL;
+  }
+  return &queue->slots[tail & queue->mask];
+}  /* stats_queue_peek */
+
+
+/* Give the sample returned by stats_queue_peek() back to the producer. */
+void stats_queue_release(stats_queue_t *queue)
+{
+  atomic_fetch_add_explicit(&queue->tail, 1, memory_order_release);
+}  /* stats_queue_release */
+
+
+void stats_queue_get_stats(stats_queue_t *queue, stats_queue_stats_t *qstats)
+{
+  uint64_t tail = atomic_load(&queue->tail);  /* Load tail first so depth can't go negative. */
+  uint64_t head = atomic_load(&queue->head);
+
+  qstats->enqueued = head;
+  qstats->dropped = atomic_load(&queue->dropped);
+  qstats->depth = head - tail;
+  qstats->max_depth = atomic_load(&queue->max_depth);
+}  /* stats_queue_get_stats */
@@ -0,0 +1,63 @@
+/* stats_queue.h - bounded single-producer/single-consumer ring of samples.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_QUEUE_H
+#define STATS_QUEUE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "stats_sample.h"
+
+
+/* Counters, for reporting backpressure. */
+struct stats_queue_stats_s {
+  uint64_t enqueued;  /* Samples handed to the writer. */
+  uint64_t dropped;  /* Samples skipped because the queue was full. */
+  uint64_t depth;  /* Samples currently waiting. */
+  uint64_t max_depth;  /* High-water mark of depth. */
+};
+typedef struct stats_queue_stats_s stats_queue_stats_t;
+
+/* Opaque; the implementation uses C11 atomics. The queue never blocks or
+ * wakes anybody; the stats_monitor tells the writer when to look. */
+typedef struct stats_queue_s stats_queue_t;
+
+
+stats_queue_t *stats_queue_create(int num_slots);
+void stats_queue_delete(stats_queue_t *queue);
+/* Producer side. */
+stats_sample_t *stats_queue_claim(stats_queue_t *queue);
+void stats_queue_publish(stats_queue_t *queue);
+/* Consumer side. */
+stats_sample_t *stats_queue_peek(stats_queue_t *queue);
+void stats_queue_release(stats_queue_t *queue);
+/* Any thread. */
+void stats_queue_get_stats(stats_queue_t *queue, stats_queue_stats_t *qstats);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_QUEUE_H */
@@ -0,0 +1,229 @@
+/* stats_recorder.c - memory-mapped flight recorder of raw stats samples.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+#include "stats_recorder.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+
+/* An existing file is kept (and appended to) if it was written with the
+ * same layout; that way, restarting after a crash doesn't wipe out the
+ * records of the crash. */
+static int hdr_matches(const stats_recorder_hdr_t *hdr, size_t data_size)
+{
+  return memcmp(hdr->magic, STATS_RECORDER_MAGIC, sizeof(hdr->magic)) == 0
+      && hdr->version == STATS_RECORDER_VERSION
+      && hdr->hdr_size == STATS_RECORDER_HDR_SIZE
+      && hdr->data_size == data_size
+      && hdr->ctx_stats_size == sizeof(lbm_context_stats_t)
+      && hdr->src_stats_size == sizeof(lbm_src_transport_stats_t)
+      && hdr->rcv_stats_size == sizeof(lbm_rcv_transport_stats_t)
+      && hdr->tail <= hdr->head && hdr->head - hdr->tail <= data_size;
+}  /* hdr_matches */
+
+
+/* A record header can be garbage after a host crash (a torn page), and
+ * following a zero or odd length would never get anywhere. */
+static int rec_ok(const stats_recorder_rec_t *rec, uint64_t pos, uint64_t data_size)
+{
+  return (rec->magic == STATS_RECORDER_REC_MAGIC || rec->magic == STATS_RECORDER_PAD_MAGIC)
+      && rec->len != 0 && rec->len % 8 == 0 && rec->len <= data_size - (pos % data_size);
+}  /* rec_ok */
+
+
+/* Walks the kept records; they must end exactly at the head. */
+static int ring_ok(const stats_recorder_hdr_t *hdr, const char *data)
+{
+  uint64_t pos = hdr->tail;
+
+  while (pos < hdr->head) {
+    const stats_recorder_rec_t *rec = (const stats_recorder_rec_t *)(data + (pos % hdr->data_size));
+    if (!rec_ok(rec, pos, hdr->data_size)) {
+      return 0;
+    }
+    pos += rec->len;
+  }
+  return pos == hdr->head;
+}  /* ring_ok */
+
+
+stats_recorder_t *stats_recorder_create(const char *path, size_t data_size, const char *ctx_name)
+{
+  stats_recorder_t *recorder;
+  struct stat st;
+  void *map;
+  uint64_t magic;
+
+  data_size &= ~(size_t)7;  /* Records are 8-byte aligned. */
+  ENL(recorder = (stats_recorder_t *)calloc(1, sizeof(stats_recorder_t)));
+  recorder->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (recorder->fd == -1) {
+    int errno_ = errno;
+    char errstr[1024];
+    snprintf(errstr, sizeof(errstr), "ERROR (%s:%d): open(%s) failed", __FILE__, __LINE__, path);
+    errno = errno_;
+    perror(errstr);
+    exit(1);
+  }
+  recorder->map_size = STATS_RECORDER_HDR_SIZE + data_size;
+  EM1(fstat(recorder->fd, &st));
+  if ((size_t)st.st_size != recorder->map_size) {
+    EM1(ftruncate(recorder->fd, 0));  /* Discard any old contents. */
+    EM1(ftruncate(recorder->fd, recorder->map_size));
+  }
+  map = mmap(NULL, recorder->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, recorder->fd, 0);
+  if (map == MAP_FAILED) {
+    EM1(-1);
+  }
+  recorder->hdr = (stats_recorder_hdr_t *)map;
+  recorder->data = (char *)map + STATS_RECORDER_HDR_SIZE;
+
+  if (!hdr_matches(recorder->hdr, data_size) || !ring_ok(recorder->hdr, recorder->data)) {
+    memset(recorder->hdr, 0, sizeof(stats_recorder_hdr_t));
+    recorder->hdr->version = STATS_RECORDER_VERSION;
+    recorder->hdr->hdr_size = STATS_RECORDER_HDR_SIZE;
+    recorder->hdr->data_size = data_size;
+    recorder->hdr->ctx_stats_size = sizeof(lbm_context_stats_t);
+    recorder->hdr->src_stats_size = sizeof(lbm_src_transport_stats_t);
+    recorder->hdr->rcv_stats_size = sizeof(lbm_rcv_transport_stats_t);
+    /* Magic last, so a half-initialized header is never valid. */
+    memcpy(&magic, STATS_RECORDER_MAGIC, sizeof(magic));
+    __atomic_store_n((uint64_t *)recorder->hdr->magic, magic, __ATOMIC_RELEASE);
+  }
+  memset(recorder->hdr->ctx_name, 0, sizeof(recorder->hdr->ctx_name));
+  if (ctx_name != NULL) {
+    strncpy(recorder->hdr->ctx_name, ctx_name, sizeof(recorder->hdr->ctx_name) - 1);
+  }
+
+  return recorder;
+}  /* stats_recorder_create */
+
+
+void stats_recorder_delete(stats_recorder_t *recorder)
+{
+  munmap(recorder->hdr, recorder->map_size);
+  close(recorder->fd);
+  free(recorder);
+}  /* stats_recorder_delete */
+
+
+/* Runs in the sampling thread. No system calls; just copies. */
+void stats_recorder_write(stats_recorder_t *recorder, const stats_sample_t *sample)
+{
+  stats_recorder_hdr_t *hdr = recorder->hdr;
+  uint64_t data_size = hdr->data_size;
+  size_t src_bytes = (size_t)sample->src_num_entries * sizeof(lbm_src_transport_stats_t);
+  size_t rcv_bytes = (size_t)sample->rcv_num_entries * sizeof(lbm_rcv_transport_stats_t);
+  uint64_t len = (sizeof(stats_recorder_rec_t) + src_bytes + rcv_bytes + 7) & ~(uint64_t)7;
+  uint64_t head = hdr->head;
+  uint64_t tail = hdr->tail;
+  uint64_t start, end, pad;
+  stats_recorder_rec_t *rec;
+
+  if (len > data_size / 2 || len > UINT32_MAX) {
+    recorder->num_too_big++;
+    return;
+  }
+
+  /* Records don't wrap. */
+  pad = data_size - (head % data_size);
+  if (pad >= len) {
+    pad = 0;
+  }
+  start = head + pad;
+  end = start + len;
+
+  /* Move the tail past the oldest records until there is room, and publish
+   * it before overwriting them. */
+  while (end - tail > data_size) {
+    const stats_recorder_rec_t *old = (const stats_recorder_rec_t *)(recorder->data + (tail % data_size));
+    if (!rec_ok(old, tail, data_size)) {
+      tail = head;  /* Corrupt; drop all the old records. */
+      break;
+    }
+    tail += old->len;
+  }
+  __atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+
+  if (pad > 0) {
+    rec = (stats_recorder_rec_t *)(recorder->data + (head % data_size));
+    rec->magic = STATS_RECORDER_PAD_MAGIC;
+    rec->len = (uint32_t)pad;
+  }
+
+  rec = (stats_recorder_rec_t *)(recorder->data + (start % data_size));
+  rec->magic = STATS_RECORDER_REC_MAGIC;
+  rec->len = (uint32_t)len;
+  rec->seq = hdr->next_seq++;
+  rec->realtime_ns = sample->sample_realtime_ns;
+  rec->mono_ns = sample->sample_ns;
+  rec->interval_ns = (recorder->prev_mono_ns == 0) ? 0 : sample->sample_ns - recorder->prev_mono_ns;
+  rec->retrieve_ns = sample->retrieve_ns;
+  rec->src_num_entries = sample->src_num_entries;
+  rec->rcv_num_entries = sample->rcv_num_entries;
+  rec->ctx_stats = sample->ctx_stats;
+  memcpy((char *)(rec + 1), sample->src_stats, src_bytes);
+  memcpy((char *)(rec + 1) + src_bytes, sample->rcv_stats, rcv_bytes);
+
+  /* Only now does the record become visible. */
+  __atomic_store_n(&hdr->head, end, __ATOMIC_RELEASE);
+  recorder->prev_mono_ns = sample->sample_ns;
+  recorder->num_recorded++;
+}  /* stats_recorder_write */
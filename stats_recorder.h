@@ -0,0 +1,105 @@
+/* stats_recorder.h - memory-mapped flight recorder of raw stats samples.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+#ifndef STATS_RECORDER_H
+#define STATS_RECORDER_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+
+/* File layout: a STATS_RECORDER_HDR_SIZE header, then a ring of
+ * "data_size" bytes holding variable-length records. Positions (head, tail)
+ * are logical byte offsets that only grow; the ring offset is
+ * position % data_size. A record never wraps; if it doesn't fit before
+ * the end of the ring, a pad record fills the gap. Records in
+ * [tail, head) are always complete: the tail is moved past records
+ * before they are overwritten, and the head is only moved after a new
+ * record is fully written. The file is MAP_SHARED, so the records survive
+ * the process being killed (they are in the page cache). */
+#define STATS_RECORDER_MAGIC "MONSELFR"
+#define STATS_RECORDER_VERSION 1
+#define STATS_RECORDER_HDR_SIZE 4096
+#define STATS_RECORDER_REC_MAGIC 0x52435253  /* "SRCR" */
+#define STATS_RECORDER_PAD_MAGIC 0x44415053  /* "SPAD" */
+
+struct stats_recorder_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t hdr_size;
+  uint64_t data_size;
+  /* UM structure sizes; the decoder must be built with the same UM. */
+  uint32_t ctx_stats_size;
+  uint32_t src_stats_size;
+  uint32_t rcv_stats_size;
+  uint32_t reserved;
+  char ctx_name[64];
+  uint64_t head;  /* Use __atomic builtins. */
+  uint64_t tail;
+  uint64_t next_seq;
+};
+typedef struct stats_recorder_hdr_s stats_recorder_hdr_t;
+
+/* Followed by src_num_entries lbm_src_transport_stats_t, then
+ * rcv_num_entries lbm_rcv_transport_stats_t. "len" includes everything
+ * and is a multiple of 8. Pad records only have magic and len. */
+struct stats_recorder_rec_s {
+  uint32_t magic;
+  uint32_t len;
+  uint64_t seq;  /* Per file; continues across restarts. */
+  uint64_t realtime_ns;
+  uint64_t mono_ns;
+  uint64_t interval_ns;  /* Since the previous record. */
+  uint64_t retrieve_ns;
+  int32_t src_num_entries;
+  int32_t rcv_num_entries;
+  lbm_context_stats_t ctx_stats;
+};
+typedef struct stats_recorder_rec_s stats_recorder_rec_t;
+
+struct stats_recorder_s {
+  int fd;
+  stats_recorder_hdr_t *hdr;  /* Start of the mapping. */
+  char *data;
+  size_t map_size;
+  uint64_t prev_mono_ns;
+  uint64_t num_recorded;
+  uint64_t num_too_big;  /* Samples bigger than half the ring, not recorded. */
+};
+typedef struct stats_recorder_s stats_recorder_t;
+
+
+stats_recorder_t *stats_recorder_create(const char *path, size_t data_size, const char *ctx_name);
+void stats_recorder_delete(stats_recorder_t *recorder);
+void stats_recorder_write(stats_recorder_t *recorder, const stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_RECORDER_H */
@@ -0,0 +1,254 @@
+/* stats_recorder_dump.c - prints the records of a flight recorder file.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+/* Prints the records of a stats_recorder file (see stats_recorder.h) in
+ * the same text format as mon_self, oldest first. Works on the file of a
+ * live process, or of one that crashed.
+ *   ./stats_recorder_dump [-f from] [-u until] [-n last_n] [-q] file
+ * "from" and "until" are UTC times, "2024-05-01T13:45:00", or seconds
+ * since the epoch. -q omits the per-sample timestamp line.
+ */
+
+#define _GNU_SOURCE  /* For timegm(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+#include "stats_thread.h"
+#include "stats_fmt.h"
+#include "stats_recorder.h"
+
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+
+static void usage(const char *msg)
+{
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Usage: stats_recorder_dump [-f from] [-u until] [-n last_n] [-q] file\n"
+      "  from, until: UTC time (2024-05-01T13:45:00) or seconds since the epoch.\n");
+  exit(1);
+}  /* usage */
+
+
+/* Returns nanoseconds since the epoch. */
+static uint64_t parse_time(const char *str)
+{
+  struct tm tm;
+  char *end;
+
+  memset(&tm, 0, sizeof(tm));
+  end = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm);
+  if (end != NULL && (*end == '\0' || strcmp(end, "Z") == 0)) {
+    return (uint64_t)timegm(&tm) * 1000000000;
+  }
+  else {
+    double sec = strtod(str, &end);
+    if (end == str || *end != '\0' || sec < 0) {
+      usage("Bad time");
+    }
+    return (uint64_t)(sec * 1e9);
+  }
+}  /* parse_time */
+
+
+/* The record's header may be torn (e.g. after a host crash): its length
+ * must be sane and fit before the end of the ring, and a sample's entries
+ * must fit in it. */
+static int rec_ok(const stats_recorder_rec_t *rec, uint64_t pos, uint64_t data_size)
+{
+  uint64_t len = rec->len;
+
+  if (len == 0 || len % 8 != 0 || len > data_size - (pos % data_size)) {
+    return 0;
+  }
+  if (rec->magic == STATS_RECORDER_REC_MAGIC && (rec->src_num_entries < 0 || rec->rcv_num_entries < 0
+      || sizeof(stats_recorder_rec_t) + (uint64_t)rec->src_num_entries * sizeof(lbm_src_transport_stats_t)
+         + (uint64_t)rec->rcv_num_entries * sizeof(lbm_rcv_transport_stats_t) > len)) {
+    return 0;
+  }
+  return 1;
+}  /* rec_ok */
+
+
+int main(int argc, char **argv)
+{
+  uint64_t from_ns = 0;
+  uint64_t until_ns = UINT64_MAX;
+  long last_n = -1;
+  int opt, fd;
+  struct stat st;
+  char *map;
+  const stats_recorder_hdr_t *hdr;
+  const char *data;
+  uint64_t data_size, head, tail, pos;
+  long num_recs, skip;
+  char ctx_name[sizeof(hdr->ctx_name) + 1];
+  stats_thread_t stats_thread;
+  stats_sample_t sample;
+  stats_fmt_t *fmt;
+
+  memset(&stats_thread, 0, sizeof(stats_thread));
+  stats_thread.config.timestamps = 1;
+  while ((opt = getopt(argc, argv, "f:u:n:qh")) != -1) {
+    switch (opt) {
+      case 'f': from_ns = parse_time(optarg); break;
+      case 'u': until_ns = parse_time(optarg); break;
+      case 'n': last_n = atol(optarg); break;
+      case 'q': stats_thread.config.timestamps = 0; break;
+      default: usage(NULL);
+    }
+  }
+  if (optind != argc - 1) {
+    usage("Need exactly one file");
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd == -1) {
+    perror(argv[optind]);
+    exit(1);
+  }
+  EM1(fstat(fd, &st));
+  if ((size_t)st.st_size < STATS_RECORDER_HDR_SIZE) {
+    fprintf(stderr, "%s: not a recorder file\n", argv[optind]);
+    exit(1);
+  }
+  map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    EM1(-1);
+  }
+  hdr = (const stats_recorder_hdr_t *)map;
+  data = map + STATS_RECORDER_HDR_SIZE;
+  if (memcmp(hdr->magic, STATS_RECORDER_MAGIC, sizeof(hdr->magic)) != 0
+      || hdr->version != STATS_RECORDER_VERSION || hdr->hdr_size != STATS_RECORDER_HDR_SIZE
+      || hdr->data_size + STATS_RECORDER_HDR_SIZE > (uint64_t)st.st_size) {
+    fprintf(stderr, "%s: not a recorder file (or an unsupported version)\n", argv[optind]);
+    exit(1);
+  }
+  if (hdr->ctx_stats_size != sizeof(lbm_context_stats_t)
+      || hdr->src_stats_size != sizeof(lbm_src_transport_stats_t)
+      || hdr->rcv_stats_size != sizeof(lbm_rcv_transport_stats_t)) {
+    fprintf(stderr, "%s: recorded with a different UM version (stats sizes %u/%u/%u)\n",
+        argv[optind], hdr->ctx_stats_size, hdr->src_stats_size, hdr->rcv_stats_size);
+    exit(1);
+  }
+  data_size = hdr->data_size;
+  memcpy(ctx_name, hdr->ctx_name, sizeof(hdr->ctx_name));
+  ctx_name[sizeof(hdr->ctx_name)] = '\0';
+  stats_thread.ctx_name = ctx_name;
+
+  /* If the process is still running, records older than its tail may be
+   * overwritten while we read. Take head, then tail; the writer publishes
+   * tail before overwriting, so re-checking tail after each record tells
+   * us if it was still intact. */
+  head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+  tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+
+  /* For -n, count the matching records first (up to the first bad one,
+   * where the dump stops too). */
+  skip = 0;
+  if (last_n >= 0) {
+    num_recs = 0;
+    for (pos = tail; pos < head; ) {
+      const stats_recorder_rec_t *rec = (const stats_recorder_rec_t *)(data + (pos % data_size));
+      if (!rec_ok(rec, pos, data_size)) {
+        break;
+      }
+      if (rec->magic == STATS_RECORDER_REC_MAGIC
+          && rec->realtime_ns >= from_ns && rec->realtime_ns <= until_ns) {
+        num_recs++;
+      }
+      pos += rec->len;
+    }
+    if (num_recs > last_n) {
+      skip = num_recs - last_n;
+    }
+  }
+
+  fmt = stats_fmt_create(64 * 1024);
+  memset(&sample, 0, sizeof(sample));
+  for (pos = tail; pos < head; ) {
+    const stats_recorder_rec_t *rec = (const stats_recorder_rec_t *)(data + (pos % data_size));
+    uint64_t len = rec->len;
+
+    if (!rec_ok(rec, pos, data_size)) {
+      fprintf(stderr, "WARNING: bad record at position %lu; stopping\n", (unsigned long)pos);
+      break;
+    }
+    if (rec->magic == STATS_RECORDER_REC_MAGIC
+        && rec->realtime_ns >= from_ns && rec->realtime_ns <= until_ns) {
+      if (skip > 0) {
+        skip--;
+      }
+      else {
+        /* Point the sample straight into the mapping. */
+        sample.seq = rec->seq;
+        sample.sample_ns = rec->mono_ns;
+        sample.sample_realtime_ns = rec->realtime_ns;
+        sample.interval_ns = rec->interval_ns;
+        sample.retrieve_ns = rec->retrieve_ns;
+        sample.ctx_stats = rec->ctx_stats;
+        sample.src_num_entries = rec->src_num_entries;
+        sample.rcv_num_entries = rec->rcv_num_entries;
+        sample.src_stats = (lbm_src_transport_stats_t *)(rec + 1);
+        sample.rcv_stats = (lbm_rcv_transport_stats_t *)(sample.src_stats + rec->src_num_entries);
+        fmt->len = 0;
+        stats_fmt_sample(fmt, &stats_thread, &sample);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);  /* The record reads complete before tail is re-read. */
+        if (__atomic_load_n(&hdr->tail, __ATOMIC_RELAXED) > pos) {
+          /* Overwritten by the live process; start over from its new tail. */
+          pos = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+          continue;
+        }
+        fwrite(fmt->buf, 1, fmt->len, stdout);
+      }
+    }
+    pos += len;
+  }
+
+  stats_fmt_delete(fmt);
+  munmap(map, st.st_size);
+  close(fd);
+  return 0;
+}  /* main */
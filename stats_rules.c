@@ -0,0 +1,315 @@
+/* stats_rules.c - threshold rules on deltas and rates, checked every sample.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_store.h"
+#include "stats_rules.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* A bad rule is a configuration error, so it is fatal, like a bad sink. */
+static void rule_error(const char *text, const char *why)
+{
+  fprintf(stderr, "ERROR: stats rule '%s': %s\n", text, why);
+  exit(1);
+}  /* rule_error */
+
+
+static const stats_field_t *fields_for(int dir, int type_index, int *num_fields)
+{
+  if (dir == STATS_RULE_CTX) {
+    return stats_fields_ctx(num_fields);
+  }
+  if (dir == STATS_STORE_SRC) {
+    return stats_fields_src(stats_fields_type_from_index(type_index), num_fields);
+  }
+  return stats_fields_rcv(stats_fields_type_from_index(type_index), num_fields);
+}  /* fields_for */
+
+
+static int find_field(const stats_field_t *fields, int num_fields, const char *name)
+{
+  int f;
+
+  for (f = 0; f < num_fields; f++) {
+    if (strcmp(fields[f].name, name) == 0) {
+      return f;
+    }
+  }
+  return -1;
+}  /* find_field */
+
+
+/* Parse "<dir>[/<type>]/<field> <delta|rate> <op> <number>" (whitespace
+ * optional around the operator), where dir is ctx, src or rcv, and op is
+ * ">" or ">=". "text" is modified. */
+static void rule_parse(stats_rule_t *rule, char *text)
+{
+  char *path, *slash, *field_name, *cond, *end;
+  int num_fields, t, found;
+
+  ENL(rule->text = strdup(text));
+  path = text;
+  cond = path;
+  while (*cond != '\0' && !isspace((unsigned char)*cond)) {
+    cond++;
+  }
+  if (*cond != '\0') {
+    *cond++ = '\0';
+  }
+  while (isspace((unsigned char)*cond)) {
+    cond++;
+  }
+
+  slash = strchr(path, '/');
+  if (slash == NULL) {
+    rule_error(rule->text, "expected <dir>[/<type>]/<field>");
+  }
+  *slash = '\0';
+  field_name = slash + 1;
+  if (strcmp(path, "ctx") == 0) {
+    rule->dir = STATS_RULE_CTX;
+  } else if (strcmp(path, "src") == 0) {
+    rule->dir = STATS_STORE_SRC;
+  } else if (strcmp(path, "rcv") == 0) {
+    rule->dir = STATS_STORE_RCV;
+  } else {
+    rule_error(rule->text, "direction must be ctx, src or rcv");
+  }
+
+  rule->type_index = -1;
+  slash = strchr(field_name, '/');
+  if (slash != NULL) {
+    if (rule->dir == STATS_RULE_CTX) {
+      rule_error(rule->text, "context rules have no transport type");
+    }
+    *slash = '\0';
+    for (t = 0; t < STATS_NUM_TYPES; t++) {
+      if (strcmp(field_name, stats_fields_type_name(stats_fields_type_from_index(t))) == 0) {
+        rule->type_index = t;
+      }
+    }
+    if (rule->type_index < 0) {
+      rule_error(rule->text, "unknown transport type");
+    }
+    field_name = slash + 1;
+  }
+
+  found = 0;
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    const stats_field_t *fields;
+    rule->field_index[t] = -1;
+    if ((rule->dir == STATS_RULE_CTX && t > 0) || (rule->type_index >= 0 && t != rule->type_index)) {
+      continue;
+    }
+    fields = fields_for(rule->dir, t, &num_fields);
+    rule->field_index[t] = find_field(fields, num_fields, field_name);
+    found |= (rule->field_index[t] >= 0);
+  }
+  if (!found) {
+    rule_error(rule->text, "no such counter (see stats_fields.c)");
+  }
+
+  if (strncmp(cond, "delta", 5) == 0) {
+    rule->rate = 0;
+    cond += 5;
+  } else if (strncmp(cond, "rate", 4) == 0) {
+    rule->rate = 1;
+    cond += 4;
+  } else {
+    rule_error(rule->text, "expected delta or rate");
+  }
+  while (isspace((unsigned char)*cond)) {
+    cond++;
+  }
+  if (cond[0] != '>') {
+    rule_error(rule->text, "expected > or >=");
+  }
+  rule->inclusive = (cond[1] == '=');
+  cond += rule->inclusive ? 2 : 1;
+  errno = 0;
+  rule->threshold = strtod(cond, &end);
+  if (end == cond || errno != 0) {
+    rule_error(rule->text, "expected a number");
+  }
+  while (isspace((unsigned char)*end)) {
+    end++;
+  }
+  if (*end != '\0') {
+    rule_error(rule->text, "unexpected text after the number");
+  }
+}  /* rule_parse */
+
+
+/* "spec" is a list of rules separated by ';', e.g.
+ * "rcv/naks_sent rate>100; rcv/lbtrm/unrecovered_tmo delta>0". Exits on a
+ * bad rule. */
+stats_rules_t *stats_rules_create(const char *spec)
+{
+  stats_rules_t *rules;
+  char *copy, *item, *save;
+  int max_rules;
+  const char *c;
+
+  max_rules = 1;
+  for (c = spec; *c != '\0'; c++) {
+    max_rules += (*c == ';');
+  }
+  ENL(rules = (stats_rules_t *)malloc(sizeof(stats_rules_t)));
+  ENL(rules->rules = (stats_rule_t *)calloc(max_rules, sizeof(stats_rule_t)));
+  rules->num_rules = 0;
+
+  ENL(copy = strdup(spec));
+  for (item = strtok_r(copy, ";", &save); item != NULL; item = strtok_r(NULL, ";", &save)) {
+    char *end = item + strlen(item);
+    while (isspace((unsigned char)*item)) {
+      item++;
+    }
+    while (end > item && isspace((unsigned char)end[-1])) {
+      *--end = '\0';
+    }
+    if (*item != '\0') {
+      rule_parse(&rules->rules[rules->num_rules], item);
+      rules->num_rules++;
+    }
+  }
+  free(copy);
+
+  return rules;
+}  /* stats_rules_create */
+
+
+void stats_rules_delete(stats_rules_t *rules)
+{
+  int r;
+
+  for (r = 0; r < rules->num_rules; r++) {
+    free(rules->rules[r].text);
+  }
+  free(rules->rules);
+  free(rules);
+}  /* stats_rules_delete */
+
+
+/* Compare one delta against the rule; returns non-zero if it fired. */
+static int rule_fires(const stats_rule_t *rule, uint64_t delta, uint64_t interval_ns, double *rate)
+{
+  double value;
+
+  *rate = (double)delta * 1e9 / (double)interval_ns;
+  value = rule->rate ? *rate : (double)delta;
+  return rule->inclusive ? (value >= rule->threshold) : (value > rule->threshold);
+}  /* rule_fires */
+
+
+/* Count a violation, and keep it if there is room. */
+static void add_alert(stats_sample_t *sample, int max_alerts, const stats_rule_t *rule, const stats_field_t *field,
+    int dir, int type, const char *source, uint64_t delta, double rate)
+{
+  stats_alert_t *alert;
+
+  sample->num_violations++;
+  if (sample->num_alerts >= max_alerts) {
+    return;
+  }
+  if (sample->num_alerts == sample->alerts_capacity) {
+    int new_capacity = (sample->alerts_capacity == 0) ? 16 : sample->alerts_capacity * 2;
+    ENL(sample->alerts = (stats_alert_t *)realloc(sample->alerts, sizeof(stats_alert_t) * new_capacity));
+    sample->alerts_capacity = new_capacity;
+  }
+  alert = &sample->alerts[sample->num_alerts++];
+  alert->rule = rule->text;
+  alert->field = field->name;
+  alert->dir = dir;
+  alert->type = type;
+  strncpy(alert->source, source, sizeof(alert->source) - 1);
+  alert->source[sizeof(alert->source) - 1] = '\0';
+  alert->delta = delta;
+  alert->rate = rate;
+}  /* add_alert */
+
+
+/* Check every rule against the deltas of "sample", which must have them.
+ * New and reset sessions are skipped; their deltas aren't real. Keeps at
+ * most max_alerts alerts in the sample, and returns the number of
+ * violations (also in sample->num_violations). */
+int stats_rules_check(const stats_rules_t *rules, stats_sample_t *sample, int max_alerts)
+{
+  int r, i;
+
+  sample->num_alerts = 0;
+  sample->num_violations = 0;
+  for (r = 0; r < rules->num_rules; r++) {
+    const stats_rule_t *rule = &rules->rules[r];
+    const stats_field_t *fields;
+    int num_fields;
+    double rate;
+
+    if (rule->dir == STATS_RULE_CTX) {
+      fields = stats_fields_ctx(&num_fields);
+      if (rule_fires(rule, sample->ctx_deltas[rule->field_index[0]], sample->interval_ns, &rate)) {
+        add_alert(sample, max_alerts, rule, &fields[rule->field_index[0]], STATS_RULE_CTX, 0, "",
+            sample->ctx_deltas[rule->field_index[0]], rate);
+      }
+      continue;
+    }
+
+    for (i = 0; i < ((rule->dir == STATS_STORE_SRC) ? sample->src_num_entries : sample->rcv_num_entries); i++) {
+      int type = (rule->dir == STATS_STORE_SRC) ? sample->src_stats[i].type : sample->rcv_stats[i].type;
+      const stats_delta_t *delta = (rule->dir == STATS_STORE_SRC) ? &sample->src_deltas[i] : &sample->rcv_deltas[i];
+      int t = stats_fields_type_index(type);
+      int f;
+
+      if (t < 0 || rule->field_index[t] < 0 || delta->status[0] != 'c') {
+        continue;
+      }
+      f = rule->field_index[t];
+      if (rule_fires(rule, delta->deltas[f], sample->interval_ns, &rate)) {
+        fields = fields_for(rule->dir, t, &num_fields);
+        add_alert(sample, max_alerts, rule, &fields[f], rule->dir, type,
+            (rule->dir == STATS_STORE_SRC) ? sample->src_stats[i].source : sample->rcv_stats[i].source,
+            delta->deltas[f], rate);
+      }
+    }
+  }
+
+  return sample->num_violations;
+}  /* stats_rules_check */
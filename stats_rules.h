@@ -0,0 +1,83 @@
+/* stats_rules.h - threshold rules on deltas and rates, checked every sample.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_RULES_H
+#define STATS_RULES_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_sample.h"
+
+/* Direction of a rule or alert, besides STATS_STORE_SRC/RCV. */
+#define STATS_RULE_CTX 2
+
+
+/* One rule, parsed from text like "rcv/lbtrm/naks_sent rate>100". */
+struct stats_rule_s {
+  char *text;  /* As given (trimmed), for alerts. */
+  int dir;  /* STATS_RULE_CTX or STATS_STORE_SRC/RCV. */
+  int type_index;  /* Only this transport type (see stats_fields_type_index()); -1=all. */
+  /* Index of the field in each type's field table, -1 if that type doesn't
+   * have it. The context's is field_index[0]. */
+  int field_index[STATS_NUM_TYPES];
+  int rate;  /* Non-zero to compare the per-second rate instead of the delta. */
+  int inclusive;  /* Non-zero for ">=", zero for ">". */
+  double threshold;
+};
+typedef struct stats_rule_s stats_rule_t;
+
+struct stats_rules_s {
+  stats_rule_t *rules;
+  int num_rules;
+};
+typedef struct stats_rules_s stats_rules_t;
+
+/* A rule that fired for the context or for one transport session. */
+struct stats_alert_s {
+  const char *rule;  /* The rule's text; valid while the stats_thread exists. */
+  const char *field;
+  int dir;  /* STATS_RULE_CTX or STATS_STORE_SRC/RCV. */
+  int type;  /* LBM_TRANSPORT_STAT_...; 0 for the context. */
+  char source[LBM_MSG_MAX_SOURCE_LEN];  /* Empty for the context. */
+  uint64_t delta;
+  double rate;  /* Per second. */
+};
+typedef struct stats_alert_s stats_alert_t;
+
+/* Called by the writer thread for each alert of each sample. */
+typedef void (*stats_alert_cb_t)(void *clientd, const char *ctx_name, const stats_alert_t *alert);
+
+
+stats_rules_t *stats_rules_create(const char *spec);
+void stats_rules_delete(stats_rules_t *rules);
+int stats_rules_check(const stats_rules_t *rules, stats_sample_t *sample, int max_alerts);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_RULES_H */
@@ -0,0 +1,125 @@
+/* stats_sample.c - one sample of a context's UM stats.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+void stats_sample_init(stats_sample_t *sample)
+{
+  memset(sample, 0, sizeof(*sample));
+  sample->src_stats = NULL;
+  sample->src_deltas = NULL;
+  sample->rcv_stats = NULL;
+  sample->rcv_deltas = NULL;
+  sample->left = NULL;
+  sample->alerts = NULL;
+  sample->summaries = NULL;
+  sample->aggregates = NULL;
+  sample->sends = NULL;
+}  /* stats_sample_init */
+
+
+/* Make room for at least the given number of entries. */
+void stats_sample_reserve(stats_sample_t *sample, int src_num_entries, int rcv_num_entries)
+{
+  if (src_num_entries > sample->src_capacity) {
+    ENL(sample->src_stats = (lbm_src_transport_stats_t *)realloc(sample->src_stats,
+        sizeof(lbm_src_transport_stats_t) * src_num_entries));
+    ENL(sample->src_deltas = (stats_delta_t *)realloc(sample->src_deltas,
+        sizeof(stats_delta_t) * src_num_entries));
+    sample->src_capacity = src_num_entries;
+  }
+  if (rcv_num_entries > sample->rcv_capacity) {
+    ENL(sample->rcv_stats = (lbm_rcv_transport_stats_t *)realloc(sample->rcv_stats,
+        sizeof(lbm_rcv_transport_stats_t) * rcv_num_entries));
+    ENL(sample->rcv_deltas = (stats_delta_t *)realloc(sample->rcv_deltas,
+        sizeof(stats_delta_t) * rcv_num_entries));
+    sample->rcv_capacity = rcv_num_entries;
+  }
+}  /* stats_sample_reserve */
+
+
+void stats_sample_add_left(stats_sample_t *sample, int dir, int type, const char *source)
+{
+  stats_left_t *left;
+
+  if (sample->num_left == sample->left_capacity) {
+    sample->left_capacity = (sample->left_capacity == 0) ? 16 : sample->left_capacity * 2;
+    ENL(sample->left = (stats_left_t *)realloc(sample->left, sizeof(stats_left_t) * sample->left_capacity));
+  }
+  left = &sample->left[sample->num_left++];
+  left->dir = dir;
+  left->type = type;
+  strncpy(left->source, source, sizeof(left->source) - 1);
+  left->source[sizeof(left->source) - 1] = '\0';
+}  /* stats_sample_add_left */
+
+
+/* Returns a new, zeroed aggregate at the end of the sample's list. */
+stats_aggregate_t *stats_sample_add_aggregate(stats_sample_t *sample)
+{
+  stats_aggregate_t *aggregate;
+
+  if (sample->num_aggregates == sample->aggregates_capacity) {
+    sample->aggregates_capacity = (sample->aggregates_capacity == 0) ? 16 : sample->aggregates_capacity * 2;
+    ENL(sample->aggregates = (stats_aggregate_t *)realloc(sample->aggregates,
+        sizeof(stats_aggregate_t) * sample->aggregates_capacity));
+  }
+  aggregate = &sample->aggregates[sample->num_aggregates++];
+  memset(aggregate, 0, sizeof(*aggregate));
+  return aggregate;
+}  /* stats_sample_add_aggregate */
+
+
+void stats_sample_free(stats_sample_t *sample)
+{
+  free(sample->src_stats);
+  free(sample->src_deltas);
+  free(sample->rcv_stats);
+  free(sample->rcv_deltas);
+  free(sample->left);
+  free(sample->alerts);
+  free(sample->summaries);
+  free(sample->aggregates);
+  free(sample->sends);
+  stats_sample_init(sample);
+}  /* stats_sample_free */
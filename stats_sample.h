@@ -0,0 +1,148 @@
+/* stats_sample.h - one sample of a context's UM stats, as passed from the
+ * sampling thread to the writer thread.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SAMPLE_H
+#define STATS_SAMPLE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_latency.h"
+
+struct stats_alert_s;  /* See stats_rules.h. */
+struct stats_window_summary_s;  /* See stats_window.h. */
+struct stats_send_summary_s;  /* See stats_send.h. */
+
+/* Deltas for one transport session (see project_session() in
+ * stats_thread.c and stats_store_compute()). */
+struct stats_delta_s {
+  const char *status;  /* "new", "cont", "reset". */
+  int row;  /* In the stats_store column group (used while sampling); -1=none. */
+  int changed;  /* Anything printed changed, or status isn't "cont" (for changes_only). */
+  int host_id;  /* Interned publisher address (see stats_source.h); -1=none. */
+  int group_id;  /* Interned multicast group; -1=none. */
+  lbm_ulong_t deltas[STATS_MAX_FIELDS];
+};
+typedef struct stats_delta_s stats_delta_t;
+
+/* A transport session that was in the previous sample but not this one. */
+struct stats_left_s {
+  int dir;  /* STATS_STORE_SRC/RCV. */
+  int type;
+  char source[LBM_MSG_MAX_SOURCE_LEN];
+};
+typedef struct stats_left_s stats_left_t;
+
+/* Sum of the deltas of one direction's sessions of one transport type that
+ * share a publisher host or a multicast group (see host_totals). */
+struct stats_aggregate_s {
+  int dir;  /* STATS_STORE_SRC/RCV. */
+  int type;
+  int by_group;  /* Zero: "addr" is the publisher host. */
+  uint32_t addr;  /* Host byte order. */
+  int num_sessions;
+  uint64_t deltas[STATS_MAX_FIELDS];
+};
+typedef struct stats_aggregate_s stats_aggregate_t;
+
+/* The arrays are owned by the sample and only ever grow, so a sample that
+ * is reused for every interval stops allocating once it is big enough. */
+struct stats_sample_s {
+  uint64_t seq;  /* Counts samples taken, including any dropped. */
+  uint64_t sample_ns;  /* CLOCK_MONOTONIC, right after the context stats were retrieved. */
+  uint64_t sample_realtime_ns;  /* CLOCK_REALTIME, read back-to-back with sample_ns. */
+  uint64_t retrieve_ns;  /* Time spent retrieving context, source, and receiver stats. */
+  uint64_t interval_ns;  /* Since previous sample. */
+  /* With a coordinated stats_monitor, the tick the sample was taken in and
+   * the wall clock time it is aligned to; zero for other samples. */
+  uint64_t tick_id;
+  uint64_t tick_realtime_ns;
+  int have_deltas;  /* Zero if deltas are disabled or this is the first sample. */
+  lbm_context_stats_t ctx_stats;
+  lbm_ulong_t ctx_deltas[STATS_MAX_FIELDS];
+  int src_num_entries;
+  int src_capacity;
+  lbm_src_transport_stats_t *src_stats;
+  stats_delta_t *src_deltas;
+  int rcv_num_entries;
+  int rcv_capacity;
+  lbm_rcv_transport_stats_t *rcv_stats;
+  stats_delta_t *rcv_deltas;
+  /* Sum of the deltas of all sessions of each direction and transport type
+   * ([STATS_STORE_SRC/RCV][type index]), and how many sessions there were. */
+  int have_totals;
+  int total_sessions[2][STATS_NUM_TYPES];
+  uint64_t totals[2][STATS_NUM_TYPES][STATS_MAX_FIELDS];
+  int keyframe;  /* With changes_only, print every session this time. */
+  int num_left;
+  int left_capacity;
+  stats_left_t *left;
+  /* Rules that fired (see stats_rules.h). Only the first max_alerts are
+   * kept; num_violations counts them all. */
+  int num_alerts;
+  int alerts_capacity;
+  struct stats_alert_s *alerts;
+  int num_violations;
+  int burst_change;  /* +1 if burst sampling started after this sample, -1 if it ended. */
+  uint64_t burst_sample_interval_ns;  /* With burst_change: the sampling interval from then on. */
+  /* Rolling window summaries (see stats_window.h), on some samples. */
+  int num_summaries;
+  int summaries_capacity;
+  struct stats_window_summary_s *summaries;
+  /* Per host and per group sums, by direction, in order of first session. */
+  int num_aggregates;
+  int aggregates_capacity;
+  stats_aggregate_t *aggregates;
+  /* Receive-path latency over the interval (see stats_latency.h). */
+  int have_latency;
+  stats_latency_summary_t latency[STATS_NUM_TYPES][STATS_LATENCY_NUM_METRICS];
+  /* Sends through stats_send() over the interval, one per source. */
+  int num_sends;
+  int sends_capacity;
+  struct stats_send_summary_s *sends;
+  /* The stats_thread's own costs (see self_stats and cpu_budget_pct). */
+  int retrieve_retries;  /* Buffer-grow retries while retrieving. */
+  uint64_t cpu_ns;  /* Sampling and writer CPU time since the previous output sample. */
+  /* 0: normal. 1: session lines are skipped. 2 and up: sampling is also
+   * 2^(degrade-1) times slower. */
+  int degrade;
+  int degrade_change;  /* +1 or -1 if degrade changed after this sample. */
+};
+typedef struct stats_sample_s stats_sample_t;
+
+
+void stats_sample_init(stats_sample_t *sample);
+void stats_sample_reserve(stats_sample_t *sample, int src_num_entries, int rcv_num_entries);
+void stats_sample_add_left(stats_sample_t *sample, int dir, int type, const char *source);
+stats_aggregate_t *stats_sample_add_aggregate(stats_sample_t *sample);
+void stats_sample_free(stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SAMPLE_H */
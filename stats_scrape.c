@@ -0,0 +1,546 @@
+/* stats_scrape.c - serves the current stats to scrapers (OpenMetrics text).
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#define _GNU_SOURCE  /* For accept4() and memmem(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "lbm/lbm.h"
+#include "stats_fmt.h"
+#include "stats_thread.h"
+#include "stats_monitor.h"
+#include "stats_scrape.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define IDLE_NS ((uint64_t)STATS_SCRAPE_IDLE_MS * 1000000)
+
+
+static uint64_t mono_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* mono_ns */
+
+
+/* Listen on a Unix domain socket, replacing a stale socket file (but not
+ * one that something is listening on). */
+static int listen_unix(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ERROR (%s:%d): scrape_addr '%s' too long\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  EM1(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "ERROR (%s:%d): scrape_addr '%s' is in use\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  close(fd);
+  (void)unlink(path);
+
+  EM1(fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  EM1(bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EM1(listen(fd, 64));
+  return fd;
+}  /* listen_unix */
+
+
+/* Listen on TCP "[host:]port"; the host defaults to 127.0.0.1. */
+static int listen_tcp(const char *addr_str)
+{
+  struct sockaddr_in addr;
+  const char *colon = strrchr(addr_str, ':');
+  const char *port_str = (colon != NULL) ? colon + 1 : addr_str;
+  char host[64];
+  char *end;
+  long port;
+  int one = 1;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  port = strtol(port_str, &end, 10);
+  if (end == port_str || *end != '\0' || port < 0 || port > 65535) {
+    fprintf(stderr, "ERROR (%s:%d): bad scrape_addr '%s'\n", __FILE__, __LINE__, addr_str);
+    exit(1);
+  }
+  addr.sin_port = htons((uint16_t)port);
+  if (colon != NULL) {
+    if ((size_t)(colon - addr_str) >= sizeof(host)) {
+      fprintf(stderr, "ERROR (%s:%d): bad scrape_addr '%s'\n", __FILE__, __LINE__, addr_str);
+      exit(1);
+    }
+    memcpy(host, addr_str, colon - addr_str);
+    host[colon - addr_str] = '\0';
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+      fprintf(stderr, "ERROR (%s:%d): bad scrape_addr '%s'\n", __FILE__, __LINE__, addr_str);
+      exit(1);
+    }
+  }
+
+  EM1(fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  EM1(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  EM1(bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  EM1(listen(fd, 64));
+  return fd;
+}  /* listen_tcp */
+
+
+/* Arm the timer for "deadline_ns", unless it is already armed for
+ * earlier. A timer that goes off early just rechecks the deadlines. */
+static void arm_timer(stats_scrape_t *scrape, uint64_t deadline_ns)
+{
+  struct itimerspec its;
+
+  if (scrape->timer_ns != 0 && scrape->timer_ns <= deadline_ns) {
+    return;
+  }
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = deadline_ns / 1000000000;
+  its.it_value.tv_nsec = deadline_ns % 1000000000;
+  EM1(timerfd_settime(scrape->timer_fd, TFD_TIMER_ABSTIME, &its, NULL));
+  scrape->timer_ns = deadline_ns;
+}  /* arm_timer */
+
+
+static void conn_close(stats_scrape_t *scrape, stats_scrape_conn_t *conn)
+{
+  stats_monitor_unwatch(scrape->monitor, conn->fd);
+  close(conn->fd);
+  conn->fd = -1;
+  if (conn->shared != NULL) {
+    conn->shared->num_senders--;
+    conn->shared = NULL;
+  }
+  conn->sending = 0;
+}  /* conn_close */
+
+
+/* Retrieve and format the stats, unless the cached response is younger
+ * than min_age. If the cached response is still being sent to someone,
+ * the new one goes in another buffer. */
+static void refresh(stats_scrape_t *scrape)
+{
+  stats_scrape_body_t *body = scrape->current;
+  int i;
+
+  if (body != NULL && mono_ns() - scrape->cached_ns < scrape->min_age_ns) {
+    return;
+  }
+  if (body == NULL || body->num_senders > 0) {
+    /* Prefer a buffer that was used before (it already has room). */
+    body = NULL;
+    for (i = 0; i < STATS_SCRAPE_MAX_CONNS + 1; i++) {
+      if (scrape->bodies[i].num_senders == 0 && (body == NULL || body->fmt == NULL)) {
+        body = &scrape->bodies[i];
+      }
+    }
+    if (body->fmt == NULL) {
+      body->fmt = stats_fmt_create(64 * 1024);
+    }
+  }
+  stats_thread_retrieve(scrape->stats_thread, &scrape->sample);
+  body->fmt->len = 0;
+  stats_fmt_openmetrics(body->fmt, scrape->stats_thread, &scrape->sample);
+  scrape->current = body;
+  scrape->cached_ns = scrape->sample.sample_ns;
+  scrape->num_retrievals++;
+}  /* refresh */
+
+
+/* Send as much of the response as the socket takes. Closes the connection
+ * when done (every response is "Connection: close"). */
+static void send_response(stats_scrape_t *scrape, stats_scrape_conn_t *conn)
+{
+  while (conn->sent < conn->header_len + conn->body_len) {
+    struct iovec iov[2];
+    struct msghdr msg;
+    int num_iov = 0;
+    ssize_t n;
+
+    if (conn->sent < conn->header_len) {
+      iov[num_iov].iov_base = conn->header + conn->sent;
+      iov[num_iov].iov_len = conn->header_len - conn->sent;
+      num_iov++;
+      iov[num_iov].iov_base = (void *)conn->body;
+      iov[num_iov].iov_len = conn->body_len;
+      num_iov++;
+    } else {
+      iov[num_iov].iov_base = (void *)(conn->body + (conn->sent - conn->header_len));
+      iov[num_iov].iov_len = conn->body_len - (conn->sent - conn->header_len);
+      num_iov++;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = num_iov;
+    n = sendmsg(conn->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!conn->sending) {
+        /* Finish when the socket has room. */
+        conn->sending = 1;
+        stats_monitor_watch_modify(scrape->monitor, conn->fd, EPOLLOUT);
+      }
+      return;
+    }
+    if (n == -1 && errno != EINTR) {
+      break;  /* The scraper went away. */
+    }
+    if (n > 0) {
+      conn->sent += n;
+      conn->deadline_ns = mono_ns() + IDLE_NS;
+    }
+  }
+  conn_close(scrape, conn);
+}  /* send_response */
+
+
+/* The request line and headers are in; answer it. Only "GET /metrics"
+ * (or "/") is served; the rest of the request is ignored. */
+static void respond(stats_scrape_t *scrape, stats_scrape_conn_t *conn, int complete)
+{
+  static const char not_found[] = "Not found\n";
+  static const char bad_request[] = "Bad request\n";
+  const char *status = "200 OK";
+  const char *content_type = CONTENT_TYPE;
+  const char *path = conn->request + 4;
+  size_t path_len = 0;
+
+  scrape->num_requests++;
+  if (complete && strncmp(conn->request, "GET ", 4) == 0) {
+    path_len = strcspn(path, " ?\r\n");
+  }
+  if (path_len == 0) {
+    status = "400 Bad Request";
+    conn->body = bad_request;
+    conn->body_len = sizeof(bad_request) - 1;
+  }
+  else if ((path_len == 8 && memcmp(path, "/metrics", 8) == 0) || (path_len == 1 && path[0] == '/')) {
+    refresh(scrape);
+    conn->shared = scrape->current;
+    conn->shared->num_senders++;
+    conn->body = conn->shared->fmt->buf;
+    conn->body_len = conn->shared->fmt->len;
+  }
+  else {
+    status = "404 Not Found";
+    conn->body = not_found;
+    conn->body_len = sizeof(not_found) - 1;
+  }
+  if (conn->shared == NULL) {
+    content_type = "text/plain; charset=utf-8";
+  }
+  conn->header_len = (size_t)snprintf(conn->header, sizeof(conn->header),
+      "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+      status, content_type, (unsigned long)conn->body_len);
+  conn->sent = 0;
+  send_response(scrape, conn);
+}  /* respond */
+
+
+/* Read what there is of the request; answer once it is complete. */
+static void read_request(stats_scrape_t *scrape, stats_scrape_conn_t *conn)
+{
+  for (;;) {
+    /* Keep room for a '\0', so that the request can be parsed as a string. */
+    ssize_t n = recv(conn->fd, conn->request + conn->request_len,
+        sizeof(conn->request) - 1 - conn->request_len, MSG_DONTWAIT);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      conn_close(scrape, conn);  /* Closed (or failed) before the request was complete. */
+      return;
+    }
+    conn->request_len += n;
+    conn->request[conn->request_len] = '\0';
+    conn->deadline_ns = mono_ns() + IDLE_NS;
+    if (memmem(conn->request, conn->request_len, "\r\n\r\n", 4) != NULL
+        || memmem(conn->request, conn->request_len, "\n\n", 2) != NULL) {
+      respond(scrape, conn, 1);
+      return;
+    }
+    if (conn->request_len == (int)sizeof(conn->request) - 1) {
+      respond(scrape, conn, 0);  /* Too long. */
+      return;
+    }
+  }
+}  /* read_request */
+
+
+/* stats_monitor_fd_cb_t for connections. */
+static void conn_cb(void *clientd, int fd, uint32_t events)
+{
+  stats_scrape_t *scrape = (stats_scrape_t *)clientd;
+  int i;
+
+  (void)events;
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS; i++) {
+    stats_scrape_conn_t *conn = &scrape->conns[i];
+    if (conn->fd == fd) {
+      if (conn->sending) {
+        send_response(scrape, conn);
+      } else {
+        read_request(scrape, conn);
+      }
+      return;
+    }
+  }
+}  /* conn_cb */
+
+
+/* stats_monitor_fd_cb_t for the listening socket. */
+static void listen_cb(void *clientd, int fd, uint32_t events)
+{
+  stats_scrape_t *scrape = (stats_scrape_t *)clientd;
+
+  (void)events;
+  for (;;) {
+    stats_scrape_conn_t *conn = NULL;
+    int conn_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    int i;
+    if (conn_fd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+        perror("WARNING: scrape accept");
+      }
+      return;
+    }
+    for (i = 0; i < STATS_SCRAPE_MAX_CONNS; i++) {
+      if (scrape->conns[i].fd == -1) {
+        conn = &scrape->conns[i];
+        break;
+      }
+      if (conn == NULL || scrape->conns[i].accept_ns < conn->accept_ns) {
+        conn = &scrape->conns[i];
+      }
+    }
+    if (conn->fd != -1) {
+      conn_close(scrape, conn);  /* All in use; evict the oldest. */
+    }
+    conn->fd = conn_fd;
+    conn->accept_ns = mono_ns();
+    conn->deadline_ns = conn->accept_ns + IDLE_NS;
+    conn->request_len = 0;
+    conn->header_len = 0;
+    conn->shared = NULL;
+    conn->body = NULL;
+    conn->body_len = 0;
+    conn->sent = 0;
+    conn->sending = 0;
+    stats_monitor_watch(scrape->monitor, conn_fd, EPOLLIN, conn_cb, scrape);
+    arm_timer(scrape, conn->deadline_ns);
+  }
+}  /* listen_cb */
+
+
+/* stats_monitor_fd_cb_t for the timer: close connections that made no
+ * progress for STATS_SCRAPE_IDLE_MS, and rearm for the next deadline. */
+static void timer_cb(void *clientd, int fd, uint32_t events)
+{
+  stats_scrape_t *scrape = (stats_scrape_t *)clientd;
+  uint64_t now = mono_ns();
+  uint64_t next_ns = 0;
+  uint64_t count;
+  int i;
+
+  (void)events;
+  if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    EM1(-1);
+  }
+  scrape->timer_ns = 0;  /* Expired. */
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS; i++) {
+    stats_scrape_conn_t *conn = &scrape->conns[i];
+    if (conn->fd == -1) {
+      continue;
+    }
+    if (conn->deadline_ns <= now) {
+      conn_close(scrape, conn);
+      scrape->num_timeouts++;
+    }
+    else if (next_ns == 0 || conn->deadline_ns < next_ns) {
+      next_ns = conn->deadline_ns;
+    }
+  }
+  if (next_ns != 0) {
+    arm_timer(scrape, next_ns);
+  }
+}  /* timer_cb */
+
+
+/* "addr" is a Unix domain socket path (starting with '/'), or TCP
+ * "[host:]port". Listens right away, but only serves once started. */
+stats_scrape_t *stats_scrape_create(const char *addr, struct stats_thread_s *stats_thread, int min_age_ms)
+{
+  stats_scrape_t *scrape;
+  int i;
+
+  ENL(scrape = (stats_scrape_t *)malloc(sizeof(stats_scrape_t)));
+  ENL(scrape->addr = strdup(addr));
+  scrape->unix_path = NULL;
+  if (addr[0] == '/') {
+    scrape->listen_fd = listen_unix(addr);
+    ENL(scrape->unix_path = strdup(addr));
+  } else {
+    scrape->listen_fd = listen_tcp(addr);
+  }
+  scrape->stats_thread = stats_thread;
+  scrape->monitor = NULL;
+  EM1(scrape->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+  scrape->timer_ns = 0;
+  scrape->min_age_ns = (uint64_t)((min_age_ms > 0) ? min_age_ms : 0) * 1000000;
+  scrape->cached_ns = 0;
+  stats_sample_init(&scrape->sample);
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS + 1; i++) {
+    scrape->bodies[i].fmt = NULL;
+    scrape->bodies[i].num_senders = 0;
+  }
+  scrape->bodies[0].fmt = stats_fmt_create(64 * 1024);
+  scrape->current = NULL;
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS; i++) {
+    scrape->conns[i].fd = -1;
+    scrape->conns[i].shared = NULL;
+    scrape->conns[i].sending = 0;
+  }
+  scrape->num_requests = 0;
+  scrape->num_retrievals = 0;
+  scrape->num_timeouts = 0;
+
+  return scrape;
+}  /* stats_scrape_create */
+
+
+/* Serve requests from the monitor's scheduler thread. */
+void stats_scrape_start(stats_scrape_t *scrape, stats_monitor_t *monitor)
+{
+  scrape->monitor = monitor;
+  stats_monitor_watch(monitor, scrape->listen_fd, EPOLLIN, listen_cb, scrape);
+  stats_monitor_watch(monitor, scrape->timer_fd, EPOLLIN, timer_cb, scrape);
+}  /* stats_scrape_start */
+
+
+/* Stop serving and close all connections. Waits for a request being served. */
+void stats_scrape_stop(stats_scrape_t *scrape)
+{
+  int i;
+
+  if (scrape->monitor == NULL) {
+    return;
+  }
+  stats_monitor_unwatch_all(scrape->monitor, scrape);
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS; i++) {
+    if (scrape->conns[i].fd != -1) {
+      close(scrape->conns[i].fd);
+      scrape->conns[i].fd = -1;
+      scrape->conns[i].shared = NULL;
+      scrape->conns[i].sending = 0;
+    }
+  }
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS + 1; i++) {
+    scrape->bodies[i].num_senders = 0;
+  }
+  scrape->monitor = NULL;
+}  /* stats_scrape_stop */
+
+
+void stats_scrape_delete(stats_scrape_t *scrape)
+{
+  int i;
+
+  stats_scrape_stop(scrape);
+  close(scrape->listen_fd);
+  close(scrape->timer_fd);
+  if (scrape->unix_path != NULL) {
+    (void)unlink(scrape->unix_path);
+    free(scrape->unix_path);
+  }
+  for (i = 0; i < STATS_SCRAPE_MAX_CONNS + 1; i++) {
+    if (scrape->bodies[i].fmt != NULL) {
+      stats_fmt_delete(scrape->bodies[i].fmt);
+    }
+  }
+  stats_sample_free(&scrape->sample);
+  free(scrape->addr);
+  free(scrape);
+}  /* stats_scrape_delete */
@@ -0,0 +1,111 @@
+/* stats_scrape.h - serves the current stats to scrapers (OpenMetrics text).
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SCRAPE_H
+#define STATS_SCRAPE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats_sample.h"
+#include "stats_monitor.h"
+
+struct stats_thread_s;  /* See stats_thread.h. */
+struct stats_fmt_s;  /* See stats_fmt.h. */
+
+/* A stats_thread with a "scrape_addr" listens on it for HTTP requests
+ * ("GET /metrics") and answers with its context, source and receiver
+ * stats in OpenMetrics text format. The sockets are watched by the
+ * stats_thread's monitor, so they are served by its scheduler thread.
+ * Stats are only retrieved for a request, and the response is kept for
+ * "min_age_ms", so that scrapers arriving together share one retrieval.
+ * A response being sent to a slow scraper stays in its buffer until it
+ * is sent, while newer responses go to another one. All buffers are
+ * reused; a request only allocates if the stats grew (or more scrapers
+ * than before are slow). */
+#define STATS_SCRAPE_MAX_CONNS 16  /* More evict the oldest. */
+#define STATS_SCRAPE_REQUEST_SIZE 1024  /* Request line and headers. */
+#define STATS_SCRAPE_HEADER_SIZE 256  /* Response status line and headers. */
+/* A connection is closed if it makes no progress (request bytes read or
+ * response bytes sent) for this long. */
+#define STATS_SCRAPE_IDLE_MS 10000
+
+/* One formatted response, shared by the connections sending it. */
+struct stats_scrape_body_s {
+  struct stats_fmt_s *fmt;  /* NULL until first needed. */
+  int num_senders;  /* Connections sending it; it isn't reused until 0. */
+};
+typedef struct stats_scrape_body_s stats_scrape_body_t;
+
+struct stats_scrape_conn_s {
+  int fd;  /* -1=free. */
+  uint64_t accept_ns;  /* CLOCK_MONOTONIC. */
+  uint64_t deadline_ns;  /* CLOCK_MONOTONIC; closed if no progress by then. */
+  char request[STATS_SCRAPE_REQUEST_SIZE];
+  int request_len;
+  /* Response, once the request is complete. */
+  char header[STATS_SCRAPE_HEADER_SIZE];
+  size_t header_len;
+  stats_scrape_body_t *shared;  /* The cached response sent, or NULL for a static error. */
+  const char *body;
+  size_t body_len;
+  size_t sent;  /* Of header plus body. */
+  int sending;
+};
+typedef struct stats_scrape_conn_s stats_scrape_conn_t;
+
+/* Only used by the monitor's scheduler thread, once started. */
+struct stats_scrape_s {
+  char *addr;
+  char *unix_path;  /* Unlinked at delete; NULL for TCP. */
+  int listen_fd;
+  struct stats_thread_s *stats_thread;
+  stats_monitor_t *monitor;  /* NULL unless started. */
+  int timer_fd;  /* Absolute CLOCK_MONOTONIC time to check the deadlines. */
+  uint64_t timer_ns;  /* When timer_fd is armed for; 0=disarmed. */
+  uint64_t min_age_ns;
+  uint64_t cached_ns;  /* CLOCK_MONOTONIC retrieval time of "current". */
+  stats_sample_t sample;
+  /* Each connection holds at most one body, so one is always free. */
+  stats_scrape_body_t bodies[STATS_SCRAPE_MAX_CONNS + 1];
+  stats_scrape_body_t *current;  /* The cached response; NULL=none yet. */
+  stats_scrape_conn_t conns[STATS_SCRAPE_MAX_CONNS];
+  uint64_t num_requests;
+  uint64_t num_retrievals;
+  uint64_t num_timeouts;
+};
+typedef struct stats_scrape_s stats_scrape_t;
+
+
+stats_scrape_t *stats_scrape_create(const char *addr, struct stats_thread_s *stats_thread, int min_age_ms);
+void stats_scrape_start(stats_scrape_t *scrape, stats_monitor_t *monitor);
+void stats_scrape_stop(stats_scrape_t *scrape);
+void stats_scrape_delete(stats_scrape_t *scrape);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SCRAPE_H */
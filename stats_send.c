@@ -0,0 +1,310 @@
+/* stats_send.c - instrumented lbm_src_send(), with per-thread counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+#include "stats_send.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* A sending thread's slots, by source ID. Only that thread uses it; the
+ * list is under the stats_send's lock. */
+struct stats_send_table_s {
+  stats_send_t *send;
+  stats_send_slot_t **slots;
+  int capacity;
+  struct stats_send_table_s *next;
+};
+
+
+/* Thread-exit destructor of the key. */
+static void free_table(void *arg)
+{
+  struct stats_send_table_s *table = (struct stats_send_table_s *)arg;
+  stats_send_t *send = table->send;
+  struct stats_send_table_s **link;
+
+  ENZ(errno = pthread_mutex_lock(&send->lock));
+  for (link = &send->tables; *link != table; link = &(*link)->next) {
+  }
+  *link = table->next;
+  ENZ(errno = pthread_mutex_unlock(&send->lock));
+  free(table->slots);
+  free(table);
+}  /* free_table */
+
+
+stats_send_t *stats_send_create(void)
+{
+  stats_send_t *send;
+
+  ENL(send = (stats_send_t *)malloc(sizeof(stats_send_t)));
+  ENZ(errno = pthread_key_create(&send->key, free_table));
+  ENZ(errno = pthread_mutex_init(&send->lock, NULL));
+  send->srcs = NULL;
+  send->removed = NULL;
+  send->tables = NULL;
+  send->num_ids = 0;
+
+  return send;
+}  /* stats_send_create */
+
+
+static void free_src(stats_send_src_t *send_src)
+{
+  while (send_src->slots != NULL) {
+    stats_send_slot_t *slot = send_src->slots;
+    send_src->slots = slot->next;
+    free(slot);
+  }
+  free(send_src);
+}  /* free_src */
+
+
+/* Only once nobody sends any more and the stats_thread is deleted, and
+ * no sending thread is exiting concurrently. Frees the slot tables of all
+ * threads that are still running (the key's destructor won't run for them
+ * once the key is deleted). */
+void stats_send_delete(stats_send_t *send)
+{
+  pthread_key_delete(send->key);
+  while (send->tables != NULL) {
+    struct stats_send_table_s *table = send->tables;
+    send->tables = table->next;
+    free(table->slots);
+    free(table);
+  }
+  while (send->srcs != NULL) {
+    stats_send_src_t *send_src = send->srcs;
+    send->srcs = send_src->next;
+    free_src(send_src);
+  }
+  while (send->removed != NULL) {
+    stats_send_src_t *send_src = send->removed;
+    send->removed = send_src->next;
+    free_src(send_src);
+  }
+  pthread_mutex_destroy(&send->lock);
+  free(send);
+}  /* stats_send_delete */
+
+
+/* Start counting sends on "src", reported as "name" (e.g. the topic). */
+stats_send_src_t *stats_send_src_add(stats_send_t *send, lbm_src_t *src, const char *name)
+{
+  stats_send_src_t *send_src;
+  stats_send_src_t **tail;
+
+  ENL(send_src = (stats_send_src_t *)calloc(1, sizeof(stats_send_src_t)));
+  send_src->send = send;
+  send_src->src = src;
+  strncpy(send_src->name, name, sizeof(send_src->name) - 1);
+  send_src->name[sizeof(send_src->name) - 1] = '\0';
+  send_src->slots = NULL;
+
+  ENZ(errno = pthread_mutex_lock(&send->lock));
+  send_src->id = send->num_ids++;
+  for (tail = &send->srcs; *tail != NULL; tail = &(*tail)->next) {
+  }
+  *tail = send_src;
+  ENZ(errno = pthread_mutex_unlock(&send->lock));
+
+  return send_src;
+}  /* stats_send_src_add */
+
+
+/* Call before deleting the source. Its counts are reported one more time;
+ * don't send on it after this. */
+void stats_send_src_remove(stats_send_src_t *send_src)
+{
+  ENZ(errno = pthread_mutex_lock(&send_src->send->lock));
+  send_src->removed = 1;
+  ENZ(errno = pthread_mutex_unlock(&send_src->send->lock));
+}  /* stats_send_src_remove */
+
+
+/* The calling thread's slot for a source; created on its first send. */
+static stats_send_slot_t *this_slot(stats_send_src_t *send_src)
+{
+  stats_send_t *send = send_src->send;
+  struct stats_send_table_s *table = (struct stats_send_table_s *)pthread_getspecific(send->key);
+  stats_send_slot_t *slot;
+
+  if (table != NULL && send_src->id < table->capacity && table->slots[send_src->id] != NULL) {
+    return table->slots[send_src->id];  /* Fast path. */
+  }
+
+  if (table == NULL) {
+    ENL(table = (struct stats_send_table_s *)calloc(1, sizeof(struct stats_send_table_s)));
+    table->send = send;
+    ENZ(errno = pthread_mutex_lock(&send->lock));
+    table->next = send->tables;
+    send->tables = table;
+    ENZ(errno = pthread_mutex_unlock(&send->lock));
+    ENZ(errno = pthread_setspecific(send->key, table));
+  }
+  if (send_src->id >= table->capacity) {
+    int new_capacity = (table->capacity == 0) ? 16 : table->capacity;
+    while (new_capacity <= send_src->id) {
+      new_capacity *= 2;
+    }
+    ENL(table->slots = (stats_send_slot_t **)realloc(table->slots, sizeof(stats_send_slot_t *) * new_capacity));
+    memset(&table->slots[table->capacity], 0, sizeof(stats_send_slot_t *) * (new_capacity - table->capacity));
+    table->capacity = new_capacity;
+  }
+  ENL(slot = (stats_send_slot_t *)aligned_alloc(64, sizeof(stats_send_slot_t)));
+  memset(slot, 0, sizeof(*slot));
+  ENZ(errno = pthread_mutex_lock(&send->lock));
+  slot->next = send_src->slots;
+  send_src->slots = slot;
+  ENZ(errno = pthread_mutex_unlock(&send->lock));
+  table->slots[send_src->id] = slot;
+
+  return slot;
+}  /* this_slot */
+
+
+/* Use in place of lbm_src_send(send_src->src, ...); returns the same. */
+int stats_send(stats_send_src_t *send_src, const char *msg, size_t len, int flags)
+{
+  stats_send_slot_t *slot = this_slot(send_src);
+  uint64_t start_ns = stats_latency_now_ns();
+  uint64_t duration_ns;
+  int err;
+
+  err = lbm_src_send(send_src->src, msg, len, flags);
+  duration_ns = stats_latency_now_ns() - start_ns;
+
+  stats_latency_add(&slot->calls, 1);
+  if (err == 0) {
+    stats_latency_add(&slot->bytes, len);
+  } else if (lbm_errnum() == LBM_EWOULDBLOCK) {
+    stats_latency_add(&slot->would_block, 1);
+  } else {
+    stats_latency_add(&slot->errors, 1);
+  }
+  stats_latency_add(&slot->counts[stats_latency_bucket(duration_ns)], 1);
+  stats_latency_add(&slot->sum_ns, duration_ns);
+
+  return err;
+}  /* stats_send */
+
+
+static stats_send_summary_t *add_summary(stats_sample_t *sample)
+{
+  if (sample->num_sends == sample->sends_capacity) {
+    int new_capacity = (sample->sends_capacity == 0) ? 16 : sample->sends_capacity * 2;
+    ENL(sample->sends = (stats_send_summary_t *)realloc(sample->sends, sizeof(stats_send_summary_t) * new_capacity));
+    sample->sends_capacity = new_capacity;
+  }
+  return &sample->sends[sample->num_sends++];
+}  /* add_summary */
+
+
+static uint64_t delta(uint64_t cur, uint64_t *prev)
+{
+  uint64_t d = cur - *prev;
+
+  *prev = cur;
+  return d;
+}  /* delta */
+
+
+/* Add a summary of each source's sends since the previous call to the
+ * sample. Called by the stats_thread for each output sample. */
+void stats_send_collect(stats_send_t *send, stats_sample_t *sample)
+{
+  stats_send_src_t **link;
+  int b;
+
+  ENZ(errno = pthread_mutex_lock(&send->lock));
+  link = &send->srcs;
+  while (*link != NULL) {
+    stats_send_src_t *send_src = *link;
+    stats_send_summary_t *summary = add_summary(sample);
+    uint64_t calls = 0, bytes = 0, would_block = 0, errors = 0, sum_ns = 0;
+    uint64_t counts[STATS_LATENCY_NUM_BUCKETS];
+    stats_send_slot_t *slot;
+
+    memset(counts, 0, sizeof(counts));
+    for (slot = send_src->slots; slot != NULL; slot = slot->next) {
+      calls += __atomic_load_n(&slot->calls, __ATOMIC_RELAXED);
+      bytes += __atomic_load_n(&slot->bytes, __ATOMIC_RELAXED);
+      would_block += __atomic_load_n(&slot->would_block, __ATOMIC_RELAXED);
+      errors += __atomic_load_n(&slot->errors, __ATOMIC_RELAXED);
+      sum_ns += __atomic_load_n(&slot->sum_ns, __ATOMIC_RELAXED);
+      for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+        counts[b] += __atomic_load_n(&slot->counts[b], __ATOMIC_RELAXED);
+      }
+    }
+
+    memcpy(summary->name, send_src->name, sizeof(summary->name));
+    summary->calls = delta(calls, &send_src->prev_calls);
+    summary->bytes = delta(bytes, &send_src->prev_bytes);
+    summary->would_block = delta(would_block, &send_src->prev_would_block);
+    summary->errors = delta(errors, &send_src->prev_errors);
+    for (b = 0; b < STATS_LATENCY_NUM_BUCKETS; b++) {
+      counts[b] = delta(counts[b], &send_src->prev_counts[b]);
+    }
+    stats_latency_summarize(counts, delta(sum_ns, &send_src->prev_sum_ns), &summary->duration);
+
+    if (send_src->removed) {
+      *link = send_src->next;  /* Reported for the last time. */
+      send_src->next = send->removed;
+      send->removed = send_src;
+    } else {
+      link = &send_src->next;
+    }
+  }
+  ENZ(errno = pthread_mutex_unlock(&send->lock));
+}  /* stats_send_collect */
@@ -0,0 +1,111 @@
+/* stats_send.h - instrumented lbm_src_send(), with per-thread counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SEND_H
+#define STATS_SEND_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "lbm/lbm.h"
+#include "stats_latency.h"
+
+struct stats_sample_s;  /* See stats_sample.h. */
+
+/* Longest source name kept (longer ones are truncated). */
+#define STATS_SEND_NAME_LEN 128
+
+/* One thread's counters for one source. Only that thread writes them, and
+ * each is aligned to its own cache lines, so threads sending on the same
+ * source don't share any. Like stats_latency.h, counts only increase and
+ * the collector subtracts the previous sums. */
+struct stats_send_slot_s {
+  uint64_t calls;
+  uint64_t bytes;  /* Of successful sends. */
+  uint64_t would_block;  /* LBM_EWOULDBLOCK returns. */
+  uint64_t errors;  /* Any other failure. */
+  uint64_t sum_ns;
+  uint64_t counts[STATS_LATENCY_NUM_BUCKETS];  /* Call durations. */
+  struct stats_send_slot_s *next;  /* In the source's list. */
+} __attribute__((aligned(64)));
+typedef struct stats_send_slot_s stats_send_slot_t;
+
+/* One lbm_src_t. Returned by stats_send_src_add(); kept until
+ * stats_send_delete(). */
+struct stats_send_src_s {
+  struct stats_send_s *send;
+  lbm_src_t *src;
+  char name[STATS_SEND_NAME_LEN];
+  int id;  /* Index into each thread's slot table. */
+  int removed;
+  stats_send_slot_t *slots;  /* One per thread that has sent. */
+  /* Used by the collecting stats_thread only. */
+  uint64_t prev_calls;
+  uint64_t prev_bytes;
+  uint64_t prev_would_block;
+  uint64_t prev_errors;
+  uint64_t prev_sum_ns;
+  uint64_t prev_counts[STATS_LATENCY_NUM_BUCKETS];
+  struct stats_send_src_s *next;
+};
+typedef struct stats_send_src_s stats_send_src_t;
+
+/* Shared by the sending threads and one stats_thread (see the "send"
+ * config field). */
+struct stats_send_s {
+  pthread_key_t key;  /* The calling thread's slot table, by source ID. */
+  pthread_mutex_t lock;  /* Not taken by stats_send(), except for a thread's first send on a source. */
+  stats_send_src_t *srcs;  /* In order added. */
+  stats_send_src_t *removed;  /* Reported for the last time, then kept here. */
+  struct stats_send_table_s *tables;  /* Of the sending threads, for delete. */
+  int num_ids;
+};
+typedef struct stats_send_s stats_send_t;
+
+/* One interval of one source. */
+struct stats_send_summary_s {
+  char name[STATS_SEND_NAME_LEN];
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t would_block;
+  uint64_t errors;
+  stats_latency_summary_t duration;
+};
+typedef struct stats_send_summary_s stats_send_summary_t;
+
+
+stats_send_t *stats_send_create(void);
+void stats_send_delete(stats_send_t *send);
+stats_send_src_t *stats_send_src_add(stats_send_t *send, lbm_src_t *src, const char *name);
+void stats_send_src_remove(stats_send_src_t *send_src);
+int stats_send(stats_send_src_t *send_src, const char *msg, size_t len, int flags);
+void stats_send_collect(stats_send_t *send, struct stats_sample_s *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SEND_H */
@@ -0,0 +1,372 @@
+/* stats_shm.c - latest sample in POSIX shared memory, for external readers.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#define _GNU_SOURCE  /* For mremap(). */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+#include "stats_shm.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* Error if -1 (for system calls that return a value, like file descriptors). */
+#define EM1(em1_sys_call_) do { \
+  int em1_ = (em1_sys_call_); \
+  if (em1_ == -1) { \
+    int em1_errno_ = errno; \
+    char em1_errstr_[1024]; \
+    sprintf(em1_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #em1_sys_call_); \
+    errno = em1_errno_; \
+    perror(em1_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* EM1 */
+
+/* A reader gives up if the writer stays in the middle of a write this long
+ * (e.g. it died there). */
+#define MAX_READ_TRIES 100000
+
+static int next_shm_num = 0;
+
+
+static size_t map_size_for(int capacity)
+{
+  return STATS_SHM_HDR_SIZE
+      + (size_t)capacity * (sizeof(lbm_src_transport_stats_t) + sizeof(lbm_rcv_transport_stats_t));
+}  /* map_size_for */
+
+
+static lbm_src_transport_stats_t *src_array(const stats_shm_hdr_t *hdr)
+{
+  return (lbm_src_transport_stats_t *)((char *)hdr + STATS_SHM_HDR_SIZE);
+}  /* src_array */
+
+
+static lbm_rcv_transport_stats_t *rcv_array(const stats_shm_hdr_t *hdr, int capacity)
+{
+  return (lbm_rcv_transport_stats_t *)((char *)hdr + STATS_SHM_HDR_SIZE
+      + (size_t)capacity * sizeof(lbm_src_transport_stats_t));
+}  /* rcv_array */
+
+
+/* Writer. */
+
+stats_shm_t *stats_shm_create(const char *ctx_name, int capacity)
+{
+  stats_shm_t *shm;
+  void *map;
+  uint64_t magic;
+
+  if (capacity < 1) {
+    capacity = 1;
+  }
+  ENL(shm = (stats_shm_t *)calloc(1, sizeof(stats_shm_t)));
+  snprintf(shm->name, sizeof(shm->name), "/" STATS_SHM_PREFIX "%d.%d", (int)getpid(),
+      __atomic_fetch_add(&next_shm_num, 1, __ATOMIC_RELAXED));
+  shm->fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (shm->fd == -1 && errno == EEXIST) {
+    /* Left over from a dead process that had our pid. */
+    (void)shm_unlink(shm->name);
+    shm->fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  }
+  EM1(shm->fd);
+  shm->map_size = map_size_for(capacity);
+  EM1(ftruncate(shm->fd, shm->map_size));
+  map = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+  if (map == MAP_FAILED) {
+    EM1(-1);
+  }
+  shm->hdr = (stats_shm_hdr_t *)map;  /* Zero-filled by ftruncate. */
+
+  shm->hdr->version = STATS_SHM_VERSION;
+  shm->hdr->hdr_size = STATS_SHM_HDR_SIZE;
+  shm->hdr->ctx_stats_size = sizeof(lbm_context_stats_t);
+  shm->hdr->src_stats_size = sizeof(lbm_src_transport_stats_t);
+  shm->hdr->rcv_stats_size = sizeof(lbm_rcv_transport_stats_t);
+  shm->hdr->pid = (int32_t)getpid();
+  if (ctx_name != NULL) {
+    strncpy(shm->hdr->ctx_name, ctx_name, sizeof(shm->hdr->ctx_name) - 1);
+  }
+  shm->hdr->map_size = shm->map_size;
+  shm->hdr->capacity = capacity;
+  /* Magic last, so a reader never sees a half-initialized header. */
+  memcpy(&magic, STATS_SHM_MAGIC, sizeof(magic));
+  __atomic_store_n((uint64_t *)shm->hdr->magic, magic, __ATOMIC_RELEASE);
+
+  return shm;
+}  /* stats_shm_create */
+
+
+void stats_shm_delete(stats_shm_t *shm)
+{
+  munmap(shm->hdr, shm->map_size);
+  close(shm->fd);
+  (void)shm_unlink(shm->name);  /* Readers that have it mapped keep it until they close. */
+  free(shm);
+}  /* stats_shm_delete */
+
+
+/* Grow the object so that "num_entries" fit. Returns the capacity, which
+ * is unchanged if it couldn't grow. */
+static int shm_grow(stats_shm_t *shm, int num_entries)
+{
+  int capacity = shm->hdr->capacity;
+  int new_capacity = num_entries + num_entries / 2;
+  size_t new_size = map_size_for(new_capacity);
+  void *map;
+
+  if (ftruncate(shm->fd, new_size) == -1) {
+    perror("WARNING: stats shm grow");
+    return capacity;
+  }
+  map = mremap(shm->hdr, shm->map_size, new_size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED) {
+    perror("WARNING: stats shm grow");
+    return capacity;
+  }
+  shm->hdr = (stats_shm_hdr_t *)map;
+  shm->map_size = new_size;
+  return new_capacity;  /* Published by stats_shm_write(). */
+}  /* shm_grow */
+
+
+/* Runs in the sampling thread. Just copies; no system calls unless the
+ * object has to grow. */
+void stats_shm_write(stats_shm_t *shm, const stats_sample_t *sample)
+{
+  stats_shm_hdr_t *hdr;
+  int capacity = shm->hdr->capacity;
+  int src_num_entries = sample->src_num_entries;
+  int rcv_num_entries = sample->rcv_num_entries;
+  uint64_t seq;
+
+  if (src_num_entries > capacity || rcv_num_entries > capacity) {
+    capacity = shm_grow(shm, (src_num_entries > rcv_num_entries) ? src_num_entries : rcv_num_entries);
+    if (src_num_entries > capacity) {
+      src_num_entries = capacity;
+    }
+    if (rcv_num_entries > capacity) {
+      rcv_num_entries = capacity;
+    }
+  }
+  hdr = shm->hdr;
+
+  seq = hdr->seq;
+  __atomic_store_n(&hdr->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);  /* Odd seq is visible before any of the data. */
+
+  hdr->map_size = shm->map_size;
+  hdr->capacity = capacity;
+  hdr->src_num_entries = src_num_entries;
+  hdr->rcv_num_entries = rcv_num_entries;
+  hdr->sample_seq = sample->seq;
+  hdr->sample_ns = sample->sample_ns;
+  hdr->sample_realtime_ns = sample->sample_realtime_ns;
+  hdr->retrieve_ns = sample->retrieve_ns;
+  hdr->ctx_stats = sample->ctx_stats;
+  memcpy(src_array(hdr), sample->src_stats, src_num_entries * sizeof(lbm_src_transport_stats_t));
+  memcpy(rcv_array(hdr, capacity), sample->rcv_stats, rcv_num_entries * sizeof(lbm_rcv_transport_stats_t));
+
+  __atomic_store_n(&hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}  /* stats_shm_write */
+
+
+/* Reader. */
+
+int stats_shm_list(pid_t pid, stats_shm_list_cb cb, void *clientd)
+{
+  DIR *dir;
+  struct dirent *ent;
+  char prefix[64];
+  size_t prefix_len;
+  int num_found = 0;
+
+  if (pid == 0) {
+    snprintf(prefix, sizeof(prefix), STATS_SHM_PREFIX);
+  }
+  else {
+    snprintf(prefix, sizeof(prefix), STATS_SHM_PREFIX "%d.", (int)pid);
+  }
+  prefix_len = strlen(prefix);
+
+  dir = opendir("/dev/shm");  /* Where Linux keeps POSIX shared memory. */
+  if (dir == NULL) {
+    return 0;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, prefix, prefix_len) == 0) {
+      char name[300];
+      snprintf(name, sizeof(name), "/%s", ent->d_name);
+      cb(name, clientd);
+      num_found++;
+    }
+  }
+  closedir(dir);
+  return num_found;
+}  /* stats_shm_list */
+
+
+static int reader_map(stats_shm_reader_t *reader)
+{
+  struct stat st;
+  void *map;
+
+  if (reader->hdr != NULL) {
+    munmap((void *)reader->hdr, reader->map_size);
+    reader->hdr = NULL;
+  }
+  if (fstat(reader->fd, &st) == -1 || (size_t)st.st_size < STATS_SHM_HDR_SIZE) {
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  reader->hdr = (const stats_shm_hdr_t *)map;
+  reader->map_size = st.st_size;
+  return 0;
+}  /* reader_map */
+
+
+stats_shm_reader_t *stats_shm_reader_open(const char *name)
+{
+  stats_shm_reader_t *reader;
+  const stats_shm_hdr_t *hdr;
+
+  ENL(reader = (stats_shm_reader_t *)calloc(1, sizeof(stats_shm_reader_t)));
+  strncpy(reader->name, name, sizeof(reader->name) - 1);
+  reader->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (reader->fd == -1) {
+    perror(name);
+    free(reader);
+    return NULL;
+  }
+  if (reader_map(reader) == -1) {
+    fprintf(stderr, "%s: not a stats shm object\n", name);
+    stats_shm_reader_close(reader);
+    return NULL;
+  }
+  hdr = reader->hdr;
+  if (memcmp(hdr->magic, STATS_SHM_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != STATS_SHM_VERSION
+      || hdr->hdr_size != STATS_SHM_HDR_SIZE) {
+    fprintf(stderr, "%s: not a stats shm object (or an unsupported version)\n", name);
+    stats_shm_reader_close(reader);
+    return NULL;
+  }
+  if (hdr->ctx_stats_size != sizeof(lbm_context_stats_t) || hdr->src_stats_size != sizeof(lbm_src_transport_stats_t)
+      || hdr->rcv_stats_size != sizeof(lbm_rcv_transport_stats_t)) {
+    fprintf(stderr, "%s: written with a different UM version\n", name);
+    stats_shm_reader_close(reader);
+    return NULL;
+  }
+  reader->pid = hdr->pid;
+  memcpy(reader->ctx_name, hdr->ctx_name, sizeof(hdr->ctx_name));
+  reader->ctx_name[sizeof(hdr->ctx_name)] = '\0';
+
+  return reader;
+}  /* stats_shm_reader_open */
+
+
+void stats_shm_reader_close(stats_shm_reader_t *reader)
+{
+  if (reader->hdr != NULL) {
+    munmap((void *)reader->hdr, reader->map_size);
+  }
+  close(reader->fd);
+  free(reader);
+}  /* stats_shm_reader_close */
+
+
+int stats_shm_reader_read(stats_shm_reader_t *reader, stats_sample_t *sample)
+{
+  int tries;
+
+  for (tries = 0; tries < MAX_READ_TRIES; tries++) {
+    const stats_shm_hdr_t *hdr = reader->hdr;
+    uint64_t seq1, seq2, map_size;
+    int capacity, src_num_entries, rcv_num_entries;
+
+    seq1 = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+    if (seq1 & 1) {
+      sched_yield();  /* Write in progress. */
+      continue;
+    }
+    map_size = hdr->map_size;
+    capacity = hdr->capacity;
+    src_num_entries = hdr->src_num_entries;
+    rcv_num_entries = hdr->rcv_num_entries;
+    if (map_size > reader->map_size) {
+      /* The writer grew it. */
+      if (reader_map(reader) == -1) {
+        return -1;
+      }
+      continue;
+    }
+    if (capacity < 0 || map_size_for(capacity) > reader->map_size || src_num_entries < 0
+        || src_num_entries > capacity || rcv_num_entries < 0 || rcv_num_entries > capacity) {
+      continue;  /* Torn; seq will have changed. */
+    }
+
+    stats_sample_reserve(sample, src_num_entries, rcv_num_entries);
+    sample->seq = hdr->sample_seq;
+    sample->sample_ns = hdr->sample_ns;
+    sample->sample_realtime_ns = hdr->sample_realtime_ns;
+    sample->retrieve_ns = hdr->retrieve_ns;
+    sample->ctx_stats = hdr->ctx_stats;
+    sample->src_num_entries = src_num_entries;
+    sample->rcv_num_entries = rcv_num_entries;
+    memcpy(sample->src_stats, src_array(hdr), src_num_entries * sizeof(lbm_src_transport_stats_t));
+    memcpy(sample->rcv_stats, rcv_array(hdr, capacity), rcv_num_entries * sizeof(lbm_rcv_transport_stats_t));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);  /* The copies complete before seq is re-read. */
+    seq2 = __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED);
+    if (seq1 == seq2) {
+      sample->have_deltas = 0;
+      sample->have_totals = 0;
+      return 0;
+    }
+  }
+  return -1;
+}  /* stats_shm_reader_read */
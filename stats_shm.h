@@ -0,0 +1,120 @@
+/* stats_shm.h - latest sample in POSIX shared memory, for external readers.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "lbm/lbm.h"
+#include "stats_sample.h"
+
+/* Each stats_thread with "shm" set publishes its latest sample in a POSIX
+ * shared memory object named "/mon_self.<pid>.<n>" (n counts the contexts
+ * of the process). Layout (version 1):
+ *   stats_shm_hdr_t (STATS_SHM_HDR_SIZE bytes)
+ *   lbm_src_transport_stats_t[capacity]
+ *   lbm_rcv_transport_stats_t[capacity]
+ * Everything after "seq" is protected by a seqlock: the writer makes seq
+ * odd, copies, then makes it even again. A reader copies out and retries
+ * if seq was odd or changed, so readers never block the writer and never
+ * see a torn sample, and the writer's cost doesn't depend on how many
+ * readers there are. If a sample has more sessions than "capacity", the
+ * writer grows the object; readers see a bigger map_size and remap. */
+#define STATS_SHM_MAGIC "MONSELFS"
+#define STATS_SHM_VERSION 1
+#define STATS_SHM_HDR_SIZE 4096
+#define STATS_SHM_PREFIX "mon_self."
+
+struct stats_shm_hdr_s {
+  /* Fixed. */
+  char magic[8];
+  uint32_t version;
+  uint32_t hdr_size;
+  uint32_t ctx_stats_size;
+  uint32_t src_stats_size;
+  uint32_t rcv_stats_size;
+  int32_t pid;
+  char ctx_name[64];
+  /* Seqlock. Use __atomic builtins. */
+  uint64_t seq;
+  /* Protected by seq. */
+  uint64_t map_size;
+  int32_t capacity;
+  int32_t src_num_entries;
+  int32_t rcv_num_entries;
+  int32_t reserved;
+  uint64_t sample_seq;
+  uint64_t sample_ns;  /* Writer's CLOCK_MONOTONIC (same host, so comparable). */
+  uint64_t sample_realtime_ns;
+  uint64_t retrieve_ns;
+  lbm_context_stats_t ctx_stats;
+};
+typedef struct stats_shm_hdr_s stats_shm_hdr_t;
+
+/* Writer. */
+struct stats_shm_s {
+  char name[64];
+  int fd;
+  stats_shm_hdr_t *hdr;
+  size_t map_size;
+};
+typedef struct stats_shm_s stats_shm_t;
+
+/* Reader. */
+struct stats_shm_reader_s {
+  char name[64];
+  int fd;
+  const stats_shm_hdr_t *hdr;
+  size_t map_size;
+  int32_t pid;
+  char ctx_name[65];
+};
+typedef struct stats_shm_reader_s stats_shm_reader_t;
+
+typedef void (*stats_shm_list_cb)(const char *name, void *clientd);
+
+
+stats_shm_t *stats_shm_create(const char *ctx_name, int capacity);
+void stats_shm_delete(stats_shm_t *shm);
+void stats_shm_write(stats_shm_t *shm, const stats_sample_t *sample);
+
+/* Calls "cb" with the name of each object of "pid" (0 for any process). */
+int stats_shm_list(pid_t pid, stats_shm_list_cb cb, void *clientd);
+/* Returns NULL (and prints why) if "name" isn't a stats_shm object. */
+stats_shm_reader_t *stats_shm_reader_open(const char *name);
+void stats_shm_reader_close(stats_shm_reader_t *reader);
+/* Copies the latest sample into "sample" (context, source, and receiver
+ * stats, seq, and times; no deltas). Returns 0, or -1 if the object is no
+ * longer valid. */
+int stats_shm_reader_read(stats_shm_reader_t *reader, stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SHM_H */
@@ -0,0 +1,161 @@
+/* stats_sink.c - output destinations for formatted stats.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <syslog.h>
+
+#include "stats_sink.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* Write the whole buffer, retrying partial writes. A failing output is
+ * reported but not fatal; the application being monitored matters more
+ * than its stats. */
+static void write_all(int fd, const char *buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("WARNING: stats sink write");
+      return;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+}  /* write_all */
+
+
+static void fd_sink_write(void *clientd, const char *buf, size_t len)
+{
+  write_all(*(int *)clientd, buf, len);
+}  /* fd_sink_write */
+
+
+static void fd_sink_close(void *clientd)
+{
+  int fd = *(int *)clientd;
+
+  if (fd != STDOUT_FILENO) {
+    close(fd);
+  }
+  free(clientd);
+}  /* fd_sink_close */
+
+
+/* Write to standard out with write(2), bypassing the stdio lock. */
+void stats_sink_stdout(stats_sink_t *sink)
+{
+  int *fd;
+
+  ENL(fd = (int *)malloc(sizeof(int)));
+  *fd = STDOUT_FILENO;
+  sink->write = fd_sink_write;
+  sink->close = fd_sink_close;
+  sink->clientd = fd;
+}  /* stats_sink_stdout */
+
+
+/* Append to a file, creating it if needed. */
+void stats_sink_file(stats_sink_t *sink, const char *path)
+{
+  int *fd;
+
+  ENL(fd = (int *)malloc(sizeof(int)));
+  *fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (*fd < 0) {
+    int errno_ = errno;
+    char errstr[1024];
+    snprintf(errstr, sizeof(errstr), "ERROR (%s:%d): open(%s) failed", __FILE__, __LINE__, path);
+    errno = errno_;
+    perror(errstr);
+    exit(1);
+  }
+  sink->write = fd_sink_write;
+  sink->close = fd_sink_close;
+  sink->clientd = fd;
+}  /* stats_sink_file */
+
+
+/* openlog() is process-wide (and the application may use it), so each
+ * sink passes its own facility and prefixes its own ident instead. */
+struct syslog_sink_s {
+  int priority;  /* facility | LOG_INFO. */
+  char ident[1];  /* Allocated to fit. */
+};
+
+
+/* syslog wants one record per line. */
+static void syslog_sink_write(void *clientd, const char *buf, size_t len)
+{
+  struct syslog_sink_s *syslog_sink = (struct syslog_sink_s *)clientd;
+  const char *end = buf + len;
+
+  while (buf < end) {
+    const char *nl = memchr(buf, '\n', end - buf);
+    int line_len = (int)((nl != NULL) ? (nl - buf) : (end - buf));
+    if (line_len > 0) {
+      syslog(syslog_sink->priority, "%s: %.*s", syslog_sink->ident, line_len, buf);
+    }
+    buf += line_len + 1;
+  }
+}  /* syslog_sink_write */
+
+
+static void syslog_sink_close(void *clientd)
+{
+  free(clientd);
+}  /* syslog_sink_close */
+
+
+/* Records are logged as "ident: line" with "facility" (e.g. LOG_LOCAL0). */
+void stats_sink_syslog(stats_sink_t *sink, const char *ident, int facility)
+{
+  struct syslog_sink_s *syslog_sink;
+
+  ENL(syslog_sink = (struct syslog_sink_s *)malloc(sizeof(struct syslog_sink_s) + strlen(ident)));
+  syslog_sink->priority = facility | LOG_INFO;
+  strcpy(syslog_sink->ident, ident);
+  sink->write = syslog_sink_write;
+  sink->close = syslog_sink_close;
+  sink->clientd = syslog_sink;
+}  /* stats_sink_syslog */
@@ -0,0 +1,55 @@
+/* stats_sink.h - output destinations for formatted stats.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SINK_H
+#define STATS_SINK_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+
+/* Called from the writer thread only. "buf" holds one or more complete
+ * newline-terminated lines (normally a whole sample). */
+typedef void (*stats_sink_write_cb)(void *clientd, const char *buf, size_t len);
+/* Called once from stats_thread_delete(). May be NULL. */
+typedef void (*stats_sink_close_cb)(void *clientd);
+
+struct stats_sink_s {
+  stats_sink_write_cb write;
+  stats_sink_close_cb close;
+  void *clientd;
+};
+typedef struct stats_sink_s stats_sink_t;
+
+
+void stats_sink_stdout(stats_sink_t *sink);
+void stats_sink_file(stats_sink_t *sink, const char *path);
+void stats_sink_syslog(stats_sink_t *sink, const char *ident, int facility);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SINK_H */
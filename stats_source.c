@@ -0,0 +1,274 @@
+/* stats_source.c - parses transport source strings into their parts.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_source.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define MIN_SLOTS 64
+
+
+/* Each parse_ function consumes one part and returns a pointer past it, or
+ * NULL if it isn't there (or if "p" is already NULL, so they can be chained). */
+
+static const char *parse_dec(const char *p, uint32_t max, uint32_t *val)
+{
+  uint64_t v = 0;
+  const char *start = p;
+
+  if (p == NULL) {
+    return NULL;
+  }
+  while (*p >= '0' && *p <= '9') {
+    v = v * 10 + (uint64_t)(*p - '0');
+    if (v > max) {
+      return NULL;
+    }
+    p++;
+  }
+  *val = (uint32_t)v;
+  return (p == start) ? NULL : p;
+}  /* parse_dec */
+
+
+static const char *parse_hex(const char *p, uint32_t *val)
+{
+  uint32_t v = 0;
+  int n = 0;
+
+  if (p == NULL) {
+    return NULL;
+  }
+  for (;; p++, n++) {
+    int digit;
+    if (*p >= '0' && *p <= '9') {
+      digit = *p - '0';
+    } else if (*p >= 'a' && *p <= 'f') {
+      digit = *p - 'a' + 10;
+    } else if (*p >= 'A' && *p <= 'F') {
+      digit = *p - 'A' + 10;
+    } else {
+      break;
+    }
+    if (n == 8) {
+      return NULL;
+    }
+    v = (v << 4) | (uint32_t)digit;
+  }
+  *val = v;
+  return (n == 0) ? NULL : p;
+}  /* parse_hex */
+
+
+static const char *parse_ip(const char *p, uint32_t *ip)
+{
+  uint32_t octet = 0;
+  int i;
+
+  *ip = 0;
+  for (i = 0; i < 4 && p != NULL; i++) {
+    if (i > 0) {
+      p = (*p == '.') ? p + 1 : NULL;
+    }
+    p = parse_dec(p, 255, &octet);
+    *ip = (*ip << 8) | octet;
+  }
+  return p;
+}  /* parse_ip */
+
+
+static const char *parse_colon(const char *p)
+{
+  return (p != NULL && *p == ':') ? p + 1 : NULL;
+}  /* parse_colon */
+
+
+/* Parse "source" into "info". Returns 0 on success; on failure, "info" has
+ * transport 0 and no IDs. Doesn't intern the addresses (see
+ * stats_source_intern()). */
+int stats_source_parse(const char *source, stats_source_info_t *info)
+{
+  const char *p = source;
+  int transport;
+
+  memset(info, 0, sizeof(*info));
+  info->topic_idx = -1;
+  info->host_id = -1;
+  info->group_id = -1;
+
+  if (strncmp(p, "LBTRM:", 6) == 0) {
+    transport = LBM_TRANSPORT_STAT_LBTRM;
+    p = parse_ip(p + 6, &info->ip);
+    p = parse_dec(parse_colon(p), 65535, &info->port);
+    p = parse_hex(parse_colon(p), &info->session_id);
+    p = parse_ip(parse_colon(p), &info->group);
+    p = parse_dec(parse_colon(p), 65535, &info->group_port);
+  }
+  else if (strncmp(p, "LBTRU:", 6) == 0 || strncmp(p, "TCP:", 4) == 0) {
+    transport = (p[0] == 'L') ? LBM_TRANSPORT_STAT_LBTRU : LBM_TRANSPORT_STAT_TCP;
+    p = parse_ip(p + ((p[0] == 'L') ? 6 : 4), &info->ip);
+    p = parse_dec(parse_colon(p), 65535, &info->port);
+    if (p != NULL && *p == ':') {
+      p = parse_hex(p + 1, &info->session_id);
+    }
+  }
+  else if (strncmp(p, "LBT-IPC:", 8) == 0 || strncmp(p, "LBT-SMX:", 8) == 0) {
+    transport = (p[4] == 'I') ? LBM_TRANSPORT_STAT_LBTIPC : LBM_TRANSPORT_STAT_LBTSMX;
+    p = parse_hex(p + 8, &info->session_id);
+    p = parse_dec(parse_colon(p), UINT32_MAX, &info->port);
+  }
+  else {
+    p = NULL;
+    transport = 0;
+  }
+
+  if (p != NULL && *p == '[') {
+    uint32_t topic_idx;
+    p = parse_dec(p + 1, UINT32_MAX, &topic_idx);
+    if (p != NULL && *p == ']') {
+      info->topic_idx = topic_idx;
+      p++;
+    } else {
+      p = NULL;
+    }
+  }
+  if (p == NULL || *p != '\0') {
+    memset(info, 0, sizeof(*info));
+    info->topic_idx = -1;
+    info->host_id = -1;
+    info->group_id = -1;
+    return -1;
+  }
+  info->transport = transport;
+  return 0;
+}  /* stats_source_parse */
+
+
+/* Just the transport type (LBM_TRANSPORT_STAT_...; 0 if unknown), from the
+ * prefix. Cheap enough to call for every received message. */
+int stats_source_type(const char *source)
+{
+  if (strncmp(source, "LBTRM:", 6) == 0) {
+    return LBM_TRANSPORT_STAT_LBTRM;
+  }
+  if (strncmp(source, "LBTRU:", 6) == 0) {
+    return LBM_TRANSPORT_STAT_LBTRU;
+  }
+  if (strncmp(source, "TCP:", 4) == 0) {
+    return LBM_TRANSPORT_STAT_TCP;
+  }
+  if (strncmp(source, "LBT-IPC:", 8) == 0) {
+    return LBM_TRANSPORT_STAT_LBTIPC;
+  }
+  if (strncmp(source, "LBT-SMX:", 8) == 0) {
+    return LBM_TRANSPORT_STAT_LBTSMX;
+  }
+  return 0;
+}  /* stats_source_type */
+
+
+stats_source_addrs_t *stats_source_addrs_create(void)
+{
+  stats_source_addrs_t *addrs;
+
+  ENL(addrs = (stats_source_addrs_t *)calloc(1, sizeof(stats_source_addrs_t)));
+  ENL(addrs->slots = (int *)calloc(MIN_SLOTS, sizeof(int)));
+  addrs->num_slots = MIN_SLOTS;
+
+  return addrs;
+}  /* stats_source_addrs_create */
+
+
+void stats_source_addrs_delete(stats_source_addrs_t *addrs)
+{
+  free(addrs->addrs);
+  free(addrs->slots);
+  free(addrs);
+}  /* stats_source_addrs_delete */
+
+
+static uint32_t hash_addr(uint32_t addr)
+{
+  return (addr * 2654435761u) ^ (addr >> 16);
+}  /* hash_addr */
+
+
+/* Returns the address's ID, giving it the next one if it's new. */
+int stats_source_addr_intern(stats_source_addrs_t *addrs, uint32_t addr)
+{
+  uint32_t mask = addrs->num_slots - 1;
+  uint32_t i;
+
+  for (i = hash_addr(addr) & mask; addrs->slots[i] != 0; i = (i + 1) & mask) {
+    if (addrs->addrs[addrs->slots[i] - 1] == addr) {
+      return addrs->slots[i] - 1;
+    }
+  }
+
+  if (addrs->num_addrs == addrs->addrs_capacity) {
+    addrs->addrs_capacity = (addrs->addrs_capacity == 0) ? 16 : addrs->addrs_capacity * 2;
+    ENL(addrs->addrs = (uint32_t *)realloc(addrs->addrs, addrs->addrs_capacity * sizeof(uint32_t)));
+  }
+  addrs->addrs[addrs->num_addrs] = addr;
+  addrs->slots[i] = ++addrs->num_addrs;
+
+  if ((uint32_t)addrs->num_addrs * 2 > addrs->num_slots) {
+    /* Keep the table at most half full. */
+    int id;
+    free(addrs->slots);
+    addrs->num_slots *= 2;
+    ENL(addrs->slots = (int *)calloc(addrs->num_slots, sizeof(int)));
+    mask = addrs->num_slots - 1;
+    for (id = 0; id < addrs->num_addrs; id++) {
+      for (i = hash_addr(addrs->addrs[id]) & mask; addrs->slots[i] != 0; i = (i + 1) & mask) {
+      }
+      addrs->slots[i] = id + 1;
+    }
+  }
+  return addrs->num_addrs - 1;
+}  /* stats_source_addr_intern */
+
+
+/* Fill in host_id and group_id of a parsed source. */
+void stats_source_intern(stats_source_addrs_t *addrs, stats_source_info_t *info)
+{
+  info->host_id = (info->ip != 0) ? stats_source_addr_intern(addrs, info->ip) : -1;
+  info->group_id = (info->group != 0) ? stats_source_addr_intern(addrs, info->group) : -1;
+}  /* stats_source_intern */
@@ -0,0 +1,77 @@
+/* stats_source.h - parses transport source strings into their parts.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_SOURCE_H
+#define STATS_SOURCE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+
+
+/* A transport source string, parsed. The forms are:
+ *   LBTRM:<ip>:<port>:<session ID>:<group>:<destination port>
+ *   LBTRU:<ip>:<port>[:<session ID>]
+ *   TCP:<ip>:<port>[:<session ID>]
+ *   LBT-IPC:<session ID>:<transport ID>
+ *   LBT-SMX:<session ID>:<transport ID>
+ * optionally followed by "[<topic index>]". Session IDs are hex.
+ * Addresses are in host byte order. */
+struct stats_source_info_s {
+  int transport;  /* LBM_TRANSPORT_STAT_...; 0 if the string wasn't recognized. */
+  uint32_t ip;  /* Publisher's address; 0 for LBT-IPC/SMX. */
+  uint32_t port;  /* For LBT-IPC/SMX, the transport ID. */
+  uint32_t session_id;
+  uint32_t group;  /* Multicast group (LBTRM only), else 0. */
+  uint32_t group_port;
+  int64_t topic_idx;  /* -1=none. */
+  int host_id;  /* Interned "ip" (see stats_source_addrs_t); -1=none. */
+  int group_id;  /* Interned "group"; -1=none. */
+};
+typedef struct stats_source_info_s stats_source_info_t;
+
+/* Interns IPv4 addresses as small dense IDs, for per-host and per-group
+ * sums. IDs are never reused. */
+struct stats_source_addrs_s {
+  uint32_t *addrs;  /* By ID. */
+  int num_addrs;
+  int addrs_capacity;
+  int *slots;  /* Open addressing; ID+1, 0=empty. */
+  uint32_t num_slots;  /* Power of 2. */
+};
+typedef struct stats_source_addrs_s stats_source_addrs_t;
+
+
+int stats_source_parse(const char *source, stats_source_info_t *info);
+int stats_source_type(const char *source);
+stats_source_addrs_t *stats_source_addrs_create(void);
+void stats_source_addrs_delete(stats_source_addrs_t *addrs);
+int stats_source_addr_intern(stats_source_addrs_t *addrs, uint32_t addr);
+void stats_source_intern(stats_source_addrs_t *addrs, stats_source_info_t *info);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_SOURCE_H */
@@ -0,0 +1,366 @@
+/* stats_store.c - columnar (structure of arrays) store of session counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_store.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+#define MIN_ROWS 64
+
+
+/* Kernels. Each processes one column of "n" rows in a single pass:
+ *   delta = cur - prev, reset |= (cur < prev), prev = cur
+ * and returns the sum of the deltas. */
+typedef uint64_t (*delta_kernel_t)(const uint64_t *cur, uint64_t *prev, uint64_t *delta, uint64_t *reset, int n);
+
+static uint64_t delta_scalar(const uint64_t *cur, uint64_t *prev, uint64_t *delta, uint64_t *reset, int n)
+{
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    uint64_t c = cur[i];
+    uint64_t p = prev[i];
+    delta[i] = c - p;
+    reset[i] |= (c < p);
+    prev[i] = c;
+    sum += c - p;
+  }
+  return sum;
+}  /* delta_scalar */
+
+#if defined(__x86_64__) || defined(__i386__)
+/* There is no unsigned 64-bit compare; flipping the sign bits of both
+ * operands turns it into a signed one. */
+
+__attribute__((target("sse4.2")))
+static uint64_t delta_sse42(const uint64_t *cur, uint64_t *prev, uint64_t *delta, uint64_t *reset, int n)
+{
+  const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+  __m128i sum = _mm_setzero_si128();
+  uint64_t lanes[2];
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(cur + i));
+    __m128i p = _mm_loadu_si128((const __m128i *)(prev + i));
+    __m128i d = _mm_sub_epi64(c, p);
+    __m128i lt = _mm_cmpgt_epi64(_mm_xor_si128(p, sign), _mm_xor_si128(c, sign));
+    __m128i r = _mm_loadu_si128((const __m128i *)(reset + i));
+    _mm_storeu_si128((__m128i *)(reset + i), _mm_or_si128(r, lt));
+    _mm_storeu_si128((__m128i *)(delta + i), d);
+    _mm_storeu_si128((__m128i *)(prev + i), c);
+    sum = _mm_add_epi64(sum, d);
+  }
+  _mm_storeu_si128((__m128i *)lanes, sum);
+  return lanes[0] + lanes[1] + delta_scalar(cur + i, prev + i, delta + i, reset + i, n - i);
+}  /* delta_sse42 */
+
+
+__attribute__((target("avx2")))
+static uint64_t delta_avx2(const uint64_t *cur, uint64_t *prev, uint64_t *delta, uint64_t *reset, int n)
+{
+  const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+  __m256i sum = _mm256_setzero_si256();
+  uint64_t lanes[4];
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m256i c = _mm256_loadu_si256((const __m256i *)(cur + i));
+    __m256i p = _mm256_loadu_si256((const __m256i *)(prev + i));
+    __m256i d = _mm256_sub_epi64(c, p);
+    __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(p, sign), _mm256_xor_si256(c, sign));
+    __m256i r = _mm256_loadu_si256((const __m256i *)(reset + i));
+    _mm256_storeu_si256((__m256i *)(reset + i), _mm256_or_si256(r, lt));
+    _mm256_storeu_si256((__m256i *)(delta + i), d);
+    _mm256_storeu_si256((__m256i *)(prev + i), c);
+    sum = _mm256_add_epi64(sum, d);
+  }
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+      + delta_scalar(cur + i, prev + i, delta + i, reset + i, n - i);
+}  /* delta_avx2 */
+#endif  /* x86 */
+
+
+static delta_kernel_t delta_kernel = delta_scalar;
+static const char *delta_kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/* Pick the widest kernel this CPU supports. */
+static void kernel_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    delta_kernel = delta_avx2;
+    delta_kernel_name = "avx2";
+  }
+  else if (__builtin_cpu_supports("sse4.2")) {
+    delta_kernel = delta_sse42;
+    delta_kernel_name = "sse4.2";
+  }
+#endif
+}  /* kernel_init */
+
+
+const char *stats_store_kernel_name(void)
+{
+  ENZ(errno = pthread_once(&kernel_once, kernel_init));
+  return delta_kernel_name;
+}  /* stats_store_kernel_name */
+
+
+/* Force a kernel ("scalar", "sse4.2", "avx2"), e.g. for benchmarks. Call
+ * before any stats thread starts. Returns -1 if the CPU can't run it. */
+int stats_store_select_kernel(const char *name)
+{
+  ENZ(errno = pthread_once(&kernel_once, kernel_init));
+  if (strcmp(name, "scalar") == 0) {
+    delta_kernel = delta_scalar;
+    delta_kernel_name = "scalar";
+    return 0;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+    delta_kernel = delta_sse42;
+    delta_kernel_name = "sse4.2";
+    return 0;
+  }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+    delta_kernel = delta_avx2;
+    delta_kernel_name = "avx2";
+    return 0;
+  }
+#endif
+  return -1;
+}  /* stats_store_select_kernel */
+
+
+/* Re-lay out the columns at a larger row capacity. */
+static void group_grow(stats_column_group_t *group)
+{
+  int new_capacity = (group->row_capacity == 0) ? MIN_ROWS : group->row_capacity * 2;
+  size_t col_bytes = (size_t)group->num_rows * sizeof(uint64_t);
+  uint64_t *cur, *prev, *delta, *reset;
+  int *free_rows;
+  int f;
+
+  ENL(cur = (uint64_t *)calloc((size_t)group->num_fields * new_capacity, sizeof(uint64_t)));
+  ENL(prev = (uint64_t *)calloc((size_t)group->num_fields * new_capacity, sizeof(uint64_t)));
+  ENL(delta = (uint64_t *)calloc((size_t)group->num_fields * new_capacity, sizeof(uint64_t)));
+  ENL(reset = (uint64_t *)calloc(new_capacity, sizeof(uint64_t)));
+  ENL(free_rows = (int *)malloc(new_capacity * sizeof(int)));
+  for (f = 0; f < group->num_fields && group->num_rows > 0; f++) {
+    memcpy(cur + (size_t)f * new_capacity, group->cur + (size_t)f * group->row_capacity, col_bytes);
+    memcpy(prev + (size_t)f * new_capacity, group->prev + (size_t)f * group->row_capacity, col_bytes);
+  }
+  if (group->num_free_rows > 0) {
+    memcpy(free_rows, group->free_rows, group->num_free_rows * sizeof(int));
+  }
+
+  free(group->cur);
+  free(group->prev);
+  free(group->delta);
+  free(group->reset);
+  free(group->free_rows);
+  group->cur = cur;
+  group->prev = prev;
+  group->delta = delta;
+  group->reset = reset;
+  group->free_rows = free_rows;
+  group->row_capacity = new_capacity;
+}  /* group_grow */
+
+
+stats_store_t *stats_store_create(void)
+{
+  stats_store_t *store;
+  int t;
+
+  ENZ(errno = pthread_once(&kernel_once, kernel_init));
+  ENL(store = (stats_store_t *)calloc(1, sizeof(stats_store_t)));
+  for (t = 0; t < STATS_NUM_TYPES; t++) {
+    int type = stats_fields_type_from_index(t);
+    store->groups[STATS_STORE_SRC][t].fields = stats_fields_src(type, &store->groups[STATS_STORE_SRC][t].num_fields);
+    store->groups[STATS_STORE_RCV][t].fields = stats_fields_rcv(type, &store->groups[STATS_STORE_RCV][t].num_fields);
+  }
+
+  return store;
+}  /* stats_store_create */
+
+
+void stats_store_delete(stats_store_t *store)
+{
+  int d, t;
+
+  for (d = 0; d < 2; d++) {
+    for (t = 0; t < STATS_NUM_TYPES; t++) {
+      stats_column_group_t *group = &store->groups[d][t];
+      free(group->cur);
+      free(group->prev);
+      free(group->delta);
+      free(group->reset);
+      free(group->free_rows);
+    }
+  }
+  free(store);
+}  /* stats_store_delete */
+
+
+/* Returns NULL for unknown transport types and for types with no counters. */
+stats_column_group_t *stats_store_group(stats_store_t *store, int dir, int type)
+{
+  int t = stats_fields_type_index(type);
+
+  if (t < 0 || store->groups[dir][t].num_fields == 0) {
+    return NULL;
+  }
+  return &store->groups[dir][t];
+}  /* stats_store_group */
+
+
+/* A new row starts at zero, so its first deltas are its full values. */
+int stats_store_row_alloc(stats_column_group_t *group)
+{
+  if (group->num_free_rows > 0) {
+    return group->free_rows[--group->num_free_rows];
+  }
+  if (group->num_rows == group->row_capacity) {
+    group_grow(group);
+  }
+  return group->num_rows++;
+}  /* stats_store_row_alloc */
+
+
+void stats_store_row_free(stats_column_group_t *group, int row)
+{
+  int f;
+
+  for (f = 0; f < group->num_fields; f++) {
+    size_t i = (size_t)f * group->row_capacity + row;
+    group->cur[i] = 0;
+    group->prev[i] = 0;
+    group->delta[i] = 0;
+  }
+  group->reset[row] = 0;
+  group->free_rows[group->num_free_rows++] = row;
+}  /* stats_store_row_free */
+
+
+void stats_store_begin_sample(stats_store_t *store)
+{
+  int d, t;
+
+  for (d = 0; d < 2; d++) {
+    for (t = 0; t < STATS_NUM_TYPES; t++) {
+      store->groups[d][t].num_sessions = 0;
+    }
+  }
+}  /* stats_store_begin_sample */
+
+
+/* Gather one session's counters (from its UM stats structure) into its row.
+ * This is the only pass over the UM structures. */
+void stats_store_put(stats_column_group_t *group, int row, const void *stats)
+{
+  int f;
+
+  for (f = 0; f < group->num_fields; f++) {
+    group->cur[(size_t)f * group->row_capacity + row] = stats_field_value(&group->fields[f], stats);
+  }
+  group->num_sessions++;
+}  /* stats_store_put */
+
+
+/* Compute every group's deltas, reset flags and totals. Rows that were not
+ * put this sample still hold their previous values, so their deltas are 0. */
+void stats_store_compute(stats_store_t *store)
+{
+  int d, t, f, r;
+
+  for (d = 0; d < 2; d++) {
+    for (t = 0; t < STATS_NUM_TYPES; t++) {
+      stats_column_group_t *group = &store->groups[d][t];
+      int n = group->num_rows;
+      if (n == 0) {
+        continue;
+      }
+
+      memset(group->reset, 0, n * sizeof(uint64_t));
+      for (f = 0; f < group->num_fields; f++) {
+        size_t col = (size_t)f * group->row_capacity;
+        group->totals[f] = (*delta_kernel)(group->cur + col, group->prev + col, group->delta + col,
+            group->reset, n);
+      }
+
+      /* A reset session's deltas are its full values (rare, so scalar). */
+      for (r = 0; r < n; r++) {
+        if (group->reset[r]) {
+          for (f = 0; f < group->num_fields; f++) {
+            size_t i = (size_t)f * group->row_capacity + r;
+            group->totals[f] += group->cur[i] - group->delta[i];
+            group->delta[i] = group->cur[i];
+          }
+        }
+      }
+    }
+  }
+}  /* stats_store_compute */
@@ -0,0 +1,80 @@
+/* stats_store.h - columnar (structure of arrays) store of session counters.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+#ifndef STATS_STORE_H
+#define STATS_STORE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "stats_fields.h"
+
+#define STATS_STORE_SRC 0
+#define STATS_STORE_RCV 1
+
+
+/* The sessions of one direction (src/rcv) and transport type. Each session
+ * owns a row for as long as it exists, and each field is a contiguous
+ * column, so the per-sample kernels stream through memory instead of
+ * hopping between large lbm_*_transport_stats_t unions. Column "f" of an
+ * array starts at [f * row_capacity]. */
+struct stats_column_group_s {
+  const stats_field_t *fields;
+  int num_fields;
+  int num_rows;  /* High-water mark; free rows inside it are all zero. */
+  int row_capacity;
+  uint64_t *cur;  /* Values from this sample. */
+  uint64_t *prev;  /* Values from the previous sample. */
+  uint64_t *delta;
+  uint64_t *reset;  /* Per row: non-zero if a counter went backwards. */
+  int *free_rows;
+  int num_free_rows;
+  int num_sessions;  /* Rows written since stats_store_begin_sample(). */
+  uint64_t totals[STATS_MAX_FIELDS];  /* Sum of the deltas of all rows. */
+};
+typedef struct stats_column_group_s stats_column_group_t;
+
+struct stats_store_s {
+  stats_column_group_t groups[2][STATS_NUM_TYPES];  /* [STATS_STORE_SRC/RCV][type index] */
+};
+typedef struct stats_store_s stats_store_t;
+
+
+stats_store_t *stats_store_create(void);
+void stats_store_delete(stats_store_t *store);
+const char *stats_store_kernel_name(void);
+int stats_store_select_kernel(const char *name);
+stats_column_group_t *stats_store_group(stats_store_t *store, int dir, int type);
+int stats_store_row_alloc(stats_column_group_t *group);
+void stats_store_row_free(stats_column_group_t *group, int row);
+void stats_store_begin_sample(stats_store_t *store);
+void stats_store_put(stats_column_group_t *group, int row, const void *stats);
+void stats_store_compute(stats_store_t *store);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_STORE_H */
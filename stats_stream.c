@@ -0,0 +1,407 @@
+/* stats_stream.c - sends samples as binary frames to a local aggregator.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_sample.h"
+#include "stats_stream.h"
+
+
+/* Error if non-zero. */
+#define ENZ(enz_sys_call_) do { \
+  int enz_ = (enz_sys_call_); \
+  if (enz_ != 0) { \
+    int enz_errno_ = errno; \
+    char enz_errstr_[1024]; \
+    sprintf(enz_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enz_sys_call_); \
+    errno = enz_errno_; \
+    perror(enz_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENZ */
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+/* After a failed connect or a lost connection, wait this long before
+ * trying again (samples are dropped meanwhile). */
+#define RETRY_NS (5 * (uint64_t)1000000000)
+/* A varint is at most 10 bytes; a session at most its direction, type,
+ * source length and source, and one varint per counter. */
+#define MAX_VARINT 10
+#define MAX_SESSION_BYTES (3 + LBM_MSG_MAX_SOURCE_LEN + STATS_MAX_FIELDS * MAX_VARINT)
+
+
+static uint64_t mono_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* mono_ns */
+
+
+static uint8_t *put_varint(uint8_t *p, uint64_t val)
+{
+  while (val >= 0x80) {
+    *p++ = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  *p++ = (uint8_t)val;
+  return p;
+}  /* put_varint */
+
+
+/* Make room for "len" more bytes after stream->len. */
+static void buf_reserve(stats_stream_t *stream, size_t len)
+{
+  if (stream->len + len > stream->capacity) {
+    size_t capacity = stream->capacity * 2;
+    if (capacity < stream->len + len) {
+      capacity = stream->len + len;
+    }
+    ENL(stream->buf = (uint8_t *)realloc(stream->buf, capacity));
+    stream->capacity = capacity;
+  }
+}  /* buf_reserve */
+
+
+/* Start a frame at stream->len; returns its offset for frame_end(). The
+ * caller reserves room for the header. */
+static size_t frame_begin(stats_stream_t *stream)
+{
+  size_t offset = stream->len;
+
+  stream->len += sizeof(stats_stream_frame_hdr_t);
+  return offset;
+}  /* frame_begin */
+
+
+static void frame_end(stats_stream_t *stream, size_t offset, int kind, int count)
+{
+  stats_stream_frame_hdr_t hdr;
+
+  hdr.len = (uint32_t)(stream->len - offset);
+  hdr.kind = (uint16_t)kind;
+  hdr.count = (uint16_t)count;
+  memcpy(stream->buf + offset, &hdr, sizeof(hdr));  /* Frames aren't aligned. */
+}  /* frame_end */
+
+
+/* Close the connection. Samples not completely sent are dropped; the
+ * daemon throws away the part it got. */
+static void disconnect(stats_stream_t *stream, const char *what)
+{
+  fprintf(stderr, "WARNING: stats stream %s %s: %s\n", what, stream->path, strerror(errno));
+  close(stream->fd);
+  stream->fd = -1;
+  stream->num_dropped += stream->num_ends;
+  stream->num_ends = 0;
+  stream->sent = 0;
+  stream->len = 0;
+  stream->retry_ns = mono_ns() + RETRY_NS;
+}  /* disconnect */
+
+
+static void try_connect(stats_stream_t *stream)
+{
+  struct sockaddr_un addr;
+  stats_stream_hello_t hello;
+  size_t offset;
+  int fd;
+
+  if (mono_ns() < stream->retry_ns) {
+    return;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, stream->path);  /* Length checked at create. */
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    if (!stream->warned) {
+      fprintf(stderr, "WARNING: stats stream connect %s: %s (dropping samples until it succeeds)\n",
+          stream->path, strerror(errno));
+      stream->warned = 1;
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+    stream->retry_ns = mono_ns() + RETRY_NS;
+    return;
+  }
+  stream->fd = fd;
+  stream->warned = 0;
+  stream->num_connects++;
+
+  memset(&hello, 0, sizeof(hello));
+  hello.version = STATS_STREAM_VERSION;
+  hello.pid = (uint32_t)getpid();
+  hello.field_set = (uint32_t)stats_fields_selected();
+  strncpy(hello.ctx_name, stream->ctx_name, sizeof(hello.ctx_name) - 1);
+  buf_reserve(stream, sizeof(stats_stream_frame_hdr_t) + sizeof(hello));
+  offset = frame_begin(stream);
+  memcpy(stream->buf + stream->len, &hello, sizeof(hello));
+  stream->len += sizeof(hello);
+  frame_end(stream, offset, STATS_STREAM_HELLO, 0);
+}  /* try_connect */
+
+
+/* Send as much as the socket takes without blocking. */
+static void flush(stats_stream_t *stream)
+{
+  int e = 0;
+
+  while (stream->sent < stream->len) {
+    ssize_t n = send(stream->fd, stream->buf + stream->sent, stream->len - stream->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        disconnect(stream, "send");
+        return;
+      }
+      break;  /* Daemon is behind; try again with the next sample. */
+    }
+    stream->sent += (size_t)n;
+    stream->num_bytes += (uint64_t)n;
+  }
+
+  while (e < stream->num_ends && stream->ends[e] <= stream->sent) {
+    e++;
+  }
+  if (e > 0) {
+    stream->num_samples += (uint64_t)e;
+    stream->num_ends -= e;
+    memmove(stream->ends, stream->ends + e, stream->num_ends * sizeof(size_t));
+  }
+  if (stream->sent == stream->len) {
+    stream->sent = 0;
+    stream->len = 0;
+  }
+}  /* flush */
+
+
+/* Move the unsent bytes to the start of the buffer. */
+static void compact(stats_stream_t *stream)
+{
+  int e;
+
+  if (stream->sent == 0) {
+    return;
+  }
+  memmove(stream->buf, stream->buf + stream->sent, stream->len - stream->sent);
+  for (e = 0; e < stream->num_ends; e++) {
+    stream->ends[e] -= stream->sent;
+  }
+  stream->len -= stream->sent;
+  stream->sent = 0;
+}  /* compact */
+
+
+static void encode_session(stats_stream_t *stream, int dir, int type, const char *source,
+    const stats_field_t *fields, int num_fields, const void *stats)
+{
+  size_t source_len = strnlen(source, LBM_MSG_MAX_SOURCE_LEN - 1);
+  uint8_t *p = stream->buf + stream->len;
+  int f;
+
+  *p++ = (uint8_t)dir;
+  *p++ = (uint8_t)type;
+  *p++ = (uint8_t)source_len;
+  memcpy(p, source, source_len);
+  p += source_len;
+  for (f = 0; f < num_fields; f++) {
+    p = put_varint(p, stats_field_value(&fields[f], stats));
+  }
+  stream->len = p - stream->buf;
+}  /* encode_session */
+
+
+/* Append one sample's frames at stream->len. */
+static void encode_sample(stats_stream_t *stream, const stats_sample_t *sample)
+{
+  stats_stream_sample_t hdr;
+  const stats_field_t *fields;
+  int num_fields, count, f, i, d;
+  size_t sample_offset, offset;
+  uint8_t *p;
+
+  fields = stats_fields_ctx(&num_fields);
+  if (fields == NULL) {
+    num_fields = 0;
+  }
+  buf_reserve(stream, sizeof(stats_stream_frame_hdr_t) + sizeof(hdr) + num_fields * MAX_VARINT);
+  sample_offset = frame_begin(stream);
+  stream->len += sizeof(hdr);  /* Filled in at the end. */
+  p = stream->buf + stream->len;
+  for (f = 0; f < num_fields; f++) {
+    p = put_varint(p, stats_field_value(&fields[f], &sample->ctx_stats));
+  }
+  stream->len = p - stream->buf;
+  frame_end(stream, sample_offset, STATS_STREAM_SAMPLE, 0);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.seq = sample->seq;
+  hdr.time_ms = sample->sample_realtime_ns / 1000000;
+  hdr.dropped = stream->num_dropped;
+
+  offset = 0;
+  count = 0;
+  for (d = 0; d < 2; d++) {
+    int num_entries = (d == STATS_STREAM_SRC) ? sample->src_num_entries : sample->rcv_num_entries;
+    for (i = 0; i < num_entries; i++) {
+      int type;
+      const char *source;
+      const void *stats;
+      if (d == STATS_STREAM_SRC) {
+        type = sample->src_stats[i].type;
+        source = sample->src_stats[i].source;
+        stats = &sample->src_stats[i];
+        fields = stats_fields_src(type, &num_fields);
+      } else {
+        type = sample->rcv_stats[i].type;
+        source = sample->rcv_stats[i].source;
+        stats = &sample->rcv_stats[i];
+        fields = stats_fields_rcv(type, &num_fields);
+      }
+      if (stats_fields_type_index(type) < 0) {
+        continue;  /* The daemon wouldn't know its counters. */
+      }
+      if (fields == NULL) {
+        num_fields = 0;
+      }
+      /* Start a new frame if this one is full. */
+      if (count > 0 && (stream->len - offset + MAX_SESSION_BYTES > STATS_STREAM_MAX_FRAME || count == 0xffff)) {
+        frame_end(stream, offset, STATS_STREAM_SESSIONS, count);
+        count = 0;
+      }
+      buf_reserve(stream, sizeof(stats_stream_frame_hdr_t) + MAX_SESSION_BYTES);
+      if (count == 0) {
+        offset = frame_begin(stream);
+      }
+      encode_session(stream, d, type, source, fields, num_fields, stats);
+      count++;
+      if (d == STATS_STREAM_SRC) {
+        hdr.num_src++;
+      } else {
+        hdr.num_rcv++;
+      }
+    }
+  }
+  if (count > 0) {
+    frame_end(stream, offset, STATS_STREAM_SESSIONS, count);
+  }
+  memcpy(stream->buf + sample_offset + sizeof(stats_stream_frame_hdr_t), &hdr, sizeof(hdr));
+}  /* encode_sample */
+
+
+stats_stream_t *stats_stream_create(const char *path, const char *ctx_name, size_t buf_size)
+{
+  stats_stream_t *stream;
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ERROR (%s:%d): stats stream path too long: %s\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  ENL(stream = (stats_stream_t *)calloc(1, sizeof(stats_stream_t)));
+  ENL(stream->path = strdup(path));
+  ENL(stream->ctx_name = strdup((ctx_name != NULL) ? ctx_name : ""));
+  stream->buf_size = buf_size;
+  stream->fd = -1;
+  stream->retry_ns = 0;
+  stream->capacity = 64 * 1024;
+  ENL(stream->buf = (uint8_t *)malloc(stream->capacity));
+
+  return stream;
+}  /* stats_stream_create */
+
+
+void stats_stream_delete(stats_stream_t *stream)
+{
+  if (stream->fd != -1) {
+    flush(stream);  /* Whatever the socket takes; never waits. */
+  }
+  if (stream->fd != -1) {
+    close(stream->fd);
+  }
+  free(stream->ends);
+  free(stream->buf);
+  free(stream->ctx_name);
+  free(stream->path);
+  free(stream);
+}  /* stats_stream_delete */
+
+
+/* Runs in the writer thread, once per output sample. Never blocks. */
+void stats_stream_write(stats_stream_t *stream, const stats_sample_t *sample)
+{
+  size_t start;
+
+  if (stream->fd == -1) {
+    try_connect(stream);
+  }
+  if (stream->fd != -1) {
+    flush(stream);  /* Older samples first. */
+  }
+  if (stream->fd == -1) {
+    stream->num_dropped++;
+    return;
+  }
+
+  compact(stream);
+  start = stream->len;
+  encode_sample(stream, sample);
+  if (stream->num_ends > 0 && stream->len > stream->buf_size) {
+    /* The daemon is behind. Keep the older samples whole. */
+    stream->len = start;
+    stream->num_dropped++;
+    return;
+  }
+  if (stream->num_ends == stream->ends_capacity) {
+    stream->ends_capacity = (stream->ends_capacity == 0) ? 16 : stream->ends_capacity * 2;
+    ENL(stream->ends = (size_t *)realloc(stream->ends, stream->ends_capacity * sizeof(size_t)));
+  }
+  stream->ends[stream->num_ends++] = stream->len;
+  flush(stream);
+}  /* stats_stream_write */
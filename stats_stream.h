@@ -0,0 +1,116 @@
+/* stats_stream.h - sends samples as binary frames to a local aggregator.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_STREAM_H
+#define STATS_STREAM_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats_sample.h"
+
+/* A stats_thread with a "stream_path" connects to the mon_self_agg daemon
+ * over a Unix domain stream socket and sends each output sample as a batch
+ * of frames, with one non-blocking send(). Both ends are on one host, so
+ * the frames are in host byte order. Every frame starts with
+ * stats_stream_frame_hdr_t:
+ *   HELLO, once per connection: stats_stream_hello_t.
+ *   SAMPLE: stats_stream_sample_t, then a varint per context counter.
+ *   SESSIONS: "count" sessions of that sample, each a byte of direction
+ *     (STATS_STREAM_SRC/RCV), a byte of transport type, a byte of source
+ *     length, the source (no '\0'), then a varint per counter of the type.
+ * The counters are those of the field set in the HELLO (see stats_fields.h).
+ * A sample's sessions are split into frames of at most
+ * STATS_STREAM_MAX_FRAME bytes, so the daemon's buffers stay small. */
+#define STATS_STREAM_PATH "/tmp/mon_self_agg.sock"
+#define STATS_STREAM_VERSION 1
+#define STATS_STREAM_HELLO 1
+#define STATS_STREAM_SAMPLE 2
+#define STATS_STREAM_SESSIONS 3
+#define STATS_STREAM_SRC 0
+#define STATS_STREAM_RCV 1
+#define STATS_STREAM_MAX_FRAME (64 * 1024)
+
+struct stats_stream_frame_hdr_s {
+  uint32_t len;  /* Including this header. */
+  uint16_t kind;  /* STATS_STREAM_HELLO/SAMPLE/SESSIONS. */
+  uint16_t count;  /* SESSIONS: number of sessions. */
+};
+typedef struct stats_stream_frame_hdr_s stats_stream_frame_hdr_t;
+
+struct stats_stream_hello_s {
+  uint32_t version;
+  uint32_t pid;
+  uint32_t field_set;  /* STATS_FIELDS_... */
+  uint32_t reserved;
+  char ctx_name[64];
+};
+typedef struct stats_stream_hello_s stats_stream_hello_t;
+
+struct stats_stream_sample_s {
+  uint64_t seq;
+  uint64_t time_ms;  /* Since the epoch. */
+  uint64_t dropped;  /* Samples this client has dropped so far. */
+  uint32_t num_src;  /* Sessions in the SESSIONS frames that follow. */
+  uint32_t num_rcv;
+};
+typedef struct stats_stream_sample_s stats_stream_sample_t;
+
+/* Client. Only used by the writer thread. The frames not yet accepted by
+ * the socket are kept in "buf" (from "sent" to "len"). A sample is dropped
+ * (and counted) instead of waiting, if there is no daemon, or if the
+ * daemon is behind and the sample would take "buf" past "buf_size". */
+struct stats_stream_s {
+  char *path;
+  char *ctx_name;
+  size_t buf_size;
+  int fd;  /* -1=not connected. */
+  uint64_t retry_ns;  /* CLOCK_MONOTONIC; no connect attempt before. */
+  int warned;  /* The daemon's absence was reported. */
+  uint8_t *buf;
+  size_t sent;
+  size_t len;
+  size_t capacity;
+  /* End (in "buf") of each sample not completely sent, oldest first. */
+  size_t *ends;
+  int num_ends;
+  int ends_capacity;
+  uint64_t num_samples;  /* Completely sent. */
+  uint64_t num_dropped;
+  uint64_t num_bytes;  /* Sent. */
+  uint64_t num_connects;
+};
+typedef struct stats_stream_s stats_stream_t;
+
+
+stats_stream_t *stats_stream_create(const char *path, const char *ctx_name, size_t buf_size);
+void stats_stream_delete(stats_stream_t *stream);
+void stats_stream_write(stats_stream_t *stream, const stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_STREAM_H */
@@ -21,14 +21,23 @@
 */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_sample.h"
+#include "stats_queue.h"
+#include "stats_sink.h"
+#include "stats_monitor.h"
 #include "stats_thread.h"
+#include "stats_fmt.h"
 
 
 /* Simple error handler for LBM. */
@@ -66,31 +75,186 @@
   } \
 } while (0)  /* ENL */
 
+/* Over the CPU budget: session lines skipped, then sampling up to 8 times
+ * slower (see stats_sample_t's degrade). */
+#define MAX_DEGRADE 4
 
-void print_stats(stats_thread_t *stats_thread)
+
+/* Size of the member of the transport union that "type" uses; any bytes
+ * past it are left over from other sessions. */
+static size_t transport_stats_size(int dir, int type)
 {
-  int i, err;
-  lbm_context_stats_t ctx_stats;
-  char *ctx_name = stats_thread->ctx_name;
-  if (ctx_name == NULL) {
-    ctx_name = "";
+  if (dir == STATS_STORE_SRC) {
+    switch (type) {
+      case LBM_TRANSPORT_STAT_LBTRM: return sizeof(lbm_src_transport_stats_lbtrm_t);
+      case LBM_TRANSPORT_STAT_LBTRU: return sizeof(lbm_src_transport_stats_lbtru_t);
+      case LBM_TRANSPORT_STAT_TCP: return sizeof(lbm_src_transport_stats_tcp_t);
+      case LBM_TRANSPORT_STAT_LBTIPC: return sizeof(lbm_src_transport_stats_lbtipc_t);
+      case LBM_TRANSPORT_STAT_LBTSMX: return sizeof(lbm_src_transport_stats_lbtsmx_t);
+      default: return 0;
+    }
+  }
+  else {
+    switch (type) {
+      case LBM_TRANSPORT_STAT_LBTRM: return sizeof(lbm_rcv_transport_stats_lbtrm_t);
+      case LBM_TRANSPORT_STAT_LBTRU: return sizeof(lbm_rcv_transport_stats_lbtru_t);
+      case LBM_TRANSPORT_STAT_TCP: return sizeof(lbm_rcv_transport_stats_tcp_t);
+      case LBM_TRANSPORT_STAT_LBTIPC: return sizeof(lbm_rcv_transport_stats_lbtipc_t);
+      case LBM_TRANSPORT_STAT_LBTSMX: return sizeof(lbm_rcv_transport_stats_lbtsmx_t);
+      default: return 0;
+    }
   }
+}  /* transport_stats_size */
+
+
+/* FNV-1a. */
+static uint64_t stats_digest(const void *mem, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)mem;
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}  /* stats_digest */
+
+
+/* Find the transport session in the index and gather its counters into
+ * its row of the column store, giving it a row if needed. Returns the
+ * session's status so far: "new" (first seen), "cont" (continuing), or
+ * "reset" (the same source string now has a different transport type).
+ * A continuing session can still turn out to be a reset (counters went
+ * backwards) once stats_store_compute() has run. Also fills in the delta's
+ * row and host/group IDs, and for changes_only, sets "changed" if anything
+ * printed for the session differs from the previous sample. */
+static const char *project_session(stats_thread_t *stats_thread, stats_index_t *index, int dir, int type,
+    const char *source, const void *stats, stats_delta_t *delta)
+{
+  stats_column_group_t *group;
+  stats_session_t *session;
+  const char *status;
+  int is_new;
+
+  session = stats_index_find_or_add(index, source, &is_new);
+  status = is_new ? "new" : "cont";
+  if (!is_new && session->type != type) {
+    status = "reset";
+    if (session->row >= 0) {
+      stats_store_row_free(stats_store_group(stats_thread->store, dir, session->type), session->row);
+      session->row = -1;
+    }
+  }
+  if (status[0] != 'c') {
+    /* The source string only has to be parsed when the session is new. */
+    stats_source_parse(source, &session->info);
+    stats_source_intern(stats_thread->addrs, &session->info);
+  }
+  session->type = type;
+  delta->host_id = session->info.host_id;
+  delta->group_id = session->info.group_id;
+
+  group = stats_store_group(stats_thread->store, dir, type);
+  if (group != NULL) {
+    if (session->row < 0) {
+      session->row = stats_store_row_alloc(group);
+    }
+    stats_store_put(group, session->row, stats);
+  }
+  delta->row = session->row;
+
+  delta->changed = 1;
+  if (stats_thread->config.changes_only) {
+    /* Gauges like num_clients are printed but not in the column store, so
+     * compare a digest of the whole structure. */
+    size_t offset = (dir == STATS_STORE_SRC) ? offsetof(lbm_src_transport_stats_t, transport)
+                                             : offsetof(lbm_rcv_transport_stats_t, transport);
+    uint64_t digest = stats_digest((const char *)stats + offset, transport_stats_size(dir, type));
+    delta->changed = (status[0] != 'c' || digest != session->digest);
+    session->digest = digest;
+  }
+
+  return status;
+}  /* project_session */
+
+
+/* What sweep_session() needs for one direction. */
+struct sweep_ctx_s {
+  stats_column_group_t *groups;  /* The store's column groups. */
+  stats_sample_t *sample;  /* Gets a session_left entry, or NULL. */
+  int dir;
+};
+
+
+/* stats_index_sweep() callback: give the session's row back, and note that
+ * it left. */
+static void sweep_session(stats_session_t *session, void *clientd)
+{
+  struct sweep_ctx_s *sweep_ctx = (struct sweep_ctx_s *)clientd;
+
+  if (session->row >= 0) {
+    stats_store_row_free(&sweep_ctx->groups[stats_fields_type_index(session->type)], session->row);
+    session->row = -1;
+  }
+  if (sweep_ctx->sample != NULL) {
+    stats_sample_add_left(sweep_ctx->sample, sweep_ctx->dir, session->type, session->source);
+  }
+}  /* sweep_session */
+
+
+/* Copy one session's deltas out of a column store into the sample. */
+static void fetch_deltas(stats_store_t *store, int dir, int type, stats_delta_t *delta)
+{
+  stats_column_group_t *group;
+  int f;
+
+  if (delta->row < 0) {
+    return;  /* No counters. */
+  }
+  group = stats_store_group(store, dir, type);
+  if (group->reset[delta->row] && delta->status[0] == 'c') {
+    delta->status = "reset";  /* Counters only go backward when recreated. */
+    delta->changed = 1;
+  }
+  for (f = 0; f < group->num_fields; f++) {
+    delta->deltas[f] = group->delta[(size_t)f * group->row_capacity + delta->row];
+  }
+}  /* fetch_deltas */
+
+
+/* Retrieve the context, source, and receiver stats into "sample", without
+ * numbering it. Only uses the stats_thread's context, so it can run
+ * alongside sampling (the scrape server uses its own sample). */
+void stats_thread_retrieve(stats_thread_t *stats_thread, stats_sample_t *sample)
+{
+  int err;
+  struct timespec start_ts, sample_ts, realtime_ts, end_ts;
+
+  sample->retrieve_retries = 0;
 
   /* Sample context stats. */
-  E(lbm_context_retrieve_stats(stats_thread->ctx, &ctx_stats));
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &start_ts));
+  E(lbm_context_retrieve_stats(stats_thread->ctx, &sample->ctx_stats));
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &sample_ts));
+  ENZ(clock_gettime(CLOCK_REALTIME, &realtime_ts));
+  sample->sample_ns = (uint64_t)sample_ts.tv_sec * 1000000000 + sample_ts.tv_nsec;
+  sample->sample_realtime_ns = (uint64_t)realtime_ts.tv_sec * 1000000000 + realtime_ts.tv_nsec;
 
   /* Sample source stats. May require loop if our stats buffer isn't big enough. */
-  int actual_src_entries;
+  if (sample->src_capacity == 0) {
+    stats_sample_reserve(sample, 100, 0);
+  }
   do {
-    actual_src_entries = stats_thread->src_num_entries;
-    err = lbm_context_retrieve_src_transport_stats_ex(stats_thread->ctx, &actual_src_entries,
-        sizeof(lbm_src_transport_stats_t), stats_thread->src_stats);
-    if (err == -1 && lbm_errnum() == LBM_EINVAL && actual_src_entries > stats_thread->src_num_entries) {
+    sample->src_num_entries = sample->src_capacity;
+    err = lbm_context_retrieve_src_transport_stats_ex(stats_thread->ctx, &sample->src_num_entries,
+        sizeof(lbm_src_transport_stats_t), sample->src_stats);
+    if (err == -1 && lbm_errnum() == LBM_EINVAL && sample->src_num_entries > sample->src_capacity) {
       /* We didn't allow enough space for the current transport sessions. UM gives back
        * the number of entries it needs. Increase it to allow for growth. */
-      stats_thread->src_num_entries += (actual_src_entries+1)/2;
-      ENL(stats_thread->src_stats = (lbm_src_transport_stats_t *)realloc(stats_thread->src_stats,
-          sizeof(lbm_src_transport_stats_t) * stats_thread->src_num_entries));
+      stats_sample_reserve(sample, sample->src_capacity + (sample->src_num_entries+1)/2, 0);
+      sample->retrieve_retries++;
     }
     else if (err == -1) {
       E(err);  /* Any other error is fatal. */
@@ -98,193 +262,625 @@ void print_stats(stats_thread_t *stats_thread)
   } while (err != 0);
 
   /* Sample receiver stats. May require loop if our stats buffer isn't big enough. */
-  int actual_rcv_entries;
+  if (sample->rcv_capacity == 0) {
+    stats_sample_reserve(sample, 0, 100);
+  }
   do {
-    actual_rcv_entries = stats_thread->rcv_num_entries;
-    err = lbm_context_retrieve_rcv_transport_stats_ex(stats_thread->ctx, &actual_rcv_entries,
-        sizeof(lbm_rcv_transport_stats_t), stats_thread->rcv_stats);
-    if (err == -1 && lbm_errnum() == LBM_EINVAL && actual_rcv_entries > stats_thread->rcv_num_entries) {
+    sample->rcv_num_entries = sample->rcv_capacity;
+    err = lbm_context_retrieve_rcv_transport_stats_ex(stats_thread->ctx, &sample->rcv_num_entries,
+        sizeof(lbm_rcv_transport_stats_t), sample->rcv_stats);
+    if (err == -1 && lbm_errnum() == LBM_EINVAL && sample->rcv_num_entries > sample->rcv_capacity) {
       /* We didn't allow enough space for the current transport sessions. UM gives back
        * the number of entries it needs. Increase it to allow for growth. */
-      stats_thread->rcv_num_entries += (actual_rcv_entries+1)/2;
-      ENL(stats_thread->rcv_stats = (lbm_rcv_transport_stats_t *)realloc(stats_thread->rcv_stats,
-          sizeof(lbm_rcv_transport_stats_t) * stats_thread->rcv_num_entries));
+      stats_sample_reserve(sample, 0, sample->rcv_capacity + (sample->rcv_num_entries+1)/2);
+      sample->retrieve_retries++;
     }
     else if (err == -1) {
       E(err);  /* Any other error is fatal. */
     }
   } while (err != 0);
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &end_ts));
+  sample->retrieve_ns = (uint64_t)(end_ts.tv_sec - start_ts.tv_sec) * 1000000000 + end_ts.tv_nsec - start_ts.tv_nsec;
+}  /* stats_thread_retrieve */
 
-  /* Print context stats. */
-  {
-    /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__context__stats__t__stct.html */
-    unsigned long tr_drops = ctx_stats.tr_dgrams_dropped_ver + ctx_stats.tr_dgrams_dropped_type
-                             + ctx_stats.tr_dgrams_dropped_malformed;
-    printf("ctx_name='%s', context: tr_dgrams_sent=%lu, tr_dgrams_rcved=%lu, tr_drops=%lu"
-           ", tr_src_topics=%lu, tr_rcv_topics=%lu, tr_rcv_unresolved_topics=%lu"
-           ", lbtrm_unknown_msgs_rcved=%lu, lbtru_unknown_msgs_rcved=%lu"
-           ", send_blocked=%lu, send_would_block=%lu, fragments_unrecoverably_lost=%lu"
-           "\n",
-           ctx_name, ctx_stats.tr_dgrams_sent, ctx_stats.tr_dgrams_rcved, tr_drops,
-           ctx_stats.tr_src_topics, ctx_stats.tr_rcv_topics, ctx_stats.tr_rcv_unresolved_topics,
-           ctx_stats.lbtrm_unknown_msgs_rcved, ctx_stats.lbtru_unknown_msgs_rcved,
-           ctx_stats.send_blocked, ctx_stats.send_would_block, ctx_stats.fragments_unrecoverably_lost
-    ); 
-  }
-
-  /* Print source stats, one line per published transport session. */
-  for (i = 0; i < actual_src_entries; i++) {
-    switch (stats_thread->src_stats[i].type) {
-      case LBM_TRANSPORT_STAT_LBTRM: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtrm__t__stct.html */
-        lbm_src_transport_stats_lbtrm_t *stats = &stats_thread->src_stats[i].transport.lbtrm;
-        printf("ctx_name='%s', src/lbtrm: source=%s, msgs_sent=%lu, naks_rcved=%lu"
-            ", naks_ignored=%lu, naks_shed=%lu, naks_rx_delay_ignored=%lu, rxs_sent=%lu"
-            "\n",
-            ctx_name, stats_thread->src_stats[i].source, stats->msgs_sent, stats->naks_rcved,
-            stats->naks_ignored, stats->naks_shed, stats->naks_rx_delay_ignored, stats->rxs_sent
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_LBTRU: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtru__t__stct.html */
-        lbm_src_transport_stats_lbtru_t *stats = &stats_thread->src_stats[i].transport.lbtru;
-        printf("ctx_name='%s', src/lbtru: source=%s, msgs_sent=%lu, naks_rcved=%lu"
-            ", naks_ignored=%lu, naks_shed=%lu, naks_rx_delay_ignored=%lu, rxs_sent=%lu"
-            "\n",
-            ctx_name, stats_thread->src_stats[i].source, stats->msgs_sent, stats->naks_rcved,
-            stats->naks_ignored, stats->naks_shed, stats->naks_rx_delay_ignored, stats->rxs_sent
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_TCP: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__tcp__t__stct.html */
-        lbm_src_transport_stats_tcp_t *stats = &stats_thread->src_stats[i].transport.tcp;
-        printf("ctx_name='%s', src/tcp: source=%s, num_clients=%lu"
-            "\n",
-            ctx_name, stats_thread->src_stats[i].source, stats->num_clients
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_LBTIPC: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtipc__t__stct.html */
-        lbm_src_transport_stats_lbtipc_t *stats = &stats_thread->src_stats[i].transport.lbtipc;
-        printf("ctx_name='%s', src/lbtipc: source=%s, num_clients=%lu, msgs_sent=%lu"
-            "\n",
-            ctx_name, stats_thread->src_stats[i].source, stats->num_clients, stats->msgs_sent
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_LBTSMX: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__src__transport__stats__lbtsmx__t__stct.html */
-        lbm_src_transport_stats_lbtsmx_t *stats = &stats_thread->src_stats[i].transport.lbtsmx;
-        printf("ctx_name='%s', src/lbtsmx: source=%s, num_clients=%lu, msgs_sent=%lu"
-            "\n",
-            ctx_name, stats_thread->src_stats[i].source, stats->num_clients, stats->msgs_sent
-        );
-        break;
-      }
-      default:
-        printf("WARNING: ctx_name='%s', unrecognized transport type (%u)\n", ctx_name, stats_thread->rcv_stats[i].type);
-    }  /* switch */
-  }  /* for */
-
-  /* Print receiver stats, one line per subscribed transport session. */
-  for (i = 0; i < actual_rcv_entries; i++) {
-    switch (stats_thread->rcv_stats[i].type) {
-      case LBM_TRANSPORT_STAT_LBTRM: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtrm__t__stct.html */
-        lbm_rcv_transport_stats_lbtrm_t *stats = &stats_thread->rcv_stats[i].transport.lbtrm;
-        unsigned long drops = stats->dgrams_dropped_size + stats->dgrams_dropped_type + stats->dgrams_dropped_version
-                              + stats->dgrams_dropped_hdr + stats->dgrams_dropped_other;
-        printf("ctx_name='%s', rcv/lbtrm: source=%s, msgs_rcved=%lu, naks_sent=%lu"
-               ", lost=%lu, unrecovered_txw=%lu, unrecovered_tmo=%lu, lbm_msgs_rcved=%lu"
-               ", lbm_msgs_no_topic_rcved=%lu, drops=%lu, out_of_order=%lu"
-               "\n",
-               ctx_name, stats_thread->rcv_stats[i].source, stats->msgs_rcved, stats->naks_sent,
-               stats->lost, stats->unrecovered_txw, stats->unrecovered_tmo, stats->lbm_msgs_rcved,
-               drops, stats->lbm_msgs_no_topic_rcved, stats->out_of_order
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_LBTRU: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtru__t__stct.html */
-        lbm_rcv_transport_stats_lbtru_t *stats = &stats_thread->rcv_stats[i].transport.lbtru;
-        unsigned long drops = stats->dgrams_dropped_size + stats->dgrams_dropped_type + stats->dgrams_dropped_version
-                              + stats->dgrams_dropped_hdr + stats->dgrams_dropped_sid + stats->dgrams_dropped_other;
-        printf("ctx_name='%s', rcv/lbtru: source=%s, msgs_rcved=%lu, naks_sent=%lu"
-               ", lost=%lu, unrecovered_txw=%lu, unrecovered_tmo=%lu, lbm_msgs_rcved=%lu"
-               ", lbm_msgs_no_topic_rcved=%lu, drops=%lu"
-               "\n",
-               ctx_name, stats_thread->rcv_stats[i].source, stats->msgs_rcved, stats->naks_sent,
-               stats->lost, stats->unrecovered_txw, stats->unrecovered_tmo, stats->lbm_msgs_rcved,
-               drops, stats->lbm_msgs_no_topic_rcved
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_TCP: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__tcp__t__stct.html */
-        lbm_rcv_transport_stats_tcp_t *stats = &stats_thread->rcv_stats[i].transport.tcp;
-        printf("ctx_name='%s', rcv/tcp: source=%s, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu"
-            "\n",
-            ctx_name, stats_thread->rcv_stats[i].source, stats->lbm_msgs_rcved, stats->lbm_msgs_no_topic_rcved
-        );
-        break;
-      }
-      case LBM_TRANSPORT_STAT_LBTIPC: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtipc__t__stct.html */
-        lbm_rcv_transport_stats_lbtipc_t *stats = &stats_thread->rcv_stats[i].transport.lbtipc;
-        printf("ctx_name='%s', rcv/lbtipc: source=%s, msgs_rcved=%lu, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu"
-            "\n",
-            ctx_name, stats_thread->rcv_stats[i].source, stats->msgs_rcved, stats->lbm_msgs_rcved, stats->lbm_msgs_no_topic_rcved
-        );
-        break;
+
+/* Retrieve the next numbered sample. */
+static void retrieve_stats(stats_thread_t *stats_thread, stats_sample_t *sample)
+{
+  stats_thread->num_samples++;
+  sample->seq = stats_thread->num_samples;
+  sample->tick_id = stats_thread->tick_id;
+  sample->tick_realtime_ns = stats_thread->tick_realtime_ns;
+  stats_thread_retrieve(stats_thread, sample);
+}  /* retrieve_stats */
+
+
+/* Hand a freshly retrieved sample to the flight recorder, the shared
+ * memory snapshot and the rolling windows, if enabled. None of them
+ * depend on the output interval. */
+static void keep_sample(stats_thread_t *stats_thread, const stats_sample_t *sample)
+{
+  if (stats_thread->recorder != NULL) {
+    stats_recorder_write(stats_thread->recorder, sample);
+  }
+  if (stats_thread->shm != NULL) {
+    stats_shm_write(stats_thread->shm, sample);
+  }
+  if (stats_thread->window != NULL) {
+    stats_window_update(stats_thread->window, sample);
+  }
+}  /* keep_sample */
+
+
+static void check_tick(stats_thread_t *stats_thread, stats_sample_t *sample);
+
+
+/* Flight recorder or window tick that isn't output: retrieve into a
+ * private sample and keep it. */
+static void record_stats(stats_thread_t *stats_thread)
+{
+  retrieve_stats(stats_thread, &stats_thread->rec_sample);
+  keep_sample(stats_thread, &stats_thread->rec_sample);
+  if (stats_thread->tick_store != NULL) {
+    check_tick(stats_thread, &stats_thread->rec_sample);
+  }
+}  /* record_stats */
+
+
+/* Scheduling interval: the burst interval while bursting, otherwise the
+ * normal one, slowed down if over the CPU budget. */
+static void set_sample_interval(stats_thread_t *stats_thread)
+{
+  if (stats_thread->burst) {
+    stats_thread->sample_interval_ns = stats_thread->burst_interval_ns;
+  } else if (stats_thread->degrade > 1) {
+    stats_thread->sample_interval_ns = stats_thread->normal_interval_ns << (stats_thread->degrade - 1);
+  } else {
+    stats_thread->sample_interval_ns = stats_thread->normal_interval_ns;
+  }
+}  /* set_sample_interval */
+
+
+/* Check the rules against a sample's deltas, and switch between the normal
+ * and burst sampling intervals. The monitor uses the new
+ * sample_interval_ns to schedule the next sample. */
+static void check_rules(stats_thread_t *stats_thread, stats_sample_t *sample)
+{
+  if (stats_rules_check(stats_thread->rules, sample, stats_thread->config.max_alerts) > 0) {
+    stats_thread->burst_until_ns = sample->sample_ns + (uint64_t)stats_thread->config.burst_quiet_ms * 1000000;
+    if (!stats_thread->burst && stats_thread->burst_interval_ns > 0) {
+      stats_thread->burst = 1;
+      set_sample_interval(stats_thread);
+      sample->burst_change = 1;
+      sample->burst_sample_interval_ns = stats_thread->sample_interval_ns;
+    }
+  }
+  else if (stats_thread->burst && sample->sample_ns >= stats_thread->burst_until_ns) {
+    stats_thread->burst = 0;
+    set_sample_interval(stats_thread);
+    stats_thread->num_ticks = 1;  /* With the recorder, the next output is a full interval away. */
+    sample->burst_change = -1;
+    sample->burst_sample_interval_ns = stats_thread->sample_interval_ns;
+  }
+}  /* check_rules */
+
+
+/* Gather one session's counters into its row of the tick store; like
+ * project_session(), but only for the rules. */
+static void project_tick(stats_thread_t *stats_thread, stats_index_t *index, int dir, int type,
+    const char *source, const void *stats, stats_delta_t *delta)
+{
+  stats_column_group_t *group;
+  stats_session_t *session;
+  int is_new;
+
+  session = stats_index_find_or_add(index, source, &is_new);
+  delta->status = is_new ? "new" : "cont";
+  if (!is_new && session->type != type) {
+    delta->status = "reset";
+    if (session->row >= 0) {
+      stats_store_row_free(stats_store_group(stats_thread->tick_store, dir, session->type), session->row);
+      session->row = -1;
+    }
+  }
+  session->type = type;
+  group = stats_store_group(stats_thread->tick_store, dir, type);
+  if (group != NULL) {
+    if (session->row < 0) {
+      session->row = stats_store_row_alloc(group);
+    }
+    stats_store_put(group, session->row, stats);
+  }
+  delta->row = session->row;
+}  /* project_tick */
+
+
+/* With the flight recorder or windows, the rules are checked on every
+ * tick, against the deltas since the previous tick, so that a burst can
+ * start between output samples. Those deltas are tracked in their own
+ * store, so that the output samples' deltas still span the output
+ * interval; an output sample's deltas and interval_ns are overwritten
+ * afterwards, but its alerts and burst_change are kept. */
+static void check_tick(stats_thread_t *stats_thread, stats_sample_t *sample)
+{
+  struct sweep_ctx_s sweep_ctx;
+  const stats_field_t *fields;
+  int num_fields, f, i;
+
+  fields = stats_fields_ctx(&num_fields);
+  for (f = 0; f < num_fields; f++) {
+    lbm_ulong_t cur = stats_field_value(&fields[f], &sample->ctx_stats);
+    sample->ctx_deltas[f] = (cur >= stats_thread->tick_ctx_prev[f]) ? (cur - stats_thread->tick_ctx_prev[f]) : cur;
+    stats_thread->tick_ctx_prev[f] = cur;
+  }
+
+  stats_store_begin_sample(stats_thread->tick_store);
+  stats_index_begin_sample(stats_thread->tick_src_index);
+  for (i = 0; i < sample->src_num_entries; i++) {
+    project_tick(stats_thread, stats_thread->tick_src_index, STATS_STORE_SRC, sample->src_stats[i].type,
+        sample->src_stats[i].source, &sample->src_stats[i], &sample->src_deltas[i]);
+  }
+  stats_index_begin_sample(stats_thread->tick_rcv_index);
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    project_tick(stats_thread, stats_thread->tick_rcv_index, STATS_STORE_RCV, sample->rcv_stats[i].type,
+        sample->rcv_stats[i].source, &sample->rcv_stats[i], &sample->rcv_deltas[i]);
+  }
+  stats_store_compute(stats_thread->tick_store);
+  for (i = 0; i < sample->src_num_entries; i++) {
+    fetch_deltas(stats_thread->tick_store, STATS_STORE_SRC, sample->src_stats[i].type, &sample->src_deltas[i]);
+  }
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    fetch_deltas(stats_thread->tick_store, STATS_STORE_RCV, sample->rcv_stats[i].type, &sample->rcv_deltas[i]);
+  }
+
+  sweep_ctx.sample = NULL;
+  sweep_ctx.dir = STATS_STORE_SRC;
+  sweep_ctx.groups = stats_thread->tick_store->groups[STATS_STORE_SRC];
+  (void)stats_index_sweep(stats_thread->tick_src_index, sweep_session, &sweep_ctx);
+  sweep_ctx.dir = STATS_STORE_RCV;
+  sweep_ctx.groups = stats_thread->tick_store->groups[STATS_STORE_RCV];
+  (void)stats_index_sweep(stats_thread->tick_rcv_index, sweep_session, &sweep_ctx);
+
+  sample->num_alerts = 0;
+  sample->num_violations = 0;
+  sample->burst_change = 0;
+  if (stats_thread->prev_tick_ns != 0) {
+    sample->interval_ns = sample->sample_ns - stats_thread->prev_tick_ns;
+    if (sample->interval_ns == 0) {
+      sample->interval_ns = 1;
+    }
+    check_rules(stats_thread, sample);
+  }
+  stats_thread->prev_tick_ns = sample->sample_ns;
+}  /* check_tick */
+
+
+/* CPU time used by the calling thread so far. */
+static uint64_t thread_cpu_ns(void)
+{
+  struct timespec ts;
+
+  ENZ(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* thread_cpu_ns */
+
+
+/* Add up the CPU time since the previous output sample, and step the
+ * degrade level up when over budget, or back down once well under it (half
+ * the budget, so that it doesn't flap: undoing a slowdown doubles the
+ * rate). */
+static void check_budget(stats_thread_t *stats_thread, stats_sample_t *sample)
+{
+  uint64_t writer_cpu_ns = __atomic_load_n(&stats_thread->writer_cpu_ns, __ATOMIC_RELAXED);
+  double budget_pct = stats_thread->config.cpu_budget_pct;
+
+  sample->cpu_ns = stats_thread->sample_cpu_ns + (writer_cpu_ns - stats_thread->prev_writer_cpu_ns);
+  stats_thread->sample_cpu_ns = 0;
+  stats_thread->prev_writer_cpu_ns = writer_cpu_ns;
+  sample->degrade_change = 0;
+
+  if (budget_pct > 0.0 && stats_thread->prev_sample_ns != 0) {
+    double cpu_pct = (double)sample->cpu_ns * 100.0 / (double)sample->interval_ns;
+    if (cpu_pct > budget_pct && stats_thread->degrade < MAX_DEGRADE) {
+      stats_thread->degrade++;
+      sample->degrade_change = 1;
+    }
+    else if (cpu_pct < budget_pct / 2.0 && stats_thread->degrade > 0) {
+      stats_thread->degrade--;
+      sample->degrade_change = -1;
+    }
+    set_sample_interval(stats_thread);
+  }
+  sample->degrade = stats_thread->degrade;
+}  /* check_budget */
+
+
+/* Sum one direction's session deltas by publisher host or by multicast
+ * group into the sample's aggregates. */
+static void aggregate_sessions(stats_thread_t *stats_thread, stats_sample_t *sample, int dir, int by_group)
+{
+  int num_entries = (dir == STATS_STORE_SRC) ? sample->src_num_entries : sample->rcv_num_entries;
+  int first = sample->num_aggregates;
+  int i, a;
+
+  if (stats_thread->addrs->num_addrs > stats_thread->aggregate_slot_capacity) {
+    int capacity = stats_thread->addrs->addrs_capacity;
+    ENL(stats_thread->aggregate_slot = (int *)realloc(stats_thread->aggregate_slot,
+        sizeof(int) * capacity * STATS_NUM_TYPES));
+    for (i = 0; i < capacity * STATS_NUM_TYPES; i++) {
+      stats_thread->aggregate_slot[i] = -1;
+    }
+    stats_thread->aggregate_slot_capacity = capacity;
+  }
+
+  for (i = 0; i < num_entries; i++) {
+    const stats_delta_t *delta;
+    stats_aggregate_t *aggregate;
+    stats_column_group_t *group;
+    int type, id, *slot, f;
+
+    if (dir == STATS_STORE_SRC) {
+      delta = &sample->src_deltas[i];
+      type = sample->src_stats[i].type;
+    } else {
+      delta = &sample->rcv_deltas[i];
+      type = sample->rcv_stats[i].type;
+    }
+    id = by_group ? delta->group_id : delta->host_id;
+    if (id < 0 || delta->row < 0) {
+      continue;
+    }
+    group = stats_store_group(stats_thread->store, dir, type);
+    slot = &stats_thread->aggregate_slot[id * STATS_NUM_TYPES + stats_fields_type_index(type)];
+    if (*slot < 0) {
+      *slot = sample->num_aggregates;
+      aggregate = stats_sample_add_aggregate(sample);
+      aggregate->dir = dir;
+      aggregate->type = type;
+      aggregate->by_group = by_group;
+      aggregate->addr = stats_thread->addrs->addrs[id];
+    }
+    aggregate = &sample->aggregates[*slot];
+    aggregate->num_sessions++;
+    for (f = 0; f < group->num_fields; f++) {
+      aggregate->deltas[f] += delta->deltas[f];
+    }
+  }
+
+  /* Leave the scratch slots empty for next time. */
+  for (a = first; a < sample->num_aggregates; a++) {
+    const stats_aggregate_t *aggregate = &sample->aggregates[a];
+    int id = stats_source_addr_intern(stats_thread->addrs, aggregate->addr);
+    stats_thread->aggregate_slot[id * STATS_NUM_TYPES + stats_fields_type_index(aggregate->type)] = -1;
+  }
+}  /* aggregate_sessions */
+
+
+/* Runs in the sampling thread. Retrieves the stats straight into a free
+ * queue slot and computes deltas; all formatting and output is left to the
+ * writer thread. If the writer has fallen behind, the sample is skipped
+ * (and counted); the next sample's deltas then span the longer interval.
+ * A tick that isn't due for output ("emit" zero) is only kept, unless a
+ * rule fires on it (see check_tick()); then it is output too. */
+static void sample_stats(stats_thread_t *stats_thread, int emit)
+{
+  int i;
+  stats_sample_t *sample;
+
+  if (!emit && stats_thread->tick_store == NULL) {
+    record_stats(stats_thread);
+    return;
+  }
+  sample = stats_queue_claim(stats_thread->queue);
+  if (sample == NULL) {
+    if (stats_thread->recorder != NULL || stats_thread->shm != NULL || stats_thread->window != NULL) {
+      record_stats(stats_thread);  /* None depend on the writer. */
+    }
+    else {
+      stats_thread->num_samples++;  /* Leaves a gap in the printed seq. */
+    }
+    return;
+  }
+
+  retrieve_stats(stats_thread, sample);
+  sample->num_alerts = 0;
+  sample->num_violations = 0;
+  sample->burst_change = 0;
+  if (stats_thread->tick_store != NULL) {
+    check_tick(stats_thread, sample);
+    if (!emit && sample->num_violations == 0) {
+      keep_sample(stats_thread, sample);  /* The slot isn't published, so it's reused. */
+      return;
+    }
+  }
+  sample->interval_ns = sample->sample_ns - stats_thread->prev_sample_ns;
+  if (sample->interval_ns == 0) {
+    sample->interval_ns = 1;  /* Avoid divide by zero for rates. */
+  }
+  /* Deltas need a previous sample. */
+  sample->have_deltas = (stats_thread->config.deltas && stats_thread->prev_sample_ns != 0);
+  keep_sample(stats_thread, sample);
+  check_budget(stats_thread, sample);
+  sample->num_summaries = 0;
+  if (stats_thread->window != NULL && sample->sample_ns >= stats_thread->next_summary_ns) {
+    stats_window_summarize(stats_thread->window, sample);
+    /* Less half an output interval, so that jitter doesn't skip one. */
+    stats_thread->next_summary_ns = sample->sample_ns + (uint64_t)stats_thread->config.window_summary_sec * 1000000000
+        - (uint64_t)stats_thread->stats_interval_sec * 500000000;
+  }
+  sample->have_latency = (stats_thread->config.latency != NULL);
+  if (sample->have_latency) {
+    stats_latency_collect(stats_thread->config.latency, sample->latency);
+  }
+  sample->num_sends = 0;
+  if (stats_thread->config.send != NULL) {
+    stats_send_collect(stats_thread->config.send, sample);
+    if (stats_thread->prev_sample_ns == 0) {
+      sample->num_sends = 0;  /* No interval for the rates yet. */
+    }
+  }
+  sample->num_left = 0;
+  sample->num_aggregates = 0;
+  sample->keyframe = (stats_thread->num_emitted % stats_thread->config.keyframe_interval) == 0;
+  stats_thread->num_emitted++;
+
+  /* Changes-only output, session events and rules need the same
+   * per-session tracking as deltas. */
+  if (stats_thread->config.deltas || stats_thread->config.changes_only || stats_thread->config.session_events
+      || stats_thread->rules != NULL) {
+    struct sweep_ctx_s sweep_ctx;
+    const stats_field_t *fields;
+    int num_fields, f;
+
+    fields = stats_fields_ctx(&num_fields);
+    for (f = 0; f < num_fields; f++) {
+      lbm_ulong_t cur = stats_field_value(&fields[f], &sample->ctx_stats);
+      /* Context counters only reset if the context is recreated, which
+       * would be a new stats_thread; still, don't print a huge number. */
+      sample->ctx_deltas[f] = (cur >= stats_thread->ctx_prev[f]) ? (cur - stats_thread->ctx_prev[f]) : cur;
+      stats_thread->ctx_prev[f] = cur;
+    }
+
+    /* Project every session into the column store, compute all deltas
+     * and totals there, then copy each session's deltas back out. */
+    stats_store_begin_sample(stats_thread->store);
+    stats_index_begin_sample(stats_thread->src_index);
+    for (i = 0; i < sample->src_num_entries; i++) {
+      sample->src_deltas[i].status = project_session(stats_thread, stats_thread->src_index, STATS_STORE_SRC,
+          sample->src_stats[i].type, sample->src_stats[i].source, &sample->src_stats[i], &sample->src_deltas[i]);
+    }
+    stats_index_begin_sample(stats_thread->rcv_index);
+    for (i = 0; i < sample->rcv_num_entries; i++) {
+      sample->rcv_deltas[i].status = project_session(stats_thread, stats_thread->rcv_index, STATS_STORE_RCV,
+          sample->rcv_stats[i].type, sample->rcv_stats[i].source, &sample->rcv_stats[i], &sample->rcv_deltas[i]);
+    }
+
+    stats_store_compute(stats_thread->store);
+
+    for (i = 0; i < sample->src_num_entries; i++) {
+      fetch_deltas(stats_thread->store, STATS_STORE_SRC, sample->src_stats[i].type, &sample->src_deltas[i]);
+    }
+    for (i = 0; i < sample->rcv_num_entries; i++) {
+      fetch_deltas(stats_thread->store, STATS_STORE_RCV, sample->rcv_stats[i].type, &sample->rcv_deltas[i]);
+    }
+
+    sample->have_totals = (sample->have_deltas && stats_thread->config.totals);
+    if (sample->have_totals) {
+      int d, t;
+      for (d = 0; d < 2; d++) {
+        for (t = 0; t < STATS_NUM_TYPES; t++) {
+          stats_column_group_t *group = &stats_thread->store->groups[d][t];
+          sample->total_sessions[d][t] = group->num_sessions;
+          memcpy(sample->totals[d][t], group->totals, sizeof(group->totals));
+        }
       }
-      case LBM_TRANSPORT_STAT_LBTSMX: {
-        /******* See https://ultramessaging.github.io/currdoc/doc/API/structlbm__rcv__transport__stats__lbtsmx__t__stct.html */
-        lbm_rcv_transport_stats_lbtsmx_t *stats = &stats_thread->rcv_stats[i].transport.lbtsmx;
-        printf("ctx_name='%s', rcv/lbtsmx: source=%s, msgs_rcved=%lu, lbm_msgs_rcved=%lu, lbm_msgs_no_topic_rcved=%lu"
-            "\n",
-            ctx_name, stats_thread->rcv_stats[i].source, stats->msgs_rcved, stats->lbm_msgs_rcved, stats->lbm_msgs_no_topic_rcved
-        );
-        break;
+    }
+
+    if (sample->have_deltas && (stats_thread->config.host_totals || stats_thread->config.group_totals)) {
+      int d;
+      for (d = 0; d < 2; d++) {
+        if (stats_thread->config.host_totals) {
+          aggregate_sessions(stats_thread, sample, d, 0);
+        }
+        if (stats_thread->config.group_totals) {
+          aggregate_sessions(stats_thread, sample, d, 1);
+        }
       }
-      default:
-        printf("WARNING: ctx_name='%s', unrecognized transport type (%u)\n", ctx_name, stats_thread->rcv_stats[i].type);
-    }  /* switch */
-  }  /* for */
+    }
+
+    if (stats_thread->rules != NULL && stats_thread->tick_store == NULL && stats_thread->prev_sample_ns != 0) {
+      check_rules(stats_thread, sample);
+    }
 
-}  /* print_stats */
+    /* Forget sessions that went away, so that a later session with the same
+     * source string is reported as new. */
+    sweep_ctx.sample = stats_thread->config.session_events ? sample : NULL;
+    sweep_ctx.dir = STATS_STORE_SRC;
+    sweep_ctx.groups = stats_thread->store->groups[STATS_STORE_SRC];
+    (void)stats_index_sweep(stats_thread->src_index, sweep_session, &sweep_ctx);
+    sweep_ctx.dir = STATS_STORE_RCV;
+    sweep_ctx.groups = stats_thread->store->groups[STATS_STORE_RCV];
+    (void)stats_index_sweep(stats_thread->rcv_index, sweep_session, &sweep_ctx);
+  }
+
+  stats_thread->prev_sample_ns = sample->sample_ns;
+  stats_queue_publish(stats_thread->queue);
+}  /* sample_stats */
 
 
 /* stats_thread object implementation. */
 
-void *stats_thread_run(void *in_arg)
+/* Called by the monitor's scheduler thread when this member is due
+ * ("scheduled"), or for sample-now requests and the final sample. With
+ * the flight recorder or windows, only every ticks_per_emit'th scheduled
+ * sample is output (unless bursting); the others are only kept. */
+void stats_thread_sample(stats_thread_t *stats_thread, int scheduled)
+{
+  uint64_t start_cpu_ns = thread_cpu_ns();
+  int emit = 1;
+
+  if (stats_thread->ticks_per_emit > 1 && scheduled && !stats_thread->burst) {
+    if (stats_thread->tick_realtime_ns != 0) {
+      /* Coordinated: output on the wall clock's multiples of the output
+       * interval, so that all members output in the same ticks. */
+      uint64_t emit_ns = (uint64_t)stats_thread->stats_interval_sec * 1000000000;
+      emit = ((stats_thread->tick_realtime_ns + stats_thread->sample_interval_ns / 2) % emit_ns)
+             < stats_thread->sample_interval_ns;
+    } else {
+      emit = (stats_thread->num_ticks % stats_thread->ticks_per_emit) == 0;
+    }
+    stats_thread->num_ticks++;
+  }
+  sample_stats(stats_thread, emit);
+  /* Counted in the next output sample. */
+  stats_thread->sample_cpu_ns += thread_cpu_ns() - start_cpu_ns;
+}  /* stats_thread_sample */
+
+
+/* Appends one queued sample's output to "text" (if there are sinks to
+ * write it to), passes it to the alert callback, archive and stream, and
+ * releases it. */
+static void drain_sample(stats_thread_t *stats_thread, stats_sample_t *sample, stats_fmt_t *text)
+{
+  stats_queue_stats_t qstats;
+  struct timespec start_ts, end_ts;
+  size_t start_len = text->len;
+
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &start_ts));
+  stats_queue_get_stats(stats_thread->queue, &qstats);
+  if (qstats.dropped > stats_thread->reported_drops) {
+    stats_fmt_printf(text, "WARNING: ctx_name='%s', stats queue full, dropped %lu samples (total %lu)\n",
+        (stats_thread->ctx_name == NULL) ? "" : stats_thread->ctx_name,
+        (unsigned long)(qstats.dropped - stats_thread->reported_drops), (unsigned long)qstats.dropped);
+    stats_thread->reported_drops = qstats.dropped;
+  }
+  if (stats_thread->config.num_sinks > 0) {
+    stats_fmt_sample(text, stats_thread, sample);
+  }
+  ENZ(clock_gettime(CLOCK_MONOTONIC, &end_ts));
+  stats_thread->format_ns = (uint64_t)(end_ts.tv_sec - start_ts.tv_sec) * 1000000000
+                            + end_ts.tv_nsec - start_ts.tv_nsec;
+  stats_thread->format_bytes = text->len - start_len;
+  if (stats_thread->config.alert_cb != NULL) {
+    int a;
+    for (a = 0; a < sample->num_alerts; a++) {
+      stats_thread->config.alert_cb(stats_thread->config.alert_clientd, stats_thread->ctx_name, &sample->alerts[a]);
+    }
+  }
+  if (stats_thread->archive != NULL) {
+    stats_archive_write(stats_thread->archive, sample);
+  }
+  if (stats_thread->stream != NULL) {
+    stats_stream_write(stats_thread->stream, sample);
+  }
+  stats_queue_release(stats_thread->queue);
+}  /* drain_sample */
+
+
+/* Called by the monitor's writer thread. Formats each queued sample and
+ * hands it to the sinks, so that slow output never delays sampling. */
+void stats_thread_drain(stats_thread_t *stats_thread)
 {
-  stats_thread_t *stats_thread = (stats_thread_t *)in_arg;
-  int secs_since_last_print = stats_thread->stats_interval_sec;  /* Print stats immediately on start. */
+  stats_fmt_t *text = stats_thread->text;
+  stats_sample_t *sample;
+  int s;
 
-  while (stats_thread->running) {
-    if (secs_since_last_print >= stats_thread->stats_interval_sec) {
-      print_stats(stats_thread);
-      secs_since_last_print = 0;
+  while ((sample = stats_queue_peek(stats_thread->queue)) != NULL) {
+    uint64_t start_cpu_ns = thread_cpu_ns();
+
+    text->len = 0;
+    drain_sample(stats_thread, sample, text);
+    for (s = 0; s < stats_thread->config.num_sinks; s++) {
+      stats_thread->config.sinks[s].write(stats_thread->config.sinks[s].clientd, text->buf, text->len);
     }
+    __atomic_store_n(&stats_thread->writer_cpu_ns, stats_thread->writer_cpu_ns + (thread_cpu_ns() - start_cpu_ns),
+        __ATOMIC_RELAXED);
+  }
+}  /* stats_thread_drain */
 
-    sleep(1);
-    secs_since_last_print++;
-  }  /* while running */
 
-  /* Final stats. */
-  print_stats(stats_thread);
+/* Called by a coordinated monitor's writer thread. Like
+ * stats_thread_drain(), but only for the samples at the head of the queue
+ * that belong to tick "tick_id" (0 for samples taken outside ticks), and
+ * their output is appended to "batch" instead of written to the sinks. */
+void stats_thread_drain_batch(stats_thread_t *stats_thread, stats_fmt_t *batch, uint64_t tick_id)
+{
+  stats_sample_t *sample;
 
-  pthread_exit(NULL);
-  return NULL;
-}  /* stats_thread_run */
+  while ((sample = stats_queue_peek(stats_thread->queue)) != NULL && sample->tick_id == tick_id) {
+    uint64_t start_cpu_ns = thread_cpu_ns();
+
+    drain_sample(stats_thread, sample, batch);
+    __atomic_store_n(&stats_thread->writer_cpu_ns, stats_thread->writer_cpu_ns + (thread_cpu_ns() - start_cpu_ns),
+        __ATOMIC_RELAXED);
+  }
+}  /* stats_thread_drain_batch */
+
+
+void stats_thread_config_init(stats_thread_config_t *config)
+{
+  memset(config, 0, sizeof(*config));
+  config->deltas = 0;
+  config->num_sinks = 0;  /* Zero means stdout. */
+  config->queue_depth = 4;
+  config->timestamps = 0;
+  config->totals = 0;
+  config->host_totals = 0;
+  config->group_totals = 0;
+  config->recorder_path = NULL;  /* No flight recorder. */
+  config->recorder_size = 64 * 1024 * 1024;
+  config->recorder_interval_ms = 1000;
+  config->archive_dir = NULL;  /* No archive. */
+  config->archive_segment_sec = 86400;
+  config->archive_block_size = 1024;
+  config->changes_only = 0;
+  config->keyframe_interval = 10;
+  config->session_events = 0;
+  config->shm = 0;
+  config->shm_capacity = 256;
+  config->stream_path = NULL;  /* No aggregator. */
+  config->stream_buf_size = 4 * 1024 * 1024;
+  config->scrape_addr = NULL;  /* No scrape server. */
+  config->scrape_min_age_ms = 1000;
+  config->rules = NULL;  /* No rules. */
+  config->alert_cb = NULL;
+  config->alert_clientd = NULL;
+  config->max_alerts = 16;
+  config->burst_interval_ms = 1000;
+  config->burst_quiet_ms = 60000;
+  config->window_fields = NULL;  /* No windows. */
+  config->window_interval_ms = 5000;
+  config->window_summary_sec = 600;
+  config->latency = NULL;  /* No latency histograms. */
+  config->send = NULL;  /* No send counters. */
+  config->self_stats = 0;
+  config->cpu_budget_pct = 0.0;  /* No limit. */
+  config->monitor = NULL;  /* Process-wide default. */
+}  /* stats_thread_config_init */
 
 
 stats_thread_t *stats_thread_create(lbm_context_t *ctx, char *ctx_name, int stats_interval_sec)
+{
+  stats_thread_config_t config;
+
+  stats_thread_config_init(&config);
+  return stats_thread_create_ex(ctx, ctx_name, stats_interval_sec, &config);
+}  /* stats_thread_create */
+
+
+stats_thread_t *stats_thread_create_ex(lbm_context_t *ctx, char *ctx_name, int stats_interval_sec,
+    const stats_thread_config_t *config)
 {
   stats_thread_t *stats_thread;
+  int tick_ms;
+
+  if (stats_interval_sec < 0 || (stats_interval_sec == 0 && (config->scrape_addr == NULL
+      || config->recorder_path != NULL || config->window_fields != NULL || config->rules != NULL))) {
+    /* Zero means only sampled when scraped, which has no use for these. */
+    fprintf(stderr, "ERROR (%s:%d): stats_interval_sec %d needs a scrape_addr and no recorder, windows or rules\n",
+        __FILE__, __LINE__, stats_interval_sec);
+    exit(1);
+  }
 
   ENL(stats_thread = (stats_thread_t *)malloc(sizeof(stats_thread_t)));
   stats_thread->ctx = ctx;
@@ -294,46 +890,214 @@ stats_thread_t *stats_thread_create(lbm_context_t *ctx, char *ctx_name, int stat
     stats_thread->ctx_name = NULL;
   }
   stats_thread->stats_interval_sec = stats_interval_sec;
+  stats_thread->config = *config;
+  if (stats_thread->config.num_sinks == 0 && config->stream_path == NULL && config->scrape_addr == NULL) {
+    stats_sink_stdout(&stats_thread->config.sinks[0]);
+    stats_thread->config.num_sinks = 1;
+  }
   stats_thread->running = 0;
-  stats_thread->rcv_num_entries = 100;
-  ENL(stats_thread->rcv_stats = (lbm_rcv_transport_stats_t *)malloc(sizeof(lbm_rcv_transport_stats_t)
-                                                                    * stats_thread->rcv_num_entries));
-  stats_thread->src_num_entries = 100;
-  ENL(stats_thread->src_stats = (lbm_src_transport_stats_t *)malloc(sizeof(lbm_src_transport_stats_t)
-                                                                    * stats_thread->src_num_entries));
+  stats_thread->num_samples = 0;
+  stats_thread->num_emitted = 0;
+  if (stats_thread->config.keyframe_interval < 1) {
+    stats_thread->config.keyframe_interval = 1;
+  }
+  stats_thread->prev_sample_ns = 0;
+  memset(stats_thread->ctx_prev, 0, sizeof(stats_thread->ctx_prev));
+  stats_thread->rcv_index = stats_index_create();
+  stats_thread->src_index = stats_index_create();
+  stats_thread->store = stats_store_create();
+  stats_thread->addrs = stats_source_addrs_create();
+  stats_thread->aggregate_slot = NULL;
+  stats_thread->aggregate_slot_capacity = 0;
+  stats_thread->sample_interval_ns = (uint64_t)stats_interval_sec * 1000000000;
+  stats_thread->recorder = NULL;
+  stats_thread->ticks_per_emit = 1;
+  stats_thread->num_ticks = 0;
+  stats_sample_init(&stats_thread->rec_sample);
+  tick_ms = 0;
+  if (config->recorder_path != NULL) {
+    stats_thread->config.recorder_path = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->recorder = stats_recorder_create(config->recorder_path, config->recorder_size, ctx_name);
+    tick_ms = config->recorder_interval_ms;
+  }
+  stats_thread->window = NULL;
+  stats_thread->next_summary_ns = 0;
+  if (config->window_fields != NULL) {
+    stats_thread->config.window_fields = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->window = stats_window_create(config->window_fields);
+    if (tick_ms == 0 || config->window_interval_ms < tick_ms) {
+      tick_ms = config->window_interval_ms;
+    }
+  }
+  if (tick_ms > 0) {
+    /* Sample every tick; output every ticks_per_emit ticks. */
+    stats_thread->sample_interval_ns = (uint64_t)tick_ms * 1000000;
+    stats_thread->ticks_per_emit = (int)(((uint64_t)stats_interval_sec * 1000 + tick_ms / 2) / tick_ms);
+    if (stats_thread->ticks_per_emit < 1) {
+      stats_thread->ticks_per_emit = 1;
+    }
+  }
+  stats_thread->normal_interval_ns = stats_thread->sample_interval_ns;
+  stats_thread->burst_interval_ns = (uint64_t)config->burst_interval_ms * 1000000;
+  if (stats_thread->burst_interval_ns > stats_thread->sample_interval_ns) {
+    stats_thread->burst_interval_ns = stats_thread->sample_interval_ns;  /* Never sample less often. */
+  }
+  stats_thread->burst = 0;
+  stats_thread->burst_until_ns = 0;
+  stats_thread->sample_cpu_ns = 0;
+  stats_thread->writer_cpu_ns = 0;
+  stats_thread->prev_writer_cpu_ns = 0;
+  stats_thread->degrade = 0;
+  stats_thread->format_ns = 0;
+  stats_thread->format_bytes = 0;
+  stats_thread->rules = NULL;
+  if (config->rules != NULL) {
+    stats_thread->config.rules = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->rules = stats_rules_create(config->rules);
+  }
+  stats_thread->tick_store = NULL;
+  stats_thread->tick_src_index = NULL;
+  stats_thread->tick_rcv_index = NULL;
+  if (stats_thread->rules != NULL && stats_thread->ticks_per_emit > 1) {
+    stats_thread->tick_store = stats_store_create();
+    stats_thread->tick_src_index = stats_index_create();
+    stats_thread->tick_rcv_index = stats_index_create();
+  }
+  memset(stats_thread->tick_ctx_prev, 0, sizeof(stats_thread->tick_ctx_prev));
+  stats_thread->prev_tick_ns = 0;
+  if (stats_thread->config.max_alerts < 0) {
+    stats_thread->config.max_alerts = 0;
+  }
+  stats_thread->archive = NULL;
+  if (config->archive_dir != NULL) {
+    stats_thread->config.archive_dir = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->archive = stats_archive_create(config->archive_dir, ctx_name, config->archive_segment_sec,
+        config->archive_block_size);
+  }
+  stats_thread->shm = NULL;
+  if (config->shm) {
+    stats_thread->shm = stats_shm_create(ctx_name, config->shm_capacity);
+  }
+  stats_thread->stream = NULL;
+  if (config->stream_path != NULL) {
+    stats_thread->config.stream_path = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->stream = stats_stream_create(config->stream_path, ctx_name, config->stream_buf_size);
+  }
+  stats_thread->scrape = NULL;
+  if (config->scrape_addr != NULL) {
+    stats_thread->config.scrape_addr = NULL;  /* Not kept; the caller owns it. */
+    stats_thread->scrape = stats_scrape_create(config->scrape_addr, stats_thread, config->scrape_min_age_ms);
+  }
+  stats_thread->queue = stats_queue_create(stats_thread->config.queue_depth);
+  stats_thread->reported_drops = 0;
+  stats_thread->text = stats_fmt_create(64 * 1024);
+  stats_thread->monitor = NULL;
+  stats_thread->heap_index = -1;
+  stats_thread->phase_ns = 0;
+  stats_thread->next_deadline_ns = 0;
+  stats_thread->tick_id = 0;
+  stats_thread->tick_realtime_ns = 0;
+  stats_thread->sample_now = 0;
 
   return stats_thread;
-}  /* stats_thread_create */
+}  /* stats_thread_create_ex */
 
 
+/* Hand the stats_thread to its monitor's shared scheduler thread. */
 void stats_thread_start(stats_thread_t *stats_thread)
 {
+  stats_thread->monitor = stats_thread->config.monitor;
+  if (stats_thread->monitor == NULL) {
+    stats_thread->monitor = stats_monitor_default();
+  }
   stats_thread->running = 1;
-  ENZ(errno = pthread_create(&stats_thread->stats_thread_id, NULL, stats_thread_run, stats_thread));
+  stats_monitor_add(stats_thread->monitor, stats_thread);
+  if (stats_thread->scrape != NULL) {
+    stats_scrape_start(stats_thread->scrape, stats_thread->monitor);
+  }
 }  /* stats_thread_start */
 
 
+/* Take an extra sample as soon as possible, without moving the regular
+ * schedule. Async-signal-safe, so it can be called from (e.g.) a SIGUSR1
+ * handler. Ignored unless the stats_thread is started. */
+void stats_thread_sample_now(stats_thread_t *stats_thread)
+{
+  if (stats_thread->running) {
+    stats_monitor_sample_now(stats_thread->monitor, stats_thread);
+  }
+}  /* stats_thread_sample_now */
+
+
 void stats_thread_terminate(stats_thread_t *stats_thread)
 {
   if (stats_thread->running) {
     stats_thread->running = 0;
-    /* Can take up to 1 sec for stats thread to exit. */
-    ENZ(errno = pthread_join(stats_thread->stats_thread_id, NULL));
+    if (stats_thread->scrape != NULL) {
+      stats_scrape_stop(stats_thread->scrape);
+    }
+    /* Takes the final sample and waits for its output. */
+    stats_monitor_remove(stats_thread->monitor, stats_thread);
   }
 }  /* stats_thread_terminate */
 
 
+void stats_thread_queue_stats(stats_thread_t *stats_thread, stats_queue_stats_t *qstats)
+{
+  stats_queue_get_stats(stats_thread->queue, qstats);
+}  /* stats_thread_queue_stats */
+
+
 void stats_thread_delete(stats_thread_t *stats_thread)
 {
+  int s;
+
   if (stats_thread->running) {
     stats_thread_terminate(stats_thread);
   }
 
   /* Clean up. */
+  for (s = 0; s < stats_thread->config.num_sinks; s++) {
+    if (stats_thread->config.sinks[s].close != NULL) {
+      stats_thread->config.sinks[s].close(stats_thread->config.sinks[s].clientd);
+    }
+  }
   if (stats_thread->ctx_name != NULL) {
     free(stats_thread->ctx_name);
   }
-  free(stats_thread->rcv_stats);
-  free(stats_thread->src_stats);
+  stats_queue_delete(stats_thread->queue);
+  stats_fmt_delete(stats_thread->text);
+  stats_index_delete(stats_thread->rcv_index);
+  stats_index_delete(stats_thread->src_index);
+  stats_store_delete(stats_thread->store);
+  stats_source_addrs_delete(stats_thread->addrs);
+  free(stats_thread->aggregate_slot);
+  if (stats_thread->recorder != NULL) {
+    stats_recorder_delete(stats_thread->recorder);
+  }
+  stats_sample_free(&stats_thread->rec_sample);
+  if (stats_thread->rules != NULL) {
+    stats_rules_delete(stats_thread->rules);
+  }
+  if (stats_thread->tick_store != NULL) {
+    stats_store_delete(stats_thread->tick_store);
+    stats_index_delete(stats_thread->tick_src_index);
+    stats_index_delete(stats_thread->tick_rcv_index);
+  }
+  if (stats_thread->window != NULL) {
+    stats_window_delete(stats_thread->window);
+  }
+  if (stats_thread->shm != NULL) {
+    stats_shm_delete(stats_thread->shm);
+  }
+  if (stats_thread->stream != NULL) {
+    stats_stream_delete(stats_thread->stream);
+  }
+  if (stats_thread->scrape != NULL) {
+    stats_scrape_delete(stats_thread->scrape);
+  }
+  if (stats_thread->archive != NULL) {
+    stats_archive_delete(stats_thread->archive);  /* Writes the last blocks and the segment's index. */
+  }
   free(stats_thread);
 }  /* stats_thread_delete */
@@ -27,30 +27,213 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdint.h>
 #include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_store.h"
+#include "stats_recorder.h"
+#include "stats_archive.h"
+#include "stats_shm.h"
+#include "stats_stream.h"
+#include "stats_scrape.h"
+#include "stats_rules.h"
+#include "stats_window.h"
+#include "stats_latency.h"
+#include "stats_send.h"
+#include "stats_queue.h"
+#include "stats_sink.h"
+#include "stats_monitor.h"
 
+/* Most output sinks one stats_thread can write to. */
+#define STATS_MAX_SINKS 4
 
-/* stats_thread object */
+
+/* Optional behavior, passed to stats_thread_create_ex(). Always initialize
+ * with stats_thread_config_init() so that new fields get defaults. */
+struct stats_thread_config_s {
+  int deltas;  /* Non-zero to print per-interval deltas and rates. */
+  /* Where formatted stats go. Fill with stats_sink_stdout() etc. or your own
+   * callbacks. The stats_thread closes them at delete. Zero sinks means stdout
+   * (without a stream_path or scrape_addr) or no text output at all (with one). */
+  stats_sink_t sinks[STATS_MAX_SINKS];
+  int num_sinks;
+  int queue_depth;  /* Samples that can wait for the writer thread. */
+  int timestamps;  /* Non-zero to print a "sample:" line with each sample's time. */
+  int totals;  /* With deltas, non-zero to also print the sum over all sessions of each type. */
+  /* With deltas, non-zero to also print sums by publisher host (from the
+   * source string's IP address), and by multicast group (LBT-RM only). */
+  int host_totals;
+  int group_totals;
+  /* Non-zero to only print a session's line (and its deltas) if any of its
+   * UM statistics changed since the previous sample, except for a full
+   * "keyframe" every keyframe_interval samples. */
+  int changes_only;
+  int keyframe_interval;
+  /* Non-zero to print session_joined / session_left lines when a source
+   * appears in or vanishes from the transport stats. */
+  int session_events;
+  /* Flight recorder: sample every recorder_interval_ms into a ring file of
+   * recorder_size bytes (see stats_recorder.h). Output still happens every
+   * stats_interval_sec. NULL path means no recorder. */
+  char *recorder_path;
+  size_t recorder_size;
+  int recorder_interval_ms;
+  /* Archive: every printed sample's session counters are appended,
+   * compressed, to segment files in archive_dir (see stats_archive.h).
+   * NULL means no archive. */
+  char *archive_dir;
+  int archive_segment_sec;  /* New segment file every this many seconds. */
+  size_t archive_block_size;  /* Bytes of a session's samples per block. */
+  /* Non-zero to publish each sample in shared memory for mon_self_top and
+   * other readers (see stats_shm.h). shm_capacity is the initial number of
+   * sessions per direction it has room for; it grows as needed. */
+  int shm;
+  int shm_capacity;
+  /* Unix domain socket of a mon_self_agg daemon to send each output sample
+   * to as binary frames (see stats_stream.h). NULL means none. While the
+   * daemon is absent, or so far behind that stream_buf_size bytes are
+   * waiting for it, samples are dropped (and counted), never waited for. */
+  char *stream_path;
+  size_t stream_buf_size;
+  /* Address to serve the current stats on, in OpenMetrics text format, to
+   * HTTP scrapers (see stats_scrape.h): a Unix domain socket path
+   * (starting with '/'), or TCP "[host:]port" (host default 127.0.0.1).
+   * Stats are retrieved for a scrape, unless the previous scrape's are
+   * younger than scrape_min_age_ms. NULL means none. With a stats
+   * interval of 0, the stats are only retrieved when scraped. */
+  char *scrape_addr;
+  int scrape_min_age_ms;
+  /* Anomaly rules, separated by ';' (see stats_rules.c), e.g.
+   * "rcv/naks_sent rate>100; rcv/lbtrm/unrecovered_tmo delta>0". NULL means
+   * none. Each sample whose deltas break a rule prints "alert" lines (at most
+   * max_alerts) and calls alert_cb (if any) from the writer thread. With the
+   * flight recorder or windows, the rules are checked every tick, against
+   * the deltas since the previous tick, and a tick that breaks one is
+   * output even if it isn't due. Sampling
+   * then switches to every burst_interval_ms, until no rule has fired for
+   * burst_quiet_ms. A burst_interval_ms of 0 means no burst sampling. */
+  char *rules;
+  stats_alert_cb_t alert_cb;
+  void *alert_clientd;
+  int max_alerts;
+  int burst_interval_ms;
+  int burst_quiet_ms;
+  /* Rolling 1m/1h/24h min/max/mean/percentiles of the rates of these
+   * counters, comma-separated (e.g. "naks_sent,lost,drops"), for every
+   * session (see stats_window.h). Sessions are sampled every
+   * window_interval_ms for this, and the summaries are printed with the
+   * first sample every window_summary_sec. NULL means none. */
+  char *window_fields;
+  int window_interval_ms;
+  int window_summary_sec;
+  /* Receiver latency histograms to report with each sample, as
+   * "rcv/<type>/latency" lines (see stats_latency.h). The application
+   * creates it, records into it from its receiver callbacks, and deletes it
+   * after the stats_thread. NULL means none. */
+  stats_latency_t *latency;
+  /* Sends to report with each sample, as "src/send" lines, for sources the
+   * application sends on with stats_send() instead of lbm_src_send() (see
+   * stats_send.h). Created and deleted by the application, like "latency".
+   * NULL means none. */
+  stats_send_t *send;
+  /* Non-zero to print a "self" line with the stats_thread's own costs:
+   * retrieval time and buffer-grow retries, formatting time, bytes output,
+   * and sampling plus writer CPU time over the interval. */
+  int self_stats;
+  /* Most CPU time the stats_thread may use for sampling and output, in
+   * percent of one CPU. Above it, session lines are skipped first (the
+   * context line, totals and other summaries are kept), then sampling is
+   * slowed down by doubling the interval, up to 8 times. 0 means no limit. */
+  double cpu_budget_pct;
+  /* Scheduler (and writer) thread to run on. NULL means the process-wide
+   * default, shared by all stats_threads that don't name one. */
+  stats_monitor_t *monitor;
+};
+typedef struct stats_thread_config_s stats_thread_config_t;
+
+/* stats_thread object. Despite the name, it no longer owns a thread; it is
+ * sampled by its stats_monitor's scheduler thread. */
 struct stats_thread_s {
   lbm_context_t *ctx;
   char *ctx_name;
   int stats_interval_sec;
-  pthread_t stats_thread_id;
+  stats_thread_config_t config;
   int running;
-  /* Fields used by receive stats. */
-  int rcv_num_entries;
-  lbm_rcv_transport_stats_t *rcv_stats;
-  /* Fields used by source stats. */
-  int src_num_entries;
-  lbm_src_transport_stats_t *src_stats;
+  stats_queue_t *queue;  /* Samples waiting for the writer thread. */
+  uint64_t reported_drops;
+  struct stats_fmt_s *text;  /* Used by the writer thread (see stats_fmt.h). */
+  /* Fields used by the monitor (protected by its lock). */
+  stats_monitor_t *monitor;
+  int heap_index;
+  uint64_t phase_ns;
+  uint64_t next_deadline_ns;  /* CLOCK_MONOTONIC. */
+  uint64_t tick_id;  /* Set by a coordinated monitor around each tick's sample; else 0. */
+  uint64_t tick_realtime_ns;
+  int sample_now;  /* Set by stats_thread_sample_now(); accessed with __atomic builtins. */
+  /* Fields used by deltas. */
+  uint64_t num_samples;
+  uint64_t num_emitted;  /* Samples queued for output. */
+  uint64_t prev_sample_ns;  /* CLOCK_MONOTONIC. */
+  lbm_ulong_t ctx_prev[STATS_MAX_FIELDS];
+  stats_index_t *rcv_index;
+  stats_index_t *src_index;
+  stats_store_t *store;  /* Counters of every session, by column. */
+  stats_source_addrs_t *addrs;  /* Hosts and groups seen in source strings. */
+  int *aggregate_slot;  /* Scratch for host/group totals, by address ID and type; -1=none. */
+  int aggregate_slot_capacity;  /* In address IDs. */
+  /* Fields used by the flight recorder and windows, which sample more
+   * often than the output interval. */
+  uint64_t sample_interval_ns;  /* Scheduling interval (the recorder's or windows', if any, or the burst interval). */
+  stats_recorder_t *recorder;
+  int ticks_per_emit;
+  uint64_t num_ticks;
+  stats_sample_t rec_sample;  /* For samples that are only recorded. */
+  stats_archive_t *archive;  /* Only used by the writer thread. */
+  stats_shm_t *shm;
+  stats_stream_t *stream;  /* Only used by the writer thread. */
+  stats_scrape_t *scrape;  /* Only used by the scheduler thread, once started. */
+  stats_window_t *window;
+  uint64_t next_summary_ns;  /* CLOCK_MONOTONIC. */
+  /* Fields used by the rules (sampling thread only). */
+  stats_rules_t *rules;
+  uint64_t normal_interval_ns;  /* sample_interval_ns when not bursting. */
+  uint64_t burst_interval_ns;
+  int burst;
+  uint64_t burst_until_ns;  /* CLOCK_MONOTONIC. */
+  /* With the flight recorder or windows, the rules see the deltas since
+   * the previous tick, tracked here (see check_tick()); NULL otherwise. */
+  stats_store_t *tick_store;
+  stats_index_t *tick_src_index;
+  stats_index_t *tick_rcv_index;
+  lbm_ulong_t tick_ctx_prev[STATS_MAX_FIELDS];
+  uint64_t prev_tick_ns;  /* CLOCK_MONOTONIC. */
+  /* Fields used for self-monitoring and the CPU budget. */
+  uint64_t sample_cpu_ns;  /* Sampling thread, since the last output sample. */
+  uint64_t writer_cpu_ns;  /* Writer thread, cumulative; accessed with __atomic builtins. */
+  uint64_t prev_writer_cpu_ns;  /* Sampling thread only. */
+  int degrade;  /* See stats_sample_t. Sampling thread only. */
+  uint64_t format_ns;  /* Writer thread only: formatting time of the previous sample. */
+  uint64_t format_bytes;  /* And its length. */
 };
 typedef struct stats_thread_s stats_thread_t;
 
 
+void stats_thread_config_init(stats_thread_config_t *config);
 stats_thread_t *stats_thread_create(lbm_context_t *ctx, char *ctx_name, int stats_interval_sec);
+stats_thread_t *stats_thread_create_ex(lbm_context_t *ctx, char *ctx_name, int stats_interval_sec,
+    const stats_thread_config_t *config);
 void stats_thread_start(stats_thread_t *stats_thread);
+void stats_thread_sample_now(stats_thread_t *stats_thread);
 void stats_thread_terminate(stats_thread_t *stats_thread);
+void stats_thread_queue_stats(stats_thread_t *stats_thread, stats_queue_stats_t *qstats);
 void stats_thread_delete(stats_thread_t *stats_thread);
+/* For stats_monitor. */
+void stats_thread_sample(stats_thread_t *stats_thread, int scheduled);
+void stats_thread_drain(stats_thread_t *stats_thread);
+void stats_thread_drain_batch(stats_thread_t *stats_thread, struct stats_fmt_s *batch, uint64_t tick_id);
+/* For stats_scrape. */
+void stats_thread_retrieve(stats_thread_t *stats_thread, stats_sample_t *sample);
 
 #if defined(__cplusplus)
 }
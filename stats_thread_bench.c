@@ -0,0 +1,268 @@
+/* stats_thread_bench.c - times stats_thread sampling and output against lbm_mock.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+
+/* Samples a mock context (see lbm_mock.h; no UM needed) with 1 to 100,000
+ * transport sessions and reports, per sample, the time to sample (retrieve
+ * and compute deltas), the time to format and write, the allocations made,
+ * and the bytes written (to /dev/null). Build with bld_mock.sh, which links
+ * with the allocation counters below.
+ *   ./stats_thread_bench [-n samples] [-m max_sessions] [-g max_growth]
+ *       [-c churn_pct] [-a add_per_sample] [-D] [-u socket_path]
+ * -D turns off deltas. -u sends binary frames to a mon_self_agg listening
+ * on socket_path instead of writing text (see stats_stream.h); "write" is
+ * then the time to encode and send. Fewer samples are taken at the larger
+ * sizes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "lbm/lbm.h"
+#include "lbm_mock.h"
+#include "stats_thread.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+/* Allocation counts. bld_mock.sh links with -Wl,--wrap=malloc (and calloc
+ * and realloc), which sends the calls here. */
+static uint64_t num_allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  __atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}  /* __wrap_malloc */
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  __atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+  return __real_calloc(nmemb, size);
+}  /* __wrap_calloc */
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  __atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}  /* __wrap_realloc */
+
+
+/* Sink: counts the bytes and writes them to /dev/null. */
+struct bench_sink_s {
+  int fd;
+  uint64_t bytes;
+};
+typedef struct bench_sink_s bench_sink_t;
+
+static void bench_sink_write(void *clientd, const char *buf, size_t len)
+{
+  bench_sink_t *sink = (bench_sink_t *)clientd;
+
+  sink->bytes += len;
+  if (write(sink->fd, buf, len) < 0) {
+    perror("write");
+  }
+}  /* bench_sink_write */
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}  /* now_ns */
+
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}  /* cmp_u64 */
+
+
+/* Sorts "ns" and prints " <label>_us: p50=..., p99=..., max=...". */
+static void print_times(const char *label, uint64_t *ns, int num)
+{
+  qsort(ns, num, sizeof(uint64_t), cmp_u64);
+  printf("  %s_us: p50=%.1f p99=%.1f max=%.1f", label, (double)ns[num / 2] / 1000.0,
+      (double)ns[(num * 99) / 100] / 1000.0, (double)ns[num - 1] / 1000.0);
+}  /* print_times */
+
+
+static void bench(const lbm_mock_config_t *mock_config, int deltas, const char *stream_path, int num_samples)
+{
+  lbm_mock_t *mock;
+  stats_thread_config_t config;
+  stats_thread_t *stats_thread;
+  bench_sink_t sink;
+  uint64_t *sample_ns, *write_ns;
+  uint64_t start_allocs, start_bytes, start_dropped;
+  int i;
+
+  ENL(sample_ns = (uint64_t *)malloc(sizeof(uint64_t) * num_samples));
+  ENL(write_ns = (uint64_t *)malloc(sizeof(uint64_t) * num_samples));
+  sink.fd = open("/dev/null", O_WRONLY);
+  sink.bytes = 0;
+
+  mock = lbm_mock_create(mock_config);
+  stats_thread_config_init(&config);
+  config.deltas = deltas;
+  config.sinks[0].write = bench_sink_write;
+  config.sinks[0].close = NULL;
+  config.sinks[0].clientd = &sink;
+  config.num_sinks = 1;
+  if (stream_path != NULL) {
+    config.stream_path = (char *)stream_path;
+    config.num_sinks = 0;  /* Only the stream. */
+  }
+  /* Not started: samples are taken and drained here, not by a monitor. */
+  stats_thread = stats_thread_create_ex(lbm_mock_ctx(mock), "bench", 1, &config);
+
+  /* The first two samples size the buffers (and the first has no deltas). */
+  for (i = 0; i < 2; i++) {
+    lbm_mock_step(mock);
+    stats_thread_sample(stats_thread, 0);
+    stats_thread_drain(stats_thread);
+  }
+
+  start_allocs = num_allocs;
+  start_bytes = (stream_path != NULL) ? stats_thread->stream->num_bytes : sink.bytes;
+  start_dropped = (stream_path != NULL) ? stats_thread->stream->num_dropped : 0;
+  for (i = 0; i < num_samples; i++) {
+    uint64_t start, sampled;
+    uint64_t step_allocs;
+
+    step_allocs = num_allocs;
+    lbm_mock_step(mock);  /* Not counted. */
+    start_allocs += num_allocs - step_allocs;
+
+    start = now_ns();
+    stats_thread_sample(stats_thread, 0);
+    sampled = now_ns();
+    stats_thread_drain(stats_thread);
+    write_ns[i] = now_ns() - sampled;
+    sample_ns[i] = sampled - start;
+  }
+
+  printf("sessions=%6d samples=%4d", mock_config->num_src + mock_config->num_rcv, num_samples);
+  print_times("sample", sample_ns, num_samples);
+  print_times("write", write_ns, num_samples);
+  if (stream_path != NULL) {
+    sink.bytes = stats_thread->stream->num_bytes;
+  }
+  printf("  allocs/sample=%.1f bytes/sample=%lu einvals=%lu",
+      (double)(num_allocs - start_allocs) / num_samples, (unsigned long)((sink.bytes - start_bytes) / num_samples),
+      (unsigned long)mock->num_einvals);
+  if (stream_path != NULL) {
+    printf(" dropped=%lu", (unsigned long)(stats_thread->stream->num_dropped - start_dropped));
+  }
+  printf("\n");
+
+  stats_thread_delete(stats_thread);
+  lbm_mock_delete(mock);
+  close(sink.fd);
+  free(write_ns);
+  free(sample_ns);
+}  /* bench */
+
+
+static void usage(const char *msg)
+{
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Usage: stats_thread_bench [-n samples] [-m max_sessions] [-g max_growth] [-c churn_pct]"
+      " [-a add_per_sample] [-D] [-u socket_path]\n");
+  exit(1);
+}  /* usage */
+
+
+int main(int argc, char **argv)
+{
+  lbm_mock_config_t mock_config;
+  int num_samples = 200;
+  int max_sessions = 100000;
+  int deltas = 1;
+  const char *stream_path = NULL;
+  int opt, num_sessions;
+
+  lbm_mock_config_init(&mock_config);
+  while ((opt = getopt(argc, argv, "n:m:g:c:a:Du:h")) != -1) {
+    switch (opt) {
+      case 'n': num_samples = atoi(optarg); break;
+      case 'm': max_sessions = atoi(optarg); break;
+      case 'g': mock_config.max_growth = strtoul(optarg, NULL, 0); break;
+      case 'c': mock_config.churn_pct = atof(optarg); break;
+      case 'a': mock_config.add_per_step = atoi(optarg); break;
+      case 'D': deltas = 0; break;
+      case 'u': stream_path = optarg; break;
+      default: usage(NULL);
+    }
+  }
+  if (num_samples < 1) {
+    usage("Bad number of samples");
+  }
+  if (mock_config.churn_pct < 0.0 || mock_config.churn_pct > 100.0) {
+    usage("Bad churn percent");
+  }
+
+  printf("max_growth=%lu churn_pct=%.2f add_per_sample=%d deltas=%d\n", (unsigned long)mock_config.max_growth,
+      mock_config.churn_pct, mock_config.add_per_step, deltas);
+  for (num_sessions = 1; num_sessions <= max_sessions; num_sessions *= 10) {
+    int n = num_samples;
+    /* About 2 million sessions sampled per size, at most. */
+    if ((int64_t)n * num_sessions > 2000000) {
+      n = 2000000 / num_sessions;
+      if (n < 10) {
+        n = 10;
+      }
+    }
+    mock_config.num_src = (num_sessions + 1) / 2;
+    mock_config.num_rcv = num_sessions / 2;
+    bench(&mock_config, deltas, stream_path, n);
+  }
+
+  return 0;
+}  /* main */
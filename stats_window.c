@@ -0,0 +1,444 @@
+/* stats_window.c - rolling 1-minute, 1-hour and 24-hour summaries of
+ * per-session rates in fixed memory.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+
+#include "lbm/lbm.h"
+#include "stats_window.h"
+
+
+/* Error if NULL. */
+#define ENL(enl_sys_call_) do { \
+  void *enl_ = (enl_sys_call_); \
+  if (enl_ == NULL) { \
+    int enl_errno_ = errno; \
+    char enl_errstr_[1024]; \
+    sprintf(enl_errstr_, "ERROR (%s:%d): %s failed", __FILE__, __LINE__, #enl_sys_call_); \
+    errno = enl_errno_; \
+    perror(enl_errstr_); \
+    exit(1); \
+  } \
+} while (0)  /* ENL */
+
+
+static const uint64_t window_sec[STATS_WINDOW_NUM] = { 60, 3600, 86400 };
+static const char *window_names[STATS_WINDOW_NUM] = { "1m", "1h", "24h" };
+
+
+const char *stats_window_name(int window_num)
+{
+  return window_names[window_num];
+}  /* stats_window_name */
+
+
+/* Bucket 0 is [0,1); bucket b>0 starts at 2^((b-1)/2). */
+static int rate_bucket(double rate)
+{
+  int exp, b;
+  double mant;
+
+  if (rate < 1.0) {
+    return 0;
+  }
+  mant = frexp(rate, &exp);  /* rate = mant * 2^exp, mant in [0.5,1). */
+  b = 1 + 2 * (exp - 1) + (mant >= 0.70710678118654752);
+  return (b < STATS_WINDOW_BUCKETS) ? b : STATS_WINDOW_BUCKETS - 1;
+}  /* rate_bucket */
+
+
+static double bucket_start(int b)
+{
+  return (b == 0) ? 0.0 : pow(2.0, (double)(b - 1) / 2.0);
+}  /* bucket_start */
+
+
+static const stats_field_t *fields_for(int dir, int type, int *num_fields)
+{
+  return (dir == STATS_WINDOW_SRC) ? stats_fields_src(type, num_fields) : stats_fields_rcv(type, num_fields);
+}  /* fields_for */
+
+
+/* "fields" is a comma-separated list of counter names (see stats_fields.c),
+ * each tracked for every direction and transport type that has it. Exits
+ * on an unknown name. */
+stats_window_t *stats_window_create(const char *fields)
+{
+  stats_window_t *window;
+  char *copy, *name, *save;
+  int d, t, n;
+
+  ENL(window = (stats_window_t *)calloc(1, sizeof(stats_window_t)));
+  ENL(copy = strdup(fields));
+  for (name = strtok_r(copy, ", ", &save); name != NULL; name = strtok_r(NULL, ", ", &save)) {
+    if (window->num_fields == STATS_WINDOW_MAX_FIELDS) {
+      fprintf(stderr, "ERROR: stats window fields '%s': more than %d counters\n", fields, STATS_WINDOW_MAX_FIELDS);
+      exit(1);
+    }
+    ENL(window->field_names[window->num_fields++] = strdup(name));
+  }
+  free(copy);
+
+  for (n = 0; n < window->num_fields; n++) {
+    int found = 0;
+    for (d = 0; d < 2; d++) {
+      for (t = 0; t < STATS_NUM_TYPES; t++) {
+        const stats_field_t *type_fields;
+        int num_fields, f;
+        type_fields = fields_for(d, stats_fields_type_from_index(t), &num_fields);
+        window->field_index[d][t][n] = -1;
+        for (f = 0; f < num_fields; f++) {
+          if (strcmp(type_fields[f].name, window->field_names[n]) == 0) {
+            window->field_index[d][t][n] = f;
+            found = 1;
+          }
+        }
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "ERROR: stats window field '%s': no such counter (see stats_fields.c)\n",
+          window->field_names[n]);
+      exit(1);
+    }
+  }
+
+  window->block_size = sizeof(stats_window_session_t) + window->num_fields * sizeof(stats_window_series_t);
+  window->sessions[STATS_WINDOW_SRC] = stats_index_create();
+  window->sessions[STATS_WINDOW_RCV] = stats_index_create();
+
+  return window;
+}  /* stats_window_create */
+
+
+void stats_window_delete(stats_window_t *window)
+{
+  int n;
+
+  stats_index_delete(window->sessions[STATS_WINDOW_SRC]);
+  stats_index_delete(window->sessions[STATS_WINDOW_RCV]);
+  for (n = 0; n < window->num_fields; n++) {
+    free(window->field_names[n]);
+  }
+  free(window->blocks);
+  free(window->free_blocks);
+  free(window);
+}  /* stats_window_delete */
+
+
+size_t stats_window_session_bytes(const stats_window_t *window)
+{
+  return window->block_size;
+}  /* stats_window_session_bytes */
+
+
+static stats_window_session_t *block_at(stats_window_t *window, int block)
+{
+  return (stats_window_session_t *)(window->blocks + (size_t)block * window->block_size);
+}  /* block_at */
+
+
+static stats_window_series_t *series_at(stats_window_session_t *session, int n)
+{
+  return (stats_window_series_t *)(session + 1) + n;
+}  /* series_at */
+
+
+static int block_alloc(stats_window_t *window)
+{
+  int block;
+
+  if (window->num_free_blocks > 0) {
+    return window->free_blocks[--window->num_free_blocks];
+  }
+  if (window->num_blocks == window->blocks_capacity) {
+    int new_capacity = (window->blocks_capacity == 0) ? 64 : window->blocks_capacity * 2;
+    ENL(window->blocks = (char *)realloc(window->blocks, (size_t)new_capacity * window->block_size));
+    ENL(window->free_blocks = (int *)realloc(window->free_blocks, sizeof(int) * new_capacity));
+    window->blocks_capacity = new_capacity;
+  }
+  block = window->num_blocks++;
+  return block;
+}  /* block_alloc */
+
+
+/* Sweep callback: the session went away. */
+static void sweep_block(stats_session_t *session, void *clientd)
+{
+  stats_window_t *window = (stats_window_t *)clientd;
+
+  if (session->row >= 0) {
+    window->free_blocks[window->num_free_blocks++] = session->row;
+    session->row = -1;
+  }
+}  /* sweep_block */
+
+
+static void slot_add(stats_window_slot_t *slot, uint32_t epoch, double rate)
+{
+  int b;
+
+  if (slot->epoch != epoch) {
+    memset(slot, 0, sizeof(*slot));
+    slot->epoch = epoch;
+    slot->min = (float)rate;
+    slot->max = (float)rate;
+  }
+  slot->count++;
+  slot->sum += rate;
+  if (rate < slot->min) {
+    slot->min = (float)rate;
+  }
+  if (rate > slot->max) {
+    slot->max = (float)rate;
+  }
+  b = rate_bucket(rate);
+  if (slot->hist[b] == UINT16_MAX) {
+    for (b = 0; b < STATS_WINDOW_BUCKETS; b++) {
+      slot->hist[b] /= 2;  /* Keeps the proportions, which is all percentiles need. */
+    }
+    b = rate_bucket(rate);
+  }
+  slot->hist[b]++;
+}  /* slot_add */
+
+
+static uint32_t slot_epoch(const stats_window_t *window, int window_num, uint64_t sample_ns)
+{
+  uint64_t slot_ns = window_sec[window_num] * 1000000000 / STATS_WINDOW_SLOTS;
+  return (uint32_t)((sample_ns - window->start_ns) / slot_ns + 1);
+}  /* slot_epoch */
+
+
+static void window_session(stats_window_t *window, uint64_t sample_ns, int dir, int type, const char *source,
+    const void *stats)
+{
+  const stats_field_t *fields;
+  int num_fields, is_new, t, n, w;
+  uint32_t epochs[STATS_WINDOW_NUM];
+  stats_session_t *session;
+  stats_window_session_t *block;
+
+  t = stats_fields_type_index(type);
+  session = stats_index_find_or_add(window->sessions[dir], source, &is_new);
+  if (t < 0) {
+    return;
+  }
+  if (session->row < 0) {
+    session->row = block_alloc(window);
+    block = block_at(window, session->row);
+    memset(block, 0, window->block_size);
+    block->type = type;
+  }
+  block = block_at(window, session->row);
+  if (block->type != type) {
+    /* Source recreated with another transport; start over. */
+    memset(block, 0, window->block_size);
+    block->type = type;
+  }
+
+  for (w = 0; w < STATS_WINDOW_NUM; w++) {
+    epochs[w] = slot_epoch(window, w, sample_ns);
+  }
+  fields = fields_for(dir, type, &num_fields);
+  for (n = 0; n < window->num_fields; n++) {
+    int f = window->field_index[dir][t][n];
+    stats_window_series_t *series = series_at(block, n);
+    lbm_ulong_t val;
+    if (f < 0) {
+      continue;
+    }
+    val = stats_field_value(&fields[f], stats);
+    /* A counter that went backwards was reset; skip that interval. */
+    if (block->have_prev && val >= series->prev && sample_ns > block->prev_ns) {
+      double rate = (double)(val - series->prev) * 1e9 / (double)(sample_ns - block->prev_ns);
+      for (w = 0; w < STATS_WINDOW_NUM; w++) {
+        slot_add(&series->slots[w][epochs[w] % STATS_WINDOW_SLOTS], epochs[w], rate);
+      }
+    }
+    series->prev = val;
+  }
+  block->have_prev = 1;
+  block->prev_ns = sample_ns;
+}  /* window_session */
+
+
+/* Runs in the sampling thread for every sample, including ones that are
+ * not printed. */
+void stats_window_update(stats_window_t *window, const stats_sample_t *sample)
+{
+  int i;
+
+  if (window->start_ns == 0) {
+    window->start_ns = sample->sample_ns;
+  }
+  stats_index_begin_sample(window->sessions[STATS_WINDOW_SRC]);
+  for (i = 0; i < sample->src_num_entries; i++) {
+    window_session(window, sample->sample_ns, STATS_WINDOW_SRC, sample->src_stats[i].type,
+        sample->src_stats[i].source, &sample->src_stats[i]);
+  }
+  stats_index_begin_sample(window->sessions[STATS_WINDOW_RCV]);
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    window_session(window, sample->sample_ns, STATS_WINDOW_RCV, sample->rcv_stats[i].type,
+        sample->rcv_stats[i].source, &sample->rcv_stats[i]);
+  }
+  (void)stats_index_sweep(window->sessions[STATS_WINDOW_SRC], sweep_block, window);
+  (void)stats_index_sweep(window->sessions[STATS_WINDOW_RCV], sweep_block, window);
+}  /* stats_window_update */
+
+
+/* Value below which a fraction "q" of the rates fall, interpolating within
+ * the bucket and clamping to the exact min and max. */
+static double quantile(const uint32_t *hist, uint64_t total, double min, double max, double q)
+{
+  double target = q * (double)total;
+  uint64_t cum = 0;
+  int b;
+
+  for (b = 0; b < STATS_WINDOW_BUCKETS; b++) {
+    if (hist[b] > 0 && (double)(cum + hist[b]) >= target) {
+      double lo = bucket_start(b);
+      double hi = (b + 1 < STATS_WINDOW_BUCKETS) ? bucket_start(b + 1) : max;
+      double val;
+      if (lo < min) {
+        lo = min;
+      }
+      if (hi > max) {
+        hi = max;
+      }
+      val = lo + (target - (double)cum) / (double)hist[b] * (hi - lo);
+      return (val < lo) ? lo : val;
+    }
+    cum += hist[b];
+  }
+  return max;
+}  /* quantile */
+
+
+/* Merge the live slots of one window; returns the number of rates. */
+static uint32_t window_merge(const stats_window_series_t *series, int window_num, uint32_t epoch,
+    stats_window_summary_t *summary)
+{
+  uint32_t hist[STATS_WINDOW_BUCKETS];
+  uint64_t total = 0;
+  double sum = 0.0;
+  int s, b;
+
+  memset(hist, 0, sizeof(hist));
+  summary->count = 0;
+  for (s = 0; s < STATS_WINDOW_SLOTS; s++) {
+    const stats_window_slot_t *slot = &series->slots[window_num][s];
+    if (slot->epoch == 0 || slot->epoch + STATS_WINDOW_SLOTS <= epoch || slot->count == 0) {
+      continue;  /* Unused, or too old. */
+    }
+    if (summary->count == 0 || slot->min < summary->min) {
+      summary->min = slot->min;
+    }
+    if (summary->count == 0 || slot->max > summary->max) {
+      summary->max = slot->max;
+    }
+    summary->count += slot->count;
+    sum += slot->sum;
+    for (b = 0; b < STATS_WINDOW_BUCKETS; b++) {
+      hist[b] += slot->hist[b];
+      total += slot->hist[b];
+    }
+  }
+  if (summary->count > 0) {
+    summary->mean = sum / (double)summary->count;
+    summary->p50 = quantile(hist, total, summary->min, summary->max, 0.5);
+    summary->p99 = quantile(hist, total, summary->min, summary->max, 0.99);
+    summary->p999 = quantile(hist, total, summary->min, summary->max, 0.999);
+  }
+  return summary->count;
+}  /* window_merge */
+
+
+static stats_window_summary_t *add_summary(stats_sample_t *sample)
+{
+  if (sample->num_summaries == sample->summaries_capacity) {
+    int new_capacity = (sample->summaries_capacity == 0) ? 64 : sample->summaries_capacity * 2;
+    ENL(sample->summaries = (stats_window_summary_t *)realloc(sample->summaries,
+        sizeof(stats_window_summary_t) * new_capacity));
+    sample->summaries_capacity = new_capacity;
+  }
+  return &sample->summaries[sample->num_summaries];
+}  /* add_summary */
+
+
+static void summarize_session(stats_window_t *window, stats_sample_t *sample, int dir, int entry, int type,
+    const char *source, uint32_t *epochs)
+{
+  stats_session_t *session;
+  stats_window_session_t *block;
+  int is_new, t, n, w;
+
+  t = stats_fields_type_index(type);
+  session = stats_index_find_or_add(window->sessions[dir], source, &is_new);
+  if (t < 0 || session->row < 0) {
+    return;
+  }
+  block = block_at(window, session->row);
+  for (n = 0; n < window->num_fields; n++) {
+    if (window->field_index[dir][t][n] < 0) {
+      continue;
+    }
+    for (w = 0; w < STATS_WINDOW_NUM; w++) {
+      stats_window_summary_t *summary = add_summary(sample);
+      /* Leave out counters that didn't move in the window. */
+      if (window_merge(series_at(block, n), w, epochs[w], summary) > 0 && summary->max > 0.0) {
+        summary->dir = dir;
+        summary->entry = entry;
+        summary->field = window->field_names[n];
+        summary->window = w;
+        sample->num_summaries++;
+      }
+    }
+  }
+}  /* summarize_session */
+
+
+/* Runs in the sampling thread, after stats_window_update() for the same
+ * sample. Adds a summary per session, tracked counter and window (if the
+ * counter moved in the window) to the sample. */
+void stats_window_summarize(stats_window_t *window, stats_sample_t *sample)
+{
+  uint32_t epochs[STATS_WINDOW_NUM];
+  int i, w;
+
+  for (w = 0; w < STATS_WINDOW_NUM; w++) {
+    epochs[w] = slot_epoch(window, w, sample->sample_ns);
+  }
+  sample->num_summaries = 0;
+  for (i = 0; i < sample->src_num_entries; i++) {
+    summarize_session(window, sample, STATS_WINDOW_SRC, i, sample->src_stats[i].type, sample->src_stats[i].source,
+        epochs);
+  }
+  for (i = 0; i < sample->rcv_num_entries; i++) {
+    summarize_session(window, sample, STATS_WINDOW_RCV, i, sample->rcv_stats[i].type, sample->rcv_stats[i].source,
+        epochs);
+  }
+}  /* stats_window_summarize */
@@ -0,0 +1,125 @@
+/* stats_window.h - rolling 1-minute, 1-hour and 24-hour summaries of
+ * per-session rates in fixed memory.
+ * See https://github.com/UltraMessaging/mon_self */
+/*
+  (C) Copyright 2023,2024 Informatica Corporation
+  Permission is granted to licensees to use or alter this software for any
+  purpose, including commercial applications, according to the terms laid
+  out in the Software License Agreement.
+
+  This source code example is provided by Informatica for educational
+  and evaluation purposes only.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+  EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+  NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+  PURPOSE.  INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE
+  UNINTERRUPTED OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES,
+  BE LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+  INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+  TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED OF
+  THE LIKELIHOOD OF SUCH DAMAGES.
+*/
+
+#ifndef STATS_WINDOW_H
+#define STATS_WINDOW_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lbm/lbm.h"
+#include "stats_fields.h"
+#include "stats_index.h"
+#include "stats_sample.h"
+
+/* Each tracked counter of each session has, for each window (1m, 1h, 24h),
+ * a ring of STATS_WINDOW_SLOTS slots, each covering 1/STATS_WINDOW_SLOTS of
+ * the window. A slot holds the count, min, max and sum of the rates that
+ * fell in it, and a log-scale histogram with two buckets per power of 2
+ * (bucket 0 is rates below 1/s; the last one is open-ended). So a summary
+ * covers between 3/4 of the window and all of it, min/max/mean are exact,
+ * and percentiles are interpolated within a bucket (within about 20%).
+ *
+ * Memory is fixed per session: sizeof(stats_window_session_t) plus
+ * sizeof(stats_window_series_t) (about 1.4 KB) per tracked counter, see
+ * stats_window_session_bytes(). */
+#define STATS_WINDOW_NUM 3
+#define STATS_WINDOW_SLOTS 4
+#define STATS_WINDOW_BUCKETS 48
+#define STATS_WINDOW_MAX_FIELDS 8
+#define STATS_WINDOW_SRC 0
+#define STATS_WINDOW_RCV 1
+
+struct stats_window_slot_s {
+  uint32_t epoch;  /* Slot number since the window started, plus 1; 0=unused. */
+  uint32_t count;
+  float min;
+  float max;
+  double sum;
+  uint16_t hist[STATS_WINDOW_BUCKETS];  /* Halved when a bucket would overflow. */
+};
+typedef struct stats_window_slot_s stats_window_slot_t;
+
+/* One tracked counter of one session. */
+struct stats_window_series_s {
+  uint64_t prev;  /* Counter value at the previous sample. */
+  stats_window_slot_t slots[STATS_WINDOW_NUM][STATS_WINDOW_SLOTS];
+};
+typedef struct stats_window_series_s stats_window_series_t;
+
+/* One session; followed by a series per tracked counter. */
+struct stats_window_session_s {
+  int type;  /* LBM_TRANSPORT_STAT_... */
+  int have_prev;
+  uint64_t prev_ns;  /* CLOCK_MONOTONIC of the previous sample. */
+};
+typedef struct stats_window_session_s stats_window_session_t;
+
+/* The summary of one counter of one session over one window. */
+struct stats_window_summary_s {
+  int dir;  /* STATS_WINDOW_SRC/RCV. */
+  int entry;  /* Index of the session in the sample's src_stats or rcv_stats. */
+  const char *field;
+  int window;  /* 0..STATS_WINDOW_NUM-1, see stats_window_name(). */
+  uint32_t count;  /* Rates summarized. */
+  double min;
+  double max;
+  double mean;
+  double p50;
+  double p99;
+  double p999;
+};
+typedef struct stats_window_summary_s stats_window_summary_t;
+
+struct stats_window_s {
+  int num_fields;
+  char *field_names[STATS_WINDOW_MAX_FIELDS];
+  /* Index in each type's field table of each tracked counter; -1=none. */
+  int field_index[2][STATS_NUM_TYPES][STATS_WINDOW_MAX_FIELDS];
+  stats_index_t *sessions[2];  /* STATS_WINDOW_SRC/RCV. Row is the block. */
+  size_t block_size;  /* Bytes per session. */
+  char *blocks;
+  int num_blocks;
+  int blocks_capacity;  /* Of both blocks and free_blocks. */
+  int *free_blocks;
+  int num_free_blocks;
+  uint64_t start_ns;  /* CLOCK_MONOTONIC of the first sample. */
+};
+typedef struct stats_window_s stats_window_t;
+
+
+stats_window_t *stats_window_create(const char *fields);
+void stats_window_delete(stats_window_t *window);
+size_t stats_window_session_bytes(const stats_window_t *window);
+const char *stats_window_name(int window_num);
+void stats_window_update(stats_window_t *window, const stats_sample_t *sample);
+void stats_window_summarize(stats_window_t *window, stats_sample_t *sample);
+
+#if defined(__cplusplus)
+}
+#endif /* __cplusplus */
+
+#endif /* STATS_WINDOW_H */